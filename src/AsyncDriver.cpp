@@ -0,0 +1,390 @@
+#include <ptu_kongsberg_oe10/AsyncDriver.hpp>
+#include <ptu_kongsberg_oe10/PoseEstimator.hpp>
+#include <base/Logging.hpp>
+#include <cmath>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+/** Distance to its target below which an axis is considered arrived, in
+ * radians. It is twice the resolution of the protocol's angles */
+static const float TARGET_TOLERANCE = 2 * PoseEstimator::RESOLUTION;
+
+AsyncDriver::AsyncDriver()
+    : quit(false)
+{
+}
+
+AsyncDriver::~AsyncDriver()
+{
+    stop();
+}
+
+/**
+ * Open the device from the calling thread, so that errors are reported to
+ * the caller, and then start the I/O thread
+ */
+void AsyncDriver::openURI(string const& uri)
+{
+    stop();
+    driver.openURI(uri);
+    start();
+}
+
+void AsyncDriver::close()
+{
+    stop();
+    driver.close();
+}
+
+Driver& AsyncDriver::getDriver()
+{
+    return driver;
+}
+
+int AsyncDriver::getQueueSize() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    return queue.size();
+}
+
+std::future<DriverStatistics> AsyncDriver::getStatistics()
+{
+    std::shared_ptr< std::promise<DriverStatistics> > promise(new std::promise<DriverStatistics>());
+    if (!thread.joinable())
+        promise->set_value(driver.getStatistics());
+    else
+        enqueue([promise](Driver& driver) { promise->set_value(driver.getStatistics()); });
+    return promise->get_future();
+}
+
+void AsyncDriver::setEnvironmentRefresh(int device_id, base::Time const& period)
+{
+    if (device_id == Packet::BROADCAST)
+        throw std::invalid_argument("cannot refresh the environment of the broadcast address");
+
+    lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < refreshes.size(); ++i)
+    {
+        if (refreshes[i].device_id == device_id)
+        {
+            refreshes.erase(refreshes.begin() + i);
+            break;
+        }
+    }
+    if (!period.isNull())
+    {
+        Refresh refresh;
+        refresh.device_id = device_id;
+        refresh.period = std::chrono::microseconds(period.toMicroseconds());
+        refresh.next = std::chrono::steady_clock::now();
+        refreshes.push_back(refresh);
+    }
+    wakeup.notify_one();
+}
+
+void AsyncDriver::setStatusPolling(int device_id, base::Time const& moving_period,
+        base::Time const& idle_period, StatusCallback const& callback)
+{
+    if (device_id == Packet::BROADCAST)
+        throw std::invalid_argument("cannot poll the status of the broadcast address");
+    if (moving_period.isNull() || idle_period < moving_period)
+        throw std::invalid_argument("the moving period must be non-null and no longer than the idle period");
+
+    StatusPoll poll;
+    poll.device_id = device_id;
+    poll.moving_period = std::chrono::microseconds(moving_period.toMicroseconds());
+    poll.idle_period = std::chrono::microseconds(idle_period.toMicroseconds());
+    poll.callback = callback;
+    poll.motion_commanded = false;
+    poll.has_status = false;
+    poll.has_pan_target = false;
+    poll.pan_target = 0;
+    poll.has_tilt_target = false;
+    poll.tilt_target = 0;
+
+    lock_guard<std::mutex> lock(mutex);
+    bool replaced = false;
+    for (size_t i = 0; i < statusPolls.size() && !replaced; ++i)
+    {
+        if (statusPolls[i].device_id == device_id)
+        {
+            // Keep the motion state, only the configuration changes
+            statusPolls[i].moving_period = poll.moving_period;
+            statusPolls[i].idle_period = poll.idle_period;
+            statusPolls[i].callback = callback;
+            replaced = true;
+        }
+    }
+    if (!replaced)
+        statusPolls.push_back(poll);
+    wakeup.notify_one();
+}
+
+void AsyncDriver::stopStatusPolling(int device_id)
+{
+    lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < statusPolls.size(); ++i)
+    {
+        if (statusPolls[i].device_id == device_id)
+        {
+            statusPolls.erase(statusPolls.begin() + i);
+            break;
+        }
+    }
+}
+
+bool AsyncDriver::isMoving(int device_id) const
+{
+    lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < statusPolls.size(); ++i)
+    {
+        if (statusPolls[i].device_id == device_id)
+            return statusPolls[i].isMoving();
+    }
+    return false;
+}
+
+bool AsyncDriver::StatusPoll::isMoving() const
+{
+    if (motion_commanded)
+        return true;
+    else if (!has_status)
+        return false;
+    return status.pan_speed > 0 || status.tilt_speed > 0 ||
+        (has_pan_target && std::abs(status.pan - pan_target) > TARGET_TOLERANCE) ||
+        (has_tilt_target && std::abs(status.tilt - tilt_target) > TARGET_TOLERANCE);
+}
+
+std::chrono::steady_clock::time_point AsyncDriver::StatusPoll::getNext() const
+{
+    return last + (isMoving() ? moving_period : idle_period);
+}
+
+std::future<Status> AsyncDriver::getStatus(int device_id)
+{
+    return call<Status>([device_id](Driver& driver) { return driver.getStatus(device_id); });
+}
+
+std::future<Environment> AsyncDriver::getEnvironment(int device_id)
+{
+    return call<Environment>([device_id](Driver& driver) { return driver.getEnvironment(device_id); });
+}
+
+std::future<Capabilities> AsyncDriver::getCapabilities(int device_id)
+{
+    return call<Capabilities>([device_id](Driver& driver) { return driver.getCapabilities(device_id); });
+}
+
+void AsyncDriver::enqueue(Job const& job)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        queue.push_back(job);
+    }
+    wakeup.notify_one();
+}
+
+void AsyncDriver::start()
+{
+    quit = false;
+    thread = std::thread(&AsyncDriver::run, this);
+}
+
+void AsyncDriver::stop()
+{
+    if (!thread.joinable())
+        return;
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        queue.clear();
+    }
+    wakeup.notify_one();
+    thread.join();
+}
+
+AsyncDriver::Refresh* AsyncDriver::findNextRefresh()
+{
+    Refresh* next = 0;
+    for (size_t i = 0; i < refreshes.size(); ++i)
+    {
+        if (!next || refreshes[i].next < next->next)
+            next = &refreshes[i];
+    }
+    return next;
+}
+
+AsyncDriver::StatusPoll* AsyncDriver::findNextStatusPoll()
+{
+    StatusPoll* next = 0;
+    for (size_t i = 0; i < statusPolls.size(); ++i)
+    {
+        if (!next || statusPolls[i].getNext() < next->getNext())
+            next = &statusPolls[i];
+    }
+    return next;
+}
+
+AsyncDriver::Job AsyncDriver::popRefresh(Refresh& due)
+{
+    // Skip the periods that have been missed instead of catching up
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    due.next = max(due.next + due.period, now);
+    int device_id = due.device_id;
+    return [device_id](Driver& driver) {
+        try { driver.refreshEnvironment(device_id); }
+        catch(std::exception const& e)
+        {
+            LOG_WARN_S << "failed to refresh the environment of device " << device_id << ": " << e.what();
+        }
+    };
+}
+
+/**
+ * The poll period depends on whether the device is moving, and therefore
+ * changes as soon as a motion is commanded
+ */
+AsyncDriver::Job AsyncDriver::popStatusPoll(StatusPoll& due)
+{
+    due.last = std::chrono::steady_clock::now();
+    int device_id = due.device_id;
+    StatusCallback callback = due.callback;
+    return [this, device_id, callback](Driver& driver) {
+        Expected<PanTiltStatus> status = driver.tryExecute(device_id, commands::GetPanTiltStatus());
+        if (!status)
+        {
+            LOG_WARN_S << "failed to poll the status of device " << device_id << ": " << status.error().toString();
+        }
+        recordStatus(device_id, status);
+        if (callback)
+            callback(status);
+    };
+}
+
+/**
+ * Pick the most overdue of the status polls and refreshes. A poll whose
+ * period is shorter than its round trip is always due, and would otherwise
+ * starve the refreshes
+ */
+bool AsyncDriver::popDueJob(Job& job, std::chrono::steady_clock::time_point& next)
+{
+    Refresh* refresh = findNextRefresh();
+    StatusPoll* poll = findNextStatusPoll();
+    if (!refresh && !poll)
+        return false;
+
+    bool pollFirst = poll && (!refresh || poll->getNext() <= refresh->next);
+    next = pollFirst ? poll->getNext() : refresh->next;
+    if (next > std::chrono::steady_clock::now())
+        return false;
+    job = pollFirst ? popStatusPoll(*poll) : popRefresh(*refresh);
+    return true;
+}
+
+/**
+ * A target is forgotten if the axis neither moved nor reported a speed
+ * between two polls that both came after the command, as the device is not
+ * going to reach it
+ */
+void AsyncDriver::recordStatus(int device_id, Expected<PanTiltStatus> const& status)
+{
+    if (!status)
+        return;
+
+    lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < statusPolls.size(); ++i)
+    {
+        StatusPoll& poll = statusPolls[i];
+        if (poll.device_id != device_id)
+            continue;
+
+        if (poll.has_status && !poll.motion_commanded)
+        {
+            if (status->pan_speed == 0 && std::abs(status->pan - poll.status.pan) <= TARGET_TOLERANCE)
+                poll.has_pan_target = false;
+            if (status->tilt_speed == 0 && std::abs(status->tilt - poll.status.tilt) <= TARGET_TOLERANCE)
+                poll.has_tilt_target = false;
+        }
+        poll.has_status = true;
+        poll.status = *status;
+        poll.motion_commanded = false;
+    }
+}
+
+void AsyncDriver::recordSetting(int device_id, StateCache::Setting setting, unsigned invalidates,
+        byte const* payload)
+{
+    unsigned targets = invalidates & StateCache::TARGETS;
+    if (setting == StateCache::PAN_TARGET || setting == StateCache::TILT_TARGET)
+        targets |= StateCache::bit(setting);
+    if (!targets)
+        return;
+
+    lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < statusPolls.size(); ++i)
+    {
+        StatusPoll& poll = statusPolls[i];
+        if (poll.device_id != device_id && device_id != Packet::BROADCAST)
+            continue;
+
+        poll.motion_commanded = true;
+        if (invalidates & StateCache::bit(StateCache::PAN_TARGET))
+            poll.has_pan_target = false;
+        if (invalidates & StateCache::bit(StateCache::TILT_TARGET))
+            poll.has_tilt_target = false;
+        if (setting == StateCache::PAN_TARGET)
+        {
+            poll.has_pan_target = true;
+            poll.pan_target = Packet::parseAngle(payload);
+        }
+        else if (setting == StateCache::TILT_TARGET)
+        {
+            poll.has_tilt_target = true;
+            poll.tilt_target = Packet::parseAngle(payload);
+        }
+    }
+}
+
+/**
+ * Execute the queued jobs one at a time, in order. The jobs are executed
+ * without holding the lock so that commands can be submitted while I/O is
+ * in progress. The status polls and periodic refreshes run when the queue
+ * is empty
+ */
+void AsyncDriver::run()
+{
+    while (true)
+    {
+        Job job;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            while (!quit && queue.empty())
+            {
+                std::chrono::steady_clock::time_point next;
+                if (popDueJob(job, next))
+                    break;
+                if (next == std::chrono::steady_clock::time_point())
+                    wakeup.wait(lock);
+                else
+                    wakeup.wait_until(lock, next);
+            }
+            if (quit)
+                return;
+            if (!job)
+            {
+                job = queue.front();
+                queue.pop_front();
+            }
+        }
+
+        try { job(driver); }
+        catch(std::exception const& e)
+        {
+            // Command errors are reported through the futures, this only
+            // catches exceptions thrown by the callbacks themselves
+            LOG_ERROR_S << "exception in AsyncDriver job: " << e.what();
+        }
+    }
+}
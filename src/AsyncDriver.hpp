@@ -0,0 +1,339 @@
+#ifndef PTU_KONGSBERG_OE10_ASYNC_DRIVER_HPP
+#define PTU_KONGSBERG_OE10_ASYNC_DRIVER_HPP
+
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Non-blocking front-end to Driver
+     *
+     * The AsyncDriver owns a Driver and does all the I/O on a dedicated
+     * thread. Commands are submitted from any thread and executed in
+     * submission order; their result is delivered either through a
+     * std::future or through a callback that is called on the I/O thread.
+     *
+     * <code>
+     * AsyncDriver driver;
+     * driver.openURI("serial:///dev/ttyUSB0:19200");
+     * std::future<PanTiltStatus> status =
+     *     driver.submit(1, commands::GetPanTiltStatus());
+     * ...
+     * status.get();
+     * </code>
+     *
+     * Errors are reported through the future, i.e. get() rethrows the
+     * exception the command raised.
+     */
+    class AsyncDriver
+    {
+    public:
+        /** Callback called with the result of each status poll */
+        typedef std::function<void(Expected<PanTiltStatus> const&)> StatusCallback;
+
+        AsyncDriver();
+
+        /** Stops the I/O thread. Commands that are still queued are dropped,
+         * and their futures report a broken promise */
+        ~AsyncDriver();
+
+        /**
+         * Opens the device and starts the I/O thread
+         * @param uri The URI, as given to Driver::openURI
+         */
+        void openURI(std::string const& uri);
+
+        /** Stops the I/O thread and closes the device */
+        void close();
+
+        /**
+         * Returns the underlying driver
+         *
+         * It must only be accessed directly (e.g. to change its timeouts)
+         * while the I/O thread is not running, that is before openURI or
+         * after close.
+         */
+        Driver& getDriver();
+
+        /**
+         * Queues a command for execution on the I/O thread
+         * @param device_id The ID of the target device
+         * @param command The command, e.g. commands::SetPanPosition(angle)
+         * @return A future that holds the command's result
+         */
+        template<typename Command>
+        std::future<typename Command::Result> submit(int device_id, Command const& command);
+
+        /**
+         * Queues a command and calls a callback with its result
+         *
+         * The callback is called on the I/O thread, with a ready future
+         * whose get() returns the result or rethrows the command's error.
+         * It should therefore return quickly.
+         * @param device_id The ID of the target device
+         * @param command The command
+         * @param callback The callback
+         */
+        template<typename Command>
+        void submit(int device_id, Command const& command,
+                std::function<void(std::future<typename Command::Result>)> callback);
+
+        /** Returns the number of commands that are waiting to be executed */
+        int getQueueSize() const;
+
+        /**
+         * Returns a snapshot of the driver statistics
+         *
+         * The snapshot is taken on the I/O thread, after the commands that
+         * are already queued have been executed
+         */
+        std::future<DriverStatistics> getStatistics();
+
+        /**
+         * Refreshes the environment readings of a device periodically
+         *
+         * The refresh (a ST request) is done on the I/O thread when no
+         * command is queued, so that getStatus and getEnvironment find
+         * fresh readings in the driver's cache. Set the period below the
+         * driver's environment TTL (see Driver::setEnvironmentTTL) so that
+         * they never need to send ST themselves.
+         * @param device_id The ID of the device, cannot be broadcast
+         * @param period The refresh period. A null period stops the
+         *   refresh of this device
+         */
+        void setEnvironmentRefresh(int device_id, base::Time const& period);
+
+        /**
+         * Polls the position of a device with AS, faster while it moves
+         *
+         * The device is considered moving while its last AS reply reports
+         * a non-zero speed, while it is away from a position target
+         * submitted through this driver, and until the first poll after a
+         * TU, TD or TS. A target the axis stays away from for two polls in
+         * a row (e.g. behind an end stop) is forgotten.
+         *
+         * Like the environment refreshes, polls are only started when no
+         * command is queued, so that commands never wait behind a poll they
+         * have been submitted before. Polls are not queued either: one that
+         * is due while commands are being executed runs once after them.
+         * @param device_id The ID of the device, cannot be broadcast
+         * @param moving_period The poll period while the device moves, i.e.
+         *   the maximum rate
+         * @param idle_period The poll period while it is parked, i.e. the
+         *   minimum rate
+         * @param callback Called on the I/O thread with each poll's result.
+         *   It should return quickly
+         */
+        void setStatusPolling(int device_id, base::Time const& moving_period,
+                base::Time const& idle_period, StatusCallback const& callback);
+
+        /** Stops polling the status of a device */
+        void stopStatusPolling(int device_id);
+
+        /**
+         * Whether a device is considered moving by its status polling. It
+         * is false if the device is not polled
+         */
+        bool isMoving(int device_id) const;
+
+        /**
+         * Returns the status of a device, see Driver::getStatus
+         */
+        std::future<Status> getStatus(int device_id);
+
+        /**
+         * Returns the environment readings of a device, see
+         * Driver::getEnvironment
+         */
+        std::future<Environment> getEnvironment(int device_id);
+
+        /**
+         * Returns the capabilities of a device, see
+         * Driver::getCapabilities
+         */
+        std::future<Capabilities> getCapabilities(int device_id);
+
+    protected:
+        typedef std::function<void(Driver&)> Job;
+
+        /** Adds a job to the queue and wakes up the I/O thread */
+        void enqueue(Job const& job);
+
+        /** Queues a call to a driver method and returns its result */
+        template<typename Result>
+        std::future<Result> call(std::function<Result(Driver&)> const& f);
+
+        /** A periodic environment refresh */
+        struct Refresh
+        {
+            int device_id;
+            std::chrono::steady_clock::duration period;
+            std::chrono::steady_clock::time_point next;
+        };
+
+        /** The motion-adaptive AS polling of a device */
+        struct StatusPoll
+        {
+            int device_id;
+            std::chrono::steady_clock::duration moving_period;
+            std::chrono::steady_clock::duration idle_period;
+            StatusCallback callback;
+            /** Time at which the last poll started */
+            std::chrono::steady_clock::time_point last;
+
+            /** Whether a motion has been commanded since the last poll */
+            bool motion_commanded;
+            bool has_status;
+            PanTiltStatus status;
+            bool has_pan_target;
+            float pan_target;
+            bool has_tilt_target;
+            float tilt_target;
+
+            bool isMoving() const;
+            std::chrono::steady_clock::time_point getNext() const;
+        };
+
+        /** Returns the refresh that is due first, if any. The lock must be
+         * held */
+        Refresh* findNextRefresh();
+
+        /** Returns the status poll that is due first, if any. The lock must
+         * be held */
+        StatusPoll* findNextStatusPoll();
+
+        /** Returns the job of a refresh and schedules its next run. The lock
+         * must be held */
+        Job popRefresh(Refresh& due);
+
+        /** Returns the job of a status poll and schedules its next run. The
+         * lock must be held */
+        Job popStatusPoll(StatusPoll& due);
+
+        /**
+         * Returns the status poll or refresh job that is the most overdue,
+         * if any is due, and schedules its next run. The lock must be held
+         * @param next Set to the time at which the next job is due, if none
+         *   is due now. It is left unchanged if there is no job at all
+         */
+        bool popDueJob(Job& job, std::chrono::steady_clock::time_point& next);
+
+        /** Updates the motion state of a polled device with a poll result */
+        void recordStatus(int device_id, Expected<PanTiltStatus> const& status);
+
+        /**
+         * Updates the motion state of the polled devices after a setting
+         * command succeeded
+         */
+        void recordSetting(int device_id, StateCache::Setting setting, unsigned invalidates,
+                byte const* payload);
+
+        /** Records the motion commanded by a successful command */
+        template<typename Command>
+        void recordCommand(int device_id, Command const& command);
+
+        /** Executes a command on the I/O thread and records the motion it
+         * commands */
+        template<typename Command>
+        typename std::enable_if<std::is_void<typename Command::Result>::value>::type
+            execute(Driver& driver, int device_id, Command const& command);
+
+        template<typename Command>
+        typename std::enable_if<!std::is_void<typename Command::Result>::value, typename Command::Result>::type
+            execute(Driver& driver, int device_id, Command const& command);
+
+        /** Main loop of the I/O thread */
+        void run();
+
+        /** Starts the I/O thread */
+        void start();
+
+        /** Stops the I/O thread, dropping the queued jobs */
+        void stop();
+
+        Driver driver;
+        std::thread thread;
+        mutable std::mutex mutex;
+        std::condition_variable wakeup;
+        std::deque<Job> queue;
+        std::vector<Refresh> refreshes;
+        std::vector<StatusPoll> statusPolls;
+        bool quit;
+    };
+
+    template<typename Result>
+    std::future<Result> AsyncDriver::call(std::function<Result(Driver&)> const& f)
+    {
+        std::shared_ptr< std::packaged_task<Result(Driver&)> > task(
+            new std::packaged_task<Result(Driver&)>(f));
+        std::future<Result> result = task->get_future();
+        enqueue([task](Driver& driver) { (*task)(driver); });
+        return result;
+    }
+
+    template<typename Command>
+    void AsyncDriver::recordCommand(int device_id, Command const& command)
+    {
+        if (Command::SETTING == StateCache::NO_SETTING && Command::INVALIDATES == 0)
+            return;
+        byte payload[Command::REQUEST_SIZE + 1];
+        command.encode(payload);
+        recordSetting(device_id, Command::SETTING, Command::INVALIDATES, payload);
+    }
+
+    template<typename Command>
+    typename std::enable_if<std::is_void<typename Command::Result>::value>::type
+        AsyncDriver::execute(Driver& driver, int device_id, Command const& command)
+    {
+        driver.execute(device_id, command);
+        recordCommand(device_id, command);
+    }
+
+    template<typename Command>
+    typename std::enable_if<!std::is_void<typename Command::Result>::value, typename Command::Result>::type
+        AsyncDriver::execute(Driver& driver, int device_id, Command const& command)
+    {
+        typename Command::Result result = driver.execute(device_id, command);
+        recordCommand(device_id, command);
+        return result;
+    }
+
+    template<typename Command>
+    std::future<typename Command::Result> AsyncDriver::submit(int device_id, Command const& command)
+    {
+        typedef typename Command::Result Result;
+        std::shared_ptr< std::packaged_task<Result(Driver&)> > task(
+            new std::packaged_task<Result(Driver&)>(
+                [this, device_id, command](Driver& driver) { return execute(driver, device_id, command); }));
+        std::future<Result> result = task->get_future();
+        enqueue([task](Driver& driver) { (*task)(driver); });
+        return result;
+    }
+
+    template<typename Command>
+    void AsyncDriver::submit(int device_id, Command const& command,
+            std::function<void(std::future<typename Command::Result>)> callback)
+    {
+        typedef typename Command::Result Result;
+        std::shared_ptr< std::packaged_task<Result(Driver&)> > task(
+            new std::packaged_task<Result(Driver&)>(
+                [this, device_id, command](Driver& driver) { return execute(driver, device_id, command); }));
+        enqueue([task, callback](Driver& driver) {
+            std::future<Result> result = task->get_future();
+            (*task)(driver);
+            callback(std::move(result));
+        });
+    }
+}
+
+#endif
@@ -0,0 +1,281 @@
+// Microbenchmarks of the packet codec hot paths
+//
+// Each benchmark is run for a fixed number of iterations, and reports the
+// time and number of heap allocations per operation as one JSON object per
+// line, so that results of different builds can be compared with standard
+// tools.
+#include <ptu_kongsberg_oe10/Packet.hpp>
+#include <ptu_kongsberg_oe10/FrameParser.hpp>
+#include <ptu_kongsberg_oe10/Commands.hpp>
+#include <ptu_kongsberg_oe10/FrameCache.hpp>
+#include <ptu_kongsberg_oe10/Expected.hpp>
+#include <boost/lexical_cast.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+// Count heap allocations done by the benchmarked code
+static std::atomic<unsigned long> allocations(0);
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+/** Prevents the compiler from optimizing away a computed value */
+template<typename T>
+static void doNotOptimize(T const& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+static int usage(string const& argv0)
+{
+    cerr
+        << "usage: " << argv0 << " [ITERATIONS] [FILTER]\n"
+        << "  runs the codec microbenchmarks ITERATIONS times each (defaults\n"
+        << "  to 1000000), optionally only the ones whose name contains FILTER.\n"
+        << "  Results are output on stdout, one JSON object per line\n"
+        << endl;
+    return -1;
+}
+
+struct Benchmark
+{
+    long iterations;
+    string filter;
+
+    /** Runs a benchmark and outputs its result */
+    template<typename F>
+    void run(string const& name, F f)
+    {
+        if (!filter.empty() && name.find(filter) == string::npos)
+            return;
+
+        // Warm up caches and branch predictors
+        for (long i = 0; i < iterations / 10; ++i)
+            f();
+
+        unsigned long startAllocations = allocations;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (long i = 0; i < iterations; ++i)
+            f();
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        unsigned long endAllocations = allocations;
+
+        double ns = chrono::duration<double, nano>(end - start).count();
+        cout << "{\"benchmark\":\"" << name << "\""
+            << ",\"iterations\":" << iterations
+            << ",\"ns_per_op\":" << ns / iterations
+            << ",\"allocs_per_op\":" << static_cast<double>(endAllocations - startAllocations) / iterations
+            << "}" << endl;
+    }
+};
+
+/** Builds the ACK frame of a device to an AS request */
+static vector<byte> makePanTiltStatusReply(int device_id, int pan, int tilt)
+{
+    Packet packet(Packet::CONTROLLER, device_id);
+    packet.setCommand(Packet::ACK);
+    packet.data_size = 12;
+    packet.data[0] = 'A';
+    packet.data[1] = 'S';
+    packet.data[2] = 0x32;
+    packet.data[3] = 0x10;
+    Packet::encodeAngle(packet.data + 4, pan * M_PI / 180);
+    Packet::encodeAngle(packet.data + 7, tilt * M_PI / 180);
+    packet.data[10] = '1';
+    packet.data[11] = '0';
+    vector<byte> buffer;
+    packet.marshal(buffer);
+    return buffer;
+}
+
+/**
+ * Emulates the way iodrivers_base calls extractPacket on its receive buffer:
+ * called again on the remaining bytes after each skip, until a packet is
+ * found
+ */
+static int extractFromStream(byte const* buffer, int size)
+{
+    int offset = 0;
+    while (offset < size)
+    {
+        int result = Packet::extractPacket(buffer + offset, size - offset);
+        if (result > 0)
+            return offset + result;
+        else if (result == 0)
+            return 0;
+        offset += -result;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    Benchmark benchmark;
+    benchmark.iterations = 1000000;
+    if (argc > 3)
+        return usage(argv[0]);
+    if (argc > 1)
+    {
+        try { benchmark.iterations = lexical_cast<long>(argv[1]); }
+        catch(boost::bad_lexical_cast const&) { return usage(argv[0]); }
+    }
+    if (argc > 2)
+        benchmark.filter = argv[2];
+
+    // Corpus of AS replies for a scan over the whole pan range
+    vector< vector<byte> > replies;
+    for (int pan = 0; pan < 360; pan += 7)
+        replies.push_back(makePanTiltStatusReply(2, pan, (pan * 3) % 90));
+    size_t replyIndex = 0;
+    vector<byte> const& reply = replies.front();
+
+    // Garbage followed by a valid reply, as after line noise
+    vector<byte> noisy;
+    for (int i = 0; i < 64; ++i)
+        noisy.push_back((i * 37) & 0xFF);
+    noisy.insert(noisy.end(), reply.begin(), reply.end());
+
+    Packet position(2);
+    position.setCommand('P', 'P');
+    position.data_size = 3;
+    Packet::encodeAngle(position.data, M_PI);
+
+    Packet statusRequest(2);
+    statusRequest.setCommand('A', 'S');
+
+    byte buffer[Packet::MAX_PACKET_SIZE];
+    vector<byte> vectorBuffer;
+
+    benchmark.run("Packet::marshal(vector)", [&] {
+        vectorBuffer.clear();
+        position.marshal(vectorBuffer);
+        doNotOptimize(vectorBuffer);
+    });
+    benchmark.run("Packet::marshal(buffer)", [&] {
+        doNotOptimize(position.marshal(buffer, sizeof(buffer)));
+    });
+    benchmark.run("commands::marshal(SetPanPosition)", [&] {
+        doNotOptimize(commands::marshal(commands::SetPanPosition(M_PI), 2, buffer));
+    });
+    benchmark.run("commands::marshal(GetPanTiltStatus)", [&] {
+        doNotOptimize(commands::marshal(commands::GetPanTiltStatus(), 2, buffer));
+    });
+
+    FrameCache frameCache;
+    int frameSize;
+    benchmark.run("FrameCache::get(SetPanPosition)", [&] {
+        doNotOptimize(frameCache.get(commands::SetPanPosition(M_PI), 2, frameSize));
+    });
+    benchmark.run("FrameCache::get(GetPanTiltStatus)", [&] {
+        doNotOptimize(frameCache.get(commands::GetPanTiltStatus(), 2, frameSize));
+    });
+    benchmark.run("Packet::extractPacket(complete)", [&] {
+        vector<byte> const& frame = replies[replyIndex++ % replies.size()];
+        doNotOptimize(Packet::extractPacket(&frame[0], frame.size()));
+    });
+    benchmark.run("Packet::extractPacket(partial)", [&] {
+        doNotOptimize(Packet::extractPacket(&reply[0], reply.size() / 2));
+    });
+    benchmark.run("Packet::extractPacket(garbage_prefix)", [&] {
+        doNotOptimize(extractFromStream(&noisy[0], noisy.size()));
+    });
+    FrameParser parser;
+    benchmark.run("FrameParser::extract(byte_by_byte)", [&] {
+        // One call per received byte, as when reading at low baud rates
+        int result = 0;
+        for (size_t size = 1; size <= reply.size() && result == 0; ++size)
+            result = parser.extract(&reply[0], size);
+        doNotOptimize(result);
+    });
+    benchmark.run("FrameParser::extract(garbage_prefix)", [&] {
+        int offset = 0;
+        int result;
+        while ((result = parser.extract(&noisy[offset], noisy.size() - offset)) < 0)
+            offset += -result;
+        doNotOptimize(result);
+    });
+    benchmark.run("Packet::parse", [&] {
+        vector<byte> const& frame = replies[replyIndex++ % replies.size()];
+        Packet packet = Packet::parse(&frame[0], frame.size());
+        doNotOptimize(packet);
+    });
+    benchmark.run("PacketView::parse", [&] {
+        vector<byte> const& frame = replies[replyIndex++ % replies.size()];
+        PacketView view = PacketView::parse(&frame[0], frame.size());
+        doNotOptimize(view);
+    });
+    benchmark.run("Packet::parseAngle", [&] {
+        vector<byte> const& frame = replies[replyIndex++ % replies.size()];
+        doNotOptimize(Packet::parseAngle(&frame[13]));
+    });
+    float angle = 0;
+    benchmark.run("Packet::encodeAngle", [&] {
+        angle += 0.01;
+        if (angle > 6)
+            angle = 0;
+        Packet::encodeAngle(buffer, angle);
+        doNotOptimize(buffer);
+    });
+    benchmark.run("Packet::computeChecksum", [&] {
+        vector<byte> const& frame = replies[replyIndex++ % replies.size()];
+        doNotOptimize(Packet::computeChecksum(&frame[1], &frame[frame.size() - 5]));
+    });
+    benchmark.run("PacketView::validateResponseFor(ACK)", [&] {
+        PacketView view = PacketView::parse(&reply[0], reply.size(), false);
+        view.validateResponseFor(statusRequest);
+        doNotOptimize(view);
+    });
+
+    // NAKs are routine on shared buses, compare the cost of reporting them
+    // with exceptions and with error codes
+    Packet nakPacket(Packet::CONTROLLER, 2);
+    nakPacket.setCommand(Packet::NAK);
+    nakPacket.data_size = 3;
+    nakPacket.data[0] = 'A';
+    nakPacket.data[1] = 'S';
+    nakPacket.data[2] = 0x20;
+    vector<byte> nak;
+    nakPacket.marshal(nak);
+    benchmark.run("PacketView::validateResponseFor(NAK)", [&] {
+        PacketView view = PacketView::parse(&nak[0], nak.size(), false);
+        try { view.validateResponseFor(statusRequest); }
+        catch(std::runtime_error const& e) { doNotOptimize(e); }
+    });
+    benchmark.run("PacketView::checkResponseFor(NAK)", [&] {
+        PacketView view = PacketView::parse(&nak[0], nak.size(), false);
+        Error error = view.checkResponseFor(2, statusRequest.command, 2);
+        doNotOptimize(error);
+    });
+    benchmark.run("commands::GetPanTiltStatus::decode", [&] {
+        vector<byte> const& frame = replies[replyIndex++ % replies.size()];
+        PanTiltStatus status = commands::GetPanTiltStatus().decode(&frame[11]);
+        doNotOptimize(status);
+    });
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef PTU_KONGSBERG_OE10_CLOCK_HPP
+#define PTU_KONGSBERG_OE10_CLOCK_HPP
+
+#include <base/Time.hpp>
+#include <time.h>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Returns the current time of the system's monotonic clock
+     *
+     * Unlike base::Time::now(), it is not affected by changes to the wall
+     * clock, and is therefore used to measure durations and timestamp I/O
+     */
+    inline base::Time monotonicNow()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return base::Time::fromMicroseconds(
+                static_cast<boost::int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000);
+    }
+}
+
+#endif
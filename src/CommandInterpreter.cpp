@@ -0,0 +1,178 @@
+#include <ptu_kongsberg_oe10/CommandInterpreter.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <ostream>
+#include <sstream>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+CommandInterpreter::CommandInterpreter(Driver& driver)
+    : driver(driver)
+{
+}
+
+vector<string> CommandInterpreter::split(string const& line)
+{
+    vector<string> args;
+    istringstream stream(line);
+    string arg;
+    while (stream >> arg)
+        args.push_back(arg);
+    return args;
+}
+
+int CommandInterpreter::parseDeviceID(string const& arg)
+{
+    char* end;
+    long id = strtol(arg.c_str(), &end, 0);
+    if (arg.empty() || *end != 0 || id < 0 || id > Packet::BROADCAST)
+        throw UsageError("invalid device ID " + arg);
+    return id;
+}
+
+string CommandInterpreter::getHelp()
+{
+    return
+        "  info\n"
+        "      reports the device's general info\n"
+        "  status\n"
+        "      reports the device's axis positions and associated info\n"
+        "  pan ANGLE [SPEED]\n"
+        "      moves the pan axis to the specified angle. Angle is\n"
+        "      specified in degrees and must be between 0 and 360.\n"
+        "      The speed is specified at a fraction of the maximum\n"
+        "      speed (between 0 and 1) and defaults to 0.1.\n"
+        "  tilt ANGLE [SPEED]\n"
+        "      moves the tilt axis to the specified angle. Angle is\n"
+        "      specified in degrees and must be between 0 and 360\n"
+        "      The speed is specified at a fraction of the maximum\n"
+        "      speed (between 0 and 1) and defaults to 0.1.\n"
+        "  move PAN TILT [SPEED]\n"
+        "      moves both axes, with the same speed\n";
+}
+
+/** Parses a numeric argument, reporting errors as UsageError */
+static double parseNumber(string const& arg)
+{
+    try { return lexical_cast<double>(arg); }
+    catch(boost::bad_lexical_cast const&)
+    {
+        throw UsageError("invalid number " + arg);
+    }
+}
+
+void CommandInterpreter::execute(string const& line, ostream& out)
+{
+    execute(split(line), out);
+}
+
+CommandLine::CommandLine()
+    : device_id(0)
+    , pan(base::unset<float>())
+    , tilt(base::unset<float>())
+    , pan_speed(base::unset<float>())
+    , tilt_speed(base::unset<float>())
+{
+}
+
+CommandLine CommandInterpreter::parse(vector<string> const& args)
+{
+    if (args.size() < 2)
+        throw UsageError("expected a device ID and a command");
+
+    CommandLine command;
+    command.device_id = parseDeviceID(args[0]);
+    command.name = args[1];
+    string const& cmd = command.name;
+    if (cmd == "info" || cmd == "status")
+    {
+        if (args.size() != 2)
+            throw UsageError(cmd + " expects no arguments");
+    }
+    // Movement commands (pan or tilt)
+    else if (cmd == "tilt" || cmd == "pan")
+    {
+        // Check if correct number of arguments is provided
+        if (args.size() != 3 && args.size() != 4)
+            throw UsageError(cmd + " expects an angle and an optional speed");
+
+        // Convert angle from degrees to radians
+        double angle = parseNumber(args[2]) * M_PI / 180;
+        // Set default speed to 10% if not specified
+        double speed = 0.1;
+        if (args.size() == 4)
+            speed = parseNumber(args[3]);
+
+        if (cmd == "pan")
+        {
+            command.pan = angle;
+            command.pan_speed = speed;
+        }
+        else
+        {
+            command.tilt = angle;
+            command.tilt_speed = speed;
+        }
+    }
+    // "move" moves both axes at once, with the same speed
+    else if (cmd == "move")
+    {
+        if (args.size() != 4 && args.size() != 5)
+            throw UsageError("move expects a pan and a tilt angle and an optional speed");
+
+        command.pan = parseNumber(args[2]) * M_PI / 180;
+        command.tilt = parseNumber(args[3]) * M_PI / 180;
+        double speed = 0.1;
+        if (args.size() == 5)
+            speed = parseNumber(args[4]);
+        command.pan_speed = command.tilt_speed = speed;
+    }
+    else
+        throw UsageError("unrecognized command " + cmd);
+    return command;
+}
+
+void CommandInterpreter::printInfo(ostream& out, Status const& status)
+{
+    out
+        << "Capabilities\n"
+        << "  Pan: " << status.ptu.pan << "\n"      // Pan axis capabilities
+        << "  Tilt: " << status.ptu.tilt << "\n"    // Tilt axis capabilities
+        << "Temperature: " << status.temperature.getCelsius() << "\n"  // Device temperature
+        << "Humidity: " << status.humidity << "\n"   // Device humidity
+        << "Pan: " << round(status.pan * 180 / M_PI) << "\n"    // Current pan position in degrees
+        << "Tilt: " << round(status.tilt * 180 / M_PI) << endl; // Current tilt position in degrees
+}
+
+void CommandInterpreter::printStatus(ostream& out, PanTiltStatus const& status)
+{
+    out
+        << "Status\n"
+        << "Pan Speed: " << status.pan_speed << "\n"     // Current pan axis speed
+        << "Tilt Speed: " << status.tilt_speed << "\n"   // Current tilt axis speed
+        << "Pan: " << round(status.pan * 180 / M_PI) << " deg\n"   // Current pan position
+        << "Tilt: " << round(status.tilt * 180 / M_PI) << " deg\n" // Current tilt position
+        << "Uses Pan Stop: " << status.uses_pan_stop << "\n"    // Pan limit switch status
+        << "Uses Tilt Stop: " << status.uses_tilt_stop << endl; // Tilt limit switch status
+}
+
+void CommandInterpreter::execute(vector<string> const& args, ostream& out)
+{
+    execute(parse(args), out);
+}
+
+void CommandInterpreter::execute(CommandLine const& command, ostream& out)
+{
+    // "info" displays general device information, including capabilities
+    if (command.name == "info")
+        printInfo(out, driver.getStatus(command.device_id));
+    // "status" displays the current motion status
+    else if (command.name == "status")
+        printStatus(out, driver.getPanTiltStatus(command.device_id));
+    // Movement commands set the speeds and targets in a single round trip
+    else
+        driver.move(command.device_id, command.pan, command.tilt, command.pan_speed, command.tilt_speed);
+}
@@ -0,0 +1,102 @@
+#ifndef PTU_KONGSBERG_OE10_COMMAND_INTERPRETER_HPP
+#define PTU_KONGSBERG_OE10_COMMAND_INTERPRETER_HPP
+
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <iosfwd>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /** Exception thrown for malformed command lines */
+    class UsageError : public std::invalid_argument
+    {
+    public:
+        explicit UsageError(std::string const& message)
+            : std::invalid_argument(message) {}
+    };
+
+    /** A parsed command line */
+    struct CommandLine
+    {
+        int device_id;
+        /** The command name, e.g. "pan" */
+        std::string name;
+        /** Target angles in radians, unset if the command does not move
+         * the axis */
+        float pan;
+        float tilt;
+        /** Speeds as fraction of maximum, unset if the command does not
+         * move the axis */
+        float pan_speed;
+        float tilt_speed;
+
+        CommandLine();
+    };
+
+    /**
+     * Executes the text commands of ptu_kongsberg_oe10_bin on a driver
+     *
+     * A command line is a device ID followed by a command and its
+     * arguments, e.g. "2 pan 90 0.5". The device ID can be given in decimal
+     * or hexadecimal (0xFF for broadcast). The commands are described by
+     * getHelp().
+     *
+     * It is shared by the command-line tool, which executes a single
+     * command, and by ControlServer, which executes the commands it
+     * receives on its socket.
+     */
+    class CommandInterpreter
+    {
+    public:
+        /**
+         * @param driver The driver, which must be open and outlive the
+         *   interpreter
+         */
+        explicit CommandInterpreter(Driver& driver);
+
+        /**
+         * Executes a command and writes its output
+         * @param args The device ID, the command and its arguments
+         * @param out The stream the output is written to
+         * @throws UsageError if the command is unknown or its arguments are
+         *   invalid. Nothing has been sent then
+         */
+        void execute(std::vector<std::string> const& args, std::ostream& out);
+
+        /** Splits a command line and executes it */
+        void execute(std::string const& line, std::ostream& out);
+
+        /** Executes an already parsed command line */
+        void execute(CommandLine const& command, std::ostream& out);
+
+        /**
+         * Parses a command line
+         * @param args The device ID, the command and its arguments
+         * @throws UsageError if the command is unknown or its arguments are
+         *   invalid
+         */
+        static CommandLine parse(std::vector<std::string> const& args);
+
+        /** Writes the output of the info command */
+        static void printInfo(std::ostream& out, Status const& status);
+
+        /** Writes the output of the status command */
+        static void printStatus(std::ostream& out, PanTiltStatus const& status);
+
+        /** Splits a command line on whitespace */
+        static std::vector<std::string> split(std::string const& line);
+
+        /** Parses a device ID, in decimal or hexadecimal */
+        static int parseDeviceID(std::string const& arg);
+
+        /** Returns the description of the commands, for usage messages */
+        static std::string getHelp();
+
+    private:
+        Driver& driver;
+    };
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include <ptu_kongsberg_oe10/Commands.hpp>
+#include <boost/lexical_cast.hpp>
+#include <stdexcept>
+#include <cmath>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+/** Whether the 3 bytes of an angle can be parsed */
+static bool canParseAngle(byte const* data)
+{
+    float angle;
+    return Packet::tryParseAngle(data, angle);
+}
+
+bool commands::GetStatus::isValidReply(byte const* data) const
+{
+    return canParseAngle(data + 3) && canParseAngle(data + 6);
+}
+
+/**
+ * Parse the ST reply: camera and PTU capabilities, temperature, humidity and
+ * current positions
+ */
+Status commands::GetStatus::decode(byte const* data) const
+{
+    Status status;
+    // Parse capability flags from first three bytes
+    byte b0 = data[0];
+    byte b1 = data[1];
+    byte b2 = data[2];
+
+    // Parse camera capabilities from first byte
+    status.camera.enabled         = (b0 & 0x01) != 0;
+    status.camera.focus           = (b0 & 0x02) != 0;
+    status.camera.zoom            = (b0 & 0x04) != 0;
+    status.ptu.pan                = (b0 & 0x08) != 0;
+    status.ptu.tilt               = (b0 & 0x10) != 0;
+    status.camera.auto_focus      = (b0 & 0x20) != 0;
+    status.camera.manual_exposure = (b0 & 0x40) != 0;
+    status.camera.stills          = (b0 & 0x80) != 0;
+
+    // Parse additional camera capabilities from second byte
+    status.camera.wipers          = (b1 & 0x01) != 0;
+    status.camera.washer          = (b1 & 0x02) != 0;
+    status.camera.lamp_control    = (b1 & 0x04) != 0;
+    status.camera.flash           = (b1 & 0x08) != 0;
+    status.camera.flash_charged   = (b1 & 0x10) != 0;
+
+    // Parse environmental data from third byte. Temperature is in the lower
+    // nibble, humidity in the upper nibble
+    status.temperature = base::Temperature::fromCelsius((b2 & 0xF) * 5 - 5);
+    status.humidity    = static_cast<int>(b2 >> 4) * 100 / 15;
+
+    // Parse current positions
+    status.pan  = Packet::parseAngle(data + 3);
+    status.tilt = Packet::parseAngle(data + 6);
+    status.time = base::Time::now();
+    return status;
+}
+
+bool commands::GetPanTiltStatus::isValidReply(byte const* data) const
+{
+    return canParseAngle(data + 2) && canParseAngle(data + 5);
+}
+
+/**
+ * Parse the AS reply: current speeds, positions, and end stop usage
+ */
+PanTiltStatus commands::GetPanTiltStatus::decode(byte const* data) const
+{
+    PanTiltStatus status;
+    // Driver::readReply refines this using the I/O timestamps
+    status.time = base::Time::now();
+    status.received_time = status.time;
+    // Parse speeds (0x64 = 100, so dividing gives percentage)
+    status.pan_speed  = static_cast<float>(data[0]) / 0x64;
+    status.tilt_speed = static_cast<float>(data[1]) / 0x64;
+    // Parse current positions
+    status.pan  = Packet::parseAngle(data + 2);
+    status.tilt = Packet::parseAngle(data + 5);
+    // Parse end stop usage (0x31 = '1' means enabled)
+    status.uses_pan_stop  = (data[8] == 0x31);
+    status.uses_tilt_stop = (data[9] == 0x31);
+    return status;
+}
+
+constexpr StateCache::Setting commands::UseEndStops::SETTING;
+constexpr unsigned commands::UseEndStops::INVALIDATES;
+
+/**
+ * The ES reply echoes the end stop setting, verify that it matches
+ */
+void commands::UseEndStops::decode(byte const* data) const
+{
+    byte expected;
+    encode(&expected);
+    if (data[0] != expected)
+        throw std::runtime_error("boolean in the reply for use end stops command mismatches the sent command");
+}
+
+/**
+ * Convert a speed in [0, 1] to the protocol's [0, 0x64] range
+ */
+byte commands::encodeSpeed(float speed)
+{
+    if (speed < 0 || speed > 1)
+        throw std::range_error("invalid range for speed, should be in [0,1] and got " + lexical_cast<string>(speed));
+    return round(speed * 0x64);  // Convert to percentage (0-100)
+}
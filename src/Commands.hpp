@@ -0,0 +1,299 @@
+#ifndef PTU_KONGSBERG_OE10_COMMANDS_HPP
+#define PTU_KONGSBERG_OE10_COMMANDS_HPP
+
+#include <ptu_kongsberg_oe10/Packet.hpp>
+#include <ptu_kongsberg_oe10/Status.hpp>
+#include <ptu_kongsberg_oe10/PanTiltStatus.hpp>
+#include <ptu_kongsberg_oe10/Expected.hpp>
+#include <ptu_kongsberg_oe10/StateCache.hpp>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Compile-time descriptions of the OE10 commands
+     *
+     * Each command is a type that derives from Descriptor, which gives its
+     * opcode, the size of its request payload and the size of the data in
+     * the ACK (after the command echo). The frame sizes and the checksum of
+     * the constant part of the request frame are derived from these at
+     * compile time.
+     *
+     * In addition, each command type provides
+     * - a Result typedef, the type returned by the driver for this command
+     * - a encode(byte* data) method that writes the REQUEST_SIZE bytes of
+     *   request payload
+     * - a decode(byte const* data) method that interprets the
+     *   RESPONSE_SIZE bytes of ACK data
+     *
+     * Commands whose parameters or reply data can be invalid also hide
+     * Descriptor's isValid() and isValidReply(byte const* data), which
+     * allow Driver::tryExecute to report these cases without throwing.
+     * encode and decode may assume that they returned true.
+     *
+     * Commands that change a device setting override SETTING and
+     * INVALIDATES, which are used by the driver's StateCache.
+     *
+     * To add a command, define a new type following this pattern and send it
+     * with Driver::execute.
+     */
+    namespace commands
+    {
+        /** Size of a marshalled frame for a given command and data size */
+        constexpr int frameSize(int command_size, int data_size)
+        {
+            return Packet::HEADER_SIZE + command_size + 1 + data_size + Packet::TRAILER_SIZE;
+        }
+
+        /**
+         * Offset of the data in a marshalled frame for a given command
+         * size: the "<to:from:length:" header, the command and its ':'
+         */
+        constexpr int dataOffset(int command_size)
+        {
+            return Packet::HEADER_SIZE + command_size + 1;
+        }
+
+        /**
+         * Common compile-time information about a two-byte command
+         * @tparam C0 First command byte
+         * @tparam C1 Second command byte
+         * @tparam RequestSize Size of the request payload
+         * @tparam ResponseSize Size of the ACK data, not including the
+         *   command echo
+         */
+        template<byte C0, byte C1, int RequestSize, int ResponseSize>
+        struct Descriptor
+        {
+            static constexpr byte OPCODE0 = C0;
+            static constexpr byte OPCODE1 = C1;
+            static constexpr int REQUEST_SIZE = RequestSize;
+            static constexpr int RESPONSE_SIZE = ResponseSize;
+
+            /** Value of the length field of the request */
+            static constexpr byte REQUEST_LENGTH = 2 + RequestSize + 1;
+            /** Size of the marshalled request */
+            static constexpr int FRAME_SIZE = frameSize(2, RequestSize);
+            /** Offset of the payload in the marshalled request */
+            static constexpr int PAYLOAD_OFFSET = dataOffset(2);
+            /** Size of the marshalled ACK */
+            static constexpr int RESPONSE_FRAME_SIZE = frameSize(1, 2 + ResponseSize);
+
+            /**
+             * XOR of all the bytes of the request that do not depend on the
+             * device IDs and payload, i.e. the separators, the length field
+             * and the opcode
+             */
+            static constexpr byte HEADER_CHECKSUM =
+                ':' ^ ':' ^ REQUEST_LENGTH ^ ':' ^ C0 ^ C1 ^ ':';
+
+            /** The setting whose value is the request payload, if any */
+            static constexpr StateCache::Setting SETTING = StateCache::NO_SETTING;
+            /** The cached settings that become unknown once this command
+             * has been ACKed, see StateCache::bit */
+            static constexpr unsigned INVALIDATES = 0;
+
+            /** Whether the parameters can be encoded */
+            bool isValid() const { return true; }
+            /** Whether the ACK data can be decoded */
+            bool isValidReply(byte const*) const { return true; }
+
+            static_assert(RequestSize + 3 <= 0xFF, "the length of the request does not fit in its one-byte field");
+            static_assert(ResponseSize + 4 <= 0xFF, "the length of the ACK does not fit in its one-byte field");
+        };
+
+        template<byte C0, byte C1, int Req, int Resp> constexpr byte Descriptor<C0, C1, Req, Resp>::OPCODE0;
+        template<byte C0, byte C1, int Req, int Resp> constexpr byte Descriptor<C0, C1, Req, Resp>::OPCODE1;
+        template<byte C0, byte C1, int Req, int Resp> constexpr int Descriptor<C0, C1, Req, Resp>::REQUEST_SIZE;
+        template<byte C0, byte C1, int Req, int Resp> constexpr int Descriptor<C0, C1, Req, Resp>::RESPONSE_SIZE;
+        template<byte C0, byte C1, int Req, int Resp> constexpr byte Descriptor<C0, C1, Req, Resp>::REQUEST_LENGTH;
+        template<byte C0, byte C1, int Req, int Resp> constexpr int Descriptor<C0, C1, Req, Resp>::FRAME_SIZE;
+        template<byte C0, byte C1, int Req, int Resp> constexpr int Descriptor<C0, C1, Req, Resp>::PAYLOAD_OFFSET;
+        template<byte C0, byte C1, int Req, int Resp> constexpr int Descriptor<C0, C1, Req, Resp>::RESPONSE_FRAME_SIZE;
+        template<byte C0, byte C1, int Req, int Resp> constexpr byte Descriptor<C0, C1, Req, Resp>::HEADER_CHECKSUM;
+        template<byte C0, byte C1, int Req, int Resp> constexpr StateCache::Setting Descriptor<C0, C1, Req, Resp>::SETTING;
+        template<byte C0, byte C1, int Req, int Resp> constexpr unsigned Descriptor<C0, C1, Req, Resp>::INVALIDATES;
+
+        /** ST: reads the device capabilities, environment and positions */
+        struct GetStatus : Descriptor<'S', 'T', 0, 9>
+        {
+            typedef Status Result;
+            void encode(byte*) const {}
+            bool isValidReply(byte const* data) const;
+            Status decode(byte const* data) const;
+        };
+
+        /** AS: reads the axis positions, speeds and end stop usage */
+        struct GetPanTiltStatus : Descriptor<'A', 'S', 0, 10>
+        {
+            typedef PanTiltStatus Result;
+            void encode(byte*) const {}
+            bool isValidReply(byte const* data) const;
+            PanTiltStatus decode(byte const* data) const;
+        };
+
+        /** ES: enables or disables the soft end stops */
+        struct UseEndStops : Descriptor<'E', 'S', 1, 1>
+        {
+            typedef void Result;
+            static constexpr StateCache::Setting SETTING = StateCache::END_STOPS;
+            /** The end stops change how new targets are clamped */
+            static constexpr unsigned INVALIDATES = StateCache::TARGETS;
+            bool enable;
+
+            explicit UseEndStops(bool enable)
+                : enable(enable) {}
+            void encode(byte* data) const { data[0] = enable ? 0x31 : 0x30; }
+            bool isValidReply(byte const* data) const { return data[0] == (enable ? 0x31 : 0x30); }
+            void decode(byte const* data) const;
+        };
+
+        /**
+         * CW, AW, UT and DT: sets a soft end stop at the current position
+         */
+        template<byte C0, byte C1>
+        struct SetEndStop : Descriptor<C0, C1, 0, 0>
+        {
+            typedef void Result;
+            static constexpr unsigned INVALIDATES = StateCache::bit(
+                    C0 == 'C' || C0 == 'A' ? StateCache::PAN_TARGET : StateCache::TILT_TARGET);
+            void encode(byte*) const {}
+            void decode(byte const*) const {}
+        };
+        template<byte C0, byte C1> constexpr unsigned SetEndStop<C0, C1>::INVALIDATES;
+        typedef SetEndStop<'C', 'W'> SetPanPositiveEndStop;
+        typedef SetEndStop<'A', 'W'> SetPanNegativeEndStop;
+        typedef SetEndStop<'U', 'T'> SetTiltPositiveEndStop;
+        typedef SetEndStop<'D', 'T'> SetTiltNegativeEndStop;
+
+        /** PP and TP: moves an axis to a given angle, in radians */
+        template<byte Axis>
+        struct SetPosition : Descriptor<Axis, 'P', 3, 3>
+        {
+            typedef void Result;
+            static constexpr StateCache::Setting SETTING =
+                Axis == 'P' ? StateCache::PAN_TARGET : StateCache::TILT_TARGET;
+            float angle;
+
+            explicit SetPosition(float angle)
+                : angle(angle) {}
+            bool isValid() const { return Packet::isValidAngle(angle); }
+            void encode(byte* data) const { Packet::encodeAngle(data, angle); }
+            void decode(byte const*) const {}
+        };
+        template<byte Axis> constexpr StateCache::Setting SetPosition<Axis>::SETTING;
+        typedef SetPosition<'P'> SetPanPosition;
+        typedef SetPosition<'T'> SetTiltPosition;
+
+        /** Encodes a speed given as a fraction of the maximum speed */
+        byte encodeSpeed(float speed);
+
+        /** DS and TA: sets an axis speed, as a fraction of the maximum speed */
+        template<byte C0, byte C1>
+        struct SetSpeed : Descriptor<C0, C1, 1, 0>
+        {
+            typedef void Result;
+            static constexpr StateCache::Setting SETTING =
+                C0 == 'D' ? StateCache::PAN_SPEED : StateCache::TILT_SPEED;
+            float speed;
+
+            explicit SetSpeed(float speed)
+                : speed(speed) {}
+            bool isValid() const { return speed >= 0 && speed <= 1; }
+            void encode(byte* data) const { data[0] = encodeSpeed(speed); }
+            void decode(byte const*) const {}
+        };
+        template<byte C0, byte C1> constexpr StateCache::Setting SetSpeed<C0, C1>::SETTING;
+        typedef SetSpeed<'D', 'S'> SetPanSpeed;
+        typedef SetSpeed<'T', 'A'> SetTiltSpeed;
+
+        /**
+         * TU, TD and TS: starts or stops an axis, returns the axis angle in
+         * radians
+         */
+        template<byte C0, byte C1>
+        struct Movement : Descriptor<C0, C1, 0, 3>
+        {
+            typedef double Result;
+            /** TU, TD and TS replace the tilt target */
+            static constexpr unsigned INVALIDATES = StateCache::bit(StateCache::TILT_TARGET);
+            void encode(byte*) const {}
+            bool isValidReply(byte const* data) const
+            {
+                float angle;
+                return Packet::tryParseAngle(data, angle);
+            }
+            double decode(byte const* data) const { return Packet::parseAngle(data); }
+        };
+        template<byte C0, byte C1> constexpr unsigned Movement<C0, C1>::INVALIDATES;
+        typedef Movement<'T', 'U'> TiltUp;
+        typedef Movement<'T', 'D'> TiltDown;
+        typedef Movement<'T', 'S'> TiltStop;
+
+        /** Tag-dispatched implementation of tryDecode */
+        template<typename Command, typename T>
+        Expected<T> decodeValid(Command const& command, byte const* data, Expected<T>*)
+        {
+            return command.decode(data);
+        }
+
+        template<typename Command>
+        Expected<void> decodeValid(Command const& command, byte const* data, Expected<void>*)
+        {
+            command.decode(data);
+            return Expected<void>();
+        }
+
+        /**
+         * Decodes the ACK data of a command without throwing
+         * @param device_id The device the reply comes from, reported in the
+         *   error
+         * @param data The RESPONSE_SIZE bytes of ACK data
+         * @return The decoded reply, or an Error::INVALID_REPLY error
+         */
+        template<typename Command>
+        Expected<typename Command::Result> tryDecode(Command const& command, byte device_id, byte const* data)
+        {
+            if (!command.isValidReply(data))
+            {
+                byte const opcode[2] = { Command::OPCODE0, Command::OPCODE1 };
+                return Error(Error::INVALID_REPLY, device_id, opcode, 2);
+            }
+            return decodeValid(command, data, static_cast<Expected<typename Command::Result>*>(0));
+        }
+
+        /**
+         * Marshals the request for a command
+         *
+         * Only the device ID and payload bytes are checksummed at runtime,
+         * the rest of the checksum being Command::HEADER_CHECKSUM
+         * @param buffer Buffer of at least Command::FRAME_SIZE bytes
+         * @return Command::FRAME_SIZE
+         */
+        template<typename Command>
+        int marshal(Command const& command, byte to, byte* buffer, byte from = Packet::CONTROLLER)
+        {
+            int const REQUEST_SIZE = Command::REQUEST_SIZE;
+            buffer[0] = '<';
+            buffer[1] = to;
+            buffer[2] = ':';
+            buffer[3] = from;
+            buffer[4] = ':';
+            buffer[5] = Command::REQUEST_LENGTH;
+            buffer[6] = ':';
+            buffer[7] = Command::OPCODE0;
+            buffer[8] = Command::OPCODE1;
+            buffer[9] = ':';
+            byte* payload = buffer + Command::PAYLOAD_OFFSET;
+            command.encode(payload);
+
+            byte checksum = Command::HEADER_CHECKSUM ^ to ^ from ^
+                Packet::computeChecksum(payload, payload + REQUEST_SIZE);
+            payload[REQUEST_SIZE] = ':';
+            Packet::marshalChecksum(checksum, payload + REQUEST_SIZE + 1);
+            payload[REQUEST_SIZE + 4] = '>';
+            return Command::FRAME_SIZE;
+        }
+    }
+}
+
+#endif
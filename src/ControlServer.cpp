@@ -0,0 +1,371 @@
+#include <ptu_kongsberg_oe10/ControlServer.hpp>
+#include <base/Logging.hpp>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+/** The epoll tags of the listening socket and of the wakeup eventfd.
+ * Clients are tagged with their descriptor */
+static const boost::uint64_t LISTEN_TAG = ~static_cast<boost::uint64_t>(0);
+static const boost::uint64_t WAKEUP_TAG = LISTEN_TAG - 1;
+
+/** Time after which a client that does not read its replies is
+ * disconnected */
+static const int SEND_TIMEOUT_MS = 1000;
+
+static sockaddr_un makeAddress(string const& path)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+        throw std::invalid_argument("invalid socket path " + path);
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+/** Writes a whole buffer to a socket */
+static bool sendAll(int fd, string const& data)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t result = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR)
+            continue;
+        else if (result <= 0)
+            return false;
+        written += result;
+    }
+    return true;
+}
+
+ControlServer::ControlServer(Driver& driver)
+    : interpreter(driver)
+    , listen_fd(-1)
+    , epoll_fd(-1)
+    , event_fd(-1)
+    , stop_requested(0)
+    , stop_error(0)
+{
+}
+
+ControlServer::~ControlServer()
+{
+    close();
+}
+
+void ControlServer::open(string const& path)
+{
+    close();
+    sockaddr_un address = makeAddress(path);
+
+    // Refuse to steal the socket of a running server, but remove the file
+    // of one that is gone
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0)
+    {
+        bool inUse = ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        ::close(probe);
+        if (inUse)
+            throw std::runtime_error("another server is already listening on " + path);
+    }
+    unlink(path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        throw std::runtime_error(string("cannot create the control socket: ") + strerror(errno));
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+            listen(listen_fd, 16) < 0)
+    {
+        int error = errno;
+        ::close(listen_fd);
+        listen_fd = -1;
+        throw std::runtime_error("cannot listen on " + path + ": " + strerror(error));
+    }
+    this->path = path;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || event_fd < 0)
+    {
+        int error = errno;
+        close();
+        throw std::runtime_error(string("cannot create the control server's event loop: ") + strerror(error));
+    }
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = LISTEN_TAG;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.u64 = WAKEUP_TAG;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event);
+}
+
+string ControlServer::getPath() const
+{
+    return path;
+}
+
+void ControlServer::close()
+{
+    while (!clients.empty())
+        disconnect(clients.size() - 1);
+    if (listen_fd >= 0)
+    {
+        ::close(listen_fd);
+        unlink(path.c_str());
+    }
+    if (epoll_fd >= 0)
+        ::close(epoll_fd);
+    if (event_fd >= 0)
+        ::close(event_fd);
+    listen_fd = epoll_fd = event_fd = -1;
+    path.clear();
+}
+
+/**
+ * Only async-signal-safe functions may be called here, and errno must be
+ * preserved for the interrupted code. A failed write is left for run() to
+ * report. The flag still stops run() if the signal interrupted its
+ * epoll_wait
+ */
+void ControlServer::stop()
+{
+    int savedErrno = errno;
+    stop_requested = 1;
+    boost::uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) < 0)
+        stop_error = errno;
+    errno = savedErrno;
+}
+
+void ControlServer::run()
+{
+    if (epoll_fd < 0)
+        throw std::logic_error("ControlServer::run called before open");
+
+    epoll_event events[16];
+    while (!stop_requested)
+    {
+        int count = epoll_wait(epoll_fd, events, 16, -1);
+        if (count < 0 && errno == EINTR)
+            continue;
+        else if (count < 0)
+            throw std::runtime_error(string("ControlServer: epoll_wait failed: ") + strerror(errno));
+
+        for (int i = 0; i < count && !stop_requested; ++i)
+        {
+            boost::uint64_t tag = events[i].data.u64;
+            if (tag == LISTEN_TAG)
+                accept();
+            else if (tag != WAKEUP_TAG)
+            {
+                for (size_t c = 0; c < clients.size(); ++c)
+                {
+                    if (clients[c].fd == static_cast<int>(tag))
+                    {
+                        if (!serve(clients[c]))
+                            disconnect(c);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // Consume the stop request, so that the server can be run again. A
+    // stop() from now on is kept for the next run()
+    int error = stop_error;
+    stop_requested = 0;
+    stop_error = 0;
+    boost::uint64_t value;
+    if (read(event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    {
+        LOG_ERROR_S << "ControlServer: failed to read the wakeup eventfd: " << strerror(errno);
+    }
+    if (error)
+    {
+        LOG_ERROR_S << "ControlServer: failed to wake up the server on stop: " << strerror(error);
+    }
+}
+
+void ControlServer::accept()
+{
+    int fd = accept4(listen_fd, 0, 0, SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_WARN_S << "ControlServer: failed to accept a client: " << strerror(errno);
+        return;
+    }
+
+    timeval timeout;
+    timeout.tv_sec = SEND_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (SEND_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        LOG_WARN_S << "ControlServer: cannot watch a new client: " << strerror(errno);
+        ::close(fd);
+        return;
+    }
+    Client client;
+    client.fd = fd;
+    clients.push_back(client);
+}
+
+void ControlServer::disconnect(size_t index)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, clients[index].fd, 0);
+    ::close(clients[index].fd);
+    clients.erase(clients.begin() + index);
+}
+
+bool ControlServer::serve(Client& client)
+{
+    char buffer[MAX_LINE_SIZE];
+    ssize_t size = recv(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return true;
+    else if (size <= 0)
+        return false;
+    client.input.append(buffer, size);
+
+    string::size_type start = 0, end;
+    while ((end = client.input.find('\n', start)) != string::npos)
+    {
+        string line = client.input.substr(start, end - start);
+        start = end + 1;
+        if (CommandInterpreter::split(line).empty())
+            continue;
+        if (!sendAll(client.fd, process(line)))
+            return false;
+    }
+    client.input.erase(0, start);
+
+    if (client.input.size() > MAX_LINE_SIZE)
+    {
+        sendAll(client.fd, "usage request line too long\n\n");
+        return false;
+    }
+    return true;
+}
+
+string ControlServer::process(string const& line)
+{
+    ostringstream out;
+    string status = "ok";
+    try { interpreter.execute(line, out); }
+    catch(UsageError const& e)
+    {
+        status = string("usage ") + e.what();
+    }
+    catch(std::exception const& e)
+    {
+        status = string("error ") + e.what();
+    }
+
+    // Newlines delimit the status, and empty lines terminate the replies
+    for (size_t i = 0; i < status.size(); ++i)
+    {
+        if (status[i] == '\n')
+            status[i] = ' ';
+    }
+    string output = out.str();
+    string reply = status + "\n";
+    istringstream lines(output);
+    string outputLine;
+    while (getline(lines, outputLine))
+    {
+        if (!outputLine.empty())
+            reply += outputLine + "\n";
+    }
+    return reply + "\n";
+}
+
+ControlClient::ControlClient()
+    : fd(-1)
+{
+}
+
+ControlClient::~ControlClient()
+{
+    close();
+}
+
+void ControlClient::connect(string const& path)
+{
+    close();
+    sockaddr_un address = makeAddress(path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw std::runtime_error(string("cannot create a socket: ") + strerror(errno));
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        int error = errno;
+        close();
+        throw std::runtime_error("cannot connect to " + path + ": " + strerror(error));
+    }
+}
+
+void ControlClient::close()
+{
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    input.clear();
+}
+
+string ControlClient::execute(vector<string> const& args)
+{
+    string line;
+    for (size_t i = 0; i < args.size(); ++i)
+        line += (i == 0 ? "" : " ") + args[i];
+    return execute(line);
+}
+
+string ControlClient::execute(string const& line)
+{
+    if (line.find('\n') != string::npos)
+        throw UsageError("command lines cannot contain newlines");
+    if (!sendAll(fd, line + "\n"))
+        throw std::runtime_error(string("failed to send the command: ") + strerror(errno));
+
+    string::size_type end;
+    while ((end = input.find("\n\n")) == string::npos)
+    {
+        char buffer[1024];
+        ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+        if (size < 0 && errno == EINTR)
+            continue;
+        else if (size <= 0)
+            throw std::runtime_error("connection to the control server lost");
+        input.append(buffer, size);
+    }
+
+    string reply = input.substr(0, end + 1);
+    input.erase(0, end + 2);
+    string::size_type statusEnd = reply.find('\n');
+    string status = reply.substr(0, statusEnd);
+    string output = reply.substr(statusEnd + 1);
+    if (status == "ok")
+        return output;
+    else if (status.compare(0, 6, "usage ") == 0)
+        throw UsageError(status.substr(6));
+    else if (status.compare(0, 6, "error ") == 0)
+        throw std::runtime_error(status.substr(6));
+    throw std::runtime_error("invalid reply from the control server: " + status);
+}
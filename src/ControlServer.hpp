@@ -0,0 +1,140 @@
+#ifndef PTU_KONGSBERG_OE10_CONTROL_SERVER_HPP
+#define PTU_KONGSBERG_OE10_CONTROL_SERVER_HPP
+
+#include <ptu_kongsberg_oe10/CommandInterpreter.hpp>
+#include <csignal>
+#include <string>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Serves the commands of CommandInterpreter on a Unix domain socket
+     *
+     * It lets several local tools share a single open link, without paying
+     * for the process startup and port opening on each command. The
+     * protocol is line-based, so that it can be used from scripts with
+     * e.g. socat:
+     *
+     * - a request is a command line, as given to CommandInterpreter, e.g.
+     *   "2 pan 90 0.5", terminated by a newline
+     * - its reply is a status line, followed by the command's output and an
+     *   empty line. The status line is "ok", "usage MESSAGE" if the
+     *   command line is invalid, or "error MESSAGE" if the command failed
+     *
+     * Requests are executed one at a time, in the order they are received,
+     * on the thread that calls run(). Clients can send several requests
+     * without waiting for the replies.
+     */
+    class ControlServer
+    {
+    public:
+        /** Maximum size of a request line */
+        static const size_t MAX_LINE_SIZE = 1024;
+
+        /**
+         * @param driver The driver, which must be open and outlive the
+         *   server. It must not be used by other threads while run() is
+         *   running
+         */
+        explicit ControlServer(Driver& driver);
+
+        /** Closes the socket */
+        ~ControlServer();
+
+        /**
+         * Creates the socket
+         *
+         * A stale socket file at the same path is removed
+         * @throws std::runtime_error if the socket cannot be created, or if
+         *   another server already listens on it
+         */
+        void open(std::string const& path);
+
+        /** Returns the path of the socket, or an empty string if it is not
+         * open */
+        std::string getPath() const;
+
+        /**
+         * Serves the clients until stop() is called
+         *
+         * It logs the errors stop() could not report itself
+         */
+        void run();
+
+        /**
+         * Makes run() return
+         *
+         * It only sets a flag and writes to an eventfd, so that it can be
+         * called from any thread, and from signal handlers
+         */
+        void stop();
+
+        /** Disconnects the clients, and closes and removes the socket */
+        void close();
+
+    private:
+        struct Client
+        {
+            int fd;
+            std::string input;
+        };
+
+        /** Reads the available data of a client and executes its complete
+         * lines. Returns false if the client should be disconnected */
+        bool serve(Client& client);
+
+        /** Executes a request and returns its reply */
+        std::string process(std::string const& line);
+
+        void accept();
+        void disconnect(size_t index);
+
+        CommandInterpreter interpreter;
+        std::string path;
+        int listen_fd;
+        int epoll_fd;
+        int event_fd;
+        /** Set by stop(), cleared when run() returns */
+        volatile sig_atomic_t stop_requested;
+        /** The errno of the last failed eventfd write in stop(), or 0 */
+        volatile sig_atomic_t stop_error;
+        std::vector<Client> clients;
+    };
+
+    /**
+     * Client of ControlServer
+     */
+    class ControlClient
+    {
+    public:
+        ControlClient();
+        ~ControlClient();
+
+        /**
+         * Connects to a server
+         * @throws std::runtime_error if the connection fails
+         */
+        void connect(std::string const& path);
+
+        /** Disconnects from the server */
+        void close();
+
+        /**
+         * Executes a command line and returns its output
+         * @throws UsageError if the server rejected the command line
+         * @throws std::runtime_error if the command failed, or the
+         *   connection was lost
+         */
+        std::string execute(std::string const& line);
+
+        /** Executes a command given as separate arguments */
+        std::string execute(std::vector<std::string> const& args);
+
+    private:
+        int fd;
+        std::string input;
+    };
+}
+
+#endif
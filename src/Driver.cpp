@@ -1,5 +1,6 @@
 #include <base/Logging.hpp>
 #include <ptu_kongsberg_oe10/Driver.hpp>
+#include <ptu_kongsberg_oe10/ReplayStream.hpp>
 #include <stdexcept>
 #include <boost/lexical_cast.hpp>
 
@@ -13,62 +14,251 @@ using boost::lexical_cast;
  */
 Driver::Driver()
     : iodrivers_base::Driver(Packet::MAX_PACKET_SIZE)
+    , baudrate(0)
+    , trace(0)
+    , poseEstimator(0)
+    , poseEstimatorDevice(0)
+    , stateCacheEnabled(false)
+    , environmentTTL(base::Time::fromSeconds(10))
 {
     setReadTimeout(base::Time::fromSeconds(2));
     setWriteTimeout(base::Time::fromSeconds(2));
 }
 
+/**
+ * Opens the device, recording the baud rate of serial URIs. Captures are
+ * replayed through a ReplayStream
+ */
+void Driver::openURI(string const& uri)
+{
+    if (uri.compare(0, 9, "replay://") == 0)
+    {
+        string path = uri.substr(9);
+        ReplayStream::Mode mode = ReplayStream::FAST;
+        string::size_type colon = path.rfind(':');
+        if (colon != string::npos && path.substr(colon + 1) == "realtime")
+        {
+            mode = ReplayStream::REALTIME;
+            path = path.substr(0, colon);
+        }
+        else if (colon != string::npos && path.substr(colon + 1) == "fast")
+            path = path.substr(0, colon);
+        setMainStream(new ReplayStream(path, mode));
+    }
+    else
+        iodrivers_base::Driver::openURI(uri);
+    resetFraming();
+    stateCache.clear();
+    if (poseEstimator)
+        poseEstimator->reset();
+    for (int i = 0; i < 256; ++i)
+        deviceInfo[i] = DeviceInfo();
+
+    baudrate = 0;
+    if (uri.compare(0, 9, "serial://") == 0)
+    {
+        string::size_type colon = uri.rfind(':');
+        if (colon != string::npos && colon > 9)
+        {
+            try { baudrate = lexical_cast<int>(uri.substr(colon + 1)); }
+            catch(boost::bad_lexical_cast const&) {}
+        }
+    }
+}
+
+bool Driver::setSerialBaudrate(int brate)
+{
+    bool result = iodrivers_base::Driver::setSerialBaudrate(brate);
+    baudrate = brate;
+    return result;
+}
+
+int Driver::getBaudrate() const
+{
+    return baudrate;
+}
+
+void Driver::setBaudrate(int baudrate)
+{
+    this->baudrate = baudrate;
+}
+
+/**
+ * Estimates the sampling time as the midpoint between the end of the
+ * request and the start of the reply
+ * The write completes when the bytes are queued, the request is therefore
+ * on the wire until request_size byte times later. The reader wakes up
+ * once the first byte has been fully received, one byte time after the
+ * reply started.
+ */
+base::Time Driver::estimateSampleTime(base::Time const& request_time, int request_size,
+        base::Time const& first_byte_time, int baudrate)
+{
+    base::Time byte_time;
+    if (baudrate > 0)
+        byte_time = base::Time::fromMicroseconds(10 * 1000000LL / baudrate);
+
+    base::Time request_end = request_time + byte_time * request_size;
+    base::Time reply_start = first_byte_time - byte_time;
+    if (reply_start < request_end)
+        return request_end;
+    return request_end + (reply_start - request_end) / 2;
+}
+
+DriverStatistics Driver::getStatistics() const
+{
+    return statistics;
+}
+
+void Driver::resetStatistics()
+{
+    statistics = DriverStatistics();
+}
+
+void Driver::setTrace(Trace* trace)
+{
+    this->trace = trace;
+}
+
+Trace* Driver::getTrace() const
+{
+    return trace;
+}
+
+void Driver::setPoseEstimator(int device_id, PoseEstimator* estimator)
+{
+    poseEstimator = estimator;
+    poseEstimatorDevice = device_id;
+}
+
+PoseEstimator* Driver::getPoseEstimator() const
+{
+    return poseEstimator;
+}
+
 /**
  * Configures whether the device should use end stops for safety
  * End stops prevent the PTU from moving beyond its physical limits
  */
 void Driver::useEndStops(int device_id, bool enable)
 {
-    // Create and configure the command packet
-    Packet packet(device_id);
-    packet.setCommand('E', 'S');
-    packet.data_size = 1;
-    packet.data[0] = enable ? 0x31 : 0x30;  // 0x31 = '1' (enable), 0x30 = '0' (disable)
-    writePacket(packet);
-
-    // Read and validate response
-    Packet response = readResponse(packet, 1);
-    if (response.data[2] != packet.data[0])
-        throw std::runtime_error("boolean in the reply for use end stops command mismatches the sent command");
+    execute(device_id, commands::UseEndStops(enable));
 }
 
 // Pan end stop configuration methods
 void Driver::setPanPositiveEndStop(int device_id)
 {
-    setEndStop(device_id, 'C', 'W');  // CW = Clockwise limit
+    execute(device_id, commands::SetPanPositiveEndStop());  // CW = Clockwise limit
 }
 
 void Driver::setPanNegativeEndStop(int device_id)
 {
-    setEndStop(device_id, 'A', 'W');  // AW = Anti-clockwise limit
+    execute(device_id, commands::SetPanNegativeEndStop());  // AW = Anti-clockwise limit
 }
 
 // Tilt end stop configuration methods
 void Driver::setTiltPositiveEndStop(int device_id)
 {
-    setEndStop(device_id, 'U', 'T');  // UT = Up tilt limit
+    execute(device_id, commands::SetTiltPositiveEndStop());  // UT = Up tilt limit
 }
 
 void Driver::setTiltNegativeEndStop(int device_id)
 {
-    setEndStop(device_id, 'D', 'T');  // DT = Down tilt limit
+    execute(device_id, commands::SetTiltNegativeEndStop());  // DT = Down tilt limit
+}
+
+void Driver::setStateCacheEnabled(bool enable)
+{
+    if (enable && !stateCacheEnabled)
+        stateCache.clear();
+    stateCacheEnabled = enable;
+}
+
+bool Driver::isStateCacheEnabled() const
+{
+    return stateCacheEnabled;
+}
+
+void Driver::invalidateStateCache(int device_id)
+{
+    stateCache.invalidate(device_id);
 }
 
 /**
- * Generic method to set an end stop position
- * Used internally by the specific end stop setting methods
+ * Check whether the state cache has the given setting for a device, and
+ * count the command as suppressed if it does
  */
-void Driver::setEndStop(int device_id, char cmd0, char cmd1)
+bool Driver::isCached(byte device_id, byte const* opcode, StateCache::Setting setting,
+        byte const* payload, int size)
+{
+    if (!stateCacheEnabled || device_id == Packet::BROADCAST ||
+            !stateCache.matches(device_id, setting, payload, size))
+        return false;
+
+    ++statistics.suppressed_commands;
+    if (CommandStatistics* entry = statistics.get(opcode[0], opcode[1]))
+        ++entry->suppressed;
+    return true;
+}
+
+void Driver::updateSettings(byte device_id, StateCache::Setting setting, unsigned invalidates,
+        byte const* payload, int size, Error const& error)
 {
-    Packet packet(device_id);
-    packet.setCommand(cmd0, cmd1);
-    writePacket(packet);
-    readResponse(packet, 0);  // Expect empty response
+    if (stateCacheEnabled)
+    {
+        if (error)
+            stateCache.invalidate(device_id);
+        else
+        {
+            stateCache.invalidate(device_id, invalidates);
+            stateCache.update(device_id, setting, payload, size);
+        }
+    }
+
+    if (!poseEstimator || error ||
+            (device_id != poseEstimatorDevice && device_id != Packet::BROADCAST))
+        return;
+
+    // The command has been applied when the device received it, i.e. at
+    // the end of the write
+    base::Time time = base::Time::now() - (monotonicNow() - lastWriteTime);
+    if (invalidates & StateCache::bit(StateCache::PAN_TARGET))
+        poseEstimator->clearPanTarget(time);
+    if (invalidates & StateCache::bit(StateCache::TILT_TARGET))
+        poseEstimator->clearTiltTarget(time);
+    switch (setting)
+    {
+        case StateCache::PAN_TARGET:
+            poseEstimator->setPanTarget(Packet::parseAngle(payload), time);
+            break;
+        case StateCache::TILT_TARGET:
+            poseEstimator->setTiltTarget(Packet::parseAngle(payload), time);
+            break;
+        case StateCache::PAN_SPEED:
+            poseEstimator->setPanSpeed(static_cast<float>(payload[0]) / 0x64, time);
+            break;
+        case StateCache::TILT_SPEED:
+            poseEstimator->setTiltSpeed(static_cast<float>(payload[0]) / 0x64, time);
+            break;
+        default:
+            break;
+    }
+}
+
+void Driver::updatePoseEstimator(int device_id, Expected<PanTiltStatus> const& status)
+{
+    if (poseEstimator && device_id == poseEstimatorDevice)
+        poseEstimator->update(*status);
+}
+
+Driver::DeviceInfo::DeviceInfo()
+    : has_capabilities(false) {}
+
+/** Check that a device ID can index the per-device caches */
+static void checkDeviceID(int device_id)
+{
+    if (device_id < 0 || device_id > Packet::BROADCAST)
+        throw std::invalid_argument("invalid device ID " + lexical_cast<string>(device_id));
 }
 
 /**
@@ -78,56 +268,98 @@ void Driver::setEndStop(int device_id, char cmd0, char cmd1)
  */
 Status Driver::getStatus(int device_id)
 {
-    // Request status information
-    Packet packet(device_id);
-    packet.setCommand('S', 'T');
-    writePacket(packet);
-    Packet response = readResponse(packet, 9);
-    
+    checkDeviceID(device_id);
+    if (device_id == Packet::BROADCAST)
+        return execute(device_id, commands::GetStatus());
+    else if (!deviceInfo[device_id].has_capabilities || !hasFreshEnvironment(device_id))
+        return readStatus(device_id);
+
+    // Only the positions change quickly, read them with AS
+    PanTiltStatus positions = getPanTiltStatus(device_id);
+    DeviceInfo const& info = deviceInfo[device_id];
     Status status;
-    // Parse capability flags from first three bytes
-    byte b0 = response.data[0];
-    byte b1 = response.data[1];
-    byte b2 = response.data[2];
-
-    // Parse camera capabilities from first byte
-    status.camera.enabled         = (b0 & 0x01) != 0;
-    status.camera.focus           = (b0 & 0x02) != 0;
-    status.camera.zoom            = (b0 & 0x04) != 0;
-    status.ptu.pan                = (b0 & 0x08) != 0;
-    status.ptu.tilt               = (b0 & 0x10) != 0;
-    status.camera.auto_focus      = (b0 & 0x20) != 0;
-    status.camera.manual_exposure = (b0 & 0x40) != 0;
-    status.camera.stills          = (b0 & 0x80) != 0;
-
-    // Parse additional camera capabilities from second byte
-    status.camera.wipers          = (b1 & 0x01) != 0;
-    status.camera.washer          = (b1 & 0x02) != 0;
-    status.camera.lamp_control    = (b1 & 0x04) != 0;
-    status.camera.flash           = (b1 & 0x08) != 0;
-    status.camera.flash_charged   = (b1 & 0x10) != 0;
-
-    // Parse environmental data from third byte
-    status.temperature = base::Temperature::fromCelsius((b2 & 0xF) * 5 - 5);
-    status.humidity    = static_cast<int>(b2 >> 8) * 100 / 16;
-
-    // Parse current positions
-    float pan  = Packet::parseAngle(response.data + 3);
-    float tilt = Packet::parseAngle(response.data + 6);
-    status.pan = pan;
-    status.tilt = tilt;
+    status.camera = info.capabilities.camera;
+    status.camera.flash_charged = info.environment.flash_charged;
+    status.ptu = info.capabilities.ptu;
+    status.temperature = info.environment.temperature;
+    status.humidity = info.environment.humidity;
+    status.time = positions.time;
+    status.pan = positions.pan;
+    status.tilt = positions.tilt;
+    return status;
+}
+
+Status Driver::readStatus(int device_id)
+{
+    checkDeviceID(device_id);
+    if (device_id == Packet::BROADCAST)
+        throw std::invalid_argument("cannot cache the status of the broadcast address");
+
+    Status status = execute(device_id, commands::GetStatus());
+    cacheStatus(device_id, status);
     return status;
 }
 
+void Driver::cacheStatus(int device_id, Status const& status)
+{
+    checkDeviceID(device_id);
+    DeviceInfo& info = deviceInfo[device_id];
+    info.has_capabilities = true;
+    info.capabilities.camera = status.camera;
+    info.capabilities.ptu = status.ptu;
+    info.environment_time = monotonicNow();
+    info.environment.time = status.time;
+    info.environment.temperature = status.temperature;
+    info.environment.humidity = status.humidity;
+    info.environment.flash_charged = status.camera.flash_charged;
+}
+
+bool Driver::hasFreshEnvironment(int device_id) const
+{
+    checkDeviceID(device_id);
+    base::Time time = deviceInfo[device_id].environment_time;
+    return !time.isNull() && monotonicNow() - time < environmentTTL;
+}
+
+Capabilities Driver::getCapabilities(int device_id)
+{
+    checkDeviceID(device_id);
+    if (device_id == Packet::BROADCAST || !deviceInfo[device_id].has_capabilities)
+        readStatus(device_id);
+    return deviceInfo[device_id].capabilities;
+}
+
+Environment Driver::getEnvironment(int device_id)
+{
+    checkDeviceID(device_id);
+    if (device_id == Packet::BROADCAST || !hasFreshEnvironment(device_id))
+        readStatus(device_id);
+    return deviceInfo[device_id].environment;
+}
+
+Environment Driver::refreshEnvironment(int device_id)
+{
+    readStatus(device_id);
+    return deviceInfo[device_id].environment;
+}
+
+void Driver::setEnvironmentTTL(base::Time const& ttl)
+{
+    environmentTTL = ttl;
+}
+
+base::Time Driver::getEnvironmentTTL() const
+{
+    return environmentTTL;
+}
+
 /**
  * Sends an asynchronous request for pan/tilt status
  * Use readPanTiltStatus to get the response
  */
 void Driver::requestPanTiltStatus(int device_id)
 {
-    Packet packet(device_id);
-    packet.setCommand('A', 'S');
-    writePacket(packet);
+    writeCommand(device_id, commands::GetPanTiltStatus());
 }
 
 /**
@@ -136,22 +368,28 @@ void Driver::requestPanTiltStatus(int device_id)
  */
 PanTiltStatus Driver::readPanTiltStatus(int device_id)
 {
-    Packet packet(device_id);
-    packet.setCommand('A', 'S');
-    Packet response = readResponse(packet, 10);
-
-    PanTiltStatus status;
-    status.time = base::Time::now();
-    // Parse speeds (0x64 = 100, so dividing gives percentage)
-    status.pan_speed  = static_cast<float>(response.data[0]) / 0x64;
-    status.tilt_speed = static_cast<float>(response.data[1]) / 0x64;
-    // Parse current positions
-    status.pan  = Packet::parseAngle(response.data + 2);
-    status.tilt = Packet::parseAngle(response.data + 5);
-    // Parse end stop usage (0x31 = '1' means enabled)
-    status.uses_pan_stop  = (response.data[8] == 0x31);
-    status.uses_tilt_stop = (response.data[9] == 0x31);
-    return status;
+    return readReply(device_id, commands::GetPanTiltStatus());
+}
+
+/**
+ * Computes the acquisition timestamps of an AS reply from the time of the
+ * last write and the arrival of the reply's first byte
+ */
+void Driver::stampReply(Expected<PanTiltStatus>& result) const
+{
+    stampStatus(result.value(), lastWriteTime,
+            commands::GetPanTiltStatus::FRAME_SIZE, lastFirstByteTime);
+}
+
+void Driver::stampStatus(PanTiltStatus& status, base::Time const& request_time,
+        int request_size, base::Time const& first_byte_time) const
+{
+    base::Time now = monotonicNow();
+    status.request_time = request_time;
+    status.first_byte_time = first_byte_time;
+    status.sample_time = estimateSampleTime(request_time, request_size,
+            first_byte_time, baudrate);
+    status.time = status.received_time - (now - status.sample_time);
 }
 
 /**
@@ -167,137 +405,438 @@ PanTiltStatus Driver::getPanTiltStatus(int device_id)
 // Position control methods
 void Driver::setPanPosition(int device_id, float pan)
 {
-    return setPosition(device_id, 'P', pan);
+    execute(device_id, commands::SetPanPosition(pan));
 }
 
 void Driver::setTiltPosition(int device_id, float tilt)
 {
-    return setPosition(device_id, 'T', tilt);
+    execute(device_id, commands::SetTiltPosition(tilt));
 }
 
-// Simple tilt movement controls
+// Simple tilt movement controls, they return the current tilt angle
 double Driver::tiltUp(int device_id)
 {
-    return simpleMovement(device_id, 'T', 'U');
+    return execute(device_id, commands::TiltUp());
 }
 
 double Driver::tiltDown(int device_id)
 {
-    return simpleMovement(device_id, 'T', 'D');
+    return execute(device_id, commands::TiltDown());
 }
 
 double Driver::tiltStop(int device_id)
 {
-    return simpleMovement(device_id, 'T', 'S');
+    return execute(device_id, commands::TiltStop());
+}
+
+// Speed control methods, speed being between 0.0 (stopped) and 1.0 (maximum
+// speed)
+void Driver::setPanSpeed(int device_id, float speed)
+{
+    execute(device_id, commands::SetPanSpeed(speed));
+}
+
+void Driver::setTiltSpeed(int device_id, float speed)
+{
+    execute(device_id, commands::SetTiltSpeed(speed));
+}
+
+void Driver::move(int device_id, float pan, float tilt, float pan_speed, float tilt_speed)
+{
+    MoveResult result = tryMove(device_id, pan, tilt, pan_speed, tilt_speed);
+    if (!result.ok())
+        throw MoveError(result);
 }
 
 /**
- * Generic method for simple movement commands
- * Returns the current position after initiating movement
+ * Writes the requested speed and position commands in one go, and matches
+ * the ACKs to the commands with the device ID and command echo
  */
-double Driver::simpleMovement(int device_id, char cmd0, char cmd1)
+MoveResult Driver::tryMove(int device_id, float pan, float tilt, float pan_speed, float tilt_speed) noexcept
 {
-    Packet packet(device_id);
-    packet.setCommand(cmd0, cmd1);
-    writePacket(packet);
-    Packet response = readResponse(packet, 3);
-    return Packet::parseAngle(response.data);
+    static byte const opcodes[MoveResult::STEP_COUNT][2] = {
+        { commands::SetPanSpeed::OPCODE0, commands::SetPanSpeed::OPCODE1 },
+        { commands::SetTiltSpeed::OPCODE0, commands::SetTiltSpeed::OPCODE1 },
+        { commands::SetPanPosition::OPCODE0, commands::SetPanPosition::OPCODE1 },
+        { commands::SetTiltPosition::OPCODE0, commands::SetTiltPosition::OPCODE1 }
+    };
+    static int const requestSizes[MoveResult::STEP_COUNT] = {
+        commands::SetPanSpeed::REQUEST_SIZE, commands::SetTiltSpeed::REQUEST_SIZE,
+        commands::SetPanPosition::REQUEST_SIZE, commands::SetTiltPosition::REQUEST_SIZE
+    };
+    static int const responseSizes[MoveResult::STEP_COUNT] = {
+        commands::SetPanSpeed::RESPONSE_SIZE, commands::SetTiltSpeed::RESPONSE_SIZE,
+        commands::SetPanPosition::RESPONSE_SIZE, commands::SetTiltPosition::RESPONSE_SIZE
+    };
+    static int const payloadOffsets[MoveResult::STEP_COUNT] = {
+        commands::SetPanSpeed::PAYLOAD_OFFSET, commands::SetTiltSpeed::PAYLOAD_OFFSET,
+        commands::SetPanPosition::PAYLOAD_OFFSET, commands::SetTiltPosition::PAYLOAD_OFFSET
+    };
+    static unsigned const invalidates[MoveResult::STEP_COUNT] = {
+        commands::SetPanSpeed::INVALIDATES, commands::SetTiltSpeed::INVALIDATES,
+        commands::SetPanPosition::INVALIDATES, commands::SetTiltPosition::INVALIDATES
+    };
+    static StateCache::Setting const settings[MoveResult::STEP_COUNT] = {
+        StateCache::PAN_SPEED, StateCache::TILT_SPEED,
+        StateCache::PAN_TARGET, StateCache::TILT_TARGET
+    };
+    static_assert(commands::SetPanSpeed::FRAME_SIZE + commands::SetTiltSpeed::FRAME_SIZE +
+            commands::SetPanPosition::FRAME_SIZE + commands::SetTiltPosition::FRAME_SIZE <= Packet::MAX_PACKET_SIZE,
+            "the frames of a move do not fit in the write buffer");
+
+    MoveResult result;
+    float const values[MoveResult::STEP_COUNT] = { pan_speed, tilt_speed, pan, tilt };
+    bool const valid[MoveResult::STEP_COUNT] = {
+        commands::SetPanSpeed(pan_speed).isValid(),
+        commands::SetTiltSpeed(tilt_speed).isValid(),
+        commands::SetPanPosition(pan).isValid(),
+        commands::SetTiltPosition(tilt).isValid()
+    };
+    bool allValid = true;
+    for (int i = 0; i < MoveResult::STEP_COUNT; ++i)
+    {
+        result.requested[i] = !base::isUnset(values[i]);
+        if (result.requested[i] && !valid[i])
+        {
+            result.errors[i] = Error(Error::INVALID_ARGUMENT, device_id, opcodes[i], 2);
+            allValid = false;
+        }
+    }
+    if (!allValid)
+        return result;
+
+    // Marshal the frames back-to-back. A frame that the state cache shows
+    // to be redundant is overwritten by the next one
+    bool pending[MoveResult::STEP_COUNT];
+    byte const* payloads[MoveResult::STEP_COUNT];
+    int pendingCount = 0;
+    int size = 0;
+    for (int i = 0; i < MoveResult::STEP_COUNT; ++i)
+    {
+        pending[i] = false;
+        if (!result.requested[i])
+            continue;
+
+        byte* frame = writeBuffer + size;
+        int frameSize = 0;
+        switch (i)
+        {
+            case MoveResult::PAN_SPEED:
+                frameSize = commands::marshal(commands::SetPanSpeed(pan_speed), device_id, frame);
+                break;
+            case MoveResult::TILT_SPEED:
+                frameSize = commands::marshal(commands::SetTiltSpeed(tilt_speed), device_id, frame);
+                break;
+            case MoveResult::PAN_POSITION:
+                frameSize = commands::marshal(commands::SetPanPosition(pan), device_id, frame);
+                break;
+            case MoveResult::TILT_POSITION:
+                frameSize = commands::marshal(commands::SetTiltPosition(tilt), device_id, frame);
+                break;
+        }
+        payloads[i] = frame + payloadOffsets[i];
+        if (isCached(device_id, opcodes[i], settings[i], payloads[i], requestSizes[i]))
+            result.sent[i] = true;
+        else
+        {
+            size += frameSize;
+            pending[i] = true;
+            ++pendingCount;
+        }
+    }
+    if (size == 0)
+        return result;
+
+    Error::Code failure = Error::NONE;
+    try
+    {
+        writeRaw(writeBuffer, size);
+        for (int i = 0; i < MoveResult::STEP_COUNT; ++i)
+            result.sent[i] = result.requested[i];
+        while (pendingCount > 0)
+        {
+            boost::uint64_t checksumErrors = statistics.checksum_errors;
+            PacketView reply;
+            try { reply = readPacket(); }
+            catch(iodrivers_base::TimeoutError const&)
+            {
+                failure = statistics.checksum_errors != checksumErrors ?
+                    Error::CHECKSUM : Error::TIMEOUT;
+                break;
+            }
+
+            // Replies from other devices on the bus are not for us
+            int step = -1;
+            bool fromDevice = device_id == Packet::BROADCAST || reply.from == device_id;
+            for (int i = 0; i < MoveResult::STEP_COUNT && step == -1 && fromDevice; ++i)
+            {
+                if (pending[i] && reply.data_size >= 2 &&
+                        reply.data[0] == opcodes[i][0] && reply.data[1] == opcodes[i][1])
+                    step = i;
+            }
+            if (step == -1)
+            {
+                LOG_WARN_S << "ignoring " << reply.getCommandAsString() << " reply from device " <<
+                    static_cast<int>(reply.from) << " that does not match any command of the move";
+                continue;
+            }
+
+            PacketView data;
+            result.errors[step] = checkResponse(reply, device_id, opcodes[step], 2, responseSizes[step],
+                    lastWriteStartTime, data);
+            if (stateCacheEnabled || poseEstimator)
+            {
+                updateSettings(device_id, settings[step], invalidates[step],
+                        payloads[step], requestSizes[step], result.errors[step]);
+            }
+            pending[step] = false;
+            --pendingCount;
+        }
+    }
+    catch(std::exception const&)
+    {
+        failure = Error::IO;
+    }
+
+    if (failure != Error::NONE)
+    {
+        for (int i = 0; i < MoveResult::STEP_COUNT; ++i)
+        {
+            if (pending[i])
+                result.errors[i] = Error(failure, device_id, opcodes[i], 2);
+        }
+        if (stateCacheEnabled)
+            stateCache.invalidate(device_id);
+    }
+    return result;
 }
 
 /**
- * Sets the position for either pan or tilt axis
- * @param axis 'P' for pan, 'T' for tilt
+ * Reads and validates a response packet
+ * Handles command echo in response and validates data size
  */
-void Driver::setPosition(int device_id, char axis, float angle)
+PacketView Driver::readResponse(Packet const& cmd, int expectedSize)
 {
-    Packet packet(device_id);
-    packet.setCommand(axis, 'P');
-    packet.data_size = 3;
-    Packet::encodeAngle(packet.data, angle);
-    writePacket(packet);
-    readResponse(packet, 3);
+    return readResponse(cmd.to, cmd.command, cmd.command_size, expectedSize);
 }
 
-// Speed control methods
-void Driver::setPanSpeed(int device_id, float speed)
+/**
+ * Reads and validates a response packet
+ * Handles command echo in response and validates data size
+ */
+PacketView Driver::readResponse(byte device_id, byte const* command, int command_size, int expectedSize)
 {
-    setSpeed(device_id, 'D', 'S', speed);
+    PacketView data;
+    if (Error error = readResponse(device_id, command, command_size, expectedSize, data))
+        error.raise();
+    return data;
 }
 
-void Driver::setTiltSpeed(int device_id, float speed)
+/**
+ * Reads and checks a response packet, timeouts being reported as
+ * Error::CHECKSUM if frames got rejected because of a bad checksum while
+ * waiting, and as Error::TIMEOUT otherwise
+ */
+Error Driver::readResponse(byte device_id, byte const* command, int command_size, int expectedSize,
+        PacketView& data)
 {
-    setSpeed(device_id, 'T', 'A', speed);
+    boost::uint64_t checksumErrors = statistics.checksum_errors;
+    PacketView response;
+    try { response = readPacket(); }
+    catch(iodrivers_base::TimeoutError const&)
+    {
+        if (command_size == 2)
+        {
+            if (CommandStatistics* entry = statistics.get(command[0], command[1]))
+                ++entry->timeouts;
+        }
+        Error::Code code = statistics.checksum_errors != checksumErrors ?
+            Error::CHECKSUM : Error::TIMEOUT;
+        return Error(code, device_id, command, command_size);
+    }
+    return checkResponse(response, device_id, command, command_size, expectedSize,
+            lastWriteStartTime, data);
 }
 
 /**
- * Sets the speed for either pan or tilt movement
- * @param speed Value between 0.0 (stopped) and 1.0 (maximum speed)
+ * Validates a packet received in response to a command, see checkResponse
  */
-void Driver::setSpeed(int device_id, char cmd0, char cmd1, float speed)
+PacketView Driver::validateResponse(PacketView const& response,
+        byte device_id, byte const* command, int command_size, int expectedSize,
+        base::Time const& writeTime)
 {
-    if (speed < 0 || speed > 1)
-        throw std::range_error("invalid range for speed, should be in [0,1] and got " + lexical_cast<string>(speed));
-
-    Packet packet(device_id);
-    packet.setCommand(cmd0, cmd1);
-    packet.data_size = 1;
-    packet.data[0] = round(speed * 0x64);  // Convert to percentage (0-100)
-    writePacket(packet);
-    readResponse(packet, 0);
+    PacketView data;
+    if (Error error = checkResponse(response, device_id, command, command_size, expectedSize, writeTime, data))
+        error.raise();
+    return data;
 }
 
 /**
- * Reads and validates a response packet
- * Handles command echo in response and validates data size
+ * Checks a packet received in response to a command: ACK/NAK, device ID,
+ * command echo and data size
  */
-Packet Driver::readResponse(Packet const& cmd, int expectedSize)
+Error Driver::checkResponse(PacketView const& response,
+        byte device_id, byte const* command, int command_size, int expectedSize,
+        base::Time const& writeTime, PacketView& data)
 {
-    Packet response = readPacket();
-    response.validateResponseFor(cmd);
-    if (response.data_size != (expectedSize + cmd.command_size))
+    bool isNAK = response.command_size == 1 && response.command[0] == Packet::NAK;
+    if (isNAK && command_size == 2 && response.data_size > 2 &&
+            response.data[0] == command[0] && response.data[1] == command[1])
+    {
+        statistics.addNAK(command, response.data[2]);
+    }
+
+    if (Error error = response.checkResponseFor(device_id, command, command_size))
+        return error;
+    if (response.data_size != (expectedSize + command_size))
+    {
+        return Error(Error::SIZE_MISMATCH, device_id, command, command_size,
+                response.data_size - command_size, expectedSize);
+    }
+
+    if (command_size == 2)
     {
-        throw std::runtime_error("expected response to " + cmd.getCommandAsString() + " with " +
-                lexical_cast<string>(expectedSize) +
-                " bytes of data, but got " +
-                lexical_cast<string>(static_cast<int>(response.data_size)));
+        if (CommandStatistics* entry = statistics.get(command[0], command[1]))
+            entry->latency.add(monotonicNow() - writeTime);
     }
-    // Remove echoed command from response data
-    memmove(response.data,
-            response.data + cmd.command_size,
-            response.data_size - cmd.command_size);
-    response.data_size -= cmd.command_size;
-    return response;
+
+    // Skip the echoed command
+    data = response.skipData(command_size);
+    return Error();
 }
 
 /**
  * Low-level method to read a packet from the device
- * Handles the actual communication and packet parsing
+ * The packet is read in readBuffer, and the returned view points to it
  */
-Packet Driver::readPacket()
+PacketView Driver::readPacket()
 {
-    byte buffer[Packet::MAX_PACKET_SIZE];
-    int packetSize = iodrivers_base::Driver::readPacket(buffer, Packet::MAX_PACKET_SIZE);
-    return Packet::parse(buffer, packetSize, false);
+    PacketView packet;
+    if (tryReadPacket(packet))
+        return packet;
+
+    // Otherwise, wait for the first byte ourselves to timestamp its arrival
+    int packetSize = 0;
+    {
+        base::Time timeout = getReadTimeout();
+        base::Time start = monotonicNow();
+        try { getMainStream()->waitRead(timeout); }
+        catch(iodrivers_base::TimeoutError const&)
+        {
+            ++statistics.timeouts;
+            throw iodrivers_base::TimeoutError(iodrivers_base::TimeoutError::FIRST_BYTE,
+                    "readPacket(): no data received within the read timeout");
+        }
+        base::Time received = monotonicNow();
+
+        // The read timeout bounds the whole packet, only give the time
+        // that is left to the rest of the read
+        base::Time remaining = timeout - (received - start);
+        if (remaining < base::Time())
+            remaining = base::Time();
+        try { packetSize = iodrivers_base::Driver::readPacket(readBuffer, Packet::MAX_PACKET_SIZE, remaining, remaining); }
+        catch(iodrivers_base::TimeoutError const&)
+        {
+            ++statistics.timeouts;
+            throw;
+        }
+
+        // If the start of the packet was already buffered, it arrived
+        // before the bytes we waited for
+        lastFirstByteTime = min(received, takeFrameStartTime());
+    }
+    if (trace)
+        trace->add(TraceRecord::RX, lastFirstByteTime, readBuffer, packetSize);
+    return PacketView::parse(readBuffer, packetSize, false);
+}
+
+/**
+ * Get a packet from the bytes that have already been received, or that can
+ * be read without waiting. hasPacket() is not used for that, as it would
+ * run extractPacket on the buffered bytes a second time, and count and
+ * trace the skipped bytes twice
+ */
+bool Driver::tryReadPacket(PacketView& packet)
+{
+    int packetSize = 0;
+    try
+    {
+        packetSize = iodrivers_base::Driver::readPacket(readBuffer, Packet::MAX_PACKET_SIZE,
+                base::Time(), base::Time());
+    }
+    catch(iodrivers_base::TimeoutError const&) {}
+    if (packetSize == 0)
+        return false;
+
+    lastFirstByteTime = takeFrameStartTime();
+    if (trace)
+        trace->add(TraceRecord::RX, lastFirstByteTime, readBuffer, packetSize);
+    packet = PacketView::parse(readBuffer, packetSize, false);
+    return true;
 }
 
 /**
  * Low-level method to write a packet to the device
- * Handles packet marshalling and actual communication
+ * The packet is marshalled in writeBuffer, so that writing does not allocate
  */
 void Driver::writePacket(Packet const& packet)
 {
-    writeBuffer.clear();
-    packet.marshal(writeBuffer);
-    LOG_DEBUG_S << "writing " << writeBuffer.size() << " bytes: " << Packet::kongsberg_com(&writeBuffer[0], writeBuffer.size());
-    iodrivers_base::Driver::writePacket(&writeBuffer[0], writeBuffer.size());
+    int size = packet.marshal(writeBuffer, Packet::MAX_PACKET_SIZE);
+    writeRaw(writeBuffer, size);
+}
+
+/**
+ * Low-level method to write an already marshalled packet to the device
+ */
+void Driver::writeRaw(byte const* buffer, int size)
+{
+    lastWriteStartTime = monotonicNow();
+    if (trace)
+        trace->add(TraceRecord::TX, lastWriteStartTime, buffer, size);
+    iodrivers_base::Driver::writePacket(buffer, size);
+    lastWriteTime = monotonicNow();
 }
 
 /**
  * Extracts a complete packet from the raw buffer
- * Used by the base driver class for packet extraction
+ * Used by the base driver class for packet extraction. Counts the bytes
+ * that get skipped to resynchronize on the next packet
  */
 int Driver::extractPacket(boost::uint8_t const* buffer, size_t size) const
 {
-    return Packet::extractPacket(buffer, size);
+    int result = frameParser.extract(buffer, size);
+    if (result < 0)
+    {
+        ++statistics.resyncs;
+        statistics.skipped_bytes += -result;
+        if (trace)
+            trace->add(TraceRecord::RX_DISCARDED, monotonicNow(), buffer, -result);
+        if (frameParser.getLastError() == FrameParser::CHECKSUM)
+            ++statistics.checksum_errors;
+    }
+
+    // Remember when the start of a frame was first seen, so that a frame
+    // completed by a later read is timestamped with its first bytes
+    if (result == 0 && size > 0)
+    {
+        if (frameStartTime.isNull())
+            frameStartTime = monotonicNow();
+    }
+    else if (result < 0)
+        frameStartTime = base::Time();
+    return result;
+}
+
+base::Time Driver::takeFrameStartTime()
+{
+    base::Time time = frameStartTime.isNull() ? monotonicNow() : frameStartTime;
+    frameStartTime = base::Time();
+    return time;
+}
+
+void Driver::resetFraming()
+{
+    frameParser.reset();
+    frameStartTime = base::Time();
 }
 
@@ -6,6 +6,17 @@
 #include <iodrivers_base/Driver.hpp>
 #include <ptu_kongsberg_oe10/Status.hpp>
 #include <ptu_kongsberg_oe10/PanTiltStatus.hpp>
+#include <ptu_kongsberg_oe10/Commands.hpp>
+#include <ptu_kongsberg_oe10/Expected.hpp>
+#include <ptu_kongsberg_oe10/MoveResult.hpp>
+#include <ptu_kongsberg_oe10/StateCache.hpp>
+#include <base/Float.hpp>
+#include <ptu_kongsberg_oe10/Clock.hpp>
+#include <ptu_kongsberg_oe10/Statistics.hpp>
+#include <ptu_kongsberg_oe10/FrameParser.hpp>
+#include <ptu_kongsberg_oe10/FrameCache.hpp>
+#include <ptu_kongsberg_oe10/Trace.hpp>
+#include <ptu_kongsberg_oe10/PoseEstimator.hpp>
 
 namespace ptu_kongsberg_oe10
 {
@@ -17,17 +28,179 @@ namespace ptu_kongsberg_oe10
     class Driver
         : public iodrivers_base::Driver
     {
+        friend class Pipeline;
+        friend class Prober;
+        friend class DriverPool;
+
     public:
         /** Constructor initializes the driver with default settings */
         Driver();
 
+        /**
+         * Opens the device
+         *
+         * For serial URIs (serial://DEVICE:BAUDRATE), the baud rate is
+         * recorded to compensate transmission times in the status
+         * timestamps.
+         *
+         * replay://PATH replays a capture file saved from a Trace, as fast
+         * as possible, and replay://PATH:realtime at the recorded timing.
+         * See ReplayStream
+         * @param uri The device URI
+         */
+        void openURI(std::string const& uri);
+
+        /**
+         * Changes the baud rate of a serial device
+         * @param brate The new baud rate
+         */
+        bool setSerialBaudrate(int brate);
+
+        /**
+         * Returns the baud rate used to estimate transmission times, or 0 if
+         * the link is not a serial link
+         */
+        int getBaudrate() const;
+
+        /**
+         * Sets the baud rate used to estimate transmission times
+         *
+         * It is only needed when the serial line is not opened with openURI,
+         * or is behind a converter (e.g. TCP to serial). It does not change
+         * the device configuration.
+         */
+        void setBaudrate(int baudrate);
+
+        /**
+         * Estimates the time at which a device sampled its state when
+         * answering a request
+         *
+         * It is the midpoint between the end of the request transmission and
+         * the beginning of the reply transmission. Transmission times assume
+         * 10 bits per byte (8N1).
+         * @param request_time Monotonic time at which the request was written
+         * @param request_size Size of the request in bytes
+         * @param first_byte_time Monotonic time at which the first byte of
+         *   the reply was received
+         * @param baudrate The link baud rate, or 0 if transmission times
+         *   should not be accounted for
+         * @return The estimated sampling time, on the monotonic clock
+         */
+        static base::Time estimateSampleTime(base::Time const& request_time, int request_size,
+                base::Time const& first_byte_time, int baudrate);
+
+        /**
+         * Returns a snapshot of the communication statistics
+         *
+         * It must be called from the thread that uses the driver
+         */
+        DriverStatistics getStatistics() const;
+
+        /** Resets the communication statistics */
+        void resetStatistics();
+
+        /**
+         * Sets the trace in which the raw serial traffic is recorded
+         *
+         * The trace is not owned by the driver and must outlive it, or be
+         * reset first. Pass NULL to stop tracing
+         */
+        void setTrace(Trace* trace);
+
+        /** Returns the trace the traffic is recorded in, or NULL */
+        Trace* getTrace() const;
+
+        /**
+         * Sets the pose estimator of a device
+         *
+         * The driver feeds it with the device's AS replies and with the
+         * speeds and targets acknowledged by the device (or sent to all
+         * devices). The estimator is reset when the driver is opened.
+         *
+         * The estimator is not owned by the driver and must outlive it, or
+         * be reset first. Pass NULL to stop feeding it
+         */
+        void setPoseEstimator(int device_id, PoseEstimator* estimator);
+
+        /** Returns the pose estimator, or NULL */
+        PoseEstimator* getPoseEstimator() const;
+
+        /**
+         * Enables or disables the cache of the device settings
+         *
+         * When enabled, the driver keeps the speeds, position targets and
+         * end stop usage last acknowledged by each device. Commands that
+         * would set them to the same value again are not sent, and succeed
+         * right away. They are counted in the statistics' suppressed
+         * fields.
+         *
+         * The settings of a device are forgotten when one of its commands
+         * fails (NAK, timeout, invalid reply), and the whole cache when the
+         * device is opened. Commands that change the meaning of a setting
+         * (e.g. end stops and position targets, or TU/TD/TS and the tilt
+         * target) invalidate it.
+         *
+         * It assumes that no other controller changes these settings
+         * behind the driver's back. Use invalidateStateCache if that is
+         * the case. The cache is disabled by default.
+         */
+        void setStateCacheEnabled(bool enable);
+
+        /** Whether redundant setting commands are suppressed */
+        bool isStateCacheEnabled() const;
+
+        /**
+         * Forgets the cached settings of a device, or of all devices for
+         * the broadcast address
+         */
+        void invalidateStateCache(int device_id = Packet::BROADCAST);
+
         /**
          * Retrieves the complete status of the device including capabilities and positions
+         *
+         * The capabilities are read once per connection, and the
+         * environment readings are reused as long as they are younger than
+         * getEnvironmentTTL(). The positions are then read with AS, whose
+         * reply is timestamped like getPanTiltStatus. Otherwise, a ST
+         * request refreshes all of them.
+         *
+         * Broadcast requests always send ST, and are not cached
          * @param device_id The ID of the target device (0xFF for broadcast)
          * @return Status structure containing device information
          */
         Status getStatus(int device_id);
 
+        /**
+         * Returns the capabilities of a device, which are read with ST on
+         * the first call after the device has been opened
+         * @param device_id The ID of the target device, cannot be broadcast
+         */
+        Capabilities getCapabilities(int device_id);
+
+        /**
+         * Returns the environment readings of a device, reading them with
+         * ST if the cached ones are older than getEnvironmentTTL()
+         * @param device_id The ID of the target device, cannot be broadcast
+         */
+        Environment getEnvironment(int device_id);
+
+        /**
+         * Reads the environment readings of a device with ST, regardless of
+         * the cached ones
+         * @param device_id The ID of the target device, cannot be broadcast
+         */
+        Environment refreshEnvironment(int device_id);
+
+        /**
+         * Sets how long the environment readings are reused by getStatus
+         * and getEnvironment. A null duration disables the cache. Defaults
+         * to 10 seconds
+         */
+        void setEnvironmentTTL(base::Time const& ttl);
+
+        /** Returns how long the environment readings are reused */
+        base::Time getEnvironmentTTL() const;
+
         /**
          * Asynchronously requests pan-tilt status from the device
          * @param device_id The ID of the target device
@@ -107,6 +280,38 @@ namespace ptu_kongsberg_oe10
          */
         void setTiltSpeed(int device_id, float speed);
 
+        /**
+         * Sets the speeds and target positions of both axes in a single
+         * transaction
+         *
+         * The speed and position commands are written back-to-back in a
+         * single write, speeds first, and all the ACKs are then collected.
+         * This costs a single round trip instead of one per command.
+         *
+         * Pass base::unset<float>() for the values that should not be
+         * changed. If some parameters are invalid, nothing is written.
+         * With the state cache enabled, only the settings that change are
+         * written.
+         * @param device_id The ID of the target device
+         * @param pan Target pan angle in radians
+         * @param tilt Target tilt angle in radians
+         * @param pan_speed Pan speed as fraction of maximum (0.0 to 1.0)
+         * @param tilt_speed Tilt speed as fraction of maximum (0.0 to 1.0)
+         * @throws MoveError if any of the commands failed. Its result tells
+         *   which commands have been applied
+         */
+        void move(int device_id, float pan, float tilt,
+                float pan_speed = base::unset<float>(),
+                float tilt_speed = base::unset<float>());
+
+        /**
+         * Non-throwing version of move
+         * @return The outcome of each command of the move
+         */
+        MoveResult tryMove(int device_id, float pan, float tilt,
+                float pan_speed = base::unset<float>(),
+                float tilt_speed = base::unset<float>()) noexcept;
+
         /**
          * Initiates upward tilt movement
          * @param device_id The ID of the target device
@@ -128,53 +333,200 @@ namespace ptu_kongsberg_oe10
          */
         double tiltStop(int device_id);
 
+        /**
+         * Sends a command and reads its reply
+         * @param device_id The ID of the target device
+         * @param command The command, e.g. commands::SetPanPosition(angle)
+         * @return The decoded reply, whose type depends on the command
+         */
+        template<typename Command>
+        typename Command::Result execute(int device_id, Command const& command);
+
+        /**
+         * Sends a command without waiting for its reply
+         *
+         * The frame is kept in a FrameCache, so that sending the same
+         * command again to the same device only re-encodes its payload. Use
+         * readReply to get the command's reply.
+         * @param device_id The ID of the target device
+         * @param command The command
+         */
+        template<typename Command>
+        void writeCommand(int device_id, Command const& command);
+
+        /**
+         * Reads the reply to a command that has been sent with writeCommand
+         * @param device_id The ID of the target device
+         * @param command The command that has been sent
+         * @return The decoded reply, whose type depends on the command
+         */
+        template<typename Command>
+        typename Command::Result readReply(int device_id, Command const& command);
+
+        /**
+         * Sends a command and reads its reply, without throwing
+         *
+         * NAKs, timeouts, invalid replies and invalid parameters are reported
+         * as an Error code, whose message is only built if Error::toString
+         * is called. Failures of the underlying stream are reported as
+         * Error::IO
+         * @param device_id The ID of the target device
+         * @param command The command, e.g. commands::SetPanPosition(angle)
+         * @return The decoded reply, or the error
+         */
+        template<typename Command>
+        Expected<typename Command::Result> tryExecute(int device_id, Command const& command) noexcept;
+
+        /**
+         * Non-throwing version of writeCommand
+         * @return Error::INVALID_ARGUMENT if the command parameters cannot
+         *   be encoded, in which case nothing is written
+         */
+        template<typename Command>
+        Expected<void> tryWriteCommand(int device_id, Command const& command) noexcept;
+
+        /** Non-throwing version of readReply */
+        template<typename Command>
+        Expected<typename Command::Result> tryReadReply(int device_id, Command const& command) noexcept;
+
     protected:
         /** 
          * Reads and validates the response to a command
          * The protocol specifies that the data field of ACKs starts with the
-         * command that is being ACKed. This method removes the prefix (after
-         * having validated it), so the returned packet's data array starts with
+         * command that is being ACKed. This method skips the prefix (after
+         * having validated it), so the returned view's data field starts with
          * the actual data.
+         *
+         * The returned view points into the driver's read buffer, and is
+         * therefore only valid until the next packet is read.
          * 
          * @param cmd The original command packet
          * @param expectedSize Expected size of the response data
          * @return Validated response packet
          */
-        Packet readResponse(Packet const& cmd, int expectedSize);
+        PacketView readResponse(Packet const& cmd, int expectedSize);
 
         /**
-         * Helper method to set position for either pan or tilt axis
-         * @param device_id The ID of the target device
-         * @param axis Axis identifier ('P' for pan, 'T' for tilt)
-         * @param angle Target angle in radians
+         * Reads and validates the response to a command given by its
+         * destination and command bytes
+         *
+         * @param device_id The ID of the device the command was sent to
+         * @param command The command bytes
+         * @param command_size The number of command bytes
+         * @param expectedSize Expected size of the response data
+         * @return Validated response packet, with the command echo skipped
          */
-        void setPosition(int device_id, char axis, float angle);
+        PacketView readResponse(byte device_id, byte const* command, int command_size, int expectedSize);
 
         /**
-         * Helper method to set speed for either pan or tilt axis
-         * @param device_id The ID of the target device
-         * @param cmd0 First command byte
-         * @param cmd1 Second command byte
-         * @param speed Speed as fraction of maximum (0.0 to 1.0)
+         * Reads and checks the response to a command without throwing on
+         * protocol errors and timeouts. Failures of the underlying stream
+         * are still reported by exceptions
+         *
+         * @param device_id The ID of the device the command was sent to
+         * @param command The command bytes
+         * @param command_size The number of command bytes
+         * @param expectedSize Expected size of the response data
+         * @param data Set to the response with the command echo skipped, if
+         *   there is no error
          */
-        void setSpeed(int device_id, char cmd0, char cmd1, float speed);
+        Error readResponse(byte device_id, byte const* command, int command_size, int expectedSize,
+                PacketView& data);
 
         /**
-         * Executes a simple movement command (like tilt up/down)
-         * @param device_id The ID of the target device
-         * @param cmd0 First command byte
-         * @param cmd1 Second command byte
-         * @return Current position after movement initiation
+         * Validates a packet that has already been read as the response to
+         * a command, and updates the statistics accordingly
+         *
+         * @param response The received packet
+         * @param device_id The ID of the device the command was sent to
+         * @param command The command bytes
+         * @param command_size The number of command bytes
+         * @param expectedSize Expected size of the response data
+         * @param writeTime Monotonic time at which the command started to
+         *   be written, used to compute the command latency
+         * @return The response with the command echo skipped
          */
-        double simpleMovement(int device_id, char cmd0, char cmd1);
+        PacketView validateResponse(PacketView const& response,
+                byte device_id, byte const* command, int command_size, int expectedSize,
+                base::Time const& writeTime);
 
         /**
-         * Helper method to set end stops
-         * @param device_id The ID of the target device
-         * @param cmd0 First command byte
-         * @param cmd1 Second command byte
+         * Non-throwing version of validateResponse
+         * @param data Set to the response with the command echo skipped, if
+         *   there is no error
+         */
+        Error checkResponse(PacketView const& response,
+                byte device_id, byte const* command, int command_size, int expectedSize,
+                base::Time const& writeTime, PacketView& data);
+
+        /**
+         * Reads and decodes the reply to a command. Errors are returned,
+         * except for the failures of the underlying stream which are thrown
+         */
+        template<typename Command>
+        Expected<typename Command::Result> readReplyResult(int device_id, Command const& command);
+
+        /**
+         * Whether a command can be skipped because the state cache shows
+         * that the device already has the setting it sets
+         */
+        template<typename Command>
+        bool isRedundant(int device_id, Command const& command);
+
+        /**
+         * Whether the state cache shows that a device already has a
+         * setting. The command is then counted as suppressed
+         */
+        bool isCached(byte device_id, byte const* opcode, StateCache::Setting setting,
+                byte const* payload, int size);
+
+        /**
+         * Updates the state cache and the pose estimator after the reply to
+         * a command
+         * @param setting The setting the command sets
+         * @param invalidates The settings the command makes stale
+         * @param payload The command's request payload
+         * @param error The command's error. If there is one, all the
+         *   device's settings are forgotten
+         */
+        void updateSettings(byte device_id, StateCache::Setting setting, unsigned invalidates,
+                byte const* payload, int size, Error const& error);
+
+        /**
+         * Reads the status of a device with ST and updates its cached
+         * capabilities and environment
          */
-        void setEndStop(int device_id, char cmd0, char cmd1);
+        Status readStatus(int device_id);
+
+        /** Updates the cached capabilities and environment of a device from
+         * a ST reply */
+        void cacheStatus(int device_id, Status const& status);
+
+        /** Whether the cached environment of a device can be used */
+        bool hasFreshEnvironment(int device_id) const;
+
+        /** Refines the timestamps of AS replies from the I/O timestamps */
+        void stampReply(Expected<PanTiltStatus>& status) const;
+
+        /**
+         * Computes the acquisition timestamps of a decoded AS reply
+         * @param request_time Monotonic time at which the write that
+         *   contains the request started
+         * @param request_size Number of bytes of that write up to the end
+         *   of the request
+         * @param first_byte_time Monotonic arrival time of the reply
+         */
+        void stampStatus(PanTiltStatus& status, base::Time const& request_time,
+                int request_size, base::Time const& first_byte_time) const;
+
+        template<typename T>
+        void stampReply(Expected<T>&) const {}
+
+        /** Feeds AS replies to the pose estimator */
+        void updatePoseEstimator(int device_id, Expected<PanTiltStatus> const& status);
+
+        template<typename T>
+        void updatePoseEstimator(int, Expected<T> const&) {}
 
         /**
          * Low-level method to write a packet to the device
@@ -182,23 +534,213 @@ namespace ptu_kongsberg_oe10
          */
         void writePacket(Packet const& packet);
 
+        /**
+         * Low-level method to write an already marshalled packet
+         * @param buffer The marshalled packet
+         * @param size The packet size
+         */
+        void writeRaw(byte const* buffer, int size);
+
         /**
          * Low-level method to read a packet from the device
-         * @return The read packet
+         *
+         * The buffered bytes are framed only once, so that the bytes skipped
+         * before a packet are counted and traced once
+         * @return A view of the read packet. It is valid until the next call
+         *   to readPacket
+         */
+        PacketView readPacket();
+
+        /**
+         * Low-level method to read a packet without waiting
+         * @param packet Set to a view of the read packet, valid until the
+         *   next read
+         * @return false if no complete packet has been received yet
          */
-        Packet readPacket();
+        bool tryReadPacket(PacketView& packet);
+
+        /** Buffer in which packets are marshalled before being written */
+        byte writeBuffer[Packet::MAX_PACKET_SIZE];
+
+        /** The frames of the commands sent with writeCommand, which are
+         * written directly from the cache */
+        FrameCache frameCache;
+
+        /** Buffer in which received packets are stored */
+        byte readBuffer[Packet::MAX_PACKET_SIZE];
+
+        /** Baud rate used to estimate transmission times, 0 if unknown */
+        int baudrate;
+
+        /** Monotonic time at which the last write started */
+        base::Time lastWriteStartTime;
+
+        /** Monotonic time at which the last write completed */
+        base::Time lastWriteTime;
+
+        /** Communication statistics. It is mutable as extractPacket, which
+         * is const, updates it */
+        mutable DriverStatistics statistics;
+
+        /** Framing state of the receive buffer. It is mutable for the same
+         * reason as statistics */
+        mutable FrameParser frameParser;
+
+        /** Capture of the serial traffic, or NULL */
+        Trace* trace;
+
+        /** Estimator fed with the replies of poseEstimatorDevice, or NULL */
+        PoseEstimator* poseEstimator;
+        int poseEstimatorDevice;
+
+        /** Whether stateCache is maintained and used */
+        bool stateCacheEnabled;
+
+        /** The settings last acknowledged by the devices */
+        StateCache stateCache;
+
+        /** What is known about a device from its last ST reply */
+        struct DeviceInfo
+        {
+            /** Whether capabilities is valid */
+            bool has_capabilities;
+            Capabilities capabilities;
+            /** Monotonic time of the ST reply the environment comes from,
+             * null if there is none */
+            base::Time environment_time;
+            Environment environment;
+
+            DeviceInfo();
+        };
+
+        /** The cached capabilities and environments, by device ID */
+        DeviceInfo deviceInfo[256];
+
+        /** How long the environment readings are reused */
+        base::Time environmentTTL;
+
+        /** Monotonic time at which the first byte of the last packet that
+         * has been read arrived */
+        base::Time lastFirstByteTime;
+
+        /** Monotonic time at which extractPacket first saw the start of the
+         * frame being received, null if none. It is mutable for the same
+         * reason as statistics */
+        mutable base::Time frameStartTime;
 
-        /** Buffer for writing data to the device */
-        std::vector<boost::uint8_t> writeBuffer;
+        /** Returns and clears frameStartTime, or returns the current time
+         * if it is null */
+        base::Time takeFrameStartTime();
+
+        /** Forgets about a partially received frame, e.g. after the
+         * receive buffer has been cleared */
+        void resetFraming();
 
         /**
          * Extracts a packet from the raw buffer
          * @param buffer Raw data buffer
          * @param size Size of the buffer
-         * @return Size of the extracted packet, or -1 if no complete packet
+         * @return Size of the extracted packet, 0 if it is incomplete, or
+         *   -n to skip n bytes
          */
         int extractPacket(boost::uint8_t const* buffer, size_t size) const;
     };
+
+    template<typename Command>
+    typename Command::Result Driver::execute(int device_id, Command const& command)
+    {
+        if (isRedundant(device_id, command))
+            return typename Command::Result();
+        writeCommand(device_id, command);
+        return readReply(device_id, command);
+    }
+
+    template<typename Command>
+    void Driver::writeCommand(int device_id, Command const& command)
+    {
+        int size;
+        byte const* frame = frameCache.get(command, device_id, size);
+        writeRaw(frame, size);
+    }
+
+    template<typename Command>
+    typename Command::Result Driver::readReply(int device_id, Command const& command)
+    {
+        return readReplyResult(device_id, command).get();
+    }
+
+    template<typename Command>
+    Expected<typename Command::Result> Driver::readReplyResult(int device_id, Command const& command)
+    {
+        static byte const opcode[2] = { Command::OPCODE0, Command::OPCODE1 };
+        PacketView response;
+        Error error = readResponse(device_id, opcode, 2, Command::RESPONSE_SIZE, response);
+        Expected<typename Command::Result> result = error;
+        if (!error)
+            result = commands::tryDecode(command, device_id, response.data);
+        if (result.ok())
+        {
+            stampReply(result);
+            updatePoseEstimator(device_id, result);
+        }
+
+        if (stateCacheEnabled || poseEstimator)
+        {
+            byte payload[Command::REQUEST_SIZE + 1];
+            command.encode(payload);
+            updateSettings(device_id, Command::SETTING, Command::INVALIDATES,
+                    payload, Command::REQUEST_SIZE, result.error());
+        }
+        return result;
+    }
+
+    template<typename Command>
+    bool Driver::isRedundant(int device_id, Command const& command)
+    {
+        if (!stateCacheEnabled || Command::SETTING == StateCache::NO_SETTING || !command.isValid())
+            return false;
+
+        static byte const opcode[2] = { Command::OPCODE0, Command::OPCODE1 };
+        byte payload[Command::REQUEST_SIZE + 1];
+        command.encode(payload);
+        return isCached(device_id, opcode, Command::SETTING, payload, Command::REQUEST_SIZE);
+    }
+
+    template<typename Command>
+    Expected<typename Command::Result> Driver::tryExecute(int device_id, Command const& command) noexcept
+    {
+        if (isRedundant(device_id, command))
+            return Expected<typename Command::Result>();
+        Expected<void> written = tryWriteCommand(device_id, command);
+        if (!written)
+            return written.error();
+        return tryReadReply(device_id, command);
+    }
+
+    template<typename Command>
+    Expected<void> Driver::tryWriteCommand(int device_id, Command const& command) noexcept
+    {
+        static byte const opcode[2] = { Command::OPCODE0, Command::OPCODE1 };
+        if (!command.isValid())
+            return Error(Error::INVALID_ARGUMENT, device_id, opcode, 2);
+        try { writeCommand(device_id, command); }
+        catch(std::exception const&)
+        {
+            return Error(Error::IO, device_id, opcode, 2);
+        }
+        return Expected<void>();
+    }
+
+    template<typename Command>
+    Expected<typename Command::Result> Driver::tryReadReply(int device_id, Command const& command) noexcept
+    {
+        try { return readReplyResult(device_id, command); }
+        catch(std::exception const&)
+        {
+            static byte const opcode[2] = { Command::OPCODE0, Command::OPCODE1 };
+            return Error(Error::IO, device_id, opcode, 2);
+        }
+    }
 }
 
 #endif
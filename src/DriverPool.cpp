@@ -0,0 +1,466 @@
+#include <ptu_kongsberg_oe10/DriverPool.hpp>
+#include <base/Logging.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+/** The epoll tag of the wakeup eventfd. The links' descriptors are tagged
+ * with port * 2 for the serial line, and port * 2 + 1 for the timer */
+static const uint64_t WAKEUP_TAG = ~static_cast<uint64_t>(0);
+
+DriverPool::Job::Job()
+    : device_id(0)
+    , response_size(0)
+{
+    opcode[0] = opcode[1] = 0;
+}
+
+DriverPool::Link::Link()
+    : timer_fd(-1)
+    , busy(false)
+    , failed(false)
+    , checksum_errors(0)
+{
+}
+
+DriverPool::DriverPool()
+    : nextPollID(0)
+    , quit(false)
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+        throw std::runtime_error(string("cannot create the epoll instance: ") + strerror(errno));
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0)
+    {
+        int error = errno;
+        ::close(epoll_fd);
+        throw std::runtime_error(string("cannot create the wakeup eventfd: ") + strerror(error));
+    }
+
+    epoll_event event = epoll_event();
+    event.events = EPOLLIN;
+    event.data.u64 = WAKEUP_TAG;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event);
+}
+
+DriverPool::~DriverPool()
+{
+    stop();
+    for (size_t i = 0; i < links.size(); ++i)
+        ::close(links[i]->timer_fd);
+    ::close(event_fd);
+    ::close(epoll_fd);
+}
+
+/**
+ * Open the link from the calling thread, so that errors are reported to
+ * the caller, and register its descriptors in the event loop
+ */
+int DriverPool::addLink(string const& uri)
+{
+    if (isRunning())
+        throw std::logic_error("links can only be added to a DriverPool while it is stopped");
+
+    unique_ptr<Link> link(new Link);
+    link->driver.reset(new Driver);
+    link->driver->openURI(uri);
+    int fd = link->driver->getFileDescriptor();
+    if (fd == iodrivers_base::Driver::INVALID_FD)
+        throw std::invalid_argument(uri + " is not backed by a file descriptor, it cannot be used in a DriverPool");
+
+    link->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (link->timer_fd < 0)
+        throw std::runtime_error(string("cannot create the timer of ") + uri + ": " + strerror(errno));
+
+    uint64_t port = links.size();
+    epoll_event event = epoll_event();
+    event.events = EPOLLIN;
+    event.data.u64 = port * 2;
+    int result = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    if (result == 0)
+    {
+        event.data.u64 = port * 2 + 1;
+        result = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, link->timer_fd, &event);
+        if (result != 0)
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, 0);
+    }
+    if (result != 0)
+    {
+        int error = errno;
+        ::close(link->timer_fd);
+        throw std::runtime_error("cannot watch " + uri + ": " + strerror(error));
+    }
+
+    links.push_back(std::move(link));
+    return port;
+}
+
+int DriverPool::getLinkCount() const
+{
+    return links.size();
+}
+
+DriverPool::Link& DriverPool::getLink(int port)
+{
+    if (port < 0 || port >= static_cast<int>(links.size()))
+        throw std::out_of_range("DriverPool has no port " + lexical_cast<string>(port));
+    return *links[port];
+}
+
+Driver& DriverPool::getDriver(int port)
+{
+    return *getLink(port).driver;
+}
+
+void DriverPool::start()
+{
+    if (thread.joinable())
+        return;
+    quit = false;
+    thread = std::thread(&DriverPool::run, this);
+}
+
+void DriverPool::stop()
+{
+    if (!thread.joinable())
+        return;
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wakeup();
+    thread.join();
+
+    lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < links.size(); ++i)
+    {
+        Link& link = *links[i];
+        link.queue.clear();
+        link.busy = false;
+        link.current = Job();
+    }
+    for (size_t i = 0; i < polls.size(); ++i)
+        polls[i]->pending = false;
+}
+
+bool DriverPool::isRunning() const
+{
+    return thread.joinable();
+}
+
+int DriverPool::addPoll(int port, int device_id, base::Time const& period, PollCallback const& callback)
+{
+    getLink(port);
+    if (device_id == Packet::BROADCAST)
+        throw std::invalid_argument("cannot poll the broadcast address");
+    if (period <= base::Time())
+        throw std::invalid_argument("the polling period must be positive");
+
+    shared_ptr<Poll> poll(new Poll);
+    poll->port = port;
+    poll->device_id = device_id;
+    poll->period = period;
+    poll->next = monotonicNow();
+    poll->callback = callback;
+    poll->pending = false;
+    poll->active = true;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        poll->id = nextPollID++;
+        polls.push_back(poll);
+    }
+    wakeup();
+    return poll->id;
+}
+
+void DriverPool::removePoll(int poll_id)
+{
+    lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < polls.size(); ++i)
+    {
+        if (polls[i]->id == poll_id)
+        {
+            polls[i]->active = false;
+            polls.erase(polls.begin() + i);
+            return;
+        }
+    }
+}
+
+int DriverPool::getQueueSize(int port) const
+{
+    if (port < 0 || port >= static_cast<int>(links.size()))
+        throw std::out_of_range("DriverPool has no port " + lexical_cast<string>(port));
+    lock_guard<std::mutex> lock(mutex);
+    return links[port]->queue.size();
+}
+
+std::future<DriverStatistics> DriverPool::getStatistics(int port)
+{
+    Link& link = getLink(port);
+    std::shared_ptr< std::promise<DriverStatistics> > promise(new std::promise<DriverStatistics>());
+    if (!thread.joinable())
+        promise->set_value(link.driver->getStatistics());
+    else
+    {
+        Job job;
+        job.complete = [promise](Driver& driver, Error const&, PacketView const&) {
+            promise->set_value(driver.getStatistics());
+        };
+        enqueue(port, job);
+    }
+    return promise->get_future();
+}
+
+void DriverPool::wakeup()
+{
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) < 0)
+    {
+        LOG_ERROR_S << "DriverPool: failed to wake up the I/O thread: " << strerror(errno);
+    }
+}
+
+void DriverPool::enqueue(int port, Job const& job)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        links[port]->queue.push_back(job);
+    }
+    wakeup();
+}
+
+/**
+ * Start the next command of each idle link, arm the timers and wait for
+ * replies, timers and new commands
+ */
+void DriverPool::run()
+{
+    epoll_event events[32];
+    while (true)
+    {
+        for (size_t port = 0; port < links.size(); ++port)
+        {
+            startNext(*links[port]);
+            armTimer(port, *links[port]);
+        }
+
+        int count = epoll_wait(epoll_fd, events, 32, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR_S << "DriverPool: epoll_wait failed, stopping the I/O thread: " << strerror(errno);
+            return;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            uint64_t tag = events[i].data.u64;
+            uint64_t value;
+            if (tag == WAKEUP_TAG)
+            {
+                if (read(event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                {
+                    LOG_ERROR_S << "DriverPool: failed to read the wakeup eventfd: " << strerror(errno);
+                }
+                lock_guard<std::mutex> lock(mutex);
+                if (quit)
+                    return;
+                continue;
+            }
+
+            int port = tag / 2;
+            Link& link = *links[port];
+            if (tag % 2)
+            {
+                if (read(link.timer_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                {
+                    LOG_ERROR_S << "DriverPool: failed to read the timer of port " << port << ": " << strerror(errno);
+                }
+                link.armed = base::Time();
+                handleTimer(port, link);
+            }
+            else
+                handleReadable(link);
+        }
+    }
+}
+
+/**
+ * Match the received packets against the command in flight. Replies that
+ * do not echo it (e.g. late replies to a command that timed out) are
+ * dropped
+ */
+void DriverPool::handleReadable(Link& link)
+{
+    Driver& driver = *link.driver;
+    try
+    {
+        PacketView packet;
+        while (driver.tryReadPacket(packet))
+        {
+            Job const& job = link.current;
+            if (!link.busy || (packet.data_size >= 2 &&
+                    (packet.data[0] != job.opcode[0] || packet.data[1] != job.opcode[1])))
+            {
+                LOG_WARN_S << "DriverPool: ignoring " << packet.getCommandAsString() << " reply from device " <<
+                    static_cast<int>(packet.from) << " that does not match the command in flight";
+                continue;
+            }
+
+            PacketView data;
+            Error error = driver.checkResponse(packet, job.device_id, job.opcode, 2, job.response_size,
+                    driver.lastWriteStartTime, data);
+            complete(link, error, data);
+        }
+    }
+    catch(std::exception const& e)
+    {
+        LOG_ERROR_S << "DriverPool: I/O error, the link is not used anymore: " << e.what();
+        link.failed = true;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, driver.getFileDescriptor(), 0);
+        if (link.busy)
+            complete(link, Error(Error::IO, link.current.device_id, link.current.opcode, 2), PacketView());
+    }
+}
+
+void DriverPool::handleTimer(int port, Link& link)
+{
+    base::Time now = monotonicNow();
+    if (link.busy && link.deadline <= now)
+    {
+        Job const& job = link.current;
+        DriverStatistics& statistics = link.driver->statistics;
+        ++statistics.timeouts;
+        if (CommandStatistics* entry = statistics.get(job.opcode[0], job.opcode[1]))
+            ++entry->timeouts;
+        Error::Code code = statistics.checksum_errors != link.checksum_errors ?
+            Error::CHECKSUM : Error::TIMEOUT;
+        complete(link, Error(code, job.device_id, job.opcode, 2), PacketView());
+    }
+
+    vector< shared_ptr<Poll> > due;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < polls.size(); ++i)
+        {
+            Poll& poll = *polls[i];
+            if (poll.port != port || poll.pending || now < poll.next)
+                continue;
+
+            // Skip the periods that have been missed instead of catching up
+            poll.next = max(poll.next + poll.period, now);
+            poll.pending = true;
+            due.push_back(polls[i]);
+        }
+    }
+
+    for (size_t i = 0; i < due.size(); ++i)
+    {
+        shared_ptr<Poll> poll = due[i];
+        submit(port, poll->device_id, commands::GetPanTiltStatus(),
+            [poll](Expected<PanTiltStatus> const& status) {
+                poll->pending = false;
+                if (poll->active)
+                    poll->callback(poll->port, poll->device_id, status);
+            });
+    }
+}
+
+void DriverPool::startNext(Link& link)
+{
+    while (!link.busy)
+    {
+        {
+            lock_guard<std::mutex> lock(mutex);
+            if (link.queue.empty())
+                return;
+            link.current = link.queue.front();
+            link.queue.pop_front();
+        }
+        link.busy = true;
+
+        Job const& job = link.current;
+        if (job.frame.empty())
+            complete(link, Error(), PacketView());
+        else if (link.failed)
+            complete(link, Error(Error::IO, job.device_id, job.opcode, 2), PacketView());
+        else
+        {
+            Driver& driver = *link.driver;
+            link.checksum_errors = driver.statistics.checksum_errors;
+            try
+            {
+                driver.writeRaw(&job.frame[0], job.frame.size());
+                link.deadline = driver.lastWriteStartTime + driver.getReadTimeout();
+            }
+            catch(std::exception const&)
+            {
+                complete(link, Error(Error::IO, job.device_id, job.opcode, 2), PacketView());
+            }
+        }
+    }
+}
+
+void DriverPool::complete(Link& link, Error const& error, PacketView const& data)
+{
+    Job job;
+    std::swap(job, link.current);
+    link.busy = false;
+    try { job.complete(*link.driver, error, data); }
+    catch(std::exception const& e)
+    {
+        // Command errors are reported through the futures and callbacks,
+        // this only catches exceptions thrown by the callbacks themselves
+        LOG_ERROR_S << "exception in DriverPool callback: " << e.what();
+    }
+}
+
+/**
+ * Arm the timer for the current command's deadline or the next poll,
+ * whichever comes first. Polls that are pending are re-armed when their
+ * request completes
+ */
+void DriverPool::armTimer(int port, Link& link)
+{
+    base::Time next;
+    if (link.busy)
+        next = link.deadline;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < polls.size(); ++i)
+        {
+            Poll const& poll = *polls[i];
+            if (poll.port == port && !poll.pending && (next.isNull() || poll.next < next))
+                next = poll.next;
+        }
+    }
+    if (next == link.armed)
+        return;
+
+    itimerspec spec = itimerspec();
+    if (!next.isNull())
+    {
+        boost::int64_t us = next.toMicroseconds();
+        spec.it_value.tv_sec = us / 1000000;
+        spec.it_value.tv_nsec = (us % 1000000) * 1000;
+    }
+    if (timerfd_settime(link.timer_fd, TFD_TIMER_ABSTIME, &spec, 0) != 0)
+    {
+        LOG_ERROR_S << "DriverPool: failed to arm the timer of port " << port << ": " << strerror(errno);
+    }
+    link.armed = next;
+}
@@ -0,0 +1,303 @@
+#ifndef PTU_KONGSBERG_OE10_DRIVER_POOL_HPP
+#define PTU_KONGSBERG_OE10_DRIVER_POOL_HPP
+
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Drives several serial links, each with its own OE10 bus, from a
+     * single I/O thread
+     *
+     * Each link (port) is a Driver with its own command queue. The I/O
+     * thread waits on the links' file descriptors with epoll, and executes
+     * the commands of each link in submission order, one at a time, so
+     * that a slow or silent device only delays its own bus. Read timeouts
+     * and periodic polls are scheduled with one timerfd per link.
+     *
+     * <code>
+     * DriverPool pool;
+     * int port0 = pool.addLink("serial:///dev/ttyUSB0:19200");
+     * int port1 = pool.addLink("serial:///dev/ttyUSB1:19200");
+     * pool.addPoll(port1, 2, base::Time::fromMilliseconds(100), callback);
+     * pool.start();
+     * pool.submit(port0, 1, commands::SetPanPosition(angle)).get();
+     * </code>
+     *
+     * Results are delivered through a std::future or a callback that is
+     * called on the I/O thread, and should therefore return quickly.
+     *
+     * Unlike AsyncDriver, the commands are executed with the non-blocking
+     * primitives of Driver: they do not use its state cache, and the
+     * environment cache of getStatus. Only links that have a file
+     * descriptor can be added, i.e. not replay:// links.
+     */
+    class DriverPool
+    {
+    public:
+        /**
+         * Callback of a periodic poll
+         * @param port The link of the polled device
+         * @param device_id The polled device
+         * @param status The AS reply, or the error
+         */
+        typedef std::function<void(int port, int device_id, Expected<PanTiltStatus> const& status)> PollCallback;
+
+        DriverPool();
+
+        /** Stops the I/O thread and closes the links */
+        ~DriverPool();
+
+        /**
+         * Opens a link. It can only be called while the I/O thread is not
+         * running
+         * @param uri The URI, as given to Driver::openURI
+         * @return The port that identifies the link in the other calls
+         */
+        int addLink(std::string const& uri);
+
+        /** Returns the number of links */
+        int getLinkCount() const;
+
+        /**
+         * Returns the driver of a link
+         *
+         * It must only be accessed directly (e.g. to change its timeouts)
+         * while the I/O thread is not running. The read timeout is the
+         * time the pool waits for a reply
+         */
+        Driver& getDriver(int port);
+
+        /** Starts the I/O thread */
+        void start();
+
+        /**
+         * Stops the I/O thread. The commands that are queued or waiting for
+         * their reply are dropped, and their futures report a broken
+         * promise
+         */
+        void stop();
+
+        /** Whether the I/O thread is running */
+        bool isRunning() const;
+
+        /**
+         * Queues a command on a link
+         * @param port The link of the target device
+         * @param device_id The ID of the target device
+         * @param command The command, e.g. commands::SetPanPosition(angle)
+         * @return A future that holds the command's result. Errors are
+         *   thrown by its get(), as Error::raise() does
+         */
+        template<typename Command>
+        std::future<typename Command::Result> submit(int port, int device_id, Command const& command);
+
+        /**
+         * Queues a command on a link and calls a callback with its result
+         *
+         * The callback is called on the I/O thread, except when the command
+         * parameters are invalid. The error is then reported right away
+         */
+        template<typename Command>
+        void submit(int port, int device_id, Command const& command,
+                std::function<void(Expected<typename Command::Result> const&)> const& callback);
+
+        /**
+         * Reads the pan-tilt status of a device periodically
+         *
+         * The AS request is queued behind the commands that are already
+         * submitted on the link. A poll is not queued again until its
+         * previous request completed, and missed periods are skipped
+         * @param port The link of the device
+         * @param device_id The ID of the device, cannot be broadcast
+         * @param period The polling period
+         * @param callback Called on the I/O thread with each reply
+         * @return An ID to pass to removePoll
+         */
+        int addPoll(int port, int device_id, base::Time const& period, PollCallback const& callback);
+
+        /** Stops a poll. Its callback is not called anymore */
+        void removePoll(int poll_id);
+
+        /** Returns the number of commands queued on a link */
+        int getQueueSize(int port) const;
+
+        /**
+         * Returns a snapshot of the statistics of a link, taken on the I/O
+         * thread after the commands already queued on it
+         */
+        std::future<DriverStatistics> getStatistics(int port);
+
+    protected:
+        /**
+         * Called when a command completes, with the reply data (command
+         * echo skipped) if there is no error
+         */
+        typedef std::function<void(Driver&, Error const&, PacketView const&)> Completion;
+
+        /** A command waiting for execution */
+        struct Job
+        {
+            byte device_id;
+            byte opcode[2];
+            int response_size;
+            /** The marshalled request. If empty, nothing is sent and the
+             * job completes as soon as it reaches the front of the queue */
+            std::vector<byte> frame;
+            Completion complete;
+
+            Job();
+        };
+
+        struct Link
+        {
+            std::unique_ptr<Driver> driver;
+            int timer_fd;
+            /** Protected by the pool's mutex */
+            std::deque<Job> queue;
+
+            /** The following are only used by the I/O thread */
+            bool busy;
+            bool failed;
+            Job current;
+            /** Monotonic time at which the current job times out */
+            base::Time deadline;
+            /** The checksum error count when the current job was written */
+            boost::uint64_t checksum_errors;
+            /** Monotonic time the timer is armed for, null if disarmed */
+            base::Time armed;
+
+            Link();
+        };
+
+        struct Poll
+        {
+            int id;
+            int port;
+            int device_id;
+            base::Time period;
+            /** Monotonic time of the next request */
+            base::Time next;
+            PollCallback callback;
+            /** Whether a request is queued or in flight */
+            std::atomic<bool> pending;
+            /** Cleared by removePoll */
+            std::atomic<bool> active;
+        };
+
+        /** Adds a job to the queue of a link and wakes up the I/O thread */
+        void enqueue(int port, Job const& job);
+
+        /** Interrupts the I/O thread's wait */
+        void wakeup();
+
+        /** Main loop of the I/O thread */
+        void run();
+
+        /** Processes the replies that have been received on a link */
+        void handleReadable(Link& link);
+
+        /** Expires the current job of a link and queues its due polls */
+        void handleTimer(int port, Link& link);
+
+        /** Writes the next queued job of a link if it is idle */
+        void startNext(Link& link);
+
+        /** Completes the current job of a link */
+        void complete(Link& link, Error const& error, PacketView const& data);
+
+        /** Arms the timer of a link for its next deadline or poll */
+        void armTimer(int port, Link& link);
+
+        Link& getLink(int port);
+
+        std::vector< std::unique_ptr<Link> > links;
+        std::vector< std::shared_ptr<Poll> > polls;
+        int nextPollID;
+        int epoll_fd;
+        int event_fd;
+        std::thread thread;
+        mutable std::mutex mutex;
+        bool quit;
+    };
+
+    namespace details
+    {
+        template<typename T>
+        void setPromise(std::promise<T>& promise, Expected<T> const& result)
+        {
+            if (result.ok())
+                promise.set_value(result.value());
+            else
+            {
+                try { result.error().raise(); }
+                catch(...) { promise.set_exception(std::current_exception()); }
+            }
+        }
+
+        inline void setPromise(std::promise<void>& promise, Expected<void> const& result)
+        {
+            if (result.ok())
+                promise.set_value();
+            else
+            {
+                try { result.error().raise(); }
+                catch(...) { promise.set_exception(std::current_exception()); }
+            }
+        }
+    }
+
+    template<typename Command>
+    std::future<typename Command::Result> DriverPool::submit(int port, int device_id, Command const& command)
+    {
+        typedef typename Command::Result Result;
+        std::shared_ptr< std::promise<Result> > promise(new std::promise<Result>());
+        std::future<Result> result = promise->get_future();
+        submit(port, device_id, command, [promise](Expected<Result> const& result) {
+            details::setPromise(*promise, result);
+        });
+        return result;
+    }
+
+    template<typename Command>
+    void DriverPool::submit(int port, int device_id, Command const& command,
+            std::function<void(Expected<typename Command::Result> const&)> const& callback)
+    {
+        typedef typename Command::Result Result;
+        getLink(port);
+
+        Job job;
+        job.device_id = device_id;
+        job.opcode[0] = Command::OPCODE0;
+        job.opcode[1] = Command::OPCODE1;
+        job.response_size = Command::RESPONSE_SIZE;
+        if (!command.isValid())
+        {
+            callback(Error(Error::INVALID_ARGUMENT, device_id, job.opcode, 2));
+            return;
+        }
+
+        byte buffer[Packet::MAX_PACKET_SIZE];
+        int size = commands::marshal(command, device_id, buffer);
+        job.frame.assign(buffer, buffer + size);
+        job.complete = [device_id, command, callback](Driver& driver, Error const& error, PacketView const& data) {
+            Expected<Result> result = error;
+            if (!error)
+                result = commands::tryDecode(command, device_id, data.data);
+            if (result.ok())
+                driver.stampReply(result);
+            callback(result);
+        };
+        enqueue(port, job);
+    }
+}
+
+#endif
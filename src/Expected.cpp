@@ -0,0 +1,99 @@
+#include <ptu_kongsberg_oe10/Expected.hpp>
+#include <iodrivers_base/Driver.hpp>
+#include <iodrivers_base/Exceptions.hpp>
+#include <boost/lexical_cast.hpp>
+#include <stdexcept>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+Error::Error()
+    : code(NONE)
+    , device_id(0)
+    , command_size(0)
+    , received(0)
+    , expected(0)
+{
+    command[0] = command[1] = 0;
+}
+
+Error::Error(Code code, byte device_id, byte const* command, int command_size,
+        int received, int expected)
+    : code(code)
+    , device_id(device_id)
+    , command_size(command_size)
+    , received(received)
+    , expected(expected)
+{
+    this->command[0] = command_size > 0 ? command[0] : 0;
+    this->command[1] = command_size > 1 ? command[1] : 0;
+}
+
+/** Unpack command bytes that have been packed in an int, first byte in the
+ * most significant position */
+static string unpackCommand(int packed, int size)
+{
+    string result;
+    for (int i = size - 1; i >= 0; --i)
+        result += static_cast<char>((packed >> (8 * i)) & 0xFF);
+    return result;
+}
+
+string Error::toString() const
+{
+    string cmd(reinterpret_cast<char const*>(command), command_size);
+    switch (code)
+    {
+        case NONE:
+            return "no error";
+        case NAK:
+            return "received NAK with the following error bits set: " +
+                Packet::parseNACKError(received);
+        case TIMEOUT:
+            return "no reply to " + cmd + " from device " +
+                lexical_cast<string>(static_cast<int>(device_id)) + " within the read timeout";
+        case CHECKSUM:
+            return "no valid reply to " + cmd + " from device " +
+                lexical_cast<string>(static_cast<int>(device_id)) +
+                " within the read timeout, frames have been rejected because of checksum errors";
+        case SIZE_MISMATCH:
+            return "expected response to " + cmd + " with " +
+                lexical_cast<string>(expected) + " bytes of data, but got " +
+                lexical_cast<string>(received);
+        case DEVICE_MISMATCH:
+            return "expected a response from device ID " +
+                lexical_cast<string>(static_cast<int>(device_id)) + " but got one from " +
+                lexical_cast<string>(received);
+        case COMMAND_MISMATCH:
+            return "expected a ACK/NAK for command " + cmd + " but got it for " +
+                unpackCommand(received, command_size);
+        case NOT_A_REPLY:
+        {
+            byte bytes[2] = { static_cast<byte>(received >> 8), static_cast<byte>(received) };
+            return "expecting a ACK/NAK packet but got " +
+                iodrivers_base::Driver::binary_com(expected == 1 ? bytes + 1 : bytes, expected);
+        }
+        case INVALID_REPLY:
+            return "invalid data in the reply to " + cmd;
+        case INVALID_ARGUMENT:
+            return "invalid parameter for command " + cmd;
+        case IO:
+            return "I/O error while executing " + cmd;
+    }
+    return "unknown error";
+}
+
+void Error::raise() const
+{
+    switch (code)
+    {
+        case TIMEOUT:
+        case CHECKSUM:
+            throw iodrivers_base::TimeoutError(iodrivers_base::TimeoutError::FIRST_BYTE, toString());
+        case INVALID_ARGUMENT:
+            throw std::range_error(toString());
+        default:
+            throw std::runtime_error(toString());
+    }
+}
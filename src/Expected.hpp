@@ -0,0 +1,152 @@
+#ifndef PTU_KONGSBERG_OE10_EXPECTED_HPP
+#define PTU_KONGSBERG_OE10_EXPECTED_HPP
+
+#include <ptu_kongsberg_oe10/Packet.hpp>
+#include <string>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Compact description of a command failure
+     *
+     * It is returned by the non-throwing API (Driver::tryExecute and
+     * friends). It holds only codes and bytes: the human-readable message
+     * is built by toString(), i.e. only when someone asks for it.
+     */
+    struct Error
+    {
+        enum Code
+        {
+            /** No error */
+            NONE,
+            /** The device replied with a NAK, the error bits are in
+             * 'received' (see Packet::parseNACKError) */
+            NAK,
+            /** No reply within the read timeout */
+            TIMEOUT,
+            /** No valid reply within the read timeout, but frames have been
+             * rejected because of checksum errors meanwhile. It is a timeout
+             * for the throwing API */
+            CHECKSUM,
+            /** The reply does not have the expected amount of data */
+            SIZE_MISMATCH,
+            /** The reply comes from another device, whose ID is in
+             * 'received' */
+            DEVICE_MISMATCH,
+            /** The ACK/NAK echoes another command, whose bytes are packed in
+             * 'received', first byte in the most significant position */
+            COMMAND_MISMATCH,
+            /** The reply is neither an ACK nor a NAK, its command bytes are
+             * packed in 'received' and their count is in 'expected' */
+            NOT_A_REPLY,
+            /** The reply data could not be decoded, e.g. an angle that is
+             * not made of ASCII digits */
+            INVALID_REPLY,
+            /** A command parameter is out of range */
+            INVALID_ARGUMENT,
+            /** The underlying I/O failed */
+            IO
+        };
+
+        /** The error code */
+        Code code;
+        /** The ID of the device the command was sent to */
+        byte device_id;
+        /** The number of command bytes */
+        byte command_size;
+        /** The command bytes */
+        byte command[2];
+        /** Code-specific received value, see Code */
+        int received;
+        /** Code-specific expected value, e.g. the expected data size */
+        int expected;
+
+        /** Creates an object that represents success */
+        Error();
+
+        /** Creates an error for a command given by its bytes */
+        Error(Code code, byte device_id, byte const* command, int command_size,
+                int received = 0, int expected = 0);
+
+        /** True if this represents an error */
+        explicit operator bool() const { return code != NONE; }
+
+        /** Formats the error message */
+        std::string toString() const;
+
+        /**
+         * Throws the exception the throwing API reports for this error
+         *
+         * Timeouts (TIMEOUT and CHECKSUM) are reported as
+         * iodrivers_base::TimeoutError, invalid
+         * arguments as std::range_error and the other errors as
+         * std::runtime_error
+         */
+        [[noreturn]] void raise() const;
+    };
+
+    /**
+     * Either the result of a command or the Error that made it fail
+     */
+    template<typename T>
+    class Expected
+    {
+        T m_value;
+        Error m_error;
+
+    public:
+        /** Success, with a value-initialized value */
+        Expected()
+            : m_value() {}
+        Expected(T const& value)
+            : m_value(value) {}
+        Expected(Error const& error)
+            : m_value()
+            , m_error(error) {}
+
+        /** True if the command succeeded */
+        bool ok() const { return !m_error; }
+        explicit operator bool() const { return ok(); }
+
+        /** The error, whose code is Error::NONE on success */
+        Error const& error() const { return m_error; }
+
+        /** The value. Only meaningful if ok() */
+        T const& value() const { return m_value; }
+        T& value() { return m_value; }
+        T const& operator*() const { return m_value; }
+        T const* operator->() const { return &m_value; }
+
+        /** Returns the value, or throws the error with Error::raise() */
+        T const& get() const
+        {
+            if (m_error)
+                m_error.raise();
+            return m_value;
+        }
+    };
+
+    template<>
+    class Expected<void>
+    {
+        Error m_error;
+
+    public:
+        Expected() {}
+        Expected(Error const& error)
+            : m_error(error) {}
+
+        bool ok() const { return !m_error; }
+        explicit operator bool() const { return ok(); }
+        Error const& error() const { return m_error; }
+
+        /** Throws the error with Error::raise(), if there is one */
+        void get() const
+        {
+            if (m_error)
+                m_error.raise();
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,17 @@
+#include <ptu_kongsberg_oe10/FrameCache.hpp>
+#include <atomic>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+int FrameCache::allocateSlot()
+{
+    static std::atomic<int> count(0);
+    return count++;
+}
+
+void FrameCache::clear()
+{
+    for (int i = 0; i < 256; ++i)
+        frames[i].clear();
+}
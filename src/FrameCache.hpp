@@ -0,0 +1,109 @@
+#ifndef PTU_KONGSBERG_OE10_FRAME_CACHE_HPP
+#define PTU_KONGSBERG_OE10_FRAME_CACHE_HPP
+
+#include <ptu_kongsberg_oe10/Commands.hpp>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Ready-to-send request frames, by device and command
+     *
+     * The first request of a command to a device is marshalled with
+     * commands::marshal and kept. The following ones only re-encode the
+     * payload into the kept frame. The checksum is adjusted by XORing the
+     * bytes that changed, and re-escaped with Packet::marshalChecksum only
+     * if it did change. Frames without payload (AS, ST, TU, ...) are
+     * returned as-is.
+     *
+     * The returned frame is owned by the cache, and is valid until the next
+     * call for the same device and command.
+     */
+    class FrameCache
+    {
+    public:
+        /**
+         * Returns the frame for a command to a device, sent by
+         * Packet::CONTROLLER
+         *
+         * If the command parameters cannot be encoded, the exception of
+         * the command's encode() is thrown and the cache is left unchanged
+         * @param size Set to Command::FRAME_SIZE
+         */
+        template<typename Command>
+        byte const* get(Command const& command, byte to, int& size);
+
+        /** Forgets all frames */
+        void clear();
+
+    private:
+        struct Frame
+        {
+            /** The marshalled frame, empty until the first request */
+            std::vector<byte> image;
+            /** The raw checksum of the frame */
+            byte checksum;
+        };
+
+        /** Allocates the index of a command type in the per-device tables */
+        static int allocateSlot();
+
+        /** Returns the index of a command type in the per-device tables */
+        template<typename Command>
+        static int getSlot()
+        {
+            static const int slot = allocateSlot();
+            return slot;
+        }
+
+        /** The frames of each device, indexed by getSlot() */
+        std::vector<Frame> frames[256];
+    };
+
+    template<typename Command>
+    byte const* FrameCache::get(Command const& command, byte to, int& size)
+    {
+        int const REQUEST_SIZE = Command::REQUEST_SIZE;
+        size = Command::FRAME_SIZE;
+
+        std::vector<Frame>& device = frames[to];
+        size_t slot = getSlot<Command>();
+        if (slot >= device.size())
+            device.resize(slot + 1);
+
+        Frame& frame = device[slot];
+        if (frame.image.empty())
+        {
+            byte buffer[Command::FRAME_SIZE];
+            commands::marshal(command, to, buffer);
+            frame.image.assign(buffer, buffer + Command::FRAME_SIZE);
+            frame.checksum = Command::HEADER_CHECKSUM ^ to ^ Packet::CONTROLLER ^
+                Packet::computeChecksum(buffer + Command::PAYLOAD_OFFSET,
+                        buffer + Command::PAYLOAD_OFFSET + REQUEST_SIZE);
+            return &frame.image[0];
+        }
+
+        byte* buffer = &frame.image[0];
+        if (REQUEST_SIZE > 0)
+        {
+            byte payload[REQUEST_SIZE + 1];
+            command.encode(payload);
+
+            byte* cached = buffer + Command::PAYLOAD_OFFSET;
+            byte delta = 0;
+            for (int i = 0; i < REQUEST_SIZE; ++i)
+            {
+                delta ^= cached[i] ^ payload[i];
+                cached[i] = payload[i];
+            }
+            if (delta)
+            {
+                frame.checksum ^= delta;
+                Packet::marshalChecksum(frame.checksum, cached + REQUEST_SIZE + 1);
+            }
+        }
+        return buffer;
+    }
+}
+
+#endif
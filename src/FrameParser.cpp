@@ -0,0 +1,125 @@
+#include <ptu_kongsberg_oe10/FrameParser.hpp>
+#include <cstring>
+#include <stdexcept>
+
+using namespace ptu_kongsberg_oe10;
+
+// Out-of-line definition, needed when the constant is bound to a reference
+// in unoptimized builds
+const int FrameParser::MIN_FRAME_SIZE;
+
+FrameParser::FrameParser()
+    : maxFrameSize(Packet::MAX_PACKET_SIZE)
+    , validated(0)
+    , frameSize(0)
+    , lastError(NONE)
+{
+}
+
+void FrameParser::setMaxFrameSize(int size)
+{
+    if (size < MIN_FRAME_SIZE || size > Packet::MAX_PACKET_SIZE)
+        throw std::range_error("maximum frame size out of range");
+    maxFrameSize = size;
+}
+
+int FrameParser::getMaxFrameSize() const
+{
+    return maxFrameSize;
+}
+
+void FrameParser::reset()
+{
+    validated = 0;
+    frameSize = 0;
+}
+
+FrameParser::Error FrameParser::getLastError() const
+{
+    return lastError;
+}
+
+int FrameParser::skip(int count, Error error)
+{
+    reset();
+    lastError = error;
+    return -count;
+}
+
+/**
+ * The header fields are validated as they arrive, so that a corrupt header
+ * is rejected without waiting for a whole frame. Once the length field is
+ * known, the calls that do not complete the frame return immediately
+ */
+int FrameParser::extract(byte const* buffer, int size)
+{
+    lastError = NONE;
+    // Cheap sanity checks, in case the caller dropped the bytes of a frame
+    // we started to validate
+    if (size < validated || (validated > 0 && buffer[0] != '<'))
+        reset();
+    if (size <= 0)
+        return 0;
+
+    if (validated == 0)
+    {
+        if (buffer[0] != '<')
+        {
+            void const* next = memchr(buffer + 1, '<', size - 1);
+            int count = next ? static_cast<byte const*>(next) - buffer : size;
+            return skip(count, SYNC);
+        }
+        validated = 1;
+    }
+
+    // Header: <to:from:length:
+    for (; validated < 7 && validated < size; ++validated)
+    {
+        byte c = buffer[validated];
+        switch (validated)
+        {
+            case 1:
+            case 3:
+                if (c == 0)
+                    return skip(1, HEADER);
+                break;
+            case 2:
+            case 4:
+            case 6:
+                if (c != ':')
+                    return skip(1, HEADER);
+                break;
+            case 5:
+                // The length covers the command, the data and their
+                // separators, i.e. at least a one-byte command and a ':'
+                if (c < 2 || 12 + c > maxFrameSize)
+                    return skip(1, LENGTH);
+                frameSize = 12 + c;
+                break;
+        }
+    }
+    if (validated < 7 || size < frameSize)
+        return 0;
+
+    // Command: two bytes unless the second one is the separator. The length
+    // must cover the command and its separator, or the data size would be
+    // negative
+    int commandSize = buffer[8] == ':' ? 1 : 2;
+    if (buffer[5] < commandSize + 1)
+        return skip(1, LENGTH);
+    if (buffer[7 + commandSize] != ':')
+        return skip(1, HEADER);
+
+    // Trailer: checksum:indicator:>
+    int end = frameSize - 5;
+    if (buffer[end] != ':' || buffer[end + 2] != ':' || buffer[end + 4] != '>')
+        return skip(1, TRAILER);
+
+    byte expectedChecksum = Packet::computeChecksum(buffer + 1, buffer + end);
+    if (!Packet::compareChecksum(expectedChecksum, buffer + end + 1))
+        return skip(1, CHECKSUM);
+
+    int result = frameSize;
+    reset();
+    return result;
+}
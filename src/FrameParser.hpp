@@ -0,0 +1,94 @@
+#ifndef PTU_KONGSBERG_OE10_FRAME_PARSER_HPP
+#define PTU_KONGSBERG_OE10_FRAME_PARSER_HPP
+
+#include <ptu_kongsberg_oe10/Packet.hpp>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Incremental framing of the OE10 byte stream
+     *
+     * extract() follows the iodrivers_base extractPacket contract: it is
+     * called with the bytes received so far and returns the size of the
+     * frame at the beginning of the buffer, 0 if more bytes are needed, or
+     * -n to have the n first bytes discarded.
+     *
+     * Unlike a stateless parser, it remembers how far it got between the
+     * calls that returned 0, so that the header of a partially received
+     * frame is validated only once. This relies on the caller passing the
+     * same buffer, possibly with more bytes appended, until extract()
+     * returns a non-zero value. On garbage, all the bytes up to the next
+     * '<' are skipped at once, which makes recovering from line noise
+     * linear in the number of noisy bytes.
+     *
+     * Invalid length fields are handled as any other framing error.
+     */
+    class FrameParser
+    {
+    public:
+        /** Reason why the last call to extract() skipped bytes */
+        enum Error
+        {
+            /** No error */
+            NONE,
+            /** The buffer did not start with '<' */
+            SYNC,
+            /** Invalid separator or device ID in the header, or missing
+             * separator after the command */
+            HEADER,
+            /** The length field is out of range, or too small for the
+             * command */
+            LENGTH,
+            /** Invalid separators or end marker after the data */
+            TRAILER,
+            /** The checksum does not match the frame contents */
+            CHECKSUM
+        };
+
+        /** Size of the smallest frame, whose command is a single byte
+         * (e.g. ACK) without data */
+        static const int MIN_FRAME_SIZE = 12 + 2;
+
+        FrameParser();
+
+        /**
+         * Sets the maximum size of the frames that are accepted
+         *
+         * Frames whose length field announces a bigger frame are rejected
+         * as soon as their header is received, instead of waiting for
+         * bytes that may never come. Defaults to Packet::MAX_PACKET_SIZE
+         */
+        void setMaxFrameSize(int size);
+
+        /** Returns the maximum size of the frames that are accepted */
+        int getMaxFrameSize() const;
+
+        /**
+         * Looks for a frame at the beginning of a buffer
+         * @param buffer Raw received data
+         * @param size Size of received data
+         * @return Size of the frame if complete, 0 if incomplete, -n if
+         *   the n first bytes should be discarded
+         */
+        int extract(byte const* buffer, int size);
+
+        /** Forgets about a partially validated frame, e.g. when the
+         * receive buffer has been cleared */
+        void reset();
+
+        /** Returns the reason why the last call to extract() skipped bytes */
+        Error getLastError() const;
+
+    private:
+        int skip(int count, Error error);
+
+        int maxFrameSize;
+        /** Number of bytes of the current frame that have been validated */
+        int validated;
+        /** Size of the current frame, once its length field is known */
+        int frameSize;
+        Error lastError;
+    };
+}
+
+#endif
@@ -2,12 +2,15 @@
 #include <iostream>
 // Include the custom PTU (Pan-Tilt Unit) driver header
 #include <ptu_kongsberg_oe10/Driver.hpp>
-// Include boost library for string-to-number conversion
-#include <boost/lexical_cast.hpp>
+// The text commands, and the daemon that serves them on a socket
+#include <ptu_kongsberg_oe10/CommandInterpreter.hpp>
+#include <ptu_kongsberg_oe10/ControlServer.hpp>
+#include <ptu_kongsberg_oe10/ScriptRunner.hpp>
+#include <csignal>
+#include <fstream>
 
 // Using declarations to simplify code
 using namespace std;
-using boost::lexical_cast;
 using namespace ptu_kongsberg_oe10;
 
 /**
@@ -18,31 +21,44 @@ using namespace ptu_kongsberg_oe10;
 static int usage(string const& argv0)
 {
     cerr
-        << "usage: " << argv0 << " DEVICE DEVICE_ID CMD [ARGS]\n"
+        << "usage: " << argv0 << " [--trace FILE] DEVICE DEVICE_ID CMD [ARGS]\n"
+        << "       " << argv0 << " [--trace FILE] --daemon SOCKET DEVICE\n"
+        << "       " << argv0 << " [--trace FILE] --script FILE DEVICE\n"
         << "  use 0xFF as device ID for broadcast, otherwise use the\n"
         << "  actual device ID\n"
         << "\n"
+        << "  --trace FILE saves the serial traffic in a capture file, which\n"
+        << "  can be read with ptu_kongsberg_oe10_trace_dump\n"
+        << "\n"
+        << "  --daemon SOCKET keeps DEVICE open and executes the commands\n"
+        << "  received on the Unix socket SOCKET, until interrupted. Use\n"
+        << "  unix://SOCKET as DEVICE to send a command to the daemon\n"
+        << "  instead of opening the device\n"
+        << "\n"
+        << "  --script FILE executes the commands of FILE (- for the standard\n"
+        << "  input), one DEVICE_ID CMD [ARGS] per line, optionally prefixed\n"
+        << "  by @SECONDS (from the start of the script) or +SECONDS (from the\n"
+        << "  previous reply). Consecutive untimed status and movement commands\n"
+        << "  are pipelined, up to the number of requests set by a\n"
+        << "  'window N' line. Each reply is printed with the time of the\n"
+        << "  request and the latency. # starts a comment\n"
+        << "\n"
         << "  the following commands are recognized:\n"
         << "\n"
-        << "  info\n"
-        << "      reports the device's general info\n"
-        << "  status\n"
-        << "      reports the device's axis positions and associated info\n"
-        << "  pan ANGLE [SPEED]\n"
-        << "      moves the pan axis to the specified angle. Angle is\n"
-        << "      specified in degrees and must be between 0 and 360.\n"
-        << "      The speed is specified at a fraction of the maximum\n"
-        << "      speed (between 0 and 1) and defaults to 0.1.\n"
-        << "  tilt ANGLE\n"
-        << "      moves the tilt axis to the specified angle. Angle is\n"
-        << "      specified in degrees and must be between 0 and 360\n"
-        << "      The speed is specified at a fraction of the maximum\n"
-        << "      speed (between 0 and 1) and defaults to 0.1.\n"
+        << CommandInterpreter::getHelp()
         << endl;
 
     return -1;
 }
 
+/** The server of the daemon mode, stopped by SIGINT and SIGTERM */
+static ControlServer* daemonServer = 0;
+
+static void stopDaemon(int)
+{
+    daemonServer->stop();
+}
+
 /**
  * Main program entry point for controlling the Kongsberg OE10 Pan-Tilt Unit
  * Supports commands for:
@@ -50,83 +66,117 @@ static int usage(string const& argv0)
  * - Checking device status
  * - Controlling pan movement
  * - Controlling tilt movement
+ * Commands are either executed directly on the device, or sent to a daemon
+ * that keeps it open
  */
 int main(int argc, char** argv)
 {
     // Create an instance of the PTU driver
     ptu_kongsberg_oe10::Driver driver;
 
-    // Check if minimum required arguments are provided
-    if (argc < 4)
-        return usage(argv[0]);
-
-    // Initialize the device connection with provided URI (e.g., serial port)
-    driver.openURI(argv[1]);
-    // Convert device ID from string to integer (0xFF for broadcast)
-    int device_id = lexical_cast<int>(argv[2]);
-    // Get the command to execute
-    string cmd = argv[3];
-
-    // Handle "info" command - displays general device information
-    if (cmd == "info")
+    // Optionally record the serial traffic. The trace is declared after the
+    // driver so that the recorder is stopped first
+    Trace trace;
+    TraceRecorder recorder(trace);
+    string const argv0 = argv[0];
+    bool tracing = false;
+    if (argc > 2 && string(argv[1]) == "--trace")
     {
-        // Get current device status including capabilities and positions
-        Status status = driver.getStatus(device_id);
-        cout
-            << "Capabilities\n"
-            << "  Pan: " << status.ptu.pan << "\n"      // Pan axis capabilities
-            << "  Tilt: " << status.ptu.tilt << "\n"    // Tilt axis capabilities
-            << "Temperature: " << status.temperature.getCelsius() << "\n"  // Device temperature
-            << "Humidity: " << status.humidity << "\n"   // Device humidity
-            << "Pan: " << round(status.pan * 180 / M_PI) << "\n"    // Current pan position in degrees
-            << "Tilt: " << round(status.tilt * 180 / M_PI) << endl; // Current tilt position in degrees
+        recorder.start(argv[2]);
+        driver.setTrace(&trace);
+        tracing = true;
+        argc -= 2;
+        argv += 2;
     }
-    // Handle "status" command - displays current motion status
-    else if (cmd == "status")
+
+    // Daemon mode: serve the commands received on the socket until
+    // interrupted
+    if (argc > 1 && string(argv[1]) == "--daemon")
     {
-        // Get detailed pan-tilt status information
-        PanTiltStatus status = driver.getPanTiltStatus(device_id);
-        cout
-            << "Status\n"
-            << "Pan Speed: " << status.pan_speed << "\n"     // Current pan axis speed
-            << "Tilt Speed: " << status.tilt_speed << "\n"   // Current tilt axis speed
-            << "Pan: " << round(status.pan * 180 / M_PI) << " deg\n"   // Current pan position
-            << "Tilt: " << round(status.tilt * 180 / M_PI) << " deg\n" // Current tilt position
-            << "Uses Pan Stop: " << status.uses_pan_stop << "\n"    // Pan limit switch status
-            << "Uses Tilt Stop: " << status.uses_tilt_stop << endl; // Tilt limit switch status
+        if (argc != 4)
+            return usage(argv0);
+
+        driver.openURI(argv[3]);
+        ControlServer server(driver);
+        server.open(argv[2]);
+        daemonServer = &server;
+        signal(SIGINT, stopDaemon);
+        signal(SIGTERM, stopDaemon);
+        server.run();
+        daemonServer = 0;
+        return 0;
     }
-    // Handle movement commands (pan or tilt)
-    else if (cmd == "tilt" || cmd == "pan")
+
+    // Script mode: execute the commands of a file over the one connection
+    if (argc > 1 && string(argv[1]) == "--script")
     {
-        // Check if correct number of arguments is provided
-        if (argc != 5 && argc != 6)
-            return usage(argv[0]);
+        if (argc != 4)
+            return usage(argv0);
 
-        // Convert angle from degrees to radians
-        double angle = lexical_cast<double>(argv[4]) * M_PI / 180;
-        // Set default speed to 10% if not specified
-        double speed = 0.1;
-        if (argc == 6)
-            speed = lexical_cast<double>(argv[5]);
+        string const path = argv[2];
+        ifstream file;
+        if (path != "-")
+        {
+            file.open(path.c_str());
+            if (!file)
+            {
+                cerr << "cannot open " << path << endl;
+                return -1;
+            }
+        }
+        istream& script = (path == "-") ? cin : file;
 
-        // Execute pan movement
-        if (cmd == "pan")
+        try
+        {
+            driver.openURI(argv[3]);
+            ScriptRunner runner(driver);
+            ScriptResult result = runner.run(script, cout);
+            cerr << result.commands << " commands, " << result.failures << " failed, "
+                << result.batches << " pipelined batches in "
+                << result.duration.toSeconds() << " s" << endl;
+            return result.ok() ? 0 : 1;
+        }
+        catch(UsageError const& e)
+        {
+            cerr << path << ": " << e.what() << endl;
+            return -1;
+        }
+    }
+
+    // Check if minimum required arguments are provided
+    if (argc < 4)
+        return usage(argv0);
+
+    // The device ID, the command and its arguments
+    vector<string> args(argv + 2, argv + argc);
+    string const uri = argv[1];
+    try
+    {
+        if (uri.compare(0, 7, "unix://") == 0)
         {
-            driver.setPanSpeed(device_id, speed);     // Set pan movement speed
-            driver.setPanPosition(device_id, angle);  // Set target pan position
+            // Thin client of a daemon, which owns the device and its trace
+            if (tracing)
+            {
+                cerr << "--trace cannot be used with a daemon, pass it to the daemon instead" << endl;
+                return -1;
+            }
+            ControlClient client;
+            client.connect(uri.substr(7));
+            cout << client.execute(args) << flush;
         }
-        // Execute tilt movement
         else
         {
-            driver.setTiltSpeed(device_id, speed);    // Set tilt movement speed
-            driver.setTiltPosition(device_id, angle); // Set target tilt position
+            // Initialize the device connection with provided URI (e.g.,
+            // serial port) and execute the command
+            driver.openURI(uri);
+            CommandInterpreter interpreter(driver);
+            interpreter.execute(args, cout);
         }
     }
-    // Handle unrecognized commands
-    else
+    catch(UsageError const& e)
     {
-        cerr << "Unrecognized command " << cmd << endl << endl;
-        return usage(argv[0]);
+        cerr << e.what() << endl << endl;
+        return usage(argv0);
     }
     return 0;
 }
@@ -0,0 +1,76 @@
+#include <ptu_kongsberg_oe10/MoveResult.hpp>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+MoveResult::MoveResult()
+{
+    for (int i = 0; i < STEP_COUNT; ++i)
+        requested[i] = sent[i] = false;
+}
+
+bool MoveResult::ok() const
+{
+    for (int i = 0; i < STEP_COUNT; ++i)
+    {
+        if (requested[i] && !applied(static_cast<Step>(i)))
+            return false;
+    }
+    return true;
+}
+
+bool MoveResult::applied(Step step) const
+{
+    return sent[step] && !errors[step];
+}
+
+MoveResult::Step MoveResult::getFirstFailure() const
+{
+    for (int i = 0; i < STEP_COUNT; ++i)
+    {
+        if (requested[i] && errors[i])
+            return static_cast<Step>(i);
+    }
+    return STEP_COUNT;
+}
+
+char const* MoveResult::getStepName(Step step)
+{
+    switch (step)
+    {
+        case PAN_SPEED: return "pan speed";
+        case TILT_SPEED: return "tilt speed";
+        case PAN_POSITION: return "pan position";
+        case TILT_POSITION: return "tilt position";
+        default: return "unknown step";
+    }
+}
+
+string MoveResult::toString() const
+{
+    string failures, applied;
+    for (int i = 0; i < STEP_COUNT; ++i)
+    {
+        Step step = static_cast<Step>(i);
+        if (!requested[i])
+            continue;
+        else if (!sent[i] || errors[i])
+        {
+            failures += (failures.empty() ? "" : ", ");
+            failures += string(getStepName(step)) + ": " +
+                (errors[i] ? errors[i].toString() : "not sent");
+        }
+        else
+        {
+            applied += (applied.empty() ? "" : ", ");
+            applied += getStepName(step);
+        }
+    }
+    if (failures.empty())
+        return "applied: " + applied;
+    return failures + " (applied: " + (applied.empty() ? "none" : applied) + ")";
+}
+
+MoveError::MoveError(MoveResult const& result)
+    : std::runtime_error("move failed, " + result.toString())
+    , result(result) {}
@@ -0,0 +1,64 @@
+#ifndef PTU_KONGSBERG_OE10_MOVE_RESULT_HPP
+#define PTU_KONGSBERG_OE10_MOVE_RESULT_HPP
+
+#include <ptu_kongsberg_oe10/Expected.hpp>
+#include <stdexcept>
+#include <string>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Outcome of a Driver::move transaction, command by command
+     */
+    struct MoveResult
+    {
+        /** The commands of a move, in the order in which they are written */
+        enum Step
+        {
+            PAN_SPEED,
+            TILT_SPEED,
+            PAN_POSITION,
+            TILT_POSITION,
+            STEP_COUNT
+        };
+
+        /** Whether the step was part of the move */
+        bool requested[STEP_COUNT];
+        /** Whether the command has been written, or skipped because the
+         * state cache shows that the device already has this setting.
+         * Nothing is written if one of the move parameters is invalid */
+        bool sent[STEP_COUNT];
+        /** The error of each step, Error::NONE if it has been ACKed */
+        Error errors[STEP_COUNT];
+
+        MoveResult();
+
+        /** True if all requested commands have been sent and ACKed */
+        bool ok() const;
+
+        /** True if the step has been sent and ACKed by the device */
+        bool applied(Step step) const;
+
+        /** The first step that failed, or STEP_COUNT if none did */
+        Step getFirstFailure() const;
+
+        /** Name of a step, e.g. "pan speed" */
+        static char const* getStepName(Step step);
+
+        /**
+         * Describes the failures and what has been applied, e.g.
+         * "pan position: received NAK ... (applied: pan speed)"
+         */
+        std::string toString() const;
+    };
+
+    /** Exception thrown by Driver::move when a command of the move failed */
+    struct MoveError : public std::runtime_error
+    {
+        MoveResult result;
+
+        explicit MoveError(MoveResult const& result);
+    };
+}
+
+#endif
@@ -1,12 +1,27 @@
 #include <ptu_kongsberg_oe10/Packet.hpp>
+#include <ptu_kongsberg_oe10/FrameParser.hpp>
+#include <ptu_kongsberg_oe10/Expected.hpp>
 #include <boost/lexical_cast.hpp>
-#include <base/Logging.hpp>
 #include <iodrivers_base/Driver.hpp>
+#include <cmath>
+#include <cstring>
 
 using namespace std;
 using namespace ptu_kongsberg_oe10;
 using boost::lexical_cast;
 
+// Out-of-line definitions, needed when the constants are bound to references
+// (e.g. by std::min) in unoptimized builds
+const int Packet::CONTROLLER;
+const int Packet::BROADCAST;
+const int Packet::MAX_DATA_SIZE;
+const int Packet::MAX_COMMAND_SIZE;
+const int Packet::HEADER_SIZE;
+const int Packet::TRAILER_SIZE;
+const int Packet::MAX_PACKET_SIZE;
+const byte Packet::ACK;
+const byte Packet::NAK;
+
 /**
  * Initialize a packet with specified destination and source IDs
  * Sets initial command and data sizes to zero
@@ -40,40 +55,64 @@ void Packet::setCommand(byte c0, byte c1)
 }
 
 /**
- * Serialize the packet into a byte buffer according to the protocol format:
- * <to:from:length:command:data:checksum>
- * Handles special character escaping and checksum calculation
+ * Compute the size of the serialized packet:
+ * 7 bytes of header, the command, a colon, the data and 5 bytes of trailer
+ */
+int Packet::getMarshalledSize() const
+{
+    return HEADER_SIZE + command_size + 1 + data_size + TRAILER_SIZE;
+}
+
+/**
+ * Serialize the packet at the end of a byte vector
  */
 void Packet::marshal(vector<byte>& buffer) const
 {
     int start = buffer.size();
-    // Add packet start marker and header fields
-    buffer.push_back('<');
-    buffer.push_back(to);
-    buffer.push_back(':');
-    buffer.push_back(from);
-    buffer.push_back(':');
-    buffer.push_back(command_size + data_size + 1);  // +1 for checksum
-    buffer.push_back(':');
+    buffer.resize(start + getMarshalledSize());
+    marshal(&buffer[start], buffer.size() - start);
+}
+
+/**
+ * Serialize the packet into a byte buffer according to the protocol format:
+ * <to:from:length:command:data:checksum:checksum ind>
+ * The checksum is accumulated as the bytes are written
+ */
+int Packet::marshal(byte* buffer, int size) const
+{
+    int packetSize = getMarshalledSize();
+    if (size < packetSize)
+        throw std::length_error("buffer too small to marshal packet, need " +
+                lexical_cast<string>(packetSize) + " bytes but got " +
+                lexical_cast<string>(size));
+
+    // Add packet start marker and header fields. The checksum covers
+    // everything but the start marker
+    byte* out = buffer;
+    *out++ = '<';
+    byte checksum = 0;
+    checksum ^= *out++ = to;
+    checksum ^= *out++ = ':';
+    checksum ^= *out++ = from;
+    checksum ^= *out++ = ':';
+    checksum ^= *out++ = command_size + data_size + 1;  // +1 for separator
+    checksum ^= *out++ = ':';
 
     // Add command bytes
     for (int i = 0; i < command_size; ++i)
-        buffer.push_back(command[i]);
-    buffer.push_back(':');
+        checksum ^= *out++ = command[i];
+    checksum ^= *out++ = ':';
 
     // Add data payload
     for (int i = 0; i < data_size; ++i)
-        buffer.push_back(data[i]);
-
-    // Calculate and add checksum
-    byte checksum = computeChecksum(&buffer[start + 1], &buffer[buffer.size()]);
-    buffer.push_back(':');
+        checksum ^= *out++ = data[i];
 
     // Marshal checksum with special character handling
-    byte marshalledChecksum[3];
-    Packet::marshalChecksum(checksum, marshalledChecksum);
-    buffer.insert(buffer.end(), marshalledChecksum, marshalledChecksum + 3);
-    buffer.push_back('>');
+    *out++ = ':';
+    Packet::marshalChecksum(checksum, out);
+    out += 3;
+    *out++ = '>';
+    return out - buffer;
 }
 
 /**
@@ -84,37 +123,65 @@ void Packet::marshal(vector<byte>& buffer) const
  * @return Angle in radians
  */
 float Packet::parseAngle(byte const* buffer)
+{
+    float angle;
+    if (!tryParseAngle(buffer, angle))
+    {
+        int c = buffer[0] < '0' || buffer[0] > '9' ? buffer[0] :
+            (buffer[1] < '0' || buffer[1] > '9' ? buffer[1] : buffer[2]);
+        throw std::runtime_error("ASCII angle representation not in the 0-9 range (got " + lexical_cast<string>(static_cast<int>(static_cast<char>(c))) + ")");
+    }
+    return angle;
+}
+
+/**
+ * Non-throwing version of parseAngle
+ */
+bool Packet::tryParseAngle(byte const* buffer, float& angle)
 {
     // Handle special cases for zero angle
-    if (buffer[0] == 0 && buffer[1] == 0 && buffer[2] == 0)
-        return 0;
-    if (buffer[0] == '9' && buffer[1] == '9' && buffer[2] == '9')
-        return 0;
+    if ((buffer[0] == 0 && buffer[1] == 0 && buffer[2] == 0) ||
+            (buffer[0] == '9' && buffer[1] == '9' && buffer[2] == '9'))
+    {
+        angle = 0;
+        return true;
+    }
 
     // Validate that all bytes are ASCII digits
     for (int i = 0; i < 3; ++i)
     {
-        char c = static_cast<char>(buffer[i]);
-        if (c < '0' || c > '9')
-            throw std::runtime_error("ASCII angle representation not in the 0-9 range (got " + lexical_cast<string>(static_cast<int>(c)) + ")");
+        if (buffer[i] < '0' || buffer[i] > '9')
+            return false;
     }
 
     // Convert ASCII digits to angle value and convert to radians
-    float angle =
-        (static_cast<char>(buffer[0]) - '0') * 100 +
-        (static_cast<char>(buffer[1]) - '0') * 10 +
-        (static_cast<char>(buffer[2]) - '0') * 1;
-    return angle * M_PI / 180;
+    float degrees =
+        (buffer[0] - '0') * 100 +
+        (buffer[1] - '0') * 10 +
+        (buffer[2] - '0') * 1;
+    angle = degrees * M_PI / 180;
+    return true;
+}
+
+/**
+ * Check that an angle rounds to a whole number of degrees in [0, 360]
+ */
+bool Packet::isValidAngle(float angle)
+{
+    long degrees = lround(angle * 180 / M_PI);
+    return degrees >= 0 && degrees <= 360;
 }
 
 /**
  * Convert an angle to its 3-byte ASCII representation
  * Angles must be between 0 and 360 degrees
  * Each byte will contain an ASCII digit character
+ * The angle is rounded to the nearest degree, truncating would turn e.g.
+ * the float representation of 5 degrees into 4
  */
 void Packet::encodeAngle(byte* buffer, float angle)
 {
-    int degrees = angle * 180 / M_PI;
+    int degrees = lround(angle * 180 / M_PI);
     if (degrees < 0 || degrees > 360)
         throw std::range_error("angles must be in [0, 360], got " + lexical_cast<string>(degrees));
 
@@ -164,54 +231,16 @@ std::string Packet::kongsberg_com(boost::uint8_t const* buffer, int buffer_size)
 
 /**
  * Extract a complete packet from a buffer of received data
- * Validates packet format and checksum
- * @return Packet size if valid, 0 if incomplete, -1 if invalid
+ * This is the stateless version of FrameParser::extract
+ * @return Packet size if valid, 0 if incomplete, -n to skip n invalid bytes
  */
-int Packet::extractPacket(byte const* buffer, int size)
+int Packet::extractPacket(byte const* buffer, int size, bool* checksumError)
 {
-    LOG_DEBUG_S << "parsing " << size << " bytes: " << kongsberg_com(buffer, size);
-
-    // Protocol special characters
-    byte const BRACKET_OPEN = '<';
-    byte const COLON = ':';
-    byte const BRACKET_CLOSE = '>';
-
-    // Basic size and format validation
-    if (size < 14)
-        return 0;
-    if (size && buffer[0] != BRACKET_OPEN)
-        return -1;
-    if (buffer[1] == 0)
-        return -1;
-    if (buffer[2] != COLON)
-        return -1;
-    if (buffer[3] == 0)
-        return -1;
-    if (buffer[4] != COLON)
-        return -1;
-    byte length = buffer[5];
-    if (length >= 99)
-        throw std::logic_error("I don't know how to handle packets whose length is 99 or more, the protocol spec is very unclear");
-    if (buffer[6] != COLON)
-        return -1;
-    if (size < 12 + length)
-        return 0;
-    if (buffer[7 + length] != COLON)
-        return -1;
-    if (buffer[7 + length + 2] != COLON)
-        return -1;
-    if (buffer[7 + length + 4] != BRACKET_CLOSE)
-        return -1;
-
-    // Validate packet checksum
-    byte expectedChecksum = computeChecksum(&buffer[1], &buffer[7 + length]);
-    if (!Packet::compareChecksum(expectedChecksum, &buffer[7 + length + 1]))
-    {
-        LOG_DEBUG_S << "packet failed checksum test";
-        return -1;
-    }
-
-    return 12 + length;
+    FrameParser parser;
+    int result = parser.extract(buffer, size);
+    if (checksumError)
+        *checksumError = (parser.getLastError() == FrameParser::CHECKSUM);
+    return result;
 }
 
 /**
@@ -220,76 +249,25 @@ int Packet::extractPacket(byte const* buffer, int size)
  */
 Packet Packet::parse(byte const* buffer, int size, bool validate)
 {
-    if (validate)
-    {
-        if (extractPacket(buffer, size) <= 0)
-            throw std::runtime_error("provided buffer does not start with a complete packet");
-    }
+    PacketView view = PacketView::parse(buffer, size, validate);
 
     Packet result;
-    // Parse header fields
-    result.to   = buffer[1];
-    result.from = buffer[3];
-    byte length = buffer[5];
-
-    // Parse command (1 or 2 bytes)
-    result.command[0] = buffer[7];
-    if (buffer[8] == ':')
-    {
-        result.command_size = 1;
-    }
-    else
-    {
-        result.command[1] = buffer[8];
-        result.command_size = 2;
-    }
-        
-    // Copy data payload
-    result.data_size = length - result.command_size - 1;
-    memcpy(result.data, &buffer[7 + result.command_size + 1], result.data_size);
+    result.to   = view.to;
+    result.from = view.from;
+    result.command_size = view.command_size;
+    memcpy(result.command, view.command, view.command_size);
+    result.data_size = view.data_size;
+    memcpy(result.data, view.data, view.data_size);
     return result;
 }
 
 /**
  * Validate that this packet is a proper response to a command
- * Checks:
- * - Response is ACK or NAK
- * - Source device ID matches
- * - Command echo matches original command
- * Throws runtime_error if validation fails
+ * See PacketView::validateResponseFor
  */
 void Packet::validateResponseFor(Packet const& cmd)
 {
-    if (command_size != 1 || (command[0] != ACK && command[0] != NAK))
-    {
-        throw std::runtime_error("expecting a ACK/NAK packet but got " + iodrivers_base::Driver::binary_com(command, command_size));
-    }
-
-    if (cmd.to != BROADCAST && from != cmd.to)
-    {
-        throw std::runtime_error("expected a response from device ID " +
-                lexical_cast<string>(cmd.to) + " but got one from " +
-                lexical_cast<string>(from));
-    }
-
-    if (data_size < cmd.command_size)
-        throw std::runtime_error("got a ACK/NAK packet with a smaller-than expected data field");
-
-    // Validate command echo
-    for (int i = 0; i < cmd.command_size; ++i)
-    {
-        if (data[i] != cmd.command[i])
-            throw std::runtime_error("expected a ACK/NAK for command " +
-                    cmd.getCommandAsString() + " but got it for " +
-                    string(reinterpret_cast<char const*>(data), static_cast<string::size_type>(cmd.command_size)));
-    }
-
-    // Handle NAK responses with error information
-    if (command[0] == NAK)
-    {
-        throw std::runtime_error("received NAK with the following error bits set: " +
-                parseNACKError(data[0]));
-    }
+    PacketView(*this).validateResponseFor(cmd);
 }
 
 /**
@@ -298,14 +276,7 @@ void Packet::validateResponseFor(Packet const& cmd)
  */
 string Packet::getCommandAsString() const
 {
-    if (command_size == 1)
-    {
-        if (command[0] == ACK)
-            return "ACK";
-        else if (command[0] == NAK)
-            return "NAK";
-    }
-    return string(reinterpret_cast<char const*>(command), static_cast<string::size_type>(command_size));
+    return PacketView(*this).getCommandAsString();
 }
 
 // Error code descriptions for NAK responses
@@ -342,38 +313,193 @@ string Packet::parseNACKError(byte errorByte)
 
 /**
  * Marshal a checksum value according to protocol rules
- * Handles special cases where checksum matches field separators
+ * The checksum field is made of the checksum byte, a colon and a checksum
+ * indicator. Since the checksum cannot be '<' or '>', these two values are
+ * replaced by 0xFF and the indicator is set to '0' and '1' respectively.
+ * It is 'G' for all other values.
  * @param checksum Raw checksum value
  * @param buffer 3-byte buffer to store encoded checksum
  */
 void Packet::marshalChecksum(byte checksum, byte* buffer)
 {
-    if (checksum == ':' || checksum == '>')
+    buffer[1] = ':';
+    if (checksum == '<')
+    {
+        buffer[0] = 0xFF;
+        buffer[2] = '0';
+    }
+    else if (checksum == '>')
     {
-        buffer[0] = '0';
-        buffer[1] = '0';
-        buffer[2] = checksum;
+        buffer[0] = 0xFF;
+        buffer[2] = '1';
     }
     else
     {
         buffer[0] = checksum;
-        buffer[1] = '0';
-        buffer[2] = '0';
+        buffer[2] = 'G';
     }
 }
 
 /**
  * Compare an encoded checksum with expected value
- * Handles special cases where checksum matches field separators
+ * Handles special cases where checksum matches the packet delimiters
  * @param expected Raw checksum value to compare against
  * @param buffer Buffer containing encoded checksum
  * @return True if checksums match
  */
 bool Packet::compareChecksum(byte expected, byte const* buffer)
 {
-    if (expected == ':' || expected == '>')
-        return buffer[0] == '0' && buffer[1] == '0' && buffer[2] == expected;
-    else
-        return buffer[0] == expected && buffer[1] == '0' && buffer[2] == '0';
+    byte marshalled[3];
+    marshalChecksum(expected, marshalled);
+    return memcmp(marshalled, buffer, 3) == 0;
+}
+
+/**
+ * Initialize an empty view
+ */
+PacketView::PacketView()
+    : from(0)
+    , to(0)
+    , command_size(0)
+    , command(0)
+    , data_size(0)
+    , data(0)
+{}
+
+/**
+ * Initialize a view on the fields of an existing packet
+ */
+PacketView::PacketView(Packet const& packet)
+    : from(packet.from)
+    , to(packet.to)
+    , command_size(packet.command_size)
+    , command(packet.command)
+    , data_size(packet.data_size)
+    , data(packet.data)
+{}
+
+/**
+ * Parse a complete packet from a buffer, pointing the view's command and
+ * data fields to the buffer itself
+ * Optionally validates the packet format first
+ */
+PacketView PacketView::parse(byte const* buffer, int size, bool validate)
+{
+    if (validate)
+    {
+        if (Packet::extractPacket(buffer, size) <= 0)
+            throw std::runtime_error("provided buffer does not start with a complete packet");
+    }
+
+    PacketView result;
+    // Parse header fields
+    result.to   = buffer[1];
+    result.from = buffer[3];
+    byte length = buffer[5];
+
+    // Parse command (1 or 2 bytes)
+    result.command = buffer + 7;
+    result.command_size = (buffer[8] == ':') ? 1 : 2;
+
+    // Point to the data payload
+    result.data_size = length - result.command_size - 1;
+    result.data = buffer + 7 + result.command_size + 1;
+    return result;
+}
+
+/**
+ * Validate that this packet is a proper response to a command
+ * Checks:
+ * - Response is ACK or NAK
+ * - Source device ID matches
+ * - Command echo matches original command
+ * Throws runtime_error if validation fails
+ */
+void PacketView::validateResponseFor(Packet const& cmd) const
+{
+    validateResponseFor(cmd.to, cmd.command, cmd.command_size);
 }
 
+/**
+ * Validate that this packet is a proper response to a command given by its
+ * destination and command bytes
+ */
+void PacketView::validateResponseFor(byte cmd_to, byte const* cmd_command, int cmd_command_size) const
+{
+    Error error = checkResponseFor(cmd_to, cmd_command, cmd_command_size);
+    if (error)
+        error.raise();
+}
+
+/**
+ * Check the response without throwing nor allocating, see Error for the
+ * meaning of the error fields
+ */
+Error PacketView::checkResponseFor(byte cmd_to, byte const* cmd_command, int cmd_command_size) const
+{
+    if (command_size != 1 || (command[0] != Packet::ACK && command[0] != Packet::NAK))
+    {
+        int packed = 0;
+        for (int i = 0; i < command_size; ++i)
+            packed = (packed << 8) | command[i];
+        return Error(Error::NOT_A_REPLY, cmd_to, cmd_command, cmd_command_size,
+                packed, command_size);
+    }
+
+    if (cmd_to != Packet::BROADCAST && from != cmd_to)
+        return Error(Error::DEVICE_MISMATCH, cmd_to, cmd_command, cmd_command_size, from);
+
+    if (data_size < cmd_command_size)
+    {
+        return Error(Error::SIZE_MISMATCH, cmd_to, cmd_command, cmd_command_size,
+                data_size, cmd_command_size);
+    }
+
+    // Validate command echo
+    for (int i = 0; i < cmd_command_size; ++i)
+    {
+        if (data[i] != cmd_command[i])
+        {
+            int packed = 0;
+            for (int j = 0; j < cmd_command_size; ++j)
+                packed = (packed << 8) | data[j];
+            return Error(Error::COMMAND_MISMATCH, cmd_to, cmd_command, cmd_command_size, packed);
+        }
+    }
+
+    // Handle NAK responses with error information. The error byte follows
+    // the command echo
+    if (command[0] == Packet::NAK)
+    {
+        byte bits = (data_size > cmd_command_size) ? data[cmd_command_size] : 0;
+        return Error(Error::NAK, cmd_to, cmd_command, cmd_command_size, bits);
+    }
+    return Error();
+}
+
+/**
+ * Return a view whose data field starts count bytes later
+ */
+PacketView PacketView::skipData(int count) const
+{
+    PacketView result(*this);
+    result.data += count;
+    result.data_size -= count;
+    return result;
+}
+
+/**
+ * Get a human-readable string representation of the command
+ * Special handling for ACK and NAK commands
+ */
+string PacketView::getCommandAsString() const
+{
+    if (command_size == 1)
+    {
+        if (command[0] == Packet::ACK)
+            return "ACK";
+        else if (command[0] == Packet::NAK)
+            return "NAK";
+    }
+    return string(reinterpret_cast<char const*>(command), static_cast<string::size_type>(command_size));
+}
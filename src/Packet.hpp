@@ -4,12 +4,15 @@
 #include <boost/cstdint.hpp>
 #include <base/Angle.hpp>
 #include <vector>
+#include <string>
 
 namespace ptu_kongsberg_oe10
 {
     /** Type alias for byte-level operations */
     typedef boost::uint8_t byte;
 
+    struct Error;
+
     /**
      * Class representing a communication packet for the Kongsberg OE10 protocol
      * 
@@ -32,8 +35,15 @@ namespace ptu_kongsberg_oe10
         static const int BROADCAST  = 0xFF;
         /** Maximum size of the data payload */
         static const int MAX_DATA_SIZE   = 0xFF;
-        /** Maximum total packet size including headers and payload */
-        static const int MAX_PACKET_SIZE = 14 + MAX_DATA_SIZE;
+        /** Maximum size of the command */
+        static const int MAX_COMMAND_SIZE = 2;
+        /** Size of the "<to:from:length:" header */
+        static const int HEADER_SIZE = 7;
+        /** Size of the ":checksum:indicator>" trailer */
+        static const int TRAILER_SIZE = 5;
+        /** Maximum total packet size: header, command, ':', data and trailer */
+        static const int MAX_PACKET_SIZE =
+            HEADER_SIZE + MAX_COMMAND_SIZE + 1 + MAX_DATA_SIZE + TRAILER_SIZE;
 
         /** Acknowledgment byte indicating successful command */
         static const byte ACK = 0x06;
@@ -73,13 +83,31 @@ namespace ptu_kongsberg_oe10
          */
         void setCommand(byte c0, byte c1);
 
+        /**
+         * Returns the size of the serialized packet
+         * @return Number of bytes that marshal() will write
+         */
+        int getMarshalledSize() const;
+
         /**
          * Serializes the packet into a byte buffer for transmission
          * Handles special character escaping and checksum calculation
-         * @param buffer Vector to store the serialized packet
+         * @param buffer Vector to which the serialized packet is appended
          */
         void marshal(std::vector<byte>& buffer) const;
 
+        /**
+         * Serializes the packet into a caller-provided buffer
+         *
+         * The checksum is computed while the packet is being written, and
+         * this method does not allocate memory.
+         * @param buffer Buffer to store the serialized packet
+         * @param size Size of buffer
+         * @return Number of bytes written, i.e. getMarshalledSize()
+         * @throws length_error if buffer is too small
+         */
+        int marshal(byte* buffer, int size) const;
+
         /**
          * Converts a 3-byte angle representation to float
          * @param buffer Pointer to the 3-byte angle data
@@ -87,13 +115,32 @@ namespace ptu_kongsberg_oe10
          */
         static float parseAngle(byte const* buffer);
 
+        /**
+         * Converts a 3-byte angle representation to float, without throwing
+         * @param buffer Pointer to the 3-byte angle data
+         * @param angle Set to the angle value in radians on success
+         * @return false if the representation is invalid
+         */
+        static bool tryParseAngle(byte const* buffer, float& angle);
+
         /**
          * Converts a float angle to 3-byte representation
+         *
+         * The angle is rounded to the nearest whole degree, so that angles
+         * that are a whole number of degrees up to float precision (e.g.
+         * the result of parseAngle) encode to that number
          * @param buffer Buffer to store the encoded angle
          * @param angle Angle value in radians
+         * @throws std::range_error if the rounded angle is not in [0, 360]
          */
         static void encodeAngle(byte* buffer, float angle);
 
+        /**
+         * Whether encodeAngle accepts an angle, i.e. whether it rounds to a
+         * whole number of degrees in [0, 360]
+         */
+        static bool isValidAngle(float angle);
+
         /**
          * Calculates packet checksum for error detection
          * @param begin Start of data to checksum
@@ -121,12 +168,17 @@ namespace ptu_kongsberg_oe10
 
         /**
          * Extracts a complete packet from a buffer of received data
-         * Used by the driver's extractPacket method for packet framing
+         *
+         * It does not keep state between calls, see FrameParser for the
+         * incremental version the driver uses
          * @param buffer Raw received data
          * @param size Size of received data
-         * @return Size of packet if found, 0 if incomplete, -1 if invalid
+         * @param checksumError If non-NULL, set to true when the data is
+         *   rejected because of a checksum mismatch
+         * @return Size of packet if found, 0 if incomplete, -n if the n
+         *   first bytes are not part of a valid packet
          */
-        static int extractPacket(byte const* buffer, int size);
+        static int extractPacket(byte const* buffer, int size, bool* checksumError = 0);
 
         /**
          * Parses a complete packet from a buffer into a Packet structure
@@ -167,6 +219,94 @@ namespace ptu_kongsberg_oe10
          */
         static std::string kongsberg_com(byte const* buffer, int size);
     };
+
+    /**
+     * Non-owning view over a packet that is stored in a receive buffer
+     *
+     * Unlike Packet, it does not copy the command and data fields: they
+     * point into the buffer the view has been parsed from. The view is
+     * therefore only valid as long as the underlying buffer is not modified,
+     * i.e. for the driver, until the next packet is read.
+     */
+    struct PacketView
+    {
+        /** Source device ID of the packet */
+        byte from;
+        /** Destination device ID for the packet */
+        byte to;
+        /** Size of the command field (1 or 2 bytes) */
+        byte command_size;
+        /** Pointer to the command bytes */
+        byte const* command;
+        /** Size of the data payload */
+        byte data_size;
+        /** Pointer to the data payload */
+        byte const* data;
+
+        /** Creates an empty view */
+        PacketView();
+
+        /**
+         * Creates a view on the fields of an existing packet
+         * @param packet The packet, which must outlive the view
+         */
+        explicit PacketView(Packet const& packet);
+
+        /**
+         * Parses a complete packet from a buffer without copying it
+         * @param buffer Buffer containing complete packet
+         * @param size Size of the packet data
+         * @param validate Whether to validate packet integrity
+         * @return View on the packet fields, pointing into buffer
+         */
+        static PacketView parse(byte const* buffer, int size, bool validate = true);
+
+        /**
+         * Validates that this packet is a proper response to a command
+         * Checks device IDs, command echo, and ACK/NAK status
+         * @param cmd Original command packet
+         * @throws runtime_error if validation fails
+         */
+        void validateResponseFor(Packet const& cmd) const;
+
+        /**
+         * Validates that this packet is a proper response to a command
+         * @param to Device ID the command was sent to
+         * @param command Command bytes
+         * @param command_size Number of command bytes
+         * @throws runtime_error if validation fails
+         */
+        void validateResponseFor(byte to, byte const* command, int command_size) const;
+
+        /**
+         * Checks that this packet is a proper response to a command, without
+         * throwing
+         *
+         * Include Expected.hpp to use it
+         * @param to Device ID the command was sent to
+         * @param command Command bytes
+         * @param command_size Number of command bytes
+         * @return The error, whose code is Error::NONE if the packet is an
+         *   ACK for the command
+         */
+        Error checkResponseFor(byte to, byte const* command, int command_size) const;
+
+        /**
+         * Returns a view whose data field skips the first bytes of this
+         * view's data field
+         *
+         * It is used to strip the command echo at the beginning of ACK
+         * packets
+         * @param count Number of bytes to skip
+         */
+        PacketView skipData(int count) const;
+
+        /**
+         * Creates a human-readable string of the command
+         * @return String representation of the command
+         */
+        std::string getCommandAsString() const;
+    };
 }
 
 #endif
@@ -14,11 +14,38 @@ namespace ptu_kongsberg_oe10 {
     struct PanTiltStatus
     {
         /** 
-         * The time at which this status was acquired
-         * Used for tracking when the status information was read from the device
+         * The time at which this status was acquired, on the wall clock
+         *
+         * It is the estimated time at which the device sampled its axes:
+         * the midpoint between the end of the request transmission and the
+         * start of the reply transmission, using the link's baud rate to
+         * estimate the transmission times
          */
         base::Time time;
 
+        /**
+         * The time at which the reply had been fully received and decoded,
+         * on the wall clock
+         */
+        base::Time received_time;
+
+        /**
+         * The time at which the request was written, on the monotonic clock
+         */
+        base::Time request_time;
+
+        /**
+         * The time at which the first byte of the reply arrived, on the
+         * monotonic clock
+         */
+        base::Time first_byte_time;
+
+        /**
+         * The estimated sampling time, on the monotonic clock. It is the
+         * same instant as 'time'
+         */
+        base::Time sample_time;
+
         /** 
          * Current position on the pan axis in radians
          * Positive values indicate clockwise rotation from the zero position
@@ -0,0 +1,144 @@
+#include <ptu_kongsberg_oe10/PanTiltStreamer.hpp>
+#include <base/Logging.hpp>
+#include <chrono>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+PanTiltStreamer::PanTiltStreamer(Driver& driver, int device_id, size_t capacity)
+    : driver(driver)
+    , device_id(device_id)
+    , ring(capacity)
+    , quit(false)
+    , period_us(0)
+    , errors(0)
+    , rate(0)
+{
+}
+
+PanTiltStreamer::~PanTiltStreamer()
+{
+    stop();
+}
+
+void PanTiltStreamer::setPeriod(base::Time const& period)
+{
+    period_us = period.toMicroseconds();
+}
+
+base::Time PanTiltStreamer::getPeriod() const
+{
+    return base::Time::fromMicroseconds(period_us);
+}
+
+void PanTiltStreamer::start()
+{
+    if (thread.joinable())
+        return;
+    quit = false;
+    thread = std::thread(&PanTiltStreamer::run, this);
+}
+
+void PanTiltStreamer::stop()
+{
+    if (!thread.joinable())
+        return;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wakeup.notify_one();
+    thread.join();
+}
+
+bool PanTiltStreamer::isRunning() const
+{
+    return thread.joinable();
+}
+
+SampleRing<PanTiltStatus> const& PanTiltStreamer::getRing() const
+{
+    return ring;
+}
+
+StreamerStatistics PanTiltStreamer::getStatistics() const
+{
+    StreamerStatistics stats;
+    stats.samples = ring.getCount();
+    stats.errors  = errors;
+    stats.overwritten = (stats.samples > ring.getCapacity()) ? stats.samples - ring.getCapacity() : 0;
+    stats.rate = rate;
+    return stats;
+}
+
+/** Delay before the first retry after a failed poll */
+static const chrono::milliseconds MIN_RETRY_DELAY(10);
+/** Maximum delay between retries while the polls keep failing */
+static const chrono::milliseconds MAX_RETRY_DELAY(1000);
+
+/**
+ * Poll loop. Deadlines are absolute so that the period does not drift with
+ * the round-trip time. If a poll overruns its deadline, the next one is sent
+ * right away and the schedule restarts from there
+ *
+ * Failed polls are retried with an exponential back-off, so that a lasting
+ * failure (e.g. an unplugged port) does not spin. Only the first failure of
+ * a series is logged
+ */
+void PanTiltStreamer::run()
+{
+    typedef chrono::steady_clock Clock;
+    Clock::time_point deadline = Clock::now();
+    Clock::time_point rate_start = deadline;
+    boost::uint64_t rate_samples = 0;
+    boost::uint64_t failures = 0;
+    Clock::duration retry_delay = MIN_RETRY_DELAY;
+
+    while (true)
+    {
+        try
+        {
+            ring.push(driver.getPanTiltStatus(device_id));
+            ++rate_samples;
+            if (failures)
+            {
+                LOG_INFO_S << "polling device " << device_id << " again after " << failures << " failures";
+            }
+            failures = 0;
+            retry_delay = MIN_RETRY_DELAY;
+        }
+        catch(std::exception const& e)
+        {
+            ++errors;
+            if (!failures++)
+            {
+                LOG_WARN_S << "failed to poll pan/tilt status of device " << device_id << ": " << e.what();
+            }
+        }
+
+        Clock::time_point now = Clock::now();
+        if (now - rate_start >= chrono::seconds(1))
+        {
+            rate = rate_samples / chrono::duration<double>(now - rate_start).count();
+            rate_start = now;
+            rate_samples = 0;
+        }
+
+        unique_lock<std::mutex> lock(mutex);
+        boost::int64_t period = period_us;
+        if (period > 0 || failures)
+        {
+            deadline += chrono::microseconds(period);
+            if (deadline < now)
+                deadline = now;
+            if (failures)
+            {
+                deadline = max(deadline, now + retry_delay);
+                retry_delay = min<Clock::duration>(retry_delay * 2, MAX_RETRY_DELAY);
+            }
+            wakeup.wait_until(lock, deadline, [this] { return quit; });
+        }
+        if (quit)
+            return;
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef PTU_KONGSBERG_OE10_PAN_TILT_STREAMER_HPP
+#define PTU_KONGSBERG_OE10_PAN_TILT_STREAMER_HPP
+
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <ptu_kongsberg_oe10/SampleRing.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Statistics about a PanTiltStreamer
+     */
+    struct StreamerStatistics
+    {
+        /** Number of samples pushed to the ring */
+        boost::uint64_t samples;
+        /** Number of AS polls that failed */
+        boost::uint64_t errors;
+        /** Number of samples that have been overwritten in the ring, whether
+         * they had been read or not */
+        boost::uint64_t overwritten;
+        /** Sample rate achieved over the last second, in Hz */
+        double rate;
+    };
+
+    /**
+     * Continuously polls the pan/tilt status of a device from a background
+     * thread
+     *
+     * Each decoded PanTiltStatus is pushed into a preallocated SampleRing.
+     * Consumers read the samples at their own pace through a
+     * SampleRing::Reader without ever blocking the poller.
+     *
+     * The streamer uses the driver exclusively while it is running: the
+     * driver must not be used by other threads between start() and stop().
+     */
+    class PanTiltStreamer
+    {
+    public:
+        /**
+         * @param driver The driver, which must be open and outlive the
+         *   streamer
+         * @param device_id The ID of the polled device
+         * @param capacity Number of samples in the ring
+         */
+        PanTiltStreamer(Driver& driver, int device_id, size_t capacity = 1024);
+
+        /** Stops the polling thread */
+        ~PanTiltStreamer();
+
+        /**
+         * Sets the polling period
+         * A null period (the default) polls as fast as the link allows.
+         * Whatever the period, failed polls are retried after a delay that
+         * doubles with each failure, up to one second
+         */
+        void setPeriod(base::Time const& period);
+
+        /** Returns the polling period */
+        base::Time getPeriod() const;
+
+        /** Starts the polling thread */
+        void start();
+
+        /** Stops the polling thread, waiting for the current poll to end */
+        void stop();
+
+        /** Whether the polling thread is running */
+        bool isRunning() const;
+
+        /** Returns the ring in which samples are pushed */
+        SampleRing<PanTiltStatus> const& getRing() const;
+
+        /** Returns a snapshot of the streamer statistics */
+        StreamerStatistics getStatistics() const;
+
+    private:
+        void run();
+
+        Driver& driver;
+        int device_id;
+        SampleRing<PanTiltStatus> ring;
+
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        bool quit;
+
+        std::atomic<boost::int64_t> period_us;
+        std::atomic<boost::uint64_t> errors;
+        std::atomic<double> rate;
+    };
+}
+
+#endif
@@ -0,0 +1,263 @@
+#include <ptu_kongsberg_oe10/Pipeline.hpp>
+#include <base/Logging.hpp>
+#include <cstring>
+#include <boost/lexical_cast.hpp>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+Pipeline::Pipeline(Driver& driver, int window)
+    : driver(driver)
+{
+    setWindow(window);
+}
+
+void Pipeline::setWindow(int window)
+{
+    if (window < 1)
+        throw std::invalid_argument("the pipeline window must be at least 1");
+    this->window = window;
+}
+
+int Pipeline::getWindow() const
+{
+    return window;
+}
+
+void Pipeline::clear()
+{
+    requests.clear();
+    frames.clear();
+    replies.clear();
+    statuses.clear();
+}
+
+int Pipeline::size() const
+{
+    return requests.size();
+}
+
+/**
+ * Register a request and reserve room for its frame and reply data
+ */
+int Pipeline::addRequest(int device_id, byte c0, byte c1, int frame_size, int expected_size,
+        StateCache::Setting setting, unsigned invalidates)
+{
+    if (device_id == Packet::BROADCAST)
+        throw std::invalid_argument("cannot pipeline broadcast requests, as their replies cannot be matched");
+
+    Request request;
+    request.device_id = device_id;
+    request.opcode[0] = c0;
+    request.opcode[1] = c1;
+    request.expected_size = expected_size;
+    request.setting = setting;
+    request.invalidates = invalidates;
+    request.frame_offset = frames.size();
+    request.frame_size = frame_size;
+    request.reply_offset = replies.size();
+    request.write_size = 0;
+    request.status_index = -1;
+    request.state = Request::QUEUED;
+    request.error = Error();
+    frames.resize(frames.size() + frame_size);
+    replies.resize(replies.size() + expected_size);
+    requests.push_back(request);
+    return requests.size() - 1;
+}
+
+/**
+ * Whether a request with the same device and opcode is already in flight,
+ * in which case a reply could not be matched unambiguously
+ */
+bool Pipeline::isInFlight(byte device_id, byte const* opcode) const
+{
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        Request const& r = requests[i];
+        if (r.state == Request::IN_FLIGHT && r.device_id == device_id &&
+                r.opcode[0] == opcode[0] && r.opcode[1] == opcode[1])
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Find the in-flight request a reply is for, from the reply's source device
+ * and command echo
+ */
+int Pipeline::findInFlight(PacketView const& reply) const
+{
+    if (reply.data_size < 2)
+        return -1;
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        Request const& r = requests[i];
+        if (r.state == Request::IN_FLIGHT && r.device_id == reply.from &&
+                r.opcode[0] == reply.data[0] && r.opcode[1] == reply.data[1])
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * Write requests as long as the window allows it, and match the replies
+ * until all requests are either done or failed
+ */
+void Pipeline::run()
+{
+    size_t next = 0;
+    while (next < requests.size() && requests[next].state != Request::QUEUED)
+        ++next;
+
+    int in_flight = 0;
+    while (next < requests.size() || in_flight > 0)
+    {
+        // Fill the window with consecutive requests, which are consecutive
+        // in the frame buffer as well, and write them in one go
+        size_t first = next;
+        base::Time write_time = monotonicNow();
+        while (next < requests.size() && in_flight < window &&
+                !isInFlight(requests[next].device_id, requests[next].opcode))
+        {
+            requests[next].state = Request::IN_FLIGHT;
+            requests[next].write_time = write_time;
+            ++in_flight;
+            ++next;
+        }
+        if (next != first)
+        {
+            int offset = requests[first].frame_offset;
+            for (size_t i = first; i < next; ++i)
+                requests[i].write_size = requests[i].frame_offset + requests[i].frame_size - offset;
+            driver.writeRaw(&frames[offset], requests[next - 1].write_size);
+        }
+
+        PacketView reply;
+        boost::uint64_t checksumErrors = driver.statistics.checksum_errors;
+        try { reply = driver.readPacket(); }
+        catch(iodrivers_base::TimeoutError const&)
+        {
+            Error::Code code = driver.statistics.checksum_errors != checksumErrors ?
+                Error::CHECKSUM : Error::TIMEOUT;
+            for (size_t i = 0; i < next; ++i)
+            {
+                Request& request = requests[i];
+                if (request.state == Request::IN_FLIGHT)
+                {
+                    request.state = Request::FAILED;
+                    request.reply_time = monotonicNow();
+                    request.error = Error(code, request.device_id, request.opcode, 2);
+                    updateSettings(request);
+                }
+            }
+            in_flight = 0;
+            continue;
+        }
+
+        int index = findInFlight(reply);
+        if (index < 0)
+        {
+            LOG_WARN_S << "ignoring " << reply.getCommandAsString() << " reply from device " <<
+                static_cast<int>(reply.from) << " that does not match any request in flight";
+            continue;
+        }
+
+        Request& request = requests[index];
+        request.reply_time = monotonicNow();
+        --in_flight;
+        PacketView data;
+        request.error = driver.checkResponse(reply,
+                request.device_id, request.opcode, 2, request.expected_size,
+                request.write_time, data);
+        if (request.error)
+            request.state = Request::FAILED;
+        else
+        {
+            memcpy(replies.data() + request.reply_offset, data.data, data.data_size);
+            request.state = Request::DONE;
+            if (request.opcode[0] == commands::GetPanTiltStatus::OPCODE0 &&
+                    request.opcode[1] == commands::GetPanTiltStatus::OPCODE1)
+                decodeStatus(request);
+        }
+        updateSettings(request);
+    }
+}
+
+/**
+ * Decode an AS reply right after it has been read, so that the arrival
+ * time of its first byte is still the driver's. The sample time is
+ * estimated from the end of this request's frame within its write
+ */
+void Pipeline::decodeStatus(Request& request)
+{
+    Expected<PanTiltStatus> status = commands::tryDecode(commands::GetPanTiltStatus(),
+            request.device_id, replies.data() + request.reply_offset);
+    if (!status.ok())
+    {
+        request.state = Request::FAILED;
+        request.error = status.error();
+        return;
+    }
+
+    driver.stampStatus(status.value(), request.write_time, request.write_size,
+            driver.lastFirstByteTime);
+    driver.updatePoseEstimator(request.device_id, status);
+    request.status_index = statuses.size();
+    statuses.push_back(*status);
+}
+
+Expected<PanTiltStatus> Pipeline::decodeReply(Request const& request,
+        commands::GetPanTiltStatus const&) const
+{
+    return statuses.at(request.status_index);
+}
+
+/**
+ * Report the outcome of a request to the driver's state cache and pose
+ * estimator. The request payload is read back from its frame
+ */
+void Pipeline::updateSettings(Request const& request)
+{
+    if (!driver.stateCacheEnabled && !driver.poseEstimator)
+        return;
+    int payload_size = request.frame_size - commands::frameSize(2, 0);
+    driver.updateSettings(request.device_id, request.setting, request.invalidates,
+            &frames[request.frame_offset + commands::dataOffset(2)], payload_size, request.error);
+}
+
+bool Pipeline::succeeded(int index) const
+{
+    return requests.at(index).state == Request::DONE;
+}
+
+Error const& Pipeline::getError(int index) const
+{
+    return requests.at(index).error;
+}
+
+base::Time Pipeline::getWriteTime(int index) const
+{
+    return requests.at(index).write_time;
+}
+
+base::Time Pipeline::getReplyTime(int index) const
+{
+    return requests.at(index).reply_time;
+}
+
+/**
+ * Check that a request was registered for the given opcode and that it has
+ * been executed
+ */
+Pipeline::Request const& Pipeline::checkRequest(int index, byte c0, byte c1) const
+{
+    Request const& request = requests.at(index);
+    if (request.opcode[0] != c0 || request.opcode[1] != c1)
+        throw std::invalid_argument("request " + lexical_cast<string>(index) + " is not for the given command");
+    if (request.state != Request::DONE && request.state != Request::FAILED)
+        throw std::logic_error("request " + lexical_cast<string>(index) + " has not been executed, call run() first");
+    return request;
+}
+
@@ -0,0 +1,219 @@
+#ifndef PTU_KONGSBERG_OE10_PIPELINE_HPP
+#define PTU_KONGSBERG_OE10_PIPELINE_HPP
+
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Executes a batch of commands while keeping several of them in flight
+     *
+     * Driver's methods write a command and then block until its reply has
+     * been received, so that polling N units costs N full round trips. The
+     * pipeline instead writes up to getWindow() frames back-to-back and
+     * matches the replies back to their requests using the device ID the
+     * reply comes from and the command echo that starts the ACK/NAK data.
+     *
+     * Since requests are matched this way, two requests with the same
+     * device ID and opcode are never in flight at the same time (the second
+     * one is sent once the first one has been answered), and broadcast
+     * requests cannot be pipelined.
+     *
+     * Example, reading the status of units 1 to 8:
+     *
+     * <code>
+     * Pipeline pipeline(driver);
+     * for (int id = 1; id <= 8; ++id)
+     *     pipeline.add(id, commands::GetPanTiltStatus());
+     * pipeline.run();
+     * for (int i = 0; i < pipeline.size(); ++i)
+     *     PanTiltStatus status = pipeline.get(i, commands::GetPanTiltStatus());
+     * </code>
+     *
+     * Pipelined commands maintain the driver's state cache, but are always
+     * sent, even if the cache shows that they are redundant. AS replies are
+     * decoded as soon as they are matched, so that their timestamps are
+     * estimated from their own request and reply (see PanTiltStatus::time),
+     * and fed to the driver's pose estimator.
+     *
+     * Note that on half-duplex (two-wire RS-485) buses, units may start
+     * replying while the next frames are still being written. Use a window
+     * of 1 there unless the units are known to wait for the bus to be idle.
+     */
+    class Pipeline
+    {
+    public:
+        /** Default maximum number of requests in flight */
+        static const int DEFAULT_WINDOW = 8;
+
+        /**
+         * Creates a pipeline that executes commands on the given driver
+         * @param driver The driver, which must outlive the pipeline
+         * @param window Maximum number of requests in flight
+         */
+        explicit Pipeline(Driver& driver, int window = DEFAULT_WINDOW);
+
+        /** Sets the maximum number of requests in flight */
+        void setWindow(int window);
+
+        /** Returns the maximum number of requests in flight */
+        int getWindow() const;
+
+        /**
+         * Queues a command
+         *
+         * The command is marshalled right away, and written on the next
+         * call to run(). Nothing is queued if marshalling throws
+         * @param device_id The ID of the target device, cannot be broadcast
+         * @param command The command
+         * @return The index of the request, to be passed to get()
+         * @throws std::range_error if a parameter of the command is out of
+         *   range
+         */
+        template<typename Command>
+        int add(int device_id, Command const& command);
+
+        /** Removes all requests */
+        void clear();
+
+        /** Returns the number of requests */
+        int size() const;
+
+        /**
+         * Writes the queued requests and waits for all their replies
+         *
+         * Failures (NAKs, invalid replies, timeouts) are recorded per
+         * request and reported by get(). A read timeout fails all the
+         * requests that were in flight at the time. Use getError() or
+         * tryGet() to inspect failures without exceptions
+         */
+        void run();
+
+        /** Whether the given request has been executed successfully */
+        bool succeeded(int index) const;
+
+        /**
+         * Returns the decoded reply to a request
+         * @param index The index returned by add()
+         * @param command The command that was passed to add()
+         * @throws the error that made the request fail, if it failed
+         */
+        template<typename Command>
+        typename Command::Result get(int index, Command const& command) const;
+
+        /**
+         * Returns the error that made a request fail
+         * @return The error, whose code is Error::NONE if the request
+         *   succeeded or has not been executed yet
+         */
+        Error const& getError(int index) const;
+
+        /**
+         * Returns the decoded reply to a request, or the error that made it
+         * fail. Unlike get(), it does not throw if the request failed
+         * @param index The index returned by add()
+         * @param command The command that was passed to add()
+         */
+        template<typename Command>
+        Expected<typename Command::Result> tryGet(int index, Command const& command) const;
+
+        /**
+         * Returns the monotonic time at which a request was written, or a
+         * null time if it has not been
+         */
+        base::Time getWriteTime(int index) const;
+
+        /**
+         * Returns the monotonic time at which a request's reply was
+         * received, or its failure detected. It is null if the request has
+         * not been executed
+         */
+        base::Time getReplyTime(int index) const;
+
+    private:
+        struct Request
+        {
+            enum State { QUEUED, IN_FLIGHT, DONE, FAILED };
+
+            byte device_id;
+            byte opcode[2];
+            int expected_size;
+            StateCache::Setting setting;
+            unsigned invalidates;
+            int frame_offset;
+            int frame_size;
+            int reply_offset;
+            /** Number of bytes written up to the end of this request's
+             * frame, by the write that contained it */
+            int write_size;
+            /** Index of the decoded AS reply in statuses, or -1 */
+            int status_index;
+            State state;
+            base::Time write_time;
+            base::Time reply_time;
+            Error error;
+        };
+
+        Driver& driver;
+        int window;
+        std::vector<Request> requests;
+        /** The marshalled requests, in order */
+        std::vector<byte> frames;
+        /** The reply data, at each request's reply_offset */
+        std::vector<byte> replies;
+        /** The AS replies, decoded and timestamped when they were matched */
+        std::vector<PanTiltStatus> statuses;
+
+        int addRequest(int device_id, byte c0, byte c1, int frame_size, int expected_size,
+                StateCache::Setting setting, unsigned invalidates);
+        void updateSettings(Request const& request);
+        void decodeStatus(Request& request);
+        bool isInFlight(byte device_id, byte const* opcode) const;
+        int findInFlight(PacketView const& reply) const;
+        Request const& checkRequest(int index, byte c0, byte c1) const;
+
+        template<typename Command>
+        Expected<typename Command::Result> decodeReply(Request const& request, Command const& command) const;
+        Expected<PanTiltStatus> decodeReply(Request const& request, commands::GetPanTiltStatus const&) const;
+    };
+
+    template<typename Command>
+    int Pipeline::add(int device_id, Command const& command)
+    {
+        // Marshal first, so that an invalid command does not leave a
+        // half-written request behind
+        byte frame[Command::FRAME_SIZE];
+        commands::marshal(command, device_id, frame);
+        int index = addRequest(device_id, Command::OPCODE0, Command::OPCODE1,
+                Command::FRAME_SIZE, Command::RESPONSE_SIZE,
+                Command::SETTING, Command::INVALIDATES);
+        std::copy(frame, frame + Command::FRAME_SIZE, &frames[requests[index].frame_offset]);
+        return index;
+    }
+
+    template<typename Command>
+    typename Command::Result Pipeline::get(int index, Command const& command) const
+    {
+        return tryGet(index, command).get();
+    }
+
+    template<typename Command>
+    Expected<typename Command::Result> Pipeline::tryGet(int index, Command const& command) const
+    {
+        Request const& request = checkRequest(index, Command::OPCODE0, Command::OPCODE1);
+        if (request.state == Request::FAILED)
+            return request.error;
+        return decodeReply(request, command);
+    }
+
+    template<typename Command>
+    Expected<typename Command::Result> Pipeline::decodeReply(Request const& request, Command const& command) const
+    {
+        return commands::tryDecode(command, request.device_id, replies.data() + request.reply_offset);
+    }
+}
+
+#endif
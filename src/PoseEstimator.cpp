@@ -0,0 +1,246 @@
+#include <ptu_kongsberg_oe10/PoseEstimator.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+const float PoseEstimator::RESOLUTION = M_PI / 180;
+
+/** Number of published states. Readers retry if the one they read gets
+ * overwritten, which needs two updates during a single read */
+static const int PUBLISHED_STATES = 4;
+
+static double toSeconds(base::Time const& time)
+{
+    return time.toMicroseconds() * 1e-6;
+}
+
+void PoseEstimator::Axis::reset(float max_speed)
+{
+    this->max_speed = max_speed;
+    speed = numeric_limits<float>::quiet_NaN();
+    has_target = false;
+    target = 0;
+    anchor_time = base::Time();
+    anchor = 0;
+    anchor_uncertainty = 0;
+    velocity = 0;
+    velocity_error = 0;
+    has_previous = false;
+    previous = 0;
+    has_measurement = false;
+    measurement = 0;
+    has_observed_velocity = false;
+    observed_velocity = 0;
+}
+
+/**
+ * Anchor the model on a measurement, and update the observed velocity from
+ * the previous measurement
+ */
+void PoseEstimator::Axis::measure(base::Time const& time, float position, float speed, float noise)
+{
+    if (has_measurement && time > measurement_time)
+    {
+        observed_velocity = (position - measurement) / toSeconds(time - measurement_time);
+        has_observed_velocity = true;
+    }
+    has_measurement = true;
+    measurement_time = time;
+    measurement = position;
+
+    has_previous = anchor_time < time && !anchor_time.isNull();
+    previous_time = anchor_time;
+    previous = anchor;
+    anchor_time = time;
+    anchor = position;
+    // AS angles are rounded to whole degrees
+    anchor_uncertainty = RESOLUTION / 2;
+    // AS reports the speed the axis moves at, which is zero at rest and
+    // therefore says nothing about the speed setting
+    if (speed > 0)
+        this->speed = speed;
+    updateVelocity(noise);
+}
+
+/**
+ * Move the anchor to the predicted position at the time a command has been
+ * applied, so that the new velocity only applies from then on
+ */
+void PoseEstimator::Axis::rebase(base::Time const& time)
+{
+    if (!has_measurement || time <= anchor_time)
+        return;
+
+    float position, uncertainty;
+    predict(time, position, uncertainty);
+    has_previous = true;
+    previous_time = anchor_time;
+    previous = anchor;
+    anchor_time = time;
+    anchor = position;
+    anchor_uncertainty = uncertainty;
+}
+
+void PoseEstimator::Axis::updateVelocity(float noise)
+{
+    float error = 0;
+    if (has_target && !std::isnan(speed))
+    {
+        // The axis has arrived if its reported angle is the target rounded
+        // to the protocol's resolution
+        float distance = target - anchor;
+        if (std::abs(distance) <= RESOLUTION / 2)
+            velocity = 0;
+        else
+            velocity = (distance > 0 ? 1 : -1) * speed * max_speed;
+        if (has_observed_velocity)
+            error = std::abs(velocity - observed_velocity);
+    }
+    else if (has_observed_velocity)
+        velocity = observed_velocity;
+    else
+    {
+        // Nothing is known about the motion but its maximum speed
+        velocity = 0;
+        error = std::isnan(speed) ? max_speed : speed * max_speed;
+    }
+    velocity_error = max(noise, error);
+}
+
+void PoseEstimator::Axis::predict(base::Time const& time, float& position, float& uncertainty) const
+{
+    if (time >= anchor_time)
+    {
+        double dt = toSeconds(time - anchor_time);
+        position = anchor + velocity * dt;
+        if (has_target && ((velocity > 0 && position > target) || (velocity < 0 && position < target)))
+            position = target;
+        uncertainty = anchor_uncertainty + velocity_error * dt;
+    }
+    else if (has_previous && time >= previous_time)
+    {
+        double span = toSeconds(anchor_time - previous_time);
+        double ratio = toSeconds(time - previous_time) / span;
+        position = previous + (anchor - previous) * ratio;
+        uncertainty = anchor_uncertainty + velocity_error * min(ratio, 1 - ratio) * span;
+    }
+    else
+    {
+        base::Time oldest = has_previous ? previous_time : anchor_time;
+        position = has_previous ? previous : anchor;
+        uncertainty = anchor_uncertainty + velocity_error * toSeconds(oldest - time);
+    }
+}
+
+PoseEstimator::PoseEstimator(float pan_max_speed, float tilt_max_speed)
+    : velocityNoise(0.01 * max(pan_max_speed, tilt_max_speed))
+    , published(PUBLISHED_STATES)
+{
+    state.valid = false;
+    state.pan.reset(pan_max_speed);
+    state.tilt.reset(tilt_max_speed);
+    publish();
+}
+
+void PoseEstimator::setVelocityNoise(float noise)
+{
+    velocityNoise = noise;
+}
+
+float PoseEstimator::getVelocityNoise() const
+{
+    return velocityNoise;
+}
+
+void PoseEstimator::publish()
+{
+    published.push(state);
+}
+
+void PoseEstimator::update(PanTiltStatus const& status)
+{
+    state.pan.measure(status.time, status.pan, status.pan_speed, velocityNoise);
+    state.tilt.measure(status.time, status.tilt, status.tilt_speed, velocityNoise);
+    state.valid = true;
+    publish();
+}
+
+void PoseEstimator::setPanTarget(float target, base::Time const& time)
+{
+    state.pan.rebase(time);
+    state.pan.has_target = true;
+    state.pan.target = target;
+    state.pan.updateVelocity(velocityNoise);
+    publish();
+}
+
+void PoseEstimator::setTiltTarget(float target, base::Time const& time)
+{
+    state.tilt.rebase(time);
+    state.tilt.has_target = true;
+    state.tilt.target = target;
+    state.tilt.updateVelocity(velocityNoise);
+    publish();
+}
+
+void PoseEstimator::clearPanTarget(base::Time const& time)
+{
+    state.pan.rebase(time);
+    state.pan.has_target = false;
+    state.pan.updateVelocity(velocityNoise);
+    publish();
+}
+
+void PoseEstimator::clearTiltTarget(base::Time const& time)
+{
+    state.tilt.rebase(time);
+    state.tilt.has_target = false;
+    state.tilt.updateVelocity(velocityNoise);
+    publish();
+}
+
+void PoseEstimator::setPanSpeed(float speed, base::Time const& time)
+{
+    state.pan.rebase(time);
+    state.pan.speed = speed;
+    state.pan.updateVelocity(velocityNoise);
+    publish();
+}
+
+void PoseEstimator::setTiltSpeed(float speed, base::Time const& time)
+{
+    state.tilt.rebase(time);
+    state.tilt.speed = speed;
+    state.tilt.updateVelocity(velocityNoise);
+    publish();
+}
+
+void PoseEstimator::reset()
+{
+    state.valid = false;
+    state.pan.reset(state.pan.max_speed);
+    state.tilt.reset(state.tilt.max_speed);
+    publish();
+}
+
+PoseEstimate PoseEstimator::poseAt(base::Time const& time) const
+{
+    State snapshot;
+    published.readLatest(snapshot);
+
+    PoseEstimate estimate;
+    estimate.time = time;
+    estimate.valid = snapshot.valid;
+    if (!snapshot.valid)
+    {
+        estimate.pan = estimate.tilt = 0;
+        estimate.pan_uncertainty = estimate.tilt_uncertainty = numeric_limits<float>::infinity();
+        return estimate;
+    }
+    snapshot.pan.predict(time, estimate.pan, estimate.pan_uncertainty);
+    snapshot.tilt.predict(time, estimate.tilt, estimate.tilt_uncertainty);
+    return estimate;
+}
@@ -0,0 +1,164 @@
+#ifndef PTU_KONGSBERG_OE10_POSE_ESTIMATOR_HPP
+#define PTU_KONGSBERG_OE10_POSE_ESTIMATOR_HPP
+
+#include <ptu_kongsberg_oe10/PanTiltStatus.hpp>
+#include <ptu_kongsberg_oe10/SampleRing.hpp>
+
+namespace ptu_kongsberg_oe10
+{
+    /** Estimated pan and tilt at a given time */
+    struct PoseEstimate
+    {
+        /** The time the estimate is for, on the wall clock */
+        base::Time time;
+        /** Pan angle in radians */
+        float pan;
+        /** Tilt angle in radians */
+        float tilt;
+        /** Bound of the pan error, in radians */
+        float pan_uncertainty;
+        /** Bound of the tilt error, in radians */
+        float tilt_uncertainty;
+        /** False if no AS reply has been received yet, in which case the
+         * other fields are meaningless */
+        bool valid;
+    };
+
+    /**
+     * Estimates the pan and tilt of a device between AS polls
+     *
+     * The estimator is fed with the AS replies (update) and with the
+     * targets and speeds that have been commanded. Driver does it for the
+     * device given to Driver::setPoseEstimator. Each axis is then modelled
+     * as moving at constant speed from its last known position, either
+     * towards its commanded target at the commanded speed, or, if the
+     * target is unknown, at the speed observed between the last two AS
+     * replies.
+     *
+     * poseAt() interpolates between the last two anchors (AS replies or
+     * commands) and extrapolates after the last one. The uncertainty is
+     * the quantization error of the protocol's angles (half of RESOLUTION),
+     * plus the velocity error
+     * integrated over the time to the nearest anchor. The velocity error is
+     * the difference between the commanded and observed velocities, and
+     * at least getVelocityNoise().
+     *
+     * The estimator is updated from a single thread (the driver's), while
+     * poseAt() can be called from any number of threads. It does not lock
+     * nor allocate, and runs in constant time.
+     */
+    class PoseEstimator
+    {
+    public:
+        /** Resolution of the angles of the protocol (1 degree, as they are
+         * given in whole degrees), in radians */
+        static const float RESOLUTION;
+
+        /**
+         * @param pan_max_speed Pan speed at a speed setting of 1, in rad/s
+         * @param tilt_max_speed Tilt speed at a speed setting of 1, in rad/s
+         */
+        PoseEstimator(float pan_max_speed, float tilt_max_speed);
+
+        /**
+         * Sets the floor of the velocity error, in rad/s. It accounts for
+         * the accelerations the model ignores. Defaults to 1% of the
+         * largest max speed
+         */
+        void setVelocityNoise(float noise);
+
+        /** Returns the floor of the velocity error, in rad/s */
+        float getVelocityNoise() const;
+
+        /** Adds an AS reply, timestamped with its sampling time */
+        void update(PanTiltStatus const& status);
+
+        /** Records that a pan target has been commanded at the given time */
+        void setPanTarget(float target, base::Time const& time);
+
+        /** Records that a tilt target has been commanded at the given time */
+        void setTiltTarget(float target, base::Time const& time);
+
+        /** Records that the pan target is unknown from the given time on */
+        void clearPanTarget(base::Time const& time);
+
+        /** Records that the tilt target is unknown from the given time on,
+         * e.g. after TU, TD or TS */
+        void clearTiltTarget(base::Time const& time);
+
+        /** Records that a pan speed (as fraction of maximum) has been
+         * commanded at the given time */
+        void setPanSpeed(float speed, base::Time const& time);
+
+        /** Records that a tilt speed (as fraction of maximum) has been
+         * commanded at the given time */
+        void setTiltSpeed(float speed, base::Time const& time);
+
+        /** Forgets everything, e.g. when the device is reopened */
+        void reset();
+
+        /**
+         * Estimates the pose at a given time, on the wall clock
+         *
+         * It can be called from any thread
+         */
+        PoseEstimate poseAt(base::Time const& time) const;
+
+    private:
+        /** The model of an axis */
+        struct Axis
+        {
+            /** Maximum speed in rad/s */
+            float max_speed;
+            /** Speed setting as fraction of maximum, as last commanded or
+             * reported by AS while moving. NaN if unknown */
+            float speed;
+            bool has_target;
+            float target;
+
+            /** The position is anchor at anchor_time, known within
+             * anchor_uncertainty, and changes at velocity after that */
+            base::Time anchor_time;
+            float anchor;
+            float anchor_uncertainty;
+            float velocity;
+            float velocity_error;
+
+            /** The anchor before the current one, for interpolation */
+            bool has_previous;
+            base::Time previous_time;
+            float previous;
+
+            /** The last AS reading, to compute the observed velocity */
+            bool has_measurement;
+            base::Time measurement_time;
+            float measurement;
+            bool has_observed_velocity;
+            float observed_velocity;
+
+            void reset(float max_speed);
+            void measure(base::Time const& time, float position, float speed, float noise);
+            void rebase(base::Time const& time);
+            void updateVelocity(float noise);
+            void predict(base::Time const& time, float& position, float& uncertainty) const;
+        };
+
+        struct State
+        {
+            bool valid;
+            Axis pan;
+            Axis tilt;
+        };
+
+        /** Publishes the working state to the readers */
+        void publish();
+
+        float velocityNoise;
+        /** The state being updated, only accessed by the updating thread */
+        State state;
+        /** The published states. Readers only read the latest one */
+        SampleRing<State> published;
+    };
+}
+
+#endif
@@ -0,0 +1,286 @@
+#include <ptu_kongsberg_oe10/Prober.hpp>
+#include <base/Logging.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+static const int DEFAULT_BAUDRATES[] = { 9600, 19200, 38400, 57600, 115200 };
+
+/** Time it takes to transmit a number of bytes, with one start and one
+ * stop bit per byte */
+static base::Time getTransmissionTime(int bytes, int baudrate)
+{
+    return base::Time::fromMicroseconds(static_cast<boost::int64_t>(bytes) * 10 * 1000000 / baudrate);
+}
+
+ProbeResult::ProbeResult()
+    : found(false)
+    , baudrate(0)
+    , device_id(0)
+    , attempts(0)
+    , unresolved_baudrate(0)
+{
+}
+
+bool ProbeResult::ok() const
+{
+    return found;
+}
+
+Prober::Prober(Driver& driver)
+    : driver(driver)
+    , baudrates(DEFAULT_BAUDRATES, DEFAULT_BAUDRATES + sizeof(DEFAULT_BAUDRATES) / sizeof(int))
+    , preferredBaudRate(0)
+    , scanFirst(2)
+    , scanLast(Packet::BROADCAST - 1)
+    , initialTurnaround(base::Time::fromMilliseconds(20))
+    , maxTurnaround(base::Time::fromMilliseconds(200))
+    , deadline(base::Time::fromSeconds(2))
+{
+}
+
+void Prober::setBaudRates(vector<int> const& baudrates)
+{
+    for (size_t i = 0; i < baudrates.size(); ++i)
+    {
+        if (baudrates[i] <= 0)
+            throw std::invalid_argument("invalid baud rate " + lexical_cast<string>(baudrates[i]));
+    }
+    this->baudrates = baudrates;
+}
+
+vector<int> Prober::getBaudRates() const
+{
+    return baudrates;
+}
+
+void Prober::setPreferredBaudRate(int baudrate)
+{
+    preferredBaudRate = baudrate;
+}
+
+void Prober::setDeviceIDs(vector<int> const& ids)
+{
+    deviceIDs = ids;
+}
+
+void Prober::setScanRange(int first, int last)
+{
+    if (first <= Packet::CONTROLLER || last >= Packet::BROADCAST || last < first)
+    {
+        throw std::invalid_argument("invalid device ID scan range " + lexical_cast<string>(first) +
+                "-" + lexical_cast<string>(last));
+    }
+    scanFirst = first;
+    scanLast = last;
+}
+
+void Prober::setTurnaround(base::Time const& initial, base::Time const& max)
+{
+    if (max < initial)
+        throw std::invalid_argument("the maximum turnaround time is smaller than the initial one");
+    initialTurnaround = initial;
+    maxTurnaround = max;
+}
+
+void Prober::setDeadline(base::Time const& deadline)
+{
+    this->deadline = deadline;
+}
+
+base::Time Prober::getProbeTimeout(int baudrate, base::Time const& turnaround)
+{
+    return getTransmissionTime(commands::GetStatus::FRAME_SIZE +
+            commands::GetStatus::RESPONSE_FRAME_SIZE, baudrate) + turnaround;
+}
+
+/**
+ * All baud rates are equally likely a priori, so the expected time to find
+ * the right one is minimal when the cheapest probes come first
+ */
+vector<int> Prober::getProbeOrder() const
+{
+    vector<int> order = baudrates;
+    sort(order.begin(), order.end(), greater<int>());
+    vector<int>::iterator preferred = find(order.begin(), order.end(), preferredBaudRate);
+    if (preferred != order.end())
+        rotate(order.begin(), preferred, preferred + 1);
+    else if (preferredBaudRate > 0)
+        order.insert(order.begin(), preferredBaudRate);
+    return order;
+}
+
+ProbeResult Prober::probe(string const& port)
+{
+    if (baudrates.empty() && preferredBaudRate <= 0)
+        throw std::invalid_argument("no baud rate to probe");
+
+    ProbeResult result;
+    base::Time start = monotonicNow();
+    base::Time end = start + deadline;
+    base::Time readTimeout = driver.getReadTimeout();
+    vector<int> order = getProbeOrder();
+    base::Time turnaround = initialTurnaround;
+    if (driver.isValid())
+        driver.close();
+    try
+    {
+        while (!result.found && monotonicNow() < end)
+        {
+            for (size_t i = 0; i < order.size() && !result.found; ++i)
+            {
+                base::Time now = monotonicNow();
+                if (now >= end)
+                    break;
+
+                int baudrate = order[i];
+                string uri = "serial://" + port + ":" + lexical_cast<string>(baudrate);
+                if (!driver.isValid())
+                    driver.openURI(uri);
+                else
+                {
+                    // Much cheaper than reopening the port. The bytes
+                    // received at the previous baud rate are garbage
+                    if (!driver.setSerialBaudrate(baudrate))
+                        throw std::runtime_error("cannot set the baud rate of " + port + " to " + lexical_cast<string>(baudrate));
+                    driver.clear();
+                    driver.resetFraming();
+                }
+                base::Time timeout = min(getProbeTimeout(baudrate, turnaround), end - now);
+                if (probeBaudRate(baudrate, timeout, end, result))
+                {
+                    result.uri = uri;
+                    result.baudrate = baudrate;
+                    result.duration = monotonicNow() - start;
+                }
+            }
+            turnaround = min(turnaround * 2, maxTurnaround);
+        }
+    }
+    catch(...)
+    {
+        driver.setReadTimeout(readTimeout);
+        throw;
+    }
+
+    driver.setReadTimeout(readTimeout);
+    if (result.found)
+        result.unresolved_baudrate = 0;
+    else if (result.unresolved_baudrate)
+    {
+        LOG_WARN_S << "devices replied on " << port << " at " << result.unresolved_baudrate
+            << " bauds, but their replies collided and none of the IDs " << scanFirst << "-"
+            << scanLast << " answered before the deadline. Set the device IDs or the scan range";
+    }
+    else
+        LOG_WARN_S << "no device found on " << port << " after " << result.attempts << " probes";
+    if (!result.found)
+    {
+        if (driver.isValid())
+            driver.close();
+    }
+    return result;
+}
+
+/**
+ * Replies from the devices that share the line collide when they reply to a
+ * broadcast probe. Unless one of them gets through, the probe then only
+ * yields checksum errors, which are enough to know that the baud rate is the
+ * right one
+ */
+bool Prober::probeBaudRate(int baudrate, base::Time const& timeout,
+        base::Time const& deadline, ProbeResult& result)
+{
+    result.responders.clear();
+    if (!deviceIDs.empty())
+        return probeDevices(deviceIDs, baudrate, timeout, deadline, result);
+
+    boost::uint64_t checksumErrors = driver.statistics.checksum_errors;
+    if (probeOnce(Packet::BROADCAST, baudrate, timeout, result))
+        return true;
+    if (driver.statistics.checksum_errors == checksumErrors)
+        return false;
+
+    LOG_INFO_S << "replies to the broadcast probe got garbled at " << baudrate
+        << " bauds, probing the device IDs one at a time";
+    vector<int> ids;
+    for (int id = scanFirst; id <= scanLast; ++id)
+        ids.push_back(id);
+    if (probeDevices(ids, baudrate, timeout, deadline, result))
+        return true;
+    result.unresolved_baudrate = baudrate;
+    return false;
+}
+
+bool Prober::probeDevices(vector<int> const& ids, int baudrate,
+        base::Time const& timeout, base::Time const& deadline, ProbeResult& result)
+{
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        base::Time now = monotonicNow();
+        if (now >= deadline)
+            break;
+        if (probeOnce(ids[i], baudrate, min(timeout, deadline - now), result))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Once a device has replied to a broadcast probe, the probe only waits for
+ * the replies of the other devices that are already being transmitted, so
+ * that they do not get mistaken for the reply to the next command
+ */
+bool Prober::probeOnce(int device_id, int baudrate, base::Time const& timeout, ProbeResult& result)
+{
+    static byte const opcode[2] = { commands::GetStatus::OPCODE0, commands::GetStatus::OPCODE1 };
+
+    ++result.attempts;
+    driver.writeCommand(device_id, commands::GetStatus());
+    base::Time end = monotonicNow() + timeout;
+    while (true)
+    {
+        base::Time now = monotonicNow();
+        if (now >= end)
+            break;
+
+        driver.setReadTimeout(end - now);
+        PacketView reply;
+        try { reply = driver.readPacket(); }
+        catch(iodrivers_base::TimeoutError const&)
+        {
+            break;
+        }
+
+        PacketView data;
+        Error error = driver.checkResponse(reply, device_id, opcode, 2,
+                commands::GetStatus::RESPONSE_SIZE, driver.lastWriteStartTime, data);
+        if (error)
+        {
+            LOG_DEBUG_S << "ignoring invalid probe reply: " << error.toString();
+            continue;
+        }
+        Expected<Status> status = commands::tryDecode(commands::GetStatus(), reply.from, data.data);
+        if (!status)
+            continue;
+
+        driver.cacheStatus(reply.from, *status);
+        result.responders.push_back(reply.from);
+        if (result.found)
+            continue;
+
+        result.found = true;
+        result.device_id = reply.from;
+        result.status = *status;
+        if (device_id != Packet::BROADCAST)
+            break;
+        end = min(end, monotonicNow() +
+                getTransmissionTime(commands::GetStatus::RESPONSE_FRAME_SIZE, baudrate) +
+                initialTurnaround);
+    }
+    return result.found;
+}
@@ -0,0 +1,160 @@
+#ifndef PTU_KONGSBERG_OE10_PROBER_HPP
+#define PTU_KONGSBERG_OE10_PROBER_HPP
+
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <string>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /** Outcome of Prober::probe */
+    struct ProbeResult
+    {
+        /** Whether a device has been found */
+        bool found;
+        /** The URI the driver has been opened with */
+        std::string uri;
+        /** The baud rate the device replied at */
+        int baudrate;
+        /** The ID of the selected device */
+        int device_id;
+        /** The IDs of the devices that replied to the last probe, in reply
+         * order. Only a broadcast probe gets replies from several devices */
+        std::vector<int> responders;
+        /** The ST reply of the selected device */
+        Status status;
+        /** Number of probes that have been sent */
+        int attempts;
+        /** Time from the start of probe() to the selection of the device */
+        base::Time duration;
+        /** If no device has been found, the baud rate at which devices
+         * garbled each other's replies to a broadcast probe, but could not
+         * be told apart by the ID scan. 0 otherwise */
+        int unresolved_baudrate;
+
+        ProbeResult();
+
+        /** Whether a device has been found */
+        bool ok() const;
+    };
+
+    /**
+     * Finds the baud rate and ID of the devices on a serial line
+     *
+     * Each probe is an ST request: it has no payload, and its reply is the
+     * smallest one that carries the device's capabilities. If accepted
+     * device IDs are given, they are probed one at a time, in order of
+     * preference. Otherwise, a single probe is sent to the broadcast
+     * address. The devices on a multi-drop line reply to it at the same
+     * time, though, so that their replies usually get garbled. Checksum
+     * errors are therefore taken as a sign that devices are listening at
+     * that baud rate, which is then scanned one device ID at a time (see
+     * setScanRange).
+     *
+     * A probe waits for the time it takes to transmit the request and its
+     * reply at the probed baud rate, plus a turnaround time that starts
+     * short and doubles after each round of failed probes. The baud rates
+     * are tried in order of increasing probe time, i.e. fastest first,
+     * except for the preferred one (e.g. the last known good) which is
+     * tried first. Probing stops at the first reply, or when the deadline
+     * is reached.
+     *
+     * The port is opened once, and its baud rate changed between probes.
+     * On success, the driver is left open at the found baud rate, with the
+     * capabilities and environment of the devices that replied in its
+     * cache. It is closed otherwise. The driver's read timeout is restored
+     * in both cases.
+     */
+    class Prober
+    {
+    public:
+        /**
+         * @param driver The driver to probe with. It must outlive the prober
+         */
+        explicit Prober(Driver& driver);
+
+        /** Sets the candidate baud rates. Defaults to 9600 to 115200 */
+        void setBaudRates(std::vector<int> const& baudrates);
+
+        /** Returns the candidate baud rates */
+        std::vector<int> getBaudRates() const;
+
+        /**
+         * Sets a baud rate that is tried before the others, e.g. the one
+         * that worked the last time. Set to 0 (the default) to disable
+         */
+        void setPreferredBaudRate(int baudrate);
+
+        /**
+         * Sets the accepted device IDs, in order of preference. They are
+         * probed one at a time, and the first one that replies is selected.
+         * All IDs are accepted if the list is empty, which is the default.
+         * Setting them is recommended on multi-drop lines, whose devices
+         * garble each other's replies to broadcast probes
+         */
+        void setDeviceIDs(std::vector<int> const& ids);
+
+        /**
+         * Sets the range of device IDs that are probed one at a time when
+         * the replies to a broadcast probe collide, and no device IDs have
+         * been set. A probe takes about 40 ms at 19200 bauds, so that the
+         * default range of 2 to 254 takes about 10 s, well past the default
+         * deadline: narrow it down to the IDs in use, or raise the deadline
+         * @throws std::invalid_argument if the range is empty, or includes
+         *   the controller or broadcast IDs
+         */
+        void setScanRange(int first, int last);
+
+        /**
+         * Sets the range of the time the device takes to reply on top of
+         * the transmission times. Probes start with the initial value,
+         * which doubles after each round up to the maximum. Defaults to 20
+         * and 200 ms
+         */
+        void setTurnaround(base::Time const& initial, base::Time const& max);
+
+        /** Sets the maximum duration of probe(). Defaults to 2 seconds */
+        void setDeadline(base::Time const& deadline);
+
+        /** Returns the order in which the baud rates are tried */
+        std::vector<int> getProbeOrder() const;
+
+        /** Returns the time a probe waits for at a given baud rate and
+         * turnaround time */
+        static base::Time getProbeTimeout(int baudrate, base::Time const& turnaround);
+
+        /**
+         * Probes a serial port
+         * @param port The serial port, e.g. /dev/ttyUSB0
+         * @throws std::invalid_argument if there is no candidate baud rate
+         */
+        ProbeResult probe(std::string const& port);
+
+    private:
+        /** Probes the devices at the baud rate the driver is open at */
+        bool probeBaudRate(int baudrate, base::Time const& timeout,
+                base::Time const& deadline, ProbeResult& result);
+
+        /** Probes device IDs one at a time, until one replies or the
+         * deadline is reached */
+        bool probeDevices(std::vector<int> const& ids, int baudrate,
+                base::Time const& timeout, base::Time const& deadline,
+                ProbeResult& result);
+
+        /** Sends one probe and collects the replies */
+        bool probeOnce(int device_id, int baudrate, base::Time const& timeout,
+                ProbeResult& result);
+
+        Driver& driver;
+        std::vector<int> baudrates;
+        int preferredBaudRate;
+        std::vector<int> deviceIDs;
+        int scanFirst;
+        int scanLast;
+        base::Time initialTurnaround;
+        base::Time maxTurnaround;
+        base::Time deadline;
+    };
+}
+
+#endif
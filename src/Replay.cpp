@@ -0,0 +1,261 @@
+// Replays a capture file through the whole driver stack
+//
+// The commands found in the recorded TX frames are issued again through
+// Driver (or Pipeline, for the frames that were written together), while
+// a ReplayStream gives back the recorded replies and checks that the
+// driver writes the same bytes as in the recording. This can be used to
+// reproduce field issues and to benchmark the decoding of real traffic.
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <ptu_kongsberg_oe10/FrameParser.hpp>
+#include <ptu_kongsberg_oe10/Pipeline.hpp>
+#include <ptu_kongsberg_oe10/ReplayStream.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+using namespace std;
+using boost::lexical_cast;
+using namespace ptu_kongsberg_oe10;
+
+static int usage(string const& argv0)
+{
+    cerr
+        << "usage: " << argv0 << " [--realtime] [--repeat N] FILE\n"
+        << "  replays the commands recorded in a capture file through the\n"
+        << "  driver, checking that it writes the recorded bytes, and reports\n"
+        << "  the decoding throughput and errors\n"
+        << "\n"
+        << "  --realtime\n"
+        << "      plays the replies back at the recorded timing instead of\n"
+        << "      as fast as possible\n"
+        << "  --repeat N\n"
+        << "      replays the capture N times\n"
+        << endl;
+    return -1;
+}
+
+/** Error raised when the capture holds a command that cannot be replayed */
+struct UnsupportedCommand : public std::runtime_error
+{
+    explicit UnsupportedCommand(PacketView const& request)
+        : std::runtime_error("unsupported command " + request.getCommandAsString() + " in capture") {}
+};
+
+/** Executes a command right away */
+struct Execute
+{
+    Driver& driver;
+    int device_id;
+
+    template<typename Command>
+    void operator()(Command const& command)
+    {
+        driver.execute(device_id, command);
+    }
+};
+
+/** Adds a command to a pipeline */
+struct Queue
+{
+    Pipeline& pipeline;
+    int device_id;
+
+    template<typename Command>
+    void operator()(Command const& command)
+    {
+        pipeline.add(device_id, command);
+    }
+};
+
+/**
+ * Builds the command a request frame encodes and passes it to f
+ * @return false if the command is not known
+ */
+template<typename F>
+static bool dispatch(PacketView const& request, F& f)
+{
+    if (request.command_size != 2)
+        return false;
+
+    string opcode(reinterpret_cast<char const*>(request.command), 2);
+    byte const* data = request.data;
+    if (opcode == "ST")
+        f(commands::GetStatus());
+    else if (opcode == "AS")
+        f(commands::GetPanTiltStatus());
+    else if (opcode == "ES")
+        f(commands::UseEndStops(data[0] == '1'));
+    else if (opcode == "CW")
+        f(commands::SetPanPositiveEndStop());
+    else if (opcode == "AW")
+        f(commands::SetPanNegativeEndStop());
+    else if (opcode == "UT")
+        f(commands::SetTiltPositiveEndStop());
+    else if (opcode == "DT")
+        f(commands::SetTiltNegativeEndStop());
+    else if (opcode == "PP")
+        f(commands::SetPanPosition(Packet::parseAngle(data)));
+    else if (opcode == "TP")
+        f(commands::SetTiltPosition(Packet::parseAngle(data)));
+    else if (opcode == "DS")
+        f(commands::SetPanSpeed(static_cast<float>(data[0]) / 0x64));
+    else if (opcode == "TA")
+        f(commands::SetTiltSpeed(static_cast<float>(data[0]) / 0x64));
+    else if (opcode == "TU")
+        f(commands::TiltUp());
+    else if (opcode == "TD")
+        f(commands::TiltDown());
+    else if (opcode == "TS")
+        f(commands::TiltStop());
+    else
+        return false;
+    return true;
+}
+
+struct ReplayStatistics
+{
+    long commands;
+    long errors;
+    long timeouts;
+
+    ReplayStatistics()
+        : commands(0), errors(0), timeouts(0) {}
+};
+
+/** Splits a TX record into the frames it contains */
+static vector<PacketView> splitFrames(TraceRecord const& record)
+{
+    vector<PacketView> frames;
+    FrameParser parser;
+    int offset = 0;
+    while (offset < record.size)
+    {
+        int result = parser.extract(record.data + offset, record.size - offset);
+        if (result == 0)
+            break;
+        else if (result < 0)
+            offset += -result;
+        else
+        {
+            frames.push_back(PacketView::parse(record.data + offset, result, false));
+            offset += result;
+        }
+    }
+    return frames;
+}
+
+static void replayRecord(Driver& driver, TraceRecord const& record, ReplayStatistics& stats)
+{
+    vector<PacketView> frames = splitFrames(record);
+    if (frames.size() == 1)
+    {
+        Execute execute = { driver, frames[0].to };
+        try
+        {
+            if (!dispatch(frames[0], execute))
+                throw UnsupportedCommand(frames[0]);
+        }
+        catch(iodrivers_base::TimeoutError const&) { ++stats.timeouts; }
+        catch(ReplayMismatch const&) { throw; }
+        catch(UnsupportedCommand const&) { throw; }
+        catch(std::runtime_error const&) { ++stats.errors; }
+        ++stats.commands;
+        return;
+    }
+
+    Pipeline pipeline(driver, max<int>(1, frames.size()));
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        Queue queue = { pipeline, frames[i].to };
+        if (!dispatch(frames[i], queue))
+            throw UnsupportedCommand(frames[i]);
+    }
+    pipeline.run();
+    for (int i = 0; i < pipeline.size(); ++i)
+    {
+        if (!pipeline.succeeded(i))
+            ++stats.errors;
+    }
+    stats.commands += pipeline.size();
+}
+
+int main(int argc, char** argv)
+{
+    bool realtime = false;
+    int repeat = 1;
+    string path;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--realtime")
+            realtime = true;
+        else if (arg == "--repeat" && i + 1 < argc)
+        {
+            try { repeat = lexical_cast<int>(argv[++i]); }
+            catch(boost::bad_lexical_cast const&) { return usage(argv[0]); }
+        }
+        else if (path.empty() && !arg.empty() && arg[0] != '-')
+            path = arg;
+        else
+            return usage(argv[0]);
+    }
+    if (path.empty())
+        return usage(argv[0]);
+
+    // Load the TX records that drive the replay
+    ifstream file(path.c_str(), ios::binary);
+    vector<char> contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    byte const* buffer = reinterpret_cast<byte const*>(contents.data());
+    vector<TraceRecord> requests;
+    try
+    {
+        int offset = Trace::parseFileHeader(buffer, contents.size());
+        TraceRecord record;
+        while (int used = Trace::parseRecord(buffer + offset, contents.size() - offset, record))
+        {
+            if (record.direction == TraceRecord::TX)
+                requests.push_back(record);
+            offset += used;
+        }
+    }
+    catch(std::runtime_error const& e)
+    {
+        cerr << path << ": " << e.what() << endl;
+        return 1;
+    }
+
+    Driver driver;
+    ReplayStatistics stats;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    try
+    {
+        for (int i = 0; i < repeat; ++i)
+        {
+            driver.openURI("replay://" + path + (realtime ? ":realtime" : ":fast"));
+            for (size_t r = 0; r < requests.size(); ++r)
+                replayRecord(driver, requests[r], stats);
+        }
+    }
+    catch(std::runtime_error const& e)
+    {
+        cerr << "replay failed after " << stats.commands << " commands: " << e.what() << endl;
+        return 1;
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    DriverStatistics driverStats = driver.getStatistics();
+    cout
+        << "Commands: " << stats.commands << "\n"
+        << "Errors: " << stats.errors << "\n"
+        << "Timeouts: " << stats.timeouts << "\n"
+        << "NAKs: " << driverStats.naks << "\n"
+        << "Checksum errors: " << driverStats.checksum_errors << "\n"
+        << "Resyncs: " << driverStats.resyncs << "\n"
+        << "Skipped bytes: " << driverStats.skipped_bytes << "\n"
+        << "Elapsed: " << elapsed << " s\n"
+        << "Rate: " << (elapsed > 0 ? stats.commands / elapsed : 0) << " commands/s" << endl;
+    return 0;
+}
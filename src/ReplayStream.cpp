@@ -0,0 +1,213 @@
+#include <ptu_kongsberg_oe10/ReplayStream.hpp>
+#include <ptu_kongsberg_oe10/Clock.hpp>
+#include <iodrivers_base/Exceptions.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+ReplayStream::ReplayStream(string const& path, Mode mode)
+    : mode(mode)
+    , fd(-1)
+    , begin(0)
+    , end(0)
+    , mappedSize(0)
+    , written(0)
+    , readCount(0)
+{
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw std::runtime_error("cannot open " + path + ": " + strerror(errno));
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(Trace::FILE_MAGIC)))
+    {
+        ::close(fd);
+        throw std::runtime_error(path + " is not a ptu_kongsberg_oe10 capture file");
+    }
+    mappedSize = info.st_size;
+    void* mapped = mmap(0, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("cannot map " + path + ": " + strerror(error));
+    }
+    begin = static_cast<byte const*>(mapped);
+    end = begin + mappedSize;
+
+    int headerSize;
+    try { headerSize = Trace::parseFileHeader(begin, mappedSize); }
+    catch(std::runtime_error const&)
+    {
+        munmap(const_cast<byte*>(begin), mappedSize);
+        ::close(fd);
+        throw;
+    }
+
+    txCursor.next = rxCursor.next = begin + headerSize;
+    advance(txCursor, true);
+    advance(rxCursor, false);
+
+    // Received records that precede the first write are timed from the
+    // beginning of the replay
+    TraceRecord first;
+    if (Trace::parseRecord(begin + headerSize, mappedSize - headerSize, first))
+        lastTxRecordTime = first.time;
+    lastTxTime = monotonicNow();
+}
+
+ReplayStream::~ReplayStream()
+{
+    munmap(const_cast<byte*>(begin), mappedSize);
+    ::close(fd);
+}
+
+/**
+ * Move a cursor to the next record of the given direction. A truncated
+ * record at the end of the file, e.g. when the recorder has been killed, is
+ * treated as the end of the capture
+ */
+void ReplayStream::advance(Cursor& cursor, bool tx)
+{
+    cursor.offset = 0;
+    while (cursor.next < end)
+    {
+        byte const* position = cursor.next;
+        int used = Trace::parseRecord(position, end - position, cursor.record);
+        if (used == 0)
+            break;
+        cursor.next += used;
+        if ((cursor.record.direction == TraceRecord::TX) == tx)
+        {
+            cursor.position = position;
+            return;
+        }
+    }
+    cursor.next = cursor.position = end;
+}
+
+base::Time ReplayStream::getArrivalTime() const
+{
+    base::Time delay = rxCursor.record.time - lastTxRecordTime;
+    if (delay.toMicroseconds() < 0)
+        return lastTxTime;
+    return lastTxTime + delay;
+}
+
+bool ReplayStream::isReadable(base::Time const& now) const
+{
+    if (rxCursor.position == end || rxCursor.position > txCursor.position)
+        return false;
+    return mode == FAST || getArrivalTime() <= now;
+}
+
+void ReplayStream::waitRead(base::Time const& timeout)
+{
+    base::Time now = monotonicNow();
+    if (isReadable(now))
+        return;
+
+    if (mode == REALTIME)
+    {
+        bool pending = rxCursor.position != end && rxCursor.position < txCursor.position;
+        base::Time wait = pending ? getArrivalTime() - now : timeout;
+        if (wait < timeout)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(wait.toMicroseconds()));
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(timeout.toMicroseconds()));
+    }
+    throw iodrivers_base::TimeoutError(iodrivers_base::TimeoutError::NONE,
+            "waitRead(): no more recorded data before the next write");
+}
+
+/** Writes are only compared to the recording, they never block */
+void ReplayStream::waitWrite(base::Time const&)
+{
+}
+
+size_t ReplayStream::read(boost::uint8_t* buffer, size_t buffer_size)
+{
+    base::Time now = monotonicNow();
+    size_t count = 0;
+    while (count < buffer_size && isReadable(now))
+    {
+        int available = rxCursor.record.size - rxCursor.offset;
+        int chunk = std::min<size_t>(available, buffer_size - count);
+        memcpy(buffer + count, rxCursor.record.data + rxCursor.offset, chunk);
+        count += chunk;
+        rxCursor.offset += chunk;
+        if (rxCursor.offset == rxCursor.record.size)
+            advance(rxCursor, false);
+    }
+    readCount += count;
+    return count;
+}
+
+size_t ReplayStream::write(boost::uint8_t const* buffer, size_t buffer_size)
+{
+    for (size_t i = 0; i < buffer_size; ++i)
+    {
+        if (txCursor.position == end)
+            throw ReplayMismatch("driver wrote " + Packet::kongsberg_com(buffer + i, buffer_size - i) +
+                    " past the end of the recording");
+
+        TraceRecord const& record = txCursor.record;
+        if (record.data[txCursor.offset] != buffer[i])
+        {
+            throw ReplayMismatch("driver wrote " + Packet::kongsberg_com(buffer, buffer_size) +
+                    " but the recording has " + Packet::kongsberg_com(record.data, record.size) +
+                    " (mismatch at byte " + lexical_cast<string>(txCursor.offset) +
+                    " of the record at offset " + lexical_cast<string>(txCursor.position - begin) +
+                    " in the capture)");
+        }
+
+        if (++txCursor.offset == record.size)
+        {
+            lastTxRecordTime = record.time;
+            lastTxTime = monotonicNow();
+            advance(txCursor, true);
+        }
+    }
+    written += buffer_size;
+    return buffer_size;
+}
+
+/**
+ * Drop the received bytes that are currently available
+ */
+void ReplayStream::clear()
+{
+    base::Time now = monotonicNow();
+    while (isReadable(now))
+    {
+        readCount += rxCursor.record.size - rxCursor.offset;
+        advance(rxCursor, false);
+    }
+}
+
+bool ReplayStream::isFinished() const
+{
+    return txCursor.position == end && rxCursor.position == end;
+}
+
+boost::uint64_t ReplayStream::getWrittenCount() const
+{
+    return written;
+}
+
+boost::uint64_t ReplayStream::getReadCount() const
+{
+    return readCount;
+}
@@ -0,0 +1,106 @@
+#ifndef PTU_KONGSBERG_OE10_REPLAY_STREAM_HPP
+#define PTU_KONGSBERG_OE10_REPLAY_STREAM_HPP
+
+#include <ptu_kongsberg_oe10/Trace.hpp>
+#include <iodrivers_base/IOStream.hpp>
+#include <stdexcept>
+#include <string>
+
+namespace ptu_kongsberg_oe10
+{
+    /** Exception thrown when the driver writes bytes that differ from the
+     * recorded ones */
+    struct ReplayMismatch : public std::runtime_error
+    {
+        explicit ReplayMismatch(std::string const& msg)
+            : std::runtime_error(msg) {}
+    };
+
+    /**
+     * Stream that plays back a capture file saved from a Trace
+     *
+     * The recorded received bytes (RX and RX_DISCARDED records) are given
+     * back to the driver, and the bytes the driver writes are checked
+     * against the recorded TX records. A received record only becomes
+     * readable once all the TX records that precede it in the capture have
+     * been written, so that replies never arrive before their request.
+     *
+     * In FAST mode, the received bytes are available as soon as this
+     * condition is met, and waiting for bytes that the capture does not have
+     * times out immediately. In REALTIME mode, received bytes arrive with
+     * the delay that separated them from the last write in the recording,
+     * and waits last as long as the driver's timeouts.
+     *
+     * The file is memory-mapped. The stream is normally created through
+     * Driver::openURI("replay://PATH") or "replay://PATH:realtime"
+     */
+    class ReplayStream : public iodrivers_base::IOStream
+    {
+    public:
+        enum Mode
+        {
+            FAST,
+            REALTIME
+        };
+
+        /**
+         * Maps a capture file
+         * @throws std::runtime_error if the file cannot be opened or is not
+         *   a capture
+         */
+        explicit ReplayStream(std::string const& path, Mode mode = FAST);
+        ~ReplayStream();
+
+        void waitRead(base::Time const& timeout);
+        void waitWrite(base::Time const& timeout);
+        size_t read(boost::uint8_t* buffer, size_t buffer_size);
+        size_t write(boost::uint8_t const* buffer, size_t buffer_size);
+        void clear();
+
+        /** Returns true once all the recorded bytes have been read and
+         * written */
+        bool isFinished() const;
+
+        /** Returns the number of recorded TX bytes that have been written */
+        boost::uint64_t getWrittenCount() const;
+
+        /** Returns the number of recorded RX bytes that have been read */
+        boost::uint64_t getReadCount() const;
+
+    private:
+        /** Position in the records of one direction */
+        struct Cursor
+        {
+            /** Start of the next record to parse */
+            byte const* next;
+            /** Start of the current record in the file, end of the file if
+             * there are no more records */
+            byte const* position;
+            /** The current record */
+            TraceRecord record;
+            /** Number of bytes of the current record already consumed */
+            int offset;
+        };
+
+        void advance(Cursor& cursor, bool tx);
+        bool isReadable(base::Time const& now) const;
+        base::Time getArrivalTime() const;
+
+        Mode mode;
+        int fd;
+        byte const* begin;
+        byte const* end;
+        size_t mappedSize;
+
+        Cursor txCursor;
+        Cursor rxCursor;
+        /** Recorded time of the last TX record that has been written */
+        base::Time lastTxRecordTime;
+        /** Monotonic time at which it has been written */
+        base::Time lastTxTime;
+        boost::uint64_t written;
+        boost::uint64_t readCount;
+    };
+}
+
+#endif
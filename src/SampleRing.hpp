@@ -0,0 +1,204 @@
+#ifndef PTU_KONGSBERG_OE10_SAMPLE_RING_HPP
+#define PTU_KONGSBERG_OE10_SAMPLE_RING_HPP
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <boost/cstdint.hpp>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Preallocated, lock-free, single-producer multiple-consumer ring of
+     * samples
+     *
+     * The producer never blocks: when the ring is full, the oldest sample is
+     * overwritten. Each consumer reads at its own pace through a Reader,
+     * which reports how many samples got overwritten before it could read
+     * them.
+     *
+     * Each slot is protected by a sequence number (seqlock), so T must be
+     * trivially copyable.
+     */
+    template<typename T>
+    class SampleRing
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "SampleRing requires trivially copyable samples");
+
+        struct Slot
+        {
+            /** 2 * (index + 1) when the slot holds sample 'index', odd while
+             * it is being written */
+            std::atomic<boost::uint64_t> sequence;
+            T value;
+        };
+
+        std::unique_ptr<Slot[]> slots;
+        boost::uint64_t mask;
+        std::atomic<boost::uint64_t> count;
+
+    public:
+        /** Result of reading a given sample */
+        enum ReadStatus
+        {
+            /** The sample has been read */
+            READ_OK,
+            /** The sample has not been written yet */
+            READ_NOT_YET,
+            /** The sample has been overwritten by a newer one */
+            READ_OVERWRITTEN
+        };
+
+        /**
+         * Creates the ring
+         * @param capacity Number of samples, rounded up to a power of two
+         */
+        explicit SampleRing(size_t capacity)
+            : count(0)
+        {
+            if (capacity == 0)
+                throw std::invalid_argument("SampleRing capacity must be strictly positive");
+
+            size_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            slots.reset(new Slot[size]);
+            for (size_t i = 0; i < size; ++i)
+                slots[i].sequence.store(0, std::memory_order_relaxed);
+            mask = size - 1;
+        }
+
+        /** Returns the number of samples the ring can hold */
+        size_t getCapacity() const { return mask + 1; }
+
+        /** Returns the number of samples that have been pushed so far */
+        boost::uint64_t getCount() const { return count.load(std::memory_order_acquire); }
+
+        /**
+         * Adds a sample, overwriting the oldest one if the ring is full
+         *
+         * Must only be called from a single thread
+         */
+        void push(T const& value)
+        {
+            boost::uint64_t index = count.load(std::memory_order_relaxed);
+            Slot& slot = slots[index & mask];
+            slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.value = value;
+            slot.sequence.store(2 * index + 2, std::memory_order_release);
+            count.store(index + 1, std::memory_order_release);
+        }
+
+        /**
+         * Reads the sample with the given index, i.e. the index-th sample
+         * ever pushed
+         */
+        ReadStatus read(boost::uint64_t index, T& value) const
+        {
+            Slot const& slot = slots[index & mask];
+            boost::uint64_t expected = 2 * index + 2;
+            boost::uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            if (before != expected)
+                return (before < expected) ? READ_NOT_YET : READ_OVERWRITTEN;
+
+            value = slot.value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            boost::uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+            return (after == before) ? READ_OK : READ_OVERWRITTEN;
+        }
+
+        /**
+         * Reads the most recent sample
+         * @return false if no sample has been pushed yet
+         */
+        bool readLatest(T& value) const
+        {
+            while (true)
+            {
+                boost::uint64_t current = getCount();
+                if (current == 0)
+                    return false;
+                if (read(current - 1, value) == READ_OK)
+                    return true;
+            }
+        }
+
+        /**
+         * Consumer-side cursor in a ring
+         *
+         * Each consumer thread should use its own reader
+         */
+        class Reader
+        {
+            SampleRing const& ring;
+            boost::uint64_t next;
+            boost::uint64_t lost;
+
+        public:
+            /** Creates a reader that starts with the next pushed sample */
+            explicit Reader(SampleRing const& ring)
+                : ring(ring)
+                , next(ring.getCount())
+                , lost(0) {}
+
+            /**
+             * Creates a reader that starts with the given sample index
+             *
+             * Samples that have already been overwritten are skipped and
+             * counted in getLostCount() on the first read
+             */
+            Reader(SampleRing const& ring, boost::uint64_t start)
+                : ring(ring)
+                , next(start)
+                , lost(0) {}
+
+            /**
+             * Reads the oldest sample this reader has not read yet
+             *
+             * If samples have been overwritten since the last call, they are
+             * skipped and counted in getLostCount()
+             * @return false if there is no new sample
+             */
+            bool read(T& value)
+            {
+                while (true)
+                {
+                    switch (ring.read(next, value))
+                    {
+                        case READ_OK:
+                            ++next;
+                            return true;
+                        case READ_NOT_YET:
+                            return false;
+                        case READ_OVERWRITTEN:
+                        {
+                            // Skip to the oldest sample that is still
+                            // available, keeping a margin of one slot for the
+                            // sample being written
+                            boost::uint64_t current = ring.getCount();
+                            boost::uint64_t oldest = current - ring.getCapacity() + 1;
+                            if (oldest > next)
+                            {
+                                lost += oldest - next;
+                                next = oldest;
+                            }
+                            else
+                            {
+                                ++lost;
+                                ++next;
+                            }
+                        }
+                    }
+                }
+            }
+
+            /** Number of samples that have been overwritten before this
+             * reader could read them */
+            boost::uint64_t getLostCount() const { return lost; }
+        };
+    };
+}
+
+#endif
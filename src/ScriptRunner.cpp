@@ -0,0 +1,265 @@
+#include <ptu_kongsberg_oe10/ScriptRunner.hpp>
+#include <ptu_kongsberg_oe10/Clock.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <iomanip>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+ScriptResult::ScriptResult()
+    : commands(0)
+    , failures(0)
+    , batches(0)
+{
+}
+
+bool ScriptResult::ok() const
+{
+    return failures == 0;
+}
+
+ScriptRunner::ScriptRunner(Driver& driver)
+    : driver(driver)
+    , interpreter(driver)
+    , window(Pipeline::DEFAULT_WINDOW)
+{
+}
+
+void ScriptRunner::setWindow(int window)
+{
+    if (window < 1)
+        throw std::invalid_argument("the pipeline window must be at least 1");
+    this->window = window;
+}
+
+int ScriptRunner::getWindow() const
+{
+    return window;
+}
+
+/** Converts a monotonic time to the wall clock */
+static base::Time toWallTime(base::Time const& monotonic)
+{
+    return base::Time::now() - (monotonicNow() - monotonic);
+}
+
+/** Sleeps until a monotonic time */
+static void sleepUntil(base::Time const& deadline)
+{
+    base::Time now = monotonicNow();
+    if (deadline > now)
+        std::this_thread::sleep_for(std::chrono::microseconds((deadline - now).toMicroseconds()));
+}
+
+vector<ScriptRunner::Step> ScriptRunner::parse(istream& script)
+{
+    vector<Step> steps;
+    string line;
+    for (int lineNumber = 1; getline(script, line); ++lineNumber)
+    {
+        string::size_type comment = line.find('#');
+        if (comment != string::npos)
+            line.erase(comment);
+        vector<string> args = CommandInterpreter::split(line);
+        if (args.empty())
+            continue;
+
+        Step step;
+        step.line = lineNumber;
+        step.timing = Step::IMMEDIATE;
+        step.window = 0;
+        string const prefix = "line " + lexical_cast<string>(lineNumber) + ": ";
+        try
+        {
+            if (args[0] == "window")
+            {
+                if (args.size() != 2 || (step.window = lexical_cast<int>(args[1])) < 1)
+                    throw UsageError("window expects a number of requests of at least 1");
+            }
+            else
+            {
+                if (args[0][0] == '@' || args[0][0] == '+')
+                {
+                    step.timing = args[0][0] == '@' ? Step::AT : Step::AFTER;
+                    double seconds = lexical_cast<double>(args[0].substr(1));
+                    if (seconds < 0)
+                        throw UsageError("negative time " + args[0]);
+                    step.delay = base::Time::fromSeconds(seconds);
+                    args.erase(args.begin());
+                }
+                step.command = CommandInterpreter::parse(args);
+            }
+        }
+        catch(boost::bad_lexical_cast const&)
+        {
+            throw UsageError(prefix + "invalid number in " + line);
+        }
+        catch(UsageError const& e)
+        {
+            throw UsageError(prefix + e.what());
+        }
+
+        for (size_t i = 0; i < args.size(); ++i)
+            step.text += (i == 0 ? "" : " ") + args[i];
+        steps.push_back(step);
+    }
+    return steps;
+}
+
+/**
+ * Broadcast requests cannot be pipelined, and invalid moves are left to
+ * Driver::move to report
+ */
+bool ScriptRunner::isPipelinable(Step const& step)
+{
+    CommandLine const& command = step.command;
+    if (step.window || command.device_id == Packet::BROADCAST)
+        return false;
+    if (command.name == "status")
+        return true;
+    return (command.name == "pan" || command.name == "tilt" || command.name == "move") &&
+        (base::isUnset(command.pan) || commands::SetPanPosition(command.pan).isValid()) &&
+        (base::isUnset(command.tilt) || commands::SetTiltPosition(command.tilt).isValid()) &&
+        (base::isUnset(command.pan_speed) || commands::SetPanSpeed(command.pan_speed).isValid()) &&
+        (base::isUnset(command.tilt_speed) || commands::SetTiltSpeed(command.tilt_speed).isValid());
+}
+
+ScriptResult ScriptRunner::run(istream& script, ostream& out)
+{
+    vector<Step> steps = parse(script);
+
+    ScriptResult result;
+    int window = this->window;
+    base::Time start = monotonicNow();
+    base::Time lastReply = start;
+    size_t i = 0;
+    while (i < steps.size())
+    {
+        Step const& step = steps[i];
+        if (step.window)
+        {
+            window = step.window;
+            ++i;
+            continue;
+        }
+
+        if (step.timing == Step::AT)
+            sleepUntil(start + step.delay);
+        else if (step.timing == Step::AFTER)
+            sleepUntil(lastReply + step.delay);
+
+        size_t end = i + 1;
+        if (window > 1 && isPipelinable(step))
+        {
+            while (end < steps.size() && steps[end].timing == Step::IMMEDIATE &&
+                    isPipelinable(steps[end]))
+                ++end;
+        }
+
+        if (end - i > 1)
+        {
+            result.failures += runBatch(steps, i, end, window, out);
+            ++result.batches;
+        }
+        else if (!runSingle(step, out))
+            ++result.failures;
+        result.commands += end - i;
+        lastReply = monotonicNow();
+        i = end;
+    }
+    result.duration = monotonicNow() - start;
+    return result;
+}
+
+bool ScriptRunner::runSingle(Step const& step, ostream& out)
+{
+    ostringstream output;
+    string error;
+    base::Time write_time = monotonicNow();
+    try { interpreter.execute(step.command, output); }
+    catch(std::exception const& e)
+    {
+        error = e.what();
+    }
+    report(out, step, write_time, monotonicNow(), error, output.str());
+    return error.empty();
+}
+
+int ScriptRunner::runBatch(vector<Step> const& steps, size_t begin, size_t end,
+        int window, ostream& out)
+{
+    // Requests of each step, in the order Driver::move writes them
+    Pipeline pipeline(driver, window);
+    vector< vector<int> > indexes(end - begin);
+    for (size_t i = begin; i < end; ++i)
+    {
+        CommandLine const& command = steps[i].command;
+        vector<int>& requests = indexes[i - begin];
+        int id = command.device_id;
+        if (command.name == "status")
+            requests.push_back(pipeline.add(id, commands::GetPanTiltStatus()));
+        if (!base::isUnset(command.pan_speed))
+            requests.push_back(pipeline.add(id, commands::SetPanSpeed(command.pan_speed)));
+        if (!base::isUnset(command.tilt_speed))
+            requests.push_back(pipeline.add(id, commands::SetTiltSpeed(command.tilt_speed)));
+        if (!base::isUnset(command.pan))
+            requests.push_back(pipeline.add(id, commands::SetPanPosition(command.pan)));
+        if (!base::isUnset(command.tilt))
+            requests.push_back(pipeline.add(id, commands::SetTiltPosition(command.tilt)));
+    }
+    pipeline.run();
+
+    int failures = 0;
+    for (size_t i = begin; i < end; ++i)
+    {
+        vector<int> const& requests = indexes[i - begin];
+        base::Time write_time = pipeline.getWriteTime(requests.front());
+        base::Time reply_time = pipeline.getReplyTime(requests.front());
+        string error;
+        for (size_t r = 0; r < requests.size(); ++r)
+        {
+            write_time = min(write_time, pipeline.getWriteTime(requests[r]));
+            reply_time = max(reply_time, pipeline.getReplyTime(requests[r]));
+            if (error.empty() && !pipeline.succeeded(requests[r]))
+                error = pipeline.getError(requests[r]).toString();
+        }
+
+        ostringstream output;
+        if (error.empty() && steps[i].command.name == "status")
+        {
+            CommandInterpreter::printStatus(output,
+                    pipeline.get(requests.front(), commands::GetPanTiltStatus()));
+        }
+        if (!error.empty())
+            ++failures;
+        report(out, steps[i], write_time, reply_time, error, output.str());
+    }
+    return failures;
+}
+
+void ScriptRunner::report(ostream& out, Step const& step,
+        base::Time const& write_time, base::Time const& reply_time,
+        string const& error, string const& output)
+{
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    out << fixed << setprecision(6) << toWallTime(write_time).toSeconds() << " "
+        << setprecision(3) << (reply_time - write_time).toSeconds() * 1000 << " ms "
+        << (error.empty() ? "ok " : "error ") << step.line << ": " << step.text << "\n";
+    out.flags(flags);
+    out.precision(precision);
+
+    if (!error.empty())
+        out << "  " << error << "\n";
+    istringstream lines(output);
+    string line;
+    while (getline(lines, line))
+        out << "  " << line << "\n";
+    out << flush;
+}
@@ -0,0 +1,131 @@
+#ifndef PTU_KONGSBERG_OE10_SCRIPT_RUNNER_HPP
+#define PTU_KONGSBERG_OE10_SCRIPT_RUNNER_HPP
+
+#include <ptu_kongsberg_oe10/CommandInterpreter.hpp>
+#include <ptu_kongsberg_oe10/Pipeline.hpp>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /** Outcome of ScriptRunner::run */
+    struct ScriptResult
+    {
+        /** Number of commands that have been executed */
+        int commands;
+        /** Number of commands that failed */
+        int failures;
+        /** Number of pipelined batches */
+        int batches;
+        /** Time from the start of the script to the last reply */
+        base::Time duration;
+
+        ScriptResult();
+
+        /** Whether all commands succeeded */
+        bool ok() const;
+    };
+
+    /**
+     * Executes a script of CommandInterpreter commands over one connection
+     *
+     * A script has one command line per line, optionally prefixed by its
+     * timing:
+     *
+     * <code>
+     * # calibration sequence
+     * 2 move 0 90 1
+     * @2.5 2 status      # 2.5 seconds after the start of the script
+     * +0.1 2 pan 180 0.5 # 0.1 seconds after the previous reply
+     * window 1           # disables pipelining from here on
+     * </code>
+     *
+     * Consecutive status, pan, tilt and move commands without timing are
+     * pipelined (see Pipeline), the first one included. They are written
+     * back to back and their replies matched as they come, in up to
+     * "window N" requests in flight (Pipeline::DEFAULT_WINDOW by default).
+     * Since a device processes its requests in order, the result is the
+     * same as if they had been executed one at a time. The other commands
+     * (info, or broadcast commands) are executed one at a time.
+     *
+     * Each command is reported with the host time at which it was written,
+     * its latency (from the write of its first request to the reply to its
+     * last one) and its outcome, followed by its output, indented:
+     *
+     * <code>
+     * 1718000000.123456 12.345 ms ok 3: 2 status
+     *   Status
+     *   ...
+     * </code>
+     *
+     * The whole script is read and validated before anything is sent.
+     */
+    class ScriptRunner
+    {
+    public:
+        /**
+         * @param driver The driver, which must be open and outlive the
+         *   runner
+         */
+        explicit ScriptRunner(Driver& driver);
+
+        /**
+         * Sets the initial pipeline window. The script can change it with
+         * the window directive. A window of 1 disables pipelining
+         */
+        void setWindow(int window);
+
+        /** Returns the initial pipeline window */
+        int getWindow() const;
+
+        /**
+         * Executes a script
+         * @param script The script
+         * @param out The stream the report is written to
+         * @throws UsageError if a line of the script is invalid. Nothing has
+         *   been sent then
+         */
+        ScriptResult run(std::istream& script, std::ostream& out);
+
+    private:
+        struct Step
+        {
+            enum Timing { IMMEDIATE, AT, AFTER };
+
+            /** Line number in the script */
+            int line;
+            /** The command line, without the timing */
+            std::string text;
+            Timing timing;
+            base::Time delay;
+            /** If non-zero, the step is a window directive */
+            int window;
+            CommandLine command;
+        };
+
+        /** Parses a script, throwing UsageError on invalid lines */
+        static std::vector<Step> parse(std::istream& script);
+
+        /** Whether a step can be executed in a Pipeline */
+        static bool isPipelinable(Step const& step);
+
+        /** Executes a single step with the CommandInterpreter */
+        bool runSingle(Step const& step, std::ostream& out);
+
+        /** Executes pipelinable steps in a single Pipeline */
+        int runBatch(std::vector<Step> const& steps, size_t begin, size_t end,
+                int window, std::ostream& out);
+
+        /** Writes the report of a step */
+        static void report(std::ostream& out, Step const& step,
+                base::Time const& write_time, base::Time const& reply_time,
+                std::string const& error, std::string const& output);
+
+        Driver& driver;
+        CommandInterpreter interpreter;
+        int window;
+    };
+}
+
+#endif
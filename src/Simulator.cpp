@@ -0,0 +1,525 @@
+#include <ptu_kongsberg_oe10/Simulator.hpp>
+#include <ptu_kongsberg_oe10/Clock.hpp>
+#include <ptu_kongsberg_oe10/FrameParser.hpp>
+#include <base/Logging.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+/** NAK error bit for commands that the device does not know */
+static const byte NAK_COMMAND_NOT_RECOGNIZED = 0x10;
+/** NAK error bit for commands that are not available on this device */
+static const byte NAK_COMMAND_NOT_AVAILABLE = 0x08;
+
+SimulatedDevice::SimulatedDevice(byte id)
+    : id(id)
+    , has_tilt(true)
+    , pan(0)
+    , tilt(0)
+    , pan_target(0)
+    , tilt_target(0)
+    , pan_speed(0.5)
+    , tilt_speed(0.5)
+    , pan_current_speed(0)
+    , tilt_current_speed(0)
+    , tilt_direction(0)
+    , use_end_stops(false)
+    , pan_min(0)
+    , pan_max(360)
+    , tilt_min(0)
+    , tilt_max(360)
+{
+}
+
+Simulator::Simulator()
+    : maxSpeed(20)
+    , baudrate(0)
+    , collisions(false)
+    , master(-1)
+    , slave(-1)
+    , quit(false)
+{
+}
+
+Simulator::~Simulator()
+{
+    stop();
+}
+
+void Simulator::addDevice(int id, bool has_tilt)
+{
+    lock_guard<std::mutex> lock(mutex);
+    if (id == Packet::CONTROLLER || id == Packet::BROADCAST)
+        throw std::invalid_argument("cannot simulate a device with ID " + lexical_cast<string>(id));
+    for (size_t i = 0; i < devices.size(); ++i)
+    {
+        if (devices[i].id == id)
+            throw std::invalid_argument("device " + lexical_cast<string>(id) + " is already simulated");
+    }
+    devices.push_back(SimulatedDevice(id));
+    devices.back().has_tilt = has_tilt;
+}
+
+SimulatedDevice Simulator::getDevice(int id) const
+{
+    lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < devices.size(); ++i)
+    {
+        if (devices[i].id == id)
+            return devices[i];
+    }
+    throw std::invalid_argument("device " + lexical_cast<string>(id) + " is not simulated");
+}
+
+void Simulator::setMaxSpeed(double degrees_per_second)
+{
+    lock_guard<std::mutex> lock(mutex);
+    maxSpeed = degrees_per_second;
+}
+
+void Simulator::setBaudrate(int baudrate)
+{
+    lock_guard<std::mutex> lock(mutex);
+    this->baudrate = baudrate;
+}
+
+void Simulator::setProcessingLatency(base::Time const& latency)
+{
+    lock_guard<std::mutex> lock(mutex);
+    processingLatency = latency;
+}
+
+void Simulator::setCollisions(bool enable)
+{
+    lock_guard<std::mutex> lock(mutex);
+    collisions = enable;
+}
+
+std::string Simulator::getDevicePath() const
+{
+    return devicePath;
+}
+
+/**
+ * Create the pseudo-terminal and start the thread that serves its master
+ * side. The slave side is kept open as well, so that reading the master
+ * does not fail with EIO while no client is connected
+ */
+std::string Simulator::start()
+{
+    stop();
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1)
+        throw std::runtime_error(string("cannot create pseudo-terminal: ") + strerror(errno));
+    if (grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        int error = errno;
+        ::close(master);
+        master = -1;
+        throw std::runtime_error(string("cannot unlock pseudo-terminal: ") + strerror(error));
+    }
+    devicePath = ptsname(master);
+
+    slave = ::open(devicePath.c_str(), O_RDWR | O_NOCTTY);
+    if (slave == -1)
+    {
+        int error = errno;
+        ::close(master);
+        master = -1;
+        throw std::runtime_error("cannot open " + devicePath + ": " + strerror(error));
+    }
+    termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    lastUpdate = monotonicNow();
+    quit = false;
+    thread = std::thread(&Simulator::run, this);
+    return devicePath;
+}
+
+void Simulator::stop()
+{
+    if (thread.joinable())
+    {
+        quit = true;
+        thread.join();
+    }
+    if (slave != -1)
+        ::close(slave);
+    if (master != -1)
+        ::close(master);
+    slave = master = -1;
+    devicePath.clear();
+}
+
+SimulatedDevice* Simulator::findDevice(int id)
+{
+    for (size_t i = 0; i < devices.size(); ++i)
+    {
+        if (devices[i].id == id)
+            return &devices[i];
+    }
+    return 0;
+}
+
+/** Move an axis towards its target, and return the distance covered */
+static double moveTowards(double& position, double target, double step)
+{
+    double delta = target - position;
+    if (fabs(delta) <= step)
+    {
+        position = target;
+        return fabs(delta);
+    }
+    position += delta > 0 ? step : -step;
+    return step;
+}
+
+/**
+ * Update the axis positions to the given time
+ */
+void Simulator::advance(base::Time const& time)
+{
+    double dt = (time - lastUpdate).toSeconds();
+    lastUpdate = time;
+    if (dt <= 0)
+        return;
+
+    for (size_t i = 0; i < devices.size(); ++i)
+    {
+        SimulatedDevice& device = devices[i];
+
+        double panStep = device.pan_speed * maxSpeed * dt;
+        double moved = moveTowards(device.pan, device.pan_target, panStep);
+        device.pan_current_speed = moved > 0 ? device.pan_speed : 0;
+
+        if (device.tilt_direction != 0)
+        {
+            double limit;
+            if (device.tilt_direction > 0)
+                limit = device.use_end_stops ? device.tilt_max : 360;
+            else
+                limit = device.use_end_stops ? device.tilt_min : 0;
+            device.tilt_target = limit;
+        }
+        double tiltStep = device.tilt_speed * maxSpeed * dt;
+        moved = moveTowards(device.tilt, device.tilt_target, tiltStep);
+        device.tilt_current_speed = moved > 0 ? device.tilt_speed : 0;
+        if (device.tilt == device.tilt_target)
+            device.tilt_direction = 0;
+    }
+}
+
+/** Encode an angle in degrees, rounded to the protocol's 1 degree resolution */
+static void encodeDegrees(byte* buffer, double degrees)
+{
+    int value = std::min(360.0, std::max(0.0, round(degrees)));
+    buffer[0] = '0' + value / 100;
+    buffer[1] = '0' + (value / 10) % 10;
+    buffer[2] = '0' + value % 10;
+}
+
+/** Clamp a position target to the end stops, if they are in use */
+static double clampTarget(double target, double min, double max, bool use_end_stops)
+{
+    if (use_end_stops)
+        return std::min(max, std::max(min, target));
+    return std::min(360.0, std::max(0.0, target));
+}
+
+bool Simulator::process(PacketView const& request, Packet& reply)
+{
+    SimulatedDevice* device = findDevice(request.to);
+    if (!device)
+        return false;
+
+    reply = Packet(request.from, device->id);
+    reply.setCommand(Packet::ACK);
+    std::copy(request.command, request.command + request.command_size, reply.data);
+    reply.data_size = request.command_size;
+    byte* data = reply.data + reply.data_size;
+
+    string command(reinterpret_cast<char const*>(request.command), request.command_size);
+    bool isTiltCommand = command == "TP" || command == "TA" || command == "TU" ||
+        command == "TD" || command == "TS" || command == "UT" || command == "DT";
+    int payload = 0;
+    float angle;
+    if (isTiltCommand && !device->has_tilt)
+    {
+        reply.setCommand(Packet::NAK);
+        data[0] = NAK_COMMAND_NOT_AVAILABLE;
+        payload = 1;
+    }
+    else if (command == "ST" && request.data_size == 0)
+    {
+        // Pan and tilt are available, 20C and 40% humidity
+        data[0] = device->has_tilt ? 0x18 : 0x08;
+        data[1] = 0;
+        data[2] = 0x65;
+        encodeDegrees(data + 3, device->pan);
+        encodeDegrees(data + 6, device->tilt);
+        payload = 9;
+    }
+    else if (command == "AS" && request.data_size == 0)
+    {
+        data[0] = round(device->pan_current_speed * 0x64);
+        data[1] = round(device->tilt_current_speed * 0x64);
+        encodeDegrees(data + 2, device->pan);
+        encodeDegrees(data + 5, device->tilt);
+        data[8] = device->use_end_stops ? '1' : '0';
+        data[9] = device->use_end_stops ? '1' : '0';
+        payload = 10;
+    }
+    else if ((command == "PP" || command == "TP") && request.data_size == 3 &&
+            Packet::tryParseAngle(request.data, angle))
+    {
+        double target = angle * 180 / M_PI;
+        if (command == "PP")
+        {
+            device->pan_target = clampTarget(target,
+                    device->pan_min, device->pan_max, device->use_end_stops);
+        }
+        else
+        {
+            device->tilt_direction = 0;
+            device->tilt_target = clampTarget(target,
+                    device->tilt_min, device->tilt_max, device->use_end_stops);
+        }
+        std::copy(request.data, request.data + 3, data);
+        payload = 3;
+    }
+    else if ((command == "DS" || command == "TA") && request.data_size == 1 && request.data[0] <= 0x64)
+    {
+        double speed = static_cast<double>(request.data[0]) / 0x64;
+        if (command == "DS")
+            device->pan_speed = speed;
+        else
+            device->tilt_speed = speed;
+    }
+    else if ((command == "TU" || command == "TD" || command == "TS") && request.data_size == 0)
+    {
+        if (command == "TU")
+            device->tilt_direction = 1;
+        else if (command == "TD")
+            device->tilt_direction = -1;
+        else
+        {
+            device->tilt_direction = 0;
+            device->tilt_target = device->tilt;
+        }
+        encodeDegrees(data, device->tilt);
+        payload = 3;
+    }
+    else if (command == "ES" && request.data_size == 1 &&
+            (request.data[0] == '0' || request.data[0] == '1'))
+    {
+        device->use_end_stops = (request.data[0] == '1');
+        data[0] = request.data[0];
+        payload = 1;
+    }
+    else if ((command == "CW" || command == "AW" || command == "UT" || command == "DT") &&
+            request.data_size == 0)
+    {
+        if (command == "CW")
+            device->pan_max = device->pan;
+        else if (command == "AW")
+            device->pan_min = device->pan;
+        else if (command == "UT")
+            device->tilt_max = device->tilt;
+        else
+            device->tilt_min = device->tilt;
+    }
+    else
+    {
+        reply.setCommand(Packet::NAK);
+        data[0] = NAK_COMMAND_NOT_RECOGNIZED;
+        payload = 1;
+    }
+
+    reply.data_size += payload;
+    return true;
+}
+
+/**
+ * Process a request received on the pseudo-terminal and send the replies.
+ * Requests sent to the broadcast address are answered by all the simulated
+ * units, in sequence. If collisions are emulated and several units reply,
+ * the checksum byte of each reply is corrupted
+ */
+void Simulator::handleRequest(PacketView const& request, int request_size)
+{
+    base::Time received = monotonicNow();
+
+    vector< vector<byte> > replies;
+    base::Time requestTime, latency;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        advance(received);
+        vector<int> targets;
+        if (request.to == Packet::BROADCAST)
+        {
+            for (size_t i = 0; i < devices.size(); ++i)
+                targets.push_back(devices[i].id);
+        }
+        else
+            targets.push_back(request.to);
+
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            PacketView addressed = request;
+            addressed.to = targets[i];
+            Packet reply;
+            if (!process(addressed, reply))
+                continue;
+            replies.push_back(vector<byte>());
+            reply.marshal(replies.back());
+        }
+
+        if (collisions && replies.size() > 1)
+        {
+            // The frame ends with ":checksum:indicator>". Flip a bit of the
+            // checksum byte, making sure not to create a frame delimiter
+            for (size_t i = 0; i < replies.size(); ++i)
+            {
+                byte& checksum = replies[i][replies[i].size() - 4];
+                byte corrupted = checksum ^ 0x01;
+                if (corrupted == '<' || corrupted == '>')
+                    corrupted = checksum ^ 0x02;
+                checksum = corrupted;
+            }
+        }
+
+        if (baudrate > 0)
+            requestTime = base::Time::fromMicroseconds(request_size * 10000000LL / baudrate);
+        latency = processingLatency;
+    }
+
+    // The request reached us instantly, account for its transmission time
+    // before the reply starts
+    base::Time start = received + requestTime + latency;
+    for (size_t i = 0; i < replies.size(); ++i)
+        writeReply(&replies[i][0], replies[i].size(), start);
+}
+
+static void sleepUntil(base::Time const& deadline)
+{
+    base::Time delay = deadline - monotonicNow();
+    if (delay.toMicroseconds() > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(delay.toMicroseconds()));
+}
+
+static void writeAll(int fd, byte const* buffer, int size)
+{
+    while (size > 0)
+    {
+        int written = ::write(fd, buffer, size);
+        if (written < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            throw std::runtime_error(string("failed to write to the pseudo-terminal: ") + strerror(errno));
+        }
+        buffer += written;
+        size -= written;
+    }
+}
+
+/**
+ * Write a reply so that its first and last bytes are received when they
+ * would be on a serial line at the emulated baud rate
+ */
+void Simulator::writeReply(byte const* buffer, int size, base::Time const& start)
+{
+    int baud;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        baud = baudrate;
+    }
+
+    sleepUntil(start);
+    if (baud <= 0 || size == 1)
+    {
+        writeAll(master, buffer, size);
+        return;
+    }
+
+    writeAll(master, buffer, 1);
+    sleepUntil(start + base::Time::fromMicroseconds((size - 1) * 10000000LL / baud));
+    writeAll(master, buffer + 1, size - 1);
+}
+
+/**
+ * Read the requests from the pseudo-terminal, and keep the axes moving
+ * between requests
+ */
+void Simulator::run()
+{
+    vector<byte> received;
+    byte buffer[Packet::MAX_PACKET_SIZE];
+    FrameParser parser;
+    while (!quit)
+    {
+        pollfd fd = { master, POLLIN, 0 };
+        int result = poll(&fd, 1, 10);
+        if (result < 0 && errno != EINTR)
+        {
+            LOG_ERROR_S << "simulator: failed to poll the pseudo-terminal: " << strerror(errno);
+            return;
+        }
+
+        if (result > 0 && (fd.revents & POLLIN))
+        {
+            int count = ::read(master, buffer, sizeof(buffer));
+            if (count > 0)
+                received.insert(received.end(), buffer, buffer + count);
+        }
+
+        while (!received.empty())
+        {
+            int size = parser.extract(&received[0], received.size());
+
+            if (size == 0)
+                break;
+            else if (size < 0)
+            {
+                received.erase(received.begin(), received.begin() + std::min<int>(-size, received.size()));
+                continue;
+            }
+
+            PacketView request;
+            try { request = PacketView::parse(&received[0], size); }
+            catch(std::runtime_error const& e)
+            {
+                LOG_WARN_S << "simulator: ignoring invalid request: " << e.what();
+                received.erase(received.begin(), received.begin() + size);
+                continue;
+            }
+
+            try { handleRequest(request, size); }
+            catch(std::runtime_error const& e)
+            {
+                LOG_ERROR_S << "simulator: " << e.what();
+                return;
+            }
+            received.erase(received.begin(), received.begin() + size);
+        }
+
+        lock_guard<std::mutex> lock(mutex);
+        advance(monotonicNow());
+    }
+}
@@ -0,0 +1,140 @@
+#ifndef PTU_KONGSBERG_OE10_SIMULATOR_HPP
+#define PTU_KONGSBERG_OE10_SIMULATOR_HPP
+
+#include <ptu_kongsberg_oe10/Packet.hpp>
+#include <base/Time.hpp>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /** State of a simulated OE10 unit */
+    struct SimulatedDevice
+    {
+        /** The device ID */
+        byte id;
+        /** Whether the unit has a tilt axis. Pan-only units NAK the tilt
+         * commands */
+        bool has_tilt;
+        /** Current pan and tilt positions, in degrees */
+        double pan, tilt;
+        /** Position targets of the pan and tilt axes, in degrees */
+        double pan_target, tilt_target;
+        /** Commanded speeds, as fractions of the maximum speed */
+        double pan_speed, tilt_speed;
+        /** Current speeds, as fractions of the maximum speed */
+        double pan_current_speed, tilt_current_speed;
+        /** Direction of a TU/TD movement (1 for up, -1 for down, 0 when
+         * the tilt axis is under position control) */
+        int tilt_direction;
+        /** Whether the soft end stops are used */
+        bool use_end_stops;
+        /** Soft end stops, in degrees */
+        double pan_min, pan_max, tilt_min, tilt_max;
+
+        explicit SimulatedDevice(byte id = 2);
+    };
+
+    /**
+     * Simulator of one or several OE10 units sharing a serial line
+     *
+     * The simulator creates a pseudo-terminal, whose slave side can be
+     * opened with Driver::openURI("serial://" + getDevicePath() + ":19200").
+     * It implements the ST, AS, PP, TP, DS, TA, TU, TD, TS, ES, CW, AW, UT
+     * and DT commands, and moves the axes at the commanded speed.
+     *
+     * Optionally, it emulates the transmission delays at a given baud rate
+     * and a processing latency in the device.
+     */
+    class Simulator
+    {
+    public:
+        Simulator();
+
+        /** Stops the simulation thread and closes the pseudo-terminal */
+        ~Simulator();
+
+        /**
+         * Adds a simulated unit with the given device ID
+         * @param has_tilt false to simulate a pan-only unit
+         */
+        void addDevice(int id, bool has_tilt = true);
+
+        /** Returns a copy of the state of a simulated unit */
+        SimulatedDevice getDevice(int id) const;
+
+        /**
+         * Sets the speed of the axes at a commanded speed of 1, in degrees
+         * per second. Defaults to 20
+         */
+        void setMaxSpeed(double degrees_per_second);
+
+        /**
+         * Sets the baud rate whose transmission delays should be emulated,
+         * 0 (the default) to disable the emulation
+         */
+        void setBaudrate(int baudrate);
+
+        /** Sets the time the device takes to process a command */
+        void setProcessingLatency(base::Time const& latency);
+
+        /**
+         * Sets whether the replies of several units to a broadcast request
+         * collide, as they do on a real multi-drop line. Colliding replies
+         * are sent with a corrupted checksum byte, so that they fail the
+         * checksum check without creating a false frame delimiter.
+         * Disabled by default, in which case the units reply in sequence
+         */
+        void setCollisions(bool enable);
+
+        /**
+         * Creates the pseudo-terminal and starts the simulation thread
+         * @return The path of the serial device to connect to
+         */
+        std::string start();
+
+        /** Stops the simulation thread and closes the pseudo-terminal */
+        void stop();
+
+        /** Returns the path of the serial device, once started */
+        std::string getDevicePath() const;
+
+        /**
+         * Processes a request and builds the reply of the addressed unit
+         *
+         * This is the protocol implementation, independent of the
+         * pseudo-terminal
+         * @param request A view of the request
+         * @param reply The reply to send
+         * @return true if the unit replies, false if the request is not for
+         *   a simulated unit
+         */
+        bool process(PacketView const& request, Packet& reply);
+
+    private:
+        void run();
+        void advance(base::Time const& time);
+        void handleRequest(PacketView const& request, int request_size);
+        void writeReply(byte const* buffer, int size, base::Time const& start);
+        SimulatedDevice* findDevice(int id);
+
+        mutable std::mutex mutex;
+        std::vector<SimulatedDevice> devices;
+        base::Time lastUpdate;
+        double maxSpeed;
+        int baudrate;
+        base::Time processingLatency;
+        bool collisions;
+
+        int master;
+        int slave;
+        std::string devicePath;
+        std::thread thread;
+        std::atomic<bool> quit;
+    };
+}
+
+#endif
@@ -0,0 +1,91 @@
+// Simulator of OE10 units on a pseudo-terminal
+//
+// The simulator prints the path of the serial device it created, which can
+// then be given to ptu_kongsberg_oe10_bin or to Driver::openURI
+#include <ptu_kongsberg_oe10/Simulator.hpp>
+#include <boost/lexical_cast.hpp>
+#include <csignal>
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+using boost::lexical_cast;
+using namespace ptu_kongsberg_oe10;
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int)
+{
+    interrupted = 1;
+}
+
+static int usage(string const& argv0)
+{
+    cerr
+        << "usage: " << argv0 << " [OPTIONS] DEVICE_ID [DEVICE_ID...]\n"
+        << "  simulates OE10 units with the given device IDs on a\n"
+        << "  pseudo-terminal, until interrupted\n"
+        << "\n"
+        << "  the following options are recognized:\n"
+        << "\n"
+        << "  --baud RATE\n"
+        << "      emulates the transmission delays of a serial line at\n"
+        << "      this baud rate. Defaults to none\n"
+        << "  --latency MS\n"
+        << "      time the devices take to process a command, in\n"
+        << "      milliseconds. Defaults to 0\n"
+        << "  --max-speed DEG_PER_S\n"
+        << "      speed of the axes at the maximum commanded speed, in\n"
+        << "      degrees per second. Defaults to 20\n"
+        << endl;
+    return -1;
+}
+
+int main(int argc, char** argv)
+{
+    Simulator simulator;
+    int deviceCount = 0;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            string arg = argv[i];
+            if (arg == "--baud" && i + 1 < argc)
+                simulator.setBaudrate(lexical_cast<int>(argv[++i]));
+            else if (arg == "--latency" && i + 1 < argc)
+                simulator.setProcessingLatency(base::Time::fromMilliseconds(lexical_cast<int>(argv[++i])));
+            else if (arg == "--max-speed" && i + 1 < argc)
+                simulator.setMaxSpeed(lexical_cast<double>(argv[++i]));
+            else if (!arg.empty() && arg[0] == '-')
+                return usage(argv[0]);
+            else
+            {
+                int id;
+                if (arg.size() > 2 && arg.substr(0, 2) == "0x")
+                    id = stoi(arg, 0, 16);
+                else
+                    id = lexical_cast<int>(arg);
+                simulator.addDevice(id);
+                ++deviceCount;
+            }
+        }
+    }
+    catch(boost::bad_lexical_cast const&) { return usage(argv[0]); }
+    catch(std::invalid_argument const& e)
+    {
+        cerr << e.what() << endl;
+        return usage(argv[0]);
+    }
+    if (deviceCount == 0)
+        return usage(argv[0]);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    string path = simulator.start();
+    cout << path << endl;
+    while (!interrupted)
+        usleep(100000);
+    simulator.stop();
+    return 0;
+}
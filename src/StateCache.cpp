@@ -0,0 +1,61 @@
+#include <ptu_kongsberg_oe10/StateCache.hpp>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+StateCache::StateCache()
+{
+    clear();
+}
+
+bool StateCache::matches(byte device_id, Setting setting, byte const* payload, int size) const
+{
+    if (setting >= SETTING_COUNT || size > MAX_PAYLOAD_SIZE)
+        return false;
+    Entry const& entry = entries[device_id][setting];
+    return entry.valid && memcmp(entry.payload, payload, size) == 0;
+}
+
+void StateCache::update(byte device_id, Setting setting, byte const* payload, int size)
+{
+    if (device_id == Packet::BROADCAST)
+        return clear();
+    else if (setting >= SETTING_COUNT)
+        return;
+    else if (size > MAX_PAYLOAD_SIZE)
+        return invalidate(device_id, bit(setting));
+
+    Entry& entry = entries[device_id][setting];
+    entry.valid = true;
+    copy(payload, payload + size, entry.payload);
+}
+
+void StateCache::invalidate(byte device_id, unsigned mask)
+{
+    byte first = device_id, last = device_id;
+    if (device_id == Packet::BROADCAST)
+    {
+        first = 0;
+        last = 255;
+    }
+    for (int id = first; id <= last; ++id)
+    {
+        for (int i = 0; i < SETTING_COUNT; ++i)
+        {
+            if (mask & bit(static_cast<Setting>(i)))
+                entries[id][i].valid = false;
+        }
+    }
+}
+
+void StateCache::invalidate(byte device_id)
+{
+    invalidate(device_id, ~0u);
+}
+
+void StateCache::clear()
+{
+    invalidate(Packet::BROADCAST);
+}
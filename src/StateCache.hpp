@@ -0,0 +1,81 @@
+#ifndef PTU_KONGSBERG_OE10_STATE_CACHE_HPP
+#define PTU_KONGSBERG_OE10_STATE_CACHE_HPP
+
+#include <ptu_kongsberg_oe10/Packet.hpp>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Shadow copy of the settings last acknowledged by each device
+     *
+     * Each setting is stored as the request payload that set it, so that a
+     * command is redundant if it would send the same payload again. See
+     * Driver::setStateCacheEnabled
+     */
+    class StateCache
+    {
+    public:
+        /** The cached settings */
+        enum Setting
+        {
+            PAN_SPEED,
+            TILT_SPEED,
+            PAN_TARGET,
+            TILT_TARGET,
+            END_STOPS,
+            SETTING_COUNT,
+            /** Used by the commands that do not set a cached setting */
+            NO_SETTING = SETTING_COUNT
+        };
+
+        /** Maximum size of the payload of a cached setting */
+        static const int MAX_PAYLOAD_SIZE = 3;
+
+        /** Bit of a setting in the masks given to invalidate */
+        static constexpr unsigned bit(Setting setting) { return 1u << setting; }
+
+        /** Mask of the position targets */
+        static const unsigned TARGETS = (1u << PAN_TARGET) | (1u << TILT_TARGET);
+
+        StateCache();
+
+        /**
+         * Whether the device is known to have acknowledged this setting
+         * with the same payload
+         */
+        bool matches(byte device_id, Setting setting, byte const* payload, int size) const;
+
+        /**
+         * Records a setting acknowledged by a device
+         *
+         * Settings sent to the broadcast address invalidate the whole cache
+         * instead, as it is unknown which devices applied them
+         */
+        void update(byte device_id, Setting setting, byte const* payload, int size);
+
+        /**
+         * Forgets some settings of a device, or of all devices for the
+         * broadcast address
+         * @param mask The settings to forget, as a combination of bit()
+         */
+        void invalidate(byte device_id, unsigned mask);
+
+        /** Forgets all settings of a device, or of all devices for the
+         * broadcast address */
+        void invalidate(byte device_id);
+
+        /** Forgets all settings of all devices */
+        void clear();
+
+    private:
+        struct Entry
+        {
+            bool valid;
+            byte payload[MAX_PAYLOAD_SIZE];
+        };
+
+        Entry entries[256][SETTING_COUNT];
+    };
+}
+
+#endif
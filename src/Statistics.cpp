@@ -0,0 +1,124 @@
+#include <ptu_kongsberg_oe10/Statistics.hpp>
+
+using namespace ptu_kongsberg_oe10;
+
+LatencyHistogram::LatencyHistogram()
+    : count(0)
+    , sum(0)
+    , min(0)
+    , max(0)
+{
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+        buckets[i] = 0;
+}
+
+int LatencyHistogram::getBucketIndex(base::Time const& latency)
+{
+    boost::int64_t us = latency.toMicroseconds();
+    int index = 0;
+    while (us > 1 && index < BUCKET_COUNT - 1)
+    {
+        us >>= 1;
+        ++index;
+    }
+    return index;
+}
+
+base::Time LatencyHistogram::getBucketLowerBound(int bucket)
+{
+    if (bucket == 0)
+        return base::Time();
+    return base::Time::fromMicroseconds(static_cast<boost::uint64_t>(1) << bucket);
+}
+
+void LatencyHistogram::add(base::Time const& latency)
+{
+    boost::uint64_t us = latency.toMicroseconds() > 0 ? latency.toMicroseconds() : 0;
+    ++buckets[getBucketIndex(latency)];
+    if (count == 0 || us < min)
+        min = us;
+    if (us > max)
+        max = us;
+    sum += us;
+    ++count;
+}
+
+base::Time LatencyHistogram::getMean() const
+{
+    if (count == 0)
+        return base::Time();
+    return base::Time::fromMicroseconds(sum / count);
+}
+
+base::Time LatencyHistogram::getPercentile(double ratio) const
+{
+    if (count == 0)
+        return base::Time();
+
+    boost::uint64_t threshold = ratio * count;
+    boost::uint64_t cumulated = 0;
+    for (int i = 0; i < BUCKET_COUNT - 1; ++i)
+    {
+        cumulated += buckets[i];
+        if (cumulated > threshold)
+            return getBucketLowerBound(i + 1);
+    }
+    return base::Time::fromMicroseconds(max);
+}
+
+CommandStatistics::CommandStatistics()
+    : timeouts(0)
+    , naks(0)
+    , suppressed(0)
+{
+    command[0] = command[1] = 0;
+}
+
+DriverStatistics::DriverStatistics()
+    : command_count(0)
+    , timeouts(0)
+    , naks(0)
+    , checksum_errors(0)
+    , resyncs(0)
+    , skipped_bytes(0)
+    , suppressed_commands(0)
+{
+    for (int i = 0; i < 8; ++i)
+        nak_errors[i] = 0;
+}
+
+CommandStatistics const* DriverStatistics::find(byte c0, byte c1) const
+{
+    for (int i = 0; i < command_count; ++i)
+    {
+        if (commands[i].command[0] == c0 && commands[i].command[1] == c1)
+            return &commands[i];
+    }
+    return 0;
+}
+
+CommandStatistics* DriverStatistics::get(byte c0, byte c1)
+{
+    CommandStatistics const* existing = find(c0, c1);
+    if (existing)
+        return const_cast<CommandStatistics*>(existing);
+    if (command_count == MAX_COMMANDS)
+        return 0;
+
+    CommandStatistics& entry = commands[command_count++];
+    entry.command[0] = c0;
+    entry.command[1] = c1;
+    return &entry;
+}
+
+void DriverStatistics::addNAK(byte const* command, byte error)
+{
+    ++naks;
+    for (int i = 0; i < 8; ++i)
+    {
+        if (error & (1 << i))
+            ++nak_errors[i];
+    }
+    if (CommandStatistics* entry = get(command[0], command[1]))
+        ++entry->naks;
+}
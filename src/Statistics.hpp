@@ -0,0 +1,126 @@
+#ifndef PTU_KONGSBERG_OE10_STATISTICS_HPP
+#define PTU_KONGSBERG_OE10_STATISTICS_HPP
+
+#include <ptu_kongsberg_oe10/Packet.hpp>
+#include <base/Time.hpp>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Fixed-memory histogram of durations
+     *
+     * Buckets are logarithmic: bucket i counts the durations in
+     * [2^i, 2^(i+1)) microseconds, bucket 0 also counting durations below
+     * one microsecond and the last bucket everything above.
+     */
+    struct LatencyHistogram
+    {
+        static const int BUCKET_COUNT = 32;
+
+        /** Number of samples in each bucket */
+        boost::uint64_t buckets[BUCKET_COUNT];
+        /** Total number of samples */
+        boost::uint64_t count;
+        /** Sum of all samples, in microseconds */
+        boost::uint64_t sum;
+        /** Smallest sample, in microseconds */
+        boost::uint64_t min;
+        /** Largest sample, in microseconds */
+        boost::uint64_t max;
+
+        LatencyHistogram();
+
+        /** Adds a sample */
+        void add(base::Time const& latency);
+
+        /** Returns the mean of the samples */
+        base::Time getMean() const;
+
+        /**
+         * Returns an upper bound of the given percentile, i.e. the upper
+         * bound of the bucket that contains it
+         * @param ratio The percentile, in [0, 1]
+         */
+        base::Time getPercentile(double ratio) const;
+
+        /** Returns the lower bound of a bucket */
+        static base::Time getBucketLowerBound(int bucket);
+
+        /** Returns the bucket a duration falls into */
+        static int getBucketIndex(base::Time const& latency);
+    };
+
+    /** Statistics about a given command */
+    struct CommandStatistics
+    {
+        /** The command opcode */
+        byte command[2];
+        /** Time between the start of the write and the validated ACK */
+        LatencyHistogram latency;
+        /** Number of times no reply was received */
+        boost::uint64_t timeouts;
+        /** Number of NAK replies */
+        boost::uint64_t naks;
+        /** Number of times the command has not been sent because the
+         * device already had the requested setting (see StateCache) */
+        boost::uint64_t suppressed;
+
+        CommandStatistics();
+    };
+
+    /**
+     * Statistics gathered by the driver about the communication
+     *
+     * Updating them does not allocate. They are gathered in the thread that
+     * uses the driver, and must be read with Driver::getStatistics from that
+     * same thread.
+     */
+    struct DriverStatistics
+    {
+        /** Maximum number of distinct commands for which statistics are kept */
+        static const int MAX_COMMANDS = 32;
+
+        /** The per-command statistics, only the first command_count are valid */
+        CommandStatistics commands[MAX_COMMANDS];
+        /** Number of valid entries in commands */
+        int command_count;
+
+        /** Number of read timeouts */
+        boost::uint64_t timeouts;
+        /** Number of NAK replies */
+        boost::uint64_t naks;
+        /** Number of NAK replies with each of the error bits set (see
+         * Packet::parseNACKError) */
+        boost::uint64_t nak_errors[8];
+        /** Number of received frames whose checksum did not match */
+        boost::uint64_t checksum_errors;
+        /** Number of times the packet extraction had to skip bytes to
+         * resynchronize on a frame start */
+        boost::uint64_t resyncs;
+        /** Total number of bytes skipped while resynchronizing */
+        boost::uint64_t skipped_bytes;
+        /** Number of commands that have not been sent because the device
+         * already had the requested setting (see StateCache) */
+        boost::uint64_t suppressed_commands;
+
+        DriverStatistics();
+
+        /**
+         * Returns the statistics for a command
+         * @return the statistics, or NULL if this command has not been sent
+         */
+        CommandStatistics const* find(byte c0, byte c1) const;
+
+        /**
+         * Returns the statistics for a command, creating the entry if needed
+         * @return the statistics, or NULL if there are already MAX_COMMANDS
+         *   entries
+         */
+        CommandStatistics* get(byte c0, byte c1);
+
+        /** Records a NAK for the given command */
+        void addNAK(byte const* command, byte error);
+    };
+}
+
+#endif
@@ -37,6 +37,30 @@ namespace ptu_kongsberg_oe10
         bool tilt;  ///< Whether tilt (vertical) movement is available
     };
 
+    /**
+     * The capabilities reported by a device, which do not change while it
+     * is connected
+     *
+     * camera.flash_charged is the exception, and is reported in
+     * Environment instead
+     */
+    struct Capabilities
+    {
+        CameraCapabilities camera;  ///< Camera capabilities
+        PTUCapabilities ptu;       ///< PTU movement capabilities
+    };
+
+    /**
+     * The slowly changing part of the device status
+     */
+    struct Environment
+    {
+        base::Time time;           ///< Time of the reading, on the wall clock
+        base::Temperature temperature; ///< Current temperature reading
+        float humidity;            ///< Current humidity level (0-100%)
+        bool flash_charged;        ///< Whether flash is charged and ready to use
+    };
+
     /**
      * Comprehensive status information reported by the PTU device
      * This structure combines all status information including
@@ -0,0 +1,165 @@
+#include <ptu_kongsberg_oe10/Trace.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+char const Trace::FILE_MAGIC[8] = { 'O', 'E', '1', '0', 'T', 'R', 'C', '1' };
+
+Trace::Trace(size_t capacity)
+    : ring(capacity)
+{
+}
+
+Trace::Ring const& Trace::getRing() const
+{
+    return ring;
+}
+
+void Trace::add(TraceRecord::Direction direction, base::Time const& time,
+        byte const* buffer, int size)
+{
+    TraceRecord record;
+    record.time = time;
+    record.direction = direction;
+    do
+    {
+        int chunk = std::min<int>(size, Packet::MAX_PACKET_SIZE);
+        record.size = chunk;
+        memcpy(record.data, buffer, chunk);
+        ring.push(record);
+        buffer += chunk;
+        size -= chunk;
+    }
+    while (size > 0);
+}
+
+/**
+ * Read the ring from its oldest sample. The records that get overwritten
+ * while we are reading are simply skipped
+ */
+int Trace::dump(ostream& stream, bool withHeader) const
+{
+    if (withHeader)
+        writeFileHeader(stream);
+
+    boost::uint64_t count = ring.getCount();
+    boost::uint64_t start = count > ring.getCapacity() ? count - ring.getCapacity() : 0;
+    Ring::Reader reader(ring, start);
+    TraceRecord record;
+    int written = 0;
+    while (written < static_cast<int>(count - start) && reader.read(record))
+    {
+        writeRecord(stream, record);
+        ++written;
+    }
+    return written;
+}
+
+void Trace::writeFileHeader(ostream& stream)
+{
+    stream.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+}
+
+void Trace::writeRecord(ostream& stream, TraceRecord const& record)
+{
+    byte header[RECORD_HEADER_SIZE];
+    boost::uint64_t time = record.time.toMicroseconds();
+    for (int i = 0; i < 8; ++i)
+        header[i] = (time >> (8 * i)) & 0xFF;
+    header[8] = record.direction;
+    header[9] = record.size & 0xFF;
+    header[10] = record.size >> 8;
+    stream.write(reinterpret_cast<char const*>(header), RECORD_HEADER_SIZE);
+    stream.write(reinterpret_cast<char const*>(record.data), record.size);
+}
+
+int Trace::parseFileHeader(byte const* buffer, int size)
+{
+    if (size < static_cast<int>(sizeof(FILE_MAGIC)) ||
+            memcmp(buffer, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+        throw std::runtime_error("not a ptu_kongsberg_oe10 capture file");
+    return sizeof(FILE_MAGIC);
+}
+
+int Trace::parseRecord(byte const* buffer, int size, TraceRecord& record)
+{
+    if (size < RECORD_HEADER_SIZE)
+        return 0;
+
+    boost::uint64_t time = 0;
+    for (int i = 0; i < 8; ++i)
+        time |= static_cast<boost::uint64_t>(buffer[i]) << (8 * i);
+    record.time = base::Time::fromMicroseconds(time);
+    record.direction = buffer[8];
+    record.size = buffer[9] | (buffer[10] << 8);
+    if (record.direction > TraceRecord::RX_DISCARDED || record.size > Packet::MAX_PACKET_SIZE)
+        throw std::runtime_error("invalid record in capture file");
+    if (size < RECORD_HEADER_SIZE + record.size)
+        return 0;
+    memcpy(record.data, buffer + RECORD_HEADER_SIZE, record.size);
+    return RECORD_HEADER_SIZE + record.size;
+}
+
+TraceRecorder::TraceRecorder(Trace const& trace, base::Time const& period)
+    : trace(trace)
+    , period(period)
+    , quit(false)
+    , lost(0)
+{
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    stop();
+}
+
+void TraceRecorder::start(string const& path)
+{
+    stop();
+    file.open(path.c_str(), ios::binary | ios::trunc);
+    if (!file)
+        throw std::runtime_error("cannot open " + path);
+    Trace::writeFileHeader(file);
+
+    quit = false;
+    lost = 0;
+    Trace::Ring::Reader reader(trace.getRing());
+    thread = std::thread([this, reader]() mutable {
+        while (!quit)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(period.toMicroseconds()));
+            flush(reader);
+        }
+        flush(reader);
+    });
+}
+
+void TraceRecorder::stop()
+{
+    if (thread.joinable())
+    {
+        quit = true;
+        thread.join();
+    }
+    if (file.is_open())
+        file.close();
+}
+
+boost::uint64_t TraceRecorder::getLostCount() const
+{
+    return lost;
+}
+
+void TraceRecorder::flush(Trace::Ring::Reader& reader)
+{
+    TraceRecord record;
+    while (reader.read(record))
+        Trace::writeRecord(file, record);
+    lost = reader.getLostCount();
+    file.flush();
+}
@@ -0,0 +1,162 @@
+#ifndef PTU_KONGSBERG_OE10_TRACE_HPP
+#define PTU_KONGSBERG_OE10_TRACE_HPP
+
+#include <ptu_kongsberg_oe10/Packet.hpp>
+#include <ptu_kongsberg_oe10/SampleRing.hpp>
+#include <base/Time.hpp>
+#include <atomic>
+#include <fstream>
+#include <iosfwd>
+#include <string>
+#include <thread>
+
+namespace ptu_kongsberg_oe10
+{
+    /** A chunk of bytes that went over the wire */
+    struct TraceRecord
+    {
+        enum Direction
+        {
+            /** Bytes written to the device */
+            TX = 0,
+            /** A frame received from the device */
+            RX = 1,
+            /** Received bytes that were discarded while resynchronizing */
+            RX_DISCARDED = 2
+        };
+
+        /** Monotonic time of the write, or of the arrival of the first byte
+         * of a received frame */
+        base::Time time;
+        /** One of Direction */
+        byte direction;
+        /** Number of bytes in data */
+        boost::uint16_t size;
+        byte data[Packet::MAX_PACKET_SIZE];
+    };
+
+    /**
+     * Lock-free capture of the raw serial traffic
+     *
+     * Once given to Driver::setTrace, the driver copies every frame it
+     * writes and reads, as well as the bytes it discards, in a preallocated
+     * ring. No formatting happens in the I/O path: the ring can be saved to
+     * a compact binary capture file, either on demand with dump() or
+     * continuously with a TraceRecorder, and formatted offline with
+     * ptu_kongsberg_oe10_trace_dump.
+     *
+     * The capture file is made of the 8 bytes of FILE_MAGIC followed by the
+     * records, each encoded as the time in microseconds (8 bytes), the
+     * direction (1 byte), the size (2 bytes), all little-endian, followed by
+     * the data.
+     */
+    class Trace
+    {
+    public:
+        typedef SampleRing<TraceRecord> Ring;
+
+        /** Magic bytes at the beginning of capture files */
+        static char const FILE_MAGIC[8];
+        /** Size of the header of an encoded record */
+        static const int RECORD_HEADER_SIZE = 11;
+
+        /**
+         * Creates a trace
+         * @param capacity Number of records kept in memory
+         */
+        explicit Trace(size_t capacity = 4096);
+
+        /**
+         * Records bytes that went over the wire
+         *
+         * Chunks bigger than a record are split over several records. It
+         * does not allocate and must only be called from a single thread,
+         * normally the driver's
+         */
+        void add(TraceRecord::Direction direction, base::Time const& time,
+                byte const* buffer, int size);
+
+        /** Returns the ring the records are stored in */
+        Ring const& getRing() const;
+
+        /**
+         * Writes the records that are currently in the ring to a capture
+         * @param stream The output stream
+         * @param withHeader Whether the file magic should be written first
+         * @return The number of records written
+         */
+        int dump(std::ostream& stream, bool withHeader = true) const;
+
+        /** Writes the file magic */
+        static void writeFileHeader(std::ostream& stream);
+
+        /** Writes a record in the capture format */
+        static void writeRecord(std::ostream& stream, TraceRecord const& record);
+
+        /**
+         * Checks that a buffer starts with the file magic
+         * @return The size of the file header
+         * @throws std::runtime_error if the magic does not match
+         */
+        static int parseFileHeader(byte const* buffer, int size);
+
+        /**
+         * Decodes a record from a capture
+         * @param buffer The encoded record
+         * @param size The number of bytes available in buffer
+         * @param record The decoded record
+         * @return The number of bytes used, or 0 if the buffer does not hold
+         *   a complete record
+         * @throws std::runtime_error if the record is invalid
+         */
+        static int parseRecord(byte const* buffer, int size, TraceRecord& record);
+
+    private:
+        Ring ring;
+    };
+
+    /**
+     * Saves a Trace continuously to a capture file
+     *
+     * A background thread periodically writes the new records. If the ring
+     * gets overwritten before the records could be saved, they are lost and
+     * counted in getLostCount()
+     */
+    class TraceRecorder
+    {
+    public:
+        /**
+         * @param trace The trace to save
+         * @param period How often the new records are written
+         */
+        explicit TraceRecorder(Trace const& trace,
+                base::Time const& period = base::Time::fromMilliseconds(100));
+
+        /** Stops recording */
+        ~TraceRecorder();
+
+        /**
+         * Opens the capture file and starts recording, from the next record
+         * @throws std::runtime_error if the file cannot be opened
+         */
+        void start(std::string const& path);
+
+        /** Writes the pending records and closes the file */
+        void stop();
+
+        /** Returns the number of records that were lost */
+        boost::uint64_t getLostCount() const;
+
+    private:
+        void flush(Trace::Ring::Reader& reader);
+
+        Trace const& trace;
+        base::Time period;
+        std::ofstream file;
+        std::thread thread;
+        std::atomic<bool> quit;
+        std::atomic<boost::uint64_t> lost;
+    };
+}
+
+#endif
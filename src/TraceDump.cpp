@@ -0,0 +1,77 @@
+// Offline formatting of the capture files saved from a Trace
+//
+// Each record is output on one line, with its time relative to the first
+// record, its direction, its size and its bytes as formatted by
+// Packet::kongsberg_com
+#include <ptu_kongsberg_oe10/Trace.hpp>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+static int usage(string const& argv0)
+{
+    cerr
+        << "usage: " << argv0 << " FILE\n"
+        << "  formats the records of a capture file, one per line\n"
+        << endl;
+    return -1;
+}
+
+static char const* directionName(byte direction)
+{
+    switch (direction)
+    {
+        case TraceRecord::TX: return "TX";
+        case TraceRecord::RX: return "RX";
+        default: return "RX!";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+        return usage(argv[0]);
+
+    ifstream file(argv[1], ios::binary);
+    if (!file)
+    {
+        cerr << "cannot open " << argv[1] << endl;
+        return 1;
+    }
+    vector<char> contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    byte const* buffer = reinterpret_cast<byte const*>(contents.data());
+    int size = contents.size();
+
+    try
+    {
+        int offset = Trace::parseFileHeader(buffer, size);
+        base::Time start;
+        TraceRecord record;
+        bool first = true;
+        while (int used = Trace::parseRecord(buffer + offset, size - offset, record))
+        {
+            if (first)
+                start = record.time;
+            first = false;
+
+            cout << fixed << setprecision(6) << (record.time - start).toSeconds()
+                << " " << directionName(record.direction)
+                << " " << record.size
+                << " " << Packet::kongsberg_com(record.data, record.size) << "\n";
+            offset += used;
+        }
+        if (offset != size)
+            cerr << "capture file truncated, " << size - offset << " bytes ignored" << endl;
+    }
+    catch(std::runtime_error const& e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,302 @@
+#include <ptu_kongsberg_oe10/TrajectoryExecutor.hpp>
+#include <base/Logging.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+using boost::lexical_cast;
+
+/** Weight of the newest measurement in the delay estimates */
+static const double DELAY_FILTER_GAIN = 0.25;
+
+Waypoint::Waypoint()
+    : pan(0)
+    , tilt(0)
+    , pan_speed(base::unset<float>())
+    , tilt_speed(base::unset<float>())
+{
+}
+
+Waypoint::Waypoint(base::Time const& time, float pan, float tilt, float pan_speed, float tilt_speed)
+    : time(time)
+    , pan(pan)
+    , tilt(tilt)
+    , pan_speed(pan_speed)
+    , tilt_speed(tilt_speed)
+{
+}
+
+TrajectoryResult::TrajectoryResult()
+    : cancelled(false)
+    , failed_waypoints(0)
+    , feedback_errors(0)
+    , pan_rms_error(0)
+    , tilt_rms_error(0)
+    , pan_max_error(0)
+    , tilt_max_error(0)
+{
+}
+
+bool TrajectoryResult::ok() const
+{
+    return !cancelled && failed_waypoints == 0;
+}
+
+/** Wraps an angle difference in [-pi, pi] */
+static float wrapAngle(float angle)
+{
+    angle = fmod(angle + M_PI, 2 * M_PI);
+    if (angle < 0)
+        angle += 2 * M_PI;
+    return angle - M_PI;
+}
+
+/** Returns the mean latency of a command in the driver statistics, or a
+ * null time if it has never been acknowledged */
+static base::Time getMeanLatency(DriverStatistics const& stats, byte c0, byte c1)
+{
+    CommandStatistics const* entry = stats.find(c0, c1);
+    if (!entry || entry->latency.count == 0)
+        return base::Time();
+    return entry->latency.getMean();
+}
+
+/** Low-pass filter of the delay estimates */
+static base::Time filterDelay(base::Time const& estimate, base::Time const& measurement)
+{
+    if (estimate.isNull())
+        return measurement;
+    return estimate + (measurement - estimate) * DELAY_FILTER_GAIN;
+}
+
+TrajectoryExecutor::TrajectoryExecutor(Driver& driver, int device_id)
+    : driver(driver)
+    , device_id(device_id)
+    , feedbackEnabled(true)
+    , cancelled(false)
+{
+    DriverStatistics stats = driver.getStatistics();
+    commandDelay = getMeanLatency(stats, 'P', 'P') / 2;
+    pollDuration = getMeanLatency(stats, 'A', 'S');
+}
+
+void TrajectoryExecutor::setLookahead(base::Time const& lookahead)
+{
+    this->lookahead = lookahead;
+}
+
+base::Time TrajectoryExecutor::getLookahead() const
+{
+    return lookahead;
+}
+
+void TrajectoryExecutor::setFeedbackPeriod(base::Time const& period)
+{
+    feedbackPeriod = period;
+}
+
+base::Time TrajectoryExecutor::getFeedbackPeriod() const
+{
+    return feedbackPeriod;
+}
+
+void TrajectoryExecutor::setFeedbackEnabled(bool enable)
+{
+    feedbackEnabled = enable;
+}
+
+bool TrajectoryExecutor::isFeedbackEnabled() const
+{
+    return feedbackEnabled;
+}
+
+void TrajectoryExecutor::setFeedbackCallback(std::function<void(TrackingSample const&)> const& callback)
+{
+    feedbackCallback = callback;
+}
+
+base::Time TrajectoryExecutor::getCommandDelay() const
+{
+    return commandDelay;
+}
+
+void TrajectoryExecutor::cancel()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        cancelled = true;
+    }
+    wakeup.notify_one();
+}
+
+void TrajectoryExecutor::interpolate(Trajectory const& trajectory, base::Time const& time,
+        float& pan, float& tilt)
+{
+    size_t next = 0;
+    while (next < trajectory.size() && trajectory[next].time <= time)
+        ++next;
+
+    if (next == 0)
+    {
+        pan  = trajectory.front().pan;
+        tilt = trajectory.front().tilt;
+    }
+    else if (next == trajectory.size())
+    {
+        pan  = trajectory.back().pan;
+        tilt = trajectory.back().tilt;
+    }
+    else
+    {
+        Waypoint const& a = trajectory[next - 1];
+        Waypoint const& b = trajectory[next];
+        double ratio = static_cast<double>((time - a.time).toMicroseconds()) /
+            (b.time - a.time).toMicroseconds();
+        pan  = a.pan  + (b.pan  - a.pan)  * ratio;
+        tilt = a.tilt + (b.tilt - a.tilt) * ratio;
+    }
+}
+
+bool TrajectoryExecutor::waitUntil(base::Time const& deadline)
+{
+    chrono::steady_clock::time_point until = chrono::steady_clock::now() +
+        chrono::microseconds((deadline - monotonicNow()).toMicroseconds());
+    unique_lock<std::mutex> lock(mutex);
+    wakeup.wait_until(lock, until, [this] { return cancelled; });
+    return !cancelled;
+}
+
+void TrajectoryExecutor::poll(Trajectory const& trajectory, base::Time const& start, TrajectoryResult& result)
+{
+    base::Time requestTime = monotonicNow();
+    Expected<PanTiltStatus> status = driver.tryExecute(device_id, commands::GetPanTiltStatus());
+    pollDuration = filterDelay(pollDuration, monotonicNow() - requestTime);
+    if (!status)
+    {
+        ++result.feedback_errors;
+        LOG_WARN_S << "trajectory feedback: " << status.error().toString();
+        return;
+    }
+
+    TrackingSample sample;
+    sample.time = status->sample_time - start;
+    if (sample.time < trajectory.front().time)
+        return;
+
+    sample.status = *status;
+    interpolate(trajectory, sample.time, sample.pan_reference, sample.tilt_reference);
+    sample.pan_error  = wrapAngle(status->pan  - sample.pan_reference);
+    sample.tilt_error = wrapAngle(status->tilt - sample.tilt_reference);
+    result.tracking.push_back(sample);
+    if (feedbackCallback)
+        feedbackCallback(sample);
+}
+
+/**
+ * Each waypoint is sent commandDelay before it should land, and AS polls
+ * fill the time in between. A poll is only started if it is expected to
+ * complete before the next write is due, so that feedback never delays the
+ * commands
+ */
+TrajectoryResult TrajectoryExecutor::execute(Trajectory const& trajectory)
+{
+    if (trajectory.empty())
+        throw std::invalid_argument("cannot execute an empty trajectory");
+    for (size_t i = 0; i < trajectory.size(); ++i)
+    {
+        Waypoint const& wp = trajectory[i];
+        bool valid =
+            Packet::isValidAngle(wp.pan) && Packet::isValidAngle(wp.tilt) &&
+            (base::isUnset(wp.pan_speed) || (wp.pan_speed >= 0 && wp.pan_speed <= 1)) &&
+            (base::isUnset(wp.tilt_speed) || (wp.tilt_speed >= 0 && wp.tilt_speed <= 1));
+        if (!valid)
+            throw std::invalid_argument("invalid angle or speed in waypoint " + lexical_cast<string>(i));
+        if (i > 0 && wp.time < trajectory[i - 1].time)
+            throw std::invalid_argument("the time of waypoint " + lexical_cast<string>(i) +
+                    " is before the time of the previous one");
+    }
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        cancelled = false;
+    }
+
+    TrajectoryResult result;
+    base::Time start = monotonicNow();
+    base::Time nextPoll = start;
+    for (size_t i = 0; i <= trajectory.size(); ++i)
+    {
+        // The last iteration only collects feedback until the end of the
+        // trajectory
+        base::Time sendTime;
+        if (i == trajectory.size())
+            sendTime = start + trajectory.back().time;
+        else if (i > 0)
+            sendTime = start + trajectory[i - 1].time - lookahead - commandDelay;
+        else
+            sendTime = start;
+
+        while (true)
+        {
+            base::Time now = monotonicNow();
+            if (now >= sendTime)
+                break;
+            if (feedbackEnabled && nextPoll <= now && now + pollDuration < sendTime)
+            {
+                poll(trajectory, start, result);
+                nextPoll = max(nextPoll + feedbackPeriod, now);
+                continue;
+            }
+
+            base::Time wakeTime = sendTime;
+            if (feedbackEnabled && nextPoll + pollDuration < sendTime)
+                wakeTime = max(nextPoll, now);
+            if (!waitUntil(wakeTime))
+            {
+                result.cancelled = true;
+                break;
+            }
+        }
+        if (result.cancelled || i == trajectory.size())
+            break;
+
+        Waypoint const& wp = trajectory[i];
+        WaypointRecord record;
+        base::Time sendStart = monotonicNow();
+        record.scheduled = sendTime - start;
+        record.sent = sendStart - start;
+        record.result = driver.tryMove(device_id, wp.pan, wp.tilt, wp.pan_speed, wp.tilt_speed);
+        base::Time sendEnd = monotonicNow();
+        record.acknowledged = sendEnd - start;
+
+        result.max_lateness = max(result.max_lateness, record.sent - record.scheduled);
+        if (!record.result.ok())
+        {
+            ++result.failed_waypoints;
+            LOG_WARN_S << "trajectory waypoint " << i << ": " << record.result.toString();
+        }
+        else
+            commandDelay = filterDelay(commandDelay, (sendEnd - sendStart) / 2);
+        result.waypoints.push_back(record);
+    }
+
+    double panSquares = 0, tiltSquares = 0;
+    for (size_t i = 0; i < result.tracking.size(); ++i)
+    {
+        TrackingSample const& sample = result.tracking[i];
+        panSquares  += sample.pan_error * sample.pan_error;
+        tiltSquares += sample.tilt_error * sample.tilt_error;
+        result.pan_max_error  = max(result.pan_max_error, std::abs(sample.pan_error));
+        result.tilt_max_error = max(result.tilt_max_error, std::abs(sample.tilt_error));
+    }
+    if (!result.tracking.empty())
+    {
+        result.pan_rms_error  = sqrt(panSquares / result.tracking.size());
+        result.tilt_rms_error = sqrt(tiltSquares / result.tracking.size());
+    }
+    return result;
+}
@@ -0,0 +1,217 @@
+#ifndef PTU_KONGSBERG_OE10_TRAJECTORY_EXECUTOR_HPP
+#define PTU_KONGSBERG_OE10_TRAJECTORY_EXECUTOR_HPP
+
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * A point of a trajectory
+     */
+    struct Waypoint
+    {
+        /** Time at which the axes should reach the waypoint, relative to the
+         * start of the trajectory */
+        base::Time time;
+        /** Pan angle in radians */
+        float pan;
+        /** Tilt angle in radians */
+        float tilt;
+        /** Pan speed used to reach the waypoint, as fraction of maximum.
+         * Leave unset to keep the current speed */
+        float pan_speed;
+        /** Tilt speed used to reach the waypoint, as fraction of maximum.
+         * Leave unset to keep the current speed */
+        float tilt_speed;
+
+        Waypoint();
+        Waypoint(base::Time const& time, float pan, float tilt,
+                float pan_speed = base::unset<float>(),
+                float tilt_speed = base::unset<float>());
+    };
+
+    typedef std::vector<Waypoint> Trajectory;
+
+    /**
+     * The position measured with AS during a trajectory, compared to the
+     * reference position at the same time
+     */
+    struct TrackingSample
+    {
+        /** Estimated sampling time of the AS reply, relative to the start
+         * of the trajectory */
+        base::Time time;
+        /** The full AS reply */
+        PanTiltStatus status;
+        /** Reference angles, interpolated linearly between the waypoints */
+        float pan_reference;
+        float tilt_reference;
+        /** Measured minus reference angles, in [-pi, pi] */
+        float pan_error;
+        float tilt_error;
+    };
+
+    /** How and when the commands of a waypoint have been sent */
+    struct WaypointRecord
+    {
+        /** Time at which the commands were scheduled to be written,
+         * relative to the start of the trajectory */
+        base::Time scheduled;
+        /** Time at which they were actually written */
+        base::Time sent;
+        /** Time at which all their ACKs had been received */
+        base::Time acknowledged;
+        /** The outcome of the commands */
+        MoveResult result;
+    };
+
+    /** Outcome of TrajectoryExecutor::execute */
+    struct TrajectoryResult
+    {
+        /** One record per waypoint that has been sent */
+        std::vector<WaypointRecord> waypoints;
+        /** The AS feedback, from the time of the first waypoint on */
+        std::vector<TrackingSample> tracking;
+        /** Whether execution has been cancelled */
+        bool cancelled;
+        /** Number of waypoints whose commands failed */
+        int failed_waypoints;
+        /** Number of AS requests that failed */
+        int feedback_errors;
+        /** Largest delay between the scheduled and actual writes */
+        base::Time max_lateness;
+        /** Root mean square and largest absolute tracking errors, in
+         * radians */
+        float pan_rms_error;
+        float tilt_rms_error;
+        float pan_max_error;
+        float tilt_max_error;
+
+        TrajectoryResult();
+
+        /** Whether all waypoints have been sent and acknowledged */
+        bool ok() const;
+    };
+
+    /**
+     * Executes a time-parameterised sequence of waypoints
+     *
+     * The commands of waypoint i are written with Driver::move so that the
+     * device receives them when the axes reach waypoint i-1, minus the
+     * lookahead. The axes therefore never stop at an intermediate
+     * waypoint. The commands of the first waypoint are written right away.
+     *
+     * The time it takes for a command to reach the device is estimated as
+     * half of the move round-trip time, starting from the latency in the
+     * driver statistics and updated with each waypoint. Commands are
+     * written that much earlier than the time they should land at.
+     *
+     * Between commands, the position is read with AS, as long as the poll
+     * is expected to complete before the next command is due. Each reply is
+     * compared to the reference position at its sampling time.
+     *
+     * The executor uses the driver exclusively during execute(): the
+     * driver must not be used by other threads meanwhile. The axes should
+     * be at the first waypoint when execution starts, or its time should
+     * leave them enough time to reach it.
+     */
+    class TrajectoryExecutor
+    {
+    public:
+        /**
+         * @param driver The driver, which must be open and outlive the
+         *   executor
+         * @param device_id The ID of the target device
+         */
+        TrajectoryExecutor(Driver& driver, int device_id);
+
+        /**
+         * Sets how much earlier than the time of waypoint i-1 the commands
+         * of waypoint i land. Defaults to zero
+         */
+        void setLookahead(base::Time const& lookahead);
+
+        /** Returns the lookahead */
+        base::Time getLookahead() const;
+
+        /**
+         * Sets the period of the AS feedback. A null period (the default)
+         * polls as fast as the link allows
+         */
+        void setFeedbackPeriod(base::Time const& period);
+
+        /** Returns the period of the AS feedback */
+        base::Time getFeedbackPeriod() const;
+
+        /** Enables or disables the AS feedback. It is enabled by default */
+        void setFeedbackEnabled(bool enable);
+
+        /** Whether the AS feedback is enabled */
+        bool isFeedbackEnabled() const;
+
+        /**
+         * Sets a callback called with each tracking sample, on the thread
+         * that runs execute()
+         */
+        void setFeedbackCallback(std::function<void(TrackingSample const&)> const& callback);
+
+        /** Returns the current estimate of the time a command takes to
+         * reach the device */
+        base::Time getCommandDelay() const;
+
+        /**
+         * Executes a trajectory, blocking until the time of its last
+         * waypoint, or until cancel() is called
+         *
+         * Failed waypoints are recorded, and execution goes on with the
+         * next one
+         * @throws std::invalid_argument if the trajectory is empty, its
+         *   times decrease, or one of its angles or speeds is invalid. Nothing
+         *   is sent then
+         */
+        TrajectoryResult execute(Trajectory const& trajectory);
+
+        /** Interrupts execute() from another thread */
+        void cancel();
+
+        /**
+         * Returns the reference angles of a trajectory at a given time,
+         * interpolated linearly between the waypoints
+         */
+        static void interpolate(Trajectory const& trajectory, base::Time const& time,
+                float& pan, float& tilt);
+
+    private:
+        /**
+         * Waits until a monotonic time, or until cancel() is called
+         * @return false if cancelled
+         */
+        bool waitUntil(base::Time const& deadline);
+
+        /** Reads the position and adds it to the result if it is within
+         * the trajectory */
+        void poll(Trajectory const& trajectory, base::Time const& start, TrajectoryResult& result);
+
+        Driver& driver;
+        int device_id;
+        base::Time lookahead;
+        base::Time feedbackPeriod;
+        bool feedbackEnabled;
+        std::function<void(TrackingSample const&)> feedbackCallback;
+
+        /** Estimated one-way delay of a move */
+        base::Time commandDelay;
+        /** Estimated round-trip time of an AS poll */
+        base::Time pollDuration;
+
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        bool cancelled;
+    };
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef PTU_KONGSBERG_OE10_TEST_SIMULATOR_FIXTURE_HPP
+#define PTU_KONGSBERG_OE10_TEST_SIMULATOR_FIXTURE_HPP
+
+#include <ptu_kongsberg_oe10/Simulator.hpp>
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <string>
+#include <vector>
+
+namespace ptu_kongsberg_oe10
+{
+    /**
+     * Base of the test fixtures that run a Driver against simulated devices
+     *
+     * The simulator is started with the given devices, and the driver opened
+     * on its PTY. Derived fixtures give the devices and read timeout they
+     * need in their default constructor, which Boost.Test requires, and
+     * configure the simulator further (e.g. setMaxSpeed) in its body.
+     */
+    struct SimulatorFixture
+    {
+        Simulator simulator;
+        Driver driver;
+
+        /**
+         * @param device_ids The IDs of the simulated devices
+         * @param read_timeout The driver's read timeout
+         * @param pan_only_ids The IDs of additional simulated devices that
+         *   have no tilt axis
+         */
+        SimulatorFixture(std::vector<int> const& device_ids, base::Time const& read_timeout,
+                std::vector<int> const& pan_only_ids = std::vector<int>())
+        {
+            for (size_t i = 0; i < device_ids.size(); ++i)
+                simulator.addDevice(device_ids[i]);
+            for (size_t i = 0; i < pan_only_ids.size(); ++i)
+                simulator.addDevice(pan_only_ids[i], false);
+            simulator.start();
+            driver.setReadTimeout(read_timeout);
+            driver.openURI(getURI());
+        }
+
+        /** The URI of the simulator's PTY, for other drivers */
+        std::string getURI() const
+        {
+            return "serial://" + simulator.getDevicePath() + ":19200";
+        }
+    };
+}
+
+#endif
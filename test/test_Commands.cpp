@@ -0,0 +1,159 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/Commands.hpp>
+#include <ptu_kongsberg_oe10/FrameCache.hpp>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+template<typename Command>
+static void requireSameFrameAsPacket(Command const& command, int device_id)
+{
+    Packet packet(device_id);
+    packet.setCommand(Command::OPCODE0, Command::OPCODE1);
+    packet.data_size = Command::REQUEST_SIZE;
+    command.encode(packet.data);
+    vector<byte> expected;
+    packet.marshal(expected);
+
+    byte buffer[Packet::MAX_PACKET_SIZE];
+    int size = commands::marshal(command, device_id, buffer);
+    BOOST_REQUIRE_EQUAL(expected.size(), size);
+    BOOST_REQUIRE(equal(expected.begin(), expected.end(), buffer));
+}
+
+/**
+ * Checks the compile-time frame sizes of a command against the frames that
+ * are actually marshalled for its request and its ACK
+ */
+template<typename Command>
+static void requireFrameSizes(Command const& command, int frameSize, int responseFrameSize)
+{
+    byte buffer[Packet::MAX_PACKET_SIZE];
+    memset(buffer, 0, sizeof(buffer));
+    BOOST_REQUIRE_EQUAL(frameSize, Command::FRAME_SIZE);
+    BOOST_REQUIRE_EQUAL(frameSize, commands::marshal(command, 2, buffer));
+    BOOST_REQUIRE_EQUAL('>', buffer[frameSize - 1]);
+    BOOST_REQUIRE_EQUAL(0, buffer[frameSize]);
+    BOOST_REQUIRE_EQUAL(Command::REQUEST_LENGTH, buffer[5]);
+
+    Packet ack(Packet::CONTROLLER, 2);
+    ack.setCommand(Packet::ACK);
+    ack.data_size = 2 + Command::RESPONSE_SIZE;
+    memset(ack.data, '0', ack.data_size);
+    vector<byte> reply;
+    ack.marshal(reply);
+    BOOST_REQUIRE_EQUAL(responseFrameSize, Command::RESPONSE_FRAME_SIZE);
+    BOOST_REQUIRE_EQUAL(responseFrameSize, reply.size());
+}
+
+BOOST_AUTO_TEST_CASE(commands_frame_sizes_match_the_marshalled_frames)
+{
+    requireFrameSizes(commands::GetStatus(), 15, 25);
+    requireFrameSizes(commands::GetPanTiltStatus(), 15, 26);
+    requireFrameSizes(commands::SetPanPosition(M_PI / 2), 18, 19);
+    requireFrameSizes(commands::SetTiltSpeed(0.5), 16, 16);
+    requireFrameSizes(commands::UseEndStops(true), 16, 17);
+    requireFrameSizes(commands::TiltStop(), 15, 19);
+}
+
+BOOST_AUTO_TEST_CASE(commands_marshal_matches_the_generic_packet_marshalling)
+{
+    for (int device_id = 2; device_id < 256; ++device_id)
+    {
+        requireSameFrameAsPacket(commands::GetStatus(), device_id);
+        requireSameFrameAsPacket(commands::GetPanTiltStatus(), device_id);
+        requireSameFrameAsPacket(commands::UseEndStops(true), device_id);
+        requireSameFrameAsPacket(commands::SetPanNegativeEndStop(), device_id);
+        requireSameFrameAsPacket(commands::SetTiltPosition(245 * M_PI / 180), device_id);
+        requireSameFrameAsPacket(commands::SetPanSpeed(0.5), device_id);
+        requireSameFrameAsPacket(commands::TiltStop(), device_id);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(commands_decode_the_pan_tilt_status)
+{
+    byte data[10] = { 0x64, 0x32, '0', '9', '0', '1', '8', '0', '1', '0' };
+    PanTiltStatus status = commands::GetPanTiltStatus().decode(data);
+    BOOST_REQUIRE_CLOSE(1.0, status.pan_speed, 1e-3);
+    BOOST_REQUIRE_CLOSE(0.5, status.tilt_speed, 1e-3);
+    BOOST_REQUIRE_CLOSE(M_PI / 2, status.pan, 1e-3);
+    BOOST_REQUIRE_CLOSE(M_PI, status.tilt, 1e-3);
+    BOOST_REQUIRE(status.uses_pan_stop);
+    BOOST_REQUIRE(!status.uses_tilt_stop);
+}
+
+BOOST_AUTO_TEST_CASE(commands_decode_the_environment_of_the_status)
+{
+    byte data[9] = { 0x18, 0, 0xF5, '0', '9', '0', '1', '8', '0' };
+    Status status = commands::GetStatus().decode(data);
+    BOOST_REQUIRE_EQUAL(100, status.humidity);
+    BOOST_REQUIRE_CLOSE(20, status.temperature.getCelsius(), 1e-3);
+
+    data[2] = 0x00;
+    status = commands::GetStatus().decode(data);
+    BOOST_REQUIRE_EQUAL(0, status.humidity);
+    BOOST_REQUIRE_CLOSE(-5, status.temperature.getCelsius(), 1e-3);
+
+    data[2] = 0x30;
+    BOOST_REQUIRE_EQUAL(20, commands::GetStatus().decode(data).humidity);
+}
+
+BOOST_AUTO_TEST_CASE(commands_reject_out_of_range_speeds)
+{
+    byte data[1];
+    BOOST_REQUIRE_THROW(commands::SetTiltSpeed(1.5).encode(data), std::range_error);
+}
+
+/** @return true if the frame's checksum had to be escaped */
+template<typename Command>
+static bool requireSameFrameAsMarshal(FrameCache& cache, Command const& command, int device_id)
+{
+    byte expected[Packet::MAX_PACKET_SIZE];
+    int expectedSize = commands::marshal(command, device_id, expected);
+    int size;
+    byte const* frame = cache.get(command, device_id, size);
+    BOOST_REQUIRE_EQUAL(expectedSize, size);
+    BOOST_REQUIRE(equal(expected, expected + size, frame));
+    return frame[size - 2] != 'G';
+}
+
+BOOST_AUTO_TEST_CASE(frame_cache_updates_the_payload_and_checksum_incrementally)
+{
+    // Go through all angles and speeds, so that the checksums that need to
+    // be escaped are covered
+    FrameCache cache;
+    int escaped = 0;
+    for (int i = 0; i < 3600; ++i)
+    {
+        escaped += requireSameFrameAsMarshal(cache, commands::SetPanPosition(i * M_PI / 1800), 2);
+        escaped += requireSameFrameAsMarshal(cache, commands::SetTiltPosition((3599 - i) * M_PI / 1800), 2);
+        escaped += requireSameFrameAsMarshal(cache, commands::SetPanSpeed((i % 101) / 100.0), 3);
+        requireSameFrameAsMarshal(cache, commands::GetPanTiltStatus(), 2);
+    }
+    BOOST_REQUIRE_GT(escaped, 0);
+}
+
+BOOST_AUTO_TEST_CASE(frame_cache_keeps_one_frame_per_device)
+{
+    FrameCache cache;
+    int size;
+    byte const* frame2 = cache.get(commands::SetPanPosition(1), 2, size);
+    byte const* frame3 = cache.get(commands::SetPanPosition(2), 3, size);
+    BOOST_REQUIRE(frame2 != frame3);
+    BOOST_REQUIRE_EQUAL(frame2, cache.get(commands::SetPanPosition(1), 2, size));
+    requireSameFrameAsMarshal(cache, commands::SetPanPosition(1), 2);
+    requireSameFrameAsMarshal(cache, commands::SetPanPosition(2), 3);
+}
+
+BOOST_AUTO_TEST_CASE(frame_cache_is_unchanged_by_invalid_parameters)
+{
+    FrameCache cache;
+    requireSameFrameAsMarshal(cache, commands::SetPanSpeed(0.5), 2);
+    int size;
+    BOOST_REQUIRE_THROW(cache.get(commands::SetPanSpeed(2), 2, size), std::range_error);
+    BOOST_REQUIRE_THROW(cache.get(commands::SetTiltSpeed(-1), 2, size), std::range_error);
+    requireSameFrameAsMarshal(cache, commands::SetPanSpeed(0.5), 2);
+    requireSameFrameAsMarshal(cache, commands::SetTiltSpeed(0.2), 2);
+}
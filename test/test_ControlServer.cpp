@@ -0,0 +1,111 @@
+#include <boost/test/unit_test.hpp>
+#include "SimulatorFixture.hpp"
+#include <ptu_kongsberg_oe10/ControlServer.hpp>
+#include <boost/lexical_cast.hpp>
+#include <atomic>
+#include <csignal>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+struct ControlServerFixture : SimulatorFixture
+{
+    ControlServer server;
+    std::thread thread;
+
+    ControlServerFixture()
+        : SimulatorFixture({ 2 }, base::Time::fromMilliseconds(500))
+        , server(driver)
+    {
+        simulator.setMaxSpeed(1000);
+        server.open("/tmp/ptu_kongsberg_oe10_test_" + boost::lexical_cast<string>(getpid()) + ".sock");
+        thread = std::thread([this] { server.run(); });
+    }
+
+    ~ControlServerFixture()
+    {
+        server.stop();
+        thread.join();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(CommandInterpreter_rejects_invalid_command_lines)
+{
+    Driver driver;
+    CommandInterpreter interpreter(driver);
+    ostringstream out;
+    BOOST_REQUIRE_THROW(interpreter.execute("2", out), UsageError);
+    BOOST_REQUIRE_THROW(interpreter.execute("2 dance", out), UsageError);
+    BOOST_REQUIRE_THROW(interpreter.execute("2 pan", out), UsageError);
+    BOOST_REQUIRE_THROW(interpreter.execute("2 pan ninety", out), UsageError);
+    BOOST_REQUIRE_THROW(interpreter.execute("two status", out), UsageError);
+    BOOST_REQUIRE_EQUAL(0xFF, CommandInterpreter::parseDeviceID("0xFF"));
+    BOOST_REQUIRE_EQUAL(12, CommandInterpreter::parseDeviceID("12"));
+}
+
+BOOST_FIXTURE_TEST_CASE(ControlServer_executes_the_commands_of_its_clients, ControlServerFixture)
+{
+    ControlClient client;
+    client.connect(server.getPath());
+    BOOST_REQUIRE_EQUAL("", client.execute("2 pan 90 1"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    string status = client.execute("2 status");
+    BOOST_REQUIRE(status.find("Pan: 90 deg\n") != string::npos);
+    BOOST_REQUIRE_EQUAL('\n', status[status.size() - 1]);
+
+    // Several clients share the link
+    ControlClient other;
+    other.connect(server.getPath());
+    vector<string> args;
+    args.push_back("2");
+    args.push_back("info");
+    BOOST_REQUIRE(other.execute(args).find("Temperature: 20\n") != string::npos);
+    BOOST_REQUIRE_EQUAL(status, client.execute("2 status"));
+}
+
+BOOST_FIXTURE_TEST_CASE(ControlServer_reports_errors_and_keeps_serving, ControlServerFixture)
+{
+    ControlClient client;
+    client.connect(server.getPath());
+    BOOST_REQUIRE_THROW(client.execute("2 dance"), UsageError);
+    BOOST_REQUIRE_THROW(client.execute("3 status"), std::runtime_error);
+    BOOST_REQUIRE(client.execute("2 status").find("Status\n") == 0);
+
+    // A second server cannot take over the socket
+    Driver otherDriver;
+    ControlServer other(otherDriver);
+    BOOST_REQUIRE_THROW(other.open(server.getPath()), std::runtime_error);
+}
+
+static ControlServer* signaledServer = 0;
+
+static void stopSignaledServer(int)
+{
+    signaledServer->stop();
+}
+
+BOOST_AUTO_TEST_CASE(ControlServer_can_be_stopped_from_a_signal_handler)
+{
+    Driver driver;
+    ControlServer server(driver);
+    server.open("/tmp/ptu_kongsberg_oe10_test_signal_" + boost::lexical_cast<string>(getpid()) + ".sock");
+    signaledServer = &server;
+    void (*previous)(int) = signal(SIGUSR1, stopSignaledServer);
+
+    std::thread thread([&server] { server.run(); });
+    raise(SIGUSR1);
+    thread.join();
+    signal(SIGUSR1, previous);
+
+    // The stop request has been consumed
+    std::atomic<bool> returned(false);
+    thread = std::thread([&server, &returned] { server.run(); returned = true; });
+    usleep(50000);
+    BOOST_REQUIRE(!returned);
+    server.stop();
+    thread.join();
+}
@@ -0,0 +1,216 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include "SimulatorFixture.hpp"
+#include <cmath>
+#include <thread>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+BOOST_AUTO_TEST_CASE(Driver_estimates_the_sample_time_at_the_round_trip_midpoint)
+{
+    base::Time write = base::Time::fromMilliseconds(1000);
+    base::Time first_byte = base::Time::fromMilliseconds(1100);
+    BOOST_REQUIRE_EQUAL(base::Time::fromMilliseconds(1050),
+            Driver::estimateSampleTime(write, 15, first_byte, 0));
+}
+
+BOOST_AUTO_TEST_CASE(Driver_sample_time_estimate_accounts_for_transmission_times)
+{
+    // At 10000 bauds, a byte takes 1ms. The 10-bytes request ends at 1010ms
+    // and the reply started at 1089ms
+    base::Time write = base::Time::fromMilliseconds(1000);
+    base::Time first_byte = base::Time::fromMilliseconds(1090);
+    BOOST_REQUIRE_EQUAL(base::Time::fromMicroseconds(1049500),
+            Driver::estimateSampleTime(write, 10, first_byte, 10000));
+}
+
+BOOST_AUTO_TEST_CASE(Driver_counts_and_traces_skipped_bytes_once)
+{
+    // Write garbage and a reply on a PTY before the driver reads, so that
+    // the whole packet is already buffered when the read starts
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    BOOST_REQUIRE(master >= 0);
+    BOOST_REQUIRE(grantpt(master) == 0 && unlockpt(master) == 0);
+    Trace trace;
+    Driver driver;
+    driver.setTrace(&trace);
+    driver.setReadTimeout(base::Time::fromMilliseconds(200));
+    driver.openURI(string("serial://") + ptsname(master) + ":19200");
+
+    Packet reply(Packet::CONTROLLER, 2);
+    reply.setCommand(Packet::ACK);
+    byte data[] = { 'A', 'S', 0, 0, '0', '4', '5', '0', '0', '0', '0', '0' };
+    copy(data, data + 12, reply.data);
+    reply.data_size = 12;
+    vector<byte> bytes = { 'x', 'x', '<', 'y', 'y' };
+    reply.marshal(bytes);
+    BOOST_REQUIRE_EQUAL(static_cast<ssize_t>(bytes.size()), write(master, &bytes[0], bytes.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    BOOST_REQUIRE_CLOSE(M_PI / 4, driver.readPanTiltStatus(2).pan, 1e-3);
+    BOOST_REQUIRE_EQUAL(5, driver.getStatistics().skipped_bytes);
+    SampleRing<TraceRecord>::Reader reader(trace.getRing(), 0);
+    TraceRecord record;
+    int discarded = 0;
+    while (reader.read(record))
+        discarded += (record.direction == TraceRecord::RX_DISCARDED) ? record.size : 0;
+    BOOST_REQUIRE_EQUAL(5, discarded);
+
+    driver.close();
+    ::close(master);
+}
+
+BOOST_AUTO_TEST_CASE(Driver_timestamps_a_reply_with_its_first_buffered_bytes)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    BOOST_REQUIRE(master >= 0);
+    BOOST_REQUIRE(grantpt(master) == 0 && unlockpt(master) == 0);
+    Driver driver;
+    driver.setReadTimeout(base::Time::fromMilliseconds(500));
+    driver.openURI(string("serial://") + ptsname(master) + ":19200");
+
+    Packet reply(Packet::CONTROLLER, 2);
+    reply.setCommand(Packet::ACK);
+    byte data[] = { 'A', 'S', 0, 0, '0', '4', '5', '0', '0', '0', '0', '0' };
+    copy(data, data + 12, reply.data);
+    reply.data_size = 12;
+    vector<byte> bytes;
+    reply.marshal(bytes);
+
+    // The first half of the reply is received before the read starts, the
+    // rest 150ms later
+    BOOST_REQUIRE_EQUAL(10, write(master, &bytes[0], 10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread writer([&bytes, master] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        BOOST_REQUIRE_EQUAL(static_cast<ssize_t>(bytes.size() - 10), write(master, &bytes[10], bytes.size() - 10));
+    });
+    base::Time start = monotonicNow();
+    PanTiltStatus status = driver.readPanTiltStatus(2);
+    writer.join();
+    BOOST_REQUIRE(monotonicNow() - start >= base::Time::fromMilliseconds(150));
+    BOOST_REQUIRE(status.first_byte_time - start < base::Time::fromMilliseconds(50));
+
+    driver.close();
+    ::close(master);
+}
+
+BOOST_AUTO_TEST_CASE(Driver_move_ignores_replies_from_other_devices)
+{
+    // A stray ACK from device 3 arrives before the one of device 2
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    BOOST_REQUIRE(master >= 0);
+    BOOST_REQUIRE(grantpt(master) == 0 && unlockpt(master) == 0);
+    Driver driver;
+    driver.setReadTimeout(base::Time::fromMilliseconds(200));
+    driver.openURI(string("serial://") + ptsname(master) + ":19200");
+
+    vector<byte> bytes;
+    for (int from = 3; from >= 2; --from)
+    {
+        Packet reply(Packet::CONTROLLER, from);
+        reply.setCommand(Packet::ACK);
+        reply.data[0] = commands::SetPanSpeed::OPCODE0;
+        reply.data[1] = commands::SetPanSpeed::OPCODE1;
+        reply.data_size = 2;
+        reply.marshal(bytes);
+    }
+    BOOST_REQUIRE_EQUAL(static_cast<ssize_t>(bytes.size()), write(master, &bytes[0], bytes.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    MoveResult result = driver.tryMove(2, base::unset<float>(), base::unset<float>(), 0.5);
+    BOOST_REQUIRE(result.ok());
+    BOOST_REQUIRE(result.sent[MoveResult::PAN_SPEED]);
+
+    driver.close();
+    ::close(master);
+}
+
+struct MoveFixture : SimulatorFixture
+{
+    Trace trace;
+
+    MoveFixture()
+        : SimulatorFixture({ 2 }, base::Time::fromMilliseconds(200), { 4 })
+    {
+        simulator.setMaxSpeed(1000);
+        driver.setTrace(&trace);
+    }
+
+    int countWrites()
+    {
+        int count = 0;
+        SampleRing<TraceRecord>::Reader reader(trace.getRing(), 0);
+        TraceRecord record;
+        while (reader.read(record))
+            count += (record.direction == TraceRecord::TX);
+        return count;
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(Driver_move_sets_speeds_and_positions_in_a_single_write, MoveFixture)
+{
+    driver.move(2, 90 * M_PI / 180, 45 * M_PI / 180, 1, 0.5);
+    BOOST_REQUIRE_EQUAL(1, countWrites());
+
+    SimulatedDevice device = simulator.getDevice(2);
+    BOOST_REQUIRE_EQUAL(1, device.pan_speed);
+    BOOST_REQUIRE_EQUAL(0.5, device.tilt_speed);
+    BOOST_REQUIRE_CLOSE(90, device.pan_target, 1e-3);
+    BOOST_REQUIRE_CLOSE(45, device.tilt_target, 1e-3);
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_move_leaves_unset_values_alone, MoveFixture)
+{
+    MoveResult result = driver.tryMove(2, 90 * M_PI / 180, base::unset<float>(), 1);
+    BOOST_REQUIRE(result.ok());
+    BOOST_REQUIRE(result.applied(MoveResult::PAN_SPEED));
+    BOOST_REQUIRE(result.applied(MoveResult::PAN_POSITION));
+    BOOST_REQUIRE(!result.requested[MoveResult::TILT_SPEED]);
+    BOOST_REQUIRE(!result.requested[MoveResult::TILT_POSITION]);
+
+    SimulatedDevice device = simulator.getDevice(2);
+    BOOST_REQUIRE_EQUAL(0.5, device.tilt_speed);
+    BOOST_REQUIRE_EQUAL(0, device.tilt_target);
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_move_reports_which_commands_have_been_applied, MoveFixture)
+{
+    MoveResult result = driver.tryMove(4, 90 * M_PI / 180, 45 * M_PI / 180, 1, 1);
+    BOOST_REQUIRE(!result.ok());
+    BOOST_REQUIRE_EQUAL(MoveResult::TILT_SPEED, result.getFirstFailure());
+    BOOST_REQUIRE_EQUAL(Error::NAK, result.errors[MoveResult::TILT_POSITION].code);
+    BOOST_REQUIRE(result.applied(MoveResult::PAN_SPEED));
+    BOOST_REQUIRE(result.applied(MoveResult::PAN_POSITION));
+    BOOST_REQUIRE_CLOSE(90, simulator.getDevice(4).pan_target, 1e-3);
+
+    try
+    {
+        driver.move(4, 90 * M_PI / 180, 45 * M_PI / 180, 1, 1);
+        BOOST_FAIL("expected move to throw");
+    }
+    catch(MoveError const& e)
+    {
+        BOOST_REQUIRE(e.result.applied(MoveResult::PAN_POSITION));
+        BOOST_REQUIRE(string(e.what()).find("applied: pan speed, pan position") != string::npos);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_move_writes_nothing_if_a_parameter_is_invalid, MoveFixture)
+{
+    MoveResult result = driver.tryMove(2, 90 * M_PI / 180, 45 * M_PI / 180, 1, 2);
+    BOOST_REQUIRE_EQUAL(Error::INVALID_ARGUMENT, result.errors[MoveResult::TILT_SPEED].code);
+    BOOST_REQUIRE(!result.applied(MoveResult::PAN_SPEED));
+    BOOST_REQUIRE(!result.ok());
+    BOOST_REQUIRE_EQUAL(0, countWrites());
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_move_reports_timeouts, MoveFixture)
+{
+    MoveResult result = driver.tryMove(5, 90 * M_PI / 180, base::unset<float>());
+    BOOST_REQUIRE_EQUAL(Error::TIMEOUT, result.errors[MoveResult::PAN_POSITION].code);
+}
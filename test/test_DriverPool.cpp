@@ -0,0 +1,127 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/Simulator.hpp>
+#include <ptu_kongsberg_oe10/DriverPool.hpp>
+#include <iodrivers_base/Exceptions.hpp>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+struct DriverPoolFixture
+{
+    Simulator simulators[2];
+    DriverPool pool;
+    int ports[2];
+
+    DriverPoolFixture()
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            simulators[i].addDevice(2);
+            simulators[i].setMaxSpeed(1000);
+            string path = simulators[i].start();
+            ports[i] = pool.addLink("serial://" + path + ":19200");
+            pool.getDriver(ports[i]).setReadTimeout(base::Time::fromMilliseconds(300));
+        }
+        pool.start();
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(DriverPool_executes_commands_on_several_links, DriverPoolFixture)
+{
+    std::future<void> set0 = pool.submit(ports[0], 2, commands::SetPanPosition(0.5));
+    std::future<void> set1 = pool.submit(ports[1], 2, commands::SetPanPosition(1.0));
+    set0.get();
+    set1.get();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    PanTiltStatus status0 = pool.submit(ports[0], 2, commands::GetPanTiltStatus()).get();
+    PanTiltStatus status1 = pool.submit(ports[1], 2, commands::GetPanTiltStatus()).get();
+    BOOST_REQUIRE_CLOSE(0.5, status0.pan, 2);
+    BOOST_REQUIRE_CLOSE(1.0, status1.pan, 2);
+    BOOST_REQUIRE(!status0.sample_time.isNull());
+}
+
+BOOST_FIXTURE_TEST_CASE(DriverPool_completes_the_commands_of_a_link_in_submission_order, DriverPoolFixture)
+{
+    std::mutex mutex;
+    vector<int> order;
+    for (int i = 0; i < 10; ++i)
+    {
+        pool.submit(ports[0], 2, commands::SetPanSpeed(0.1 * (i % 10)),
+            [&mutex, &order, i](Expected<void> const& result) {
+                BOOST_REQUIRE(result.ok());
+                lock_guard<std::mutex> lock(mutex);
+                order.push_back(i);
+            });
+    }
+    pool.submit(ports[0], 2, commands::GetPanTiltStatus()).get();
+
+    lock_guard<std::mutex> lock(mutex);
+    BOOST_REQUIRE_EQUAL(10, order.size());
+    for (int i = 0; i < 10; ++i)
+        BOOST_REQUIRE_EQUAL(i, order[i]);
+}
+
+BOOST_FIXTURE_TEST_CASE(DriverPool_does_not_block_a_link_on_a_silent_device, DriverPoolFixture)
+{
+    std::future<PanTiltStatus> silent = pool.submit(ports[0], 9, commands::GetPanTiltStatus());
+    base::Time start = monotonicNow();
+    for (int i = 0; i < 5; ++i)
+        pool.submit(ports[1], 2, commands::GetPanTiltStatus()).get();
+    BOOST_REQUIRE(monotonicNow() - start < base::Time::fromMilliseconds(200));
+
+    BOOST_REQUIRE_THROW(silent.get(), iodrivers_base::TimeoutError);
+    DriverStatistics stats = pool.getStatistics(ports[0]).get();
+    BOOST_REQUIRE_EQUAL(1, stats.timeouts);
+}
+
+BOOST_FIXTURE_TEST_CASE(DriverPool_reports_invalid_parameters_without_sending_them, DriverPoolFixture)
+{
+    BOOST_REQUIRE_THROW(pool.submit(ports[0], 2, commands::SetPanSpeed(2)).get(), std::range_error);
+    DriverStatistics stats = pool.getStatistics(ports[0]).get();
+    BOOST_REQUIRE_EQUAL(0, stats.timeouts);
+}
+
+BOOST_FIXTURE_TEST_CASE(DriverPool_polls_devices_periodically, DriverPoolFixture)
+{
+    std::atomic<int> counts[2];
+    counts[0] = counts[1] = 0;
+    for (int i = 0; i < 2; ++i)
+    {
+        pool.addPoll(ports[i], 2, base::Time::fromMilliseconds(20),
+            [&counts](int port, int device_id, Expected<PanTiltStatus> const& status) {
+                if (status.ok() && device_id == 2)
+                    ++counts[port];
+            });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    BOOST_REQUIRE_GE(counts[0], 5);
+    BOOST_REQUIRE_GE(counts[1], 5);
+}
+
+BOOST_FIXTURE_TEST_CASE(DriverPool_stops_calling_removed_polls, DriverPoolFixture)
+{
+    std::atomic<int> count(0);
+    int poll = pool.addPoll(ports[0], 2, base::Time::fromMilliseconds(10),
+        [&count](int, int, Expected<PanTiltStatus> const&) { ++count; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    pool.removePoll(poll);
+    int stopped = count;
+    BOOST_REQUIRE_GT(stopped, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    BOOST_REQUIRE_LE(count, stopped + 1);
+}
+
+BOOST_AUTO_TEST_CASE(DriverPool_refuses_links_while_running)
+{
+    Simulator simulator;
+    simulator.addDevice(2);
+    DriverPool pool;
+    pool.addLink("serial://" + simulator.start() + ":19200");
+    pool.start();
+    BOOST_REQUIRE_THROW(pool.addLink("serial://" + simulator.getDevicePath() + ":19200"), std::logic_error);
+    BOOST_REQUIRE_THROW(pool.getDriver(1), std::out_of_range);
+}
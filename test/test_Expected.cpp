@@ -0,0 +1,132 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/Expected.hpp>
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <ptu_kongsberg_oe10/Pipeline.hpp>
+#include "SimulatorFixture.hpp"
+#include <iodrivers_base/Exceptions.hpp>
+#include <cmath>
+#include <unistd.h>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+/** A command the simulator does not know, which it NAKs */
+struct UnknownCommand : commands::Descriptor<'Z', 'Z', 0, 0>
+{
+    typedef void Result;
+    void encode(byte*) const {}
+    void decode(byte const*) const {}
+};
+
+struct ExpectedFixture : SimulatorFixture
+{
+    ExpectedFixture()
+        : SimulatorFixture({ 2 }, base::Time::fromMilliseconds(100))
+    {
+        simulator.setMaxSpeed(1000);
+    }
+};
+
+static vector<byte> reply(byte command, byte from, vector<byte> const& data)
+{
+    Packet packet(Packet::CONTROLLER, from);
+    packet.setCommand(command);
+    packet.data_size = data.size();
+    copy(data.begin(), data.end(), packet.data);
+    vector<byte> buffer;
+    packet.marshal(buffer);
+    return buffer;
+}
+
+BOOST_AUTO_TEST_CASE(PacketView_checkResponseFor_reports_error_codes)
+{
+    byte const command[2] = { 'T', 'U' };
+
+    vector<byte> ack = reply(Packet::ACK, 2, { 'T', 'U', '0', '1', '0' });
+    BOOST_REQUIRE_EQUAL(Error::NONE, PacketView::parse(&ack[0], ack.size()).checkResponseFor(2, command, 2).code);
+
+    Error error = PacketView::parse(&ack[0], ack.size()).checkResponseFor(3, command, 2);
+    BOOST_REQUIRE_EQUAL(Error::DEVICE_MISMATCH, error.code);
+    BOOST_REQUIRE_EQUAL(2, error.received);
+
+    vector<byte> other = reply(Packet::ACK, 2, { 'T', 'D', '0', '1', '0' });
+    error = PacketView::parse(&other[0], other.size()).checkResponseFor(2, command, 2);
+    BOOST_REQUIRE_EQUAL(Error::COMMAND_MISMATCH, error.code);
+    BOOST_REQUIRE_EQUAL("expected a ACK/NAK for command TU but got it for TD", error.toString());
+
+    vector<byte> nak = reply(Packet::NAK, 2, { 'T', 'U', 0x08 });
+    error = PacketView::parse(&nak[0], nak.size()).checkResponseFor(2, command, 2);
+    BOOST_REQUIRE_EQUAL(Error::NAK, error.code);
+    BOOST_REQUIRE_EQUAL(0x08, error.received);
+    BOOST_REQUIRE(error.toString().find("command not available for this device") != string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(Packet_tryParseAngle_rejects_non_digits)
+{
+    byte const valid[3] = { '1', '8', '0' };
+    byte const invalid[3] = { '1', 'x', '0' };
+    float angle;
+    BOOST_REQUIRE(Packet::tryParseAngle(valid, angle));
+    BOOST_REQUIRE_CLOSE(M_PI, angle, 1e-4);
+    BOOST_REQUIRE(!Packet::tryParseAngle(invalid, angle));
+    BOOST_REQUIRE_THROW(Packet::parseAngle(invalid), std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_tryExecute_returns_the_reply, ExpectedFixture)
+{
+    driver.setPanSpeed(2, 1);
+    driver.setPanPosition(2, 90 * M_PI / 180);
+    usleep(200000);
+    Expected<PanTiltStatus> status = driver.tryExecute(2, commands::GetPanTiltStatus());
+    BOOST_REQUIRE(status.ok());
+    BOOST_REQUIRE_CLOSE(90, status->pan * 180 / M_PI, 1e-3);
+    BOOST_REQUIRE(!status->sample_time.isNull());
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_tryExecute_reports_NAKs_without_throwing, ExpectedFixture)
+{
+    Expected<void> result = driver.tryExecute(2, UnknownCommand());
+    BOOST_REQUIRE(!result.ok());
+    BOOST_REQUIRE_EQUAL(Error::NAK, result.error().code);
+    BOOST_REQUIRE_EQUAL(0x10, result.error().received);
+    BOOST_REQUIRE_EQUAL(1, driver.getStatistics().naks);
+    BOOST_REQUIRE_THROW(driver.execute(2, UnknownCommand()), std::runtime_error);
+
+    // The driver is still in sync
+    BOOST_REQUIRE(driver.tryExecute(2, commands::GetStatus()).ok());
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_tryExecute_reports_timeouts_without_throwing, ExpectedFixture)
+{
+    Expected<double> result = driver.tryExecute(5, commands::TiltStop());
+    BOOST_REQUIRE_EQUAL(Error::TIMEOUT, result.error().code);
+    BOOST_REQUIRE_EQUAL(5, result.error().device_id);
+    BOOST_REQUIRE_THROW(driver.tiltStop(5), iodrivers_base::TimeoutError);
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_tryExecute_rejects_invalid_parameters_before_writing, ExpectedFixture)
+{
+    Expected<void> result = driver.tryExecute(2, commands::SetPanSpeed(1.5));
+    BOOST_REQUIRE_EQUAL(Error::INVALID_ARGUMENT, result.error().code);
+    result = driver.tryExecute(2, commands::SetTiltPosition(-1));
+    BOOST_REQUIRE_EQUAL(Error::INVALID_ARGUMENT, result.error().code);
+    BOOST_REQUIRE_THROW(result.get(), std::range_error);
+
+    // Nothing has been written, so no reply is pending
+    BOOST_REQUIRE(driver.tryExecute(2, commands::GetStatus()).ok());
+}
+
+BOOST_FIXTURE_TEST_CASE(Pipeline_reports_per_request_errors, ExpectedFixture)
+{
+    Pipeline pipeline(driver);
+    int ok = pipeline.add(2, commands::GetStatus());
+    int nak = pipeline.add(2, UnknownCommand());
+    int timeout = pipeline.add(5, commands::GetStatus());
+    pipeline.run();
+
+    BOOST_REQUIRE(!pipeline.getError(ok));
+    BOOST_REQUIRE(pipeline.tryGet(ok, commands::GetStatus()).ok());
+    BOOST_REQUIRE_EQUAL(Error::NAK, pipeline.getError(nak).code);
+    BOOST_REQUIRE_EQUAL(Error::TIMEOUT, pipeline.tryGet(timeout, commands::GetStatus()).error().code);
+    BOOST_REQUIRE_THROW(pipeline.get(timeout, commands::GetStatus()), iodrivers_base::TimeoutError);
+}
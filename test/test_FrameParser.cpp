@@ -0,0 +1,139 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/FrameParser.hpp>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+static vector<byte> makeFrame()
+{
+    Packet packet(1, 2);
+    packet.setCommand('A', 'S');
+    packet.data_size = 3;
+    packet.data[0] = '0';
+    packet.data[1] = '9';
+    packet.data[2] = '0';
+    vector<byte> buffer;
+    packet.marshal(buffer);
+    return buffer;
+}
+
+BOOST_AUTO_TEST_CASE(FrameParser_extracts_a_frame_received_byte_by_byte)
+{
+    vector<byte> frame = makeFrame();
+    FrameParser parser;
+    for (size_t size = 1; size < frame.size(); ++size)
+        BOOST_REQUIRE_EQUAL(0, parser.extract(&frame[0], size));
+    BOOST_REQUIRE_EQUAL(frame.size(), parser.extract(&frame[0], frame.size()));
+    BOOST_REQUIRE_EQUAL(FrameParser::NONE, parser.getLastError());
+}
+
+BOOST_AUTO_TEST_CASE(FrameParser_skips_garbage_up_to_the_next_start_marker_at_once)
+{
+    vector<byte> frame = makeFrame();
+    vector<byte> buffer(100, 'x');
+    buffer.insert(buffer.end(), frame.begin(), frame.end());
+
+    FrameParser parser;
+    BOOST_REQUIRE_EQUAL(-100, parser.extract(&buffer[0], buffer.size()));
+    BOOST_REQUIRE_EQUAL(FrameParser::SYNC, parser.getLastError());
+    BOOST_REQUIRE_EQUAL(frame.size(), parser.extract(&buffer[100], frame.size()));
+}
+
+BOOST_AUTO_TEST_CASE(FrameParser_discards_a_buffer_without_start_marker)
+{
+    vector<byte> buffer(10, 'x');
+    FrameParser parser;
+    BOOST_REQUIRE_EQUAL(-10, parser.extract(&buffer[0], buffer.size()));
+}
+
+BOOST_AUTO_TEST_CASE(FrameParser_rejects_an_invalid_length_without_throwing)
+{
+    vector<byte> frame = makeFrame();
+    FrameParser parser;
+
+    frame[5] = 1;
+    BOOST_REQUIRE_EQUAL(-1, parser.extract(&frame[0], 6));
+    BOOST_REQUIRE_EQUAL(FrameParser::LENGTH, parser.getLastError());
+
+    frame[5] = 120;
+    parser.setMaxFrameSize(64);
+    BOOST_REQUIRE_EQUAL(-1, parser.extract(&frame[0], 6));
+    BOOST_REQUIRE_EQUAL(FrameParser::LENGTH, parser.getLastError());
+}
+
+/** Builds a frame with a valid checksum from its header and body, i.e.
+ * everything between the start marker and the trailer */
+static vector<byte> makeRawFrame(string const& body)
+{
+    vector<byte> frame(1, '<');
+    frame.insert(frame.end(), body.begin(), body.end());
+    frame.push_back(':');
+    frame.resize(frame.size() + 4);
+    Packet::marshalChecksum(Packet::computeChecksum(&frame[1], &frame[1] + body.size()),
+            &frame[frame.size() - 4]);
+    frame.back() = '>';
+    return frame;
+}
+
+BOOST_AUTO_TEST_CASE(FrameParser_rejects_a_length_that_does_not_cover_the_command)
+{
+    // The length announces a one-byte command, but the opcode has two
+    vector<byte> frame = makeRawFrame("\x01:\x02:\x02:AS");
+    BOOST_REQUIRE_EQUAL(FrameParser::MIN_FRAME_SIZE, frame.size());
+    FrameParser parser;
+    BOOST_REQUIRE_EQUAL(-1, parser.extract(&frame[0], frame.size()));
+    BOOST_REQUIRE_EQUAL(FrameParser::LENGTH, parser.getLastError());
+    BOOST_REQUIRE_LT(Packet::extractPacket(&frame[0], frame.size()), 0);
+
+    // The separator after the command is missing
+    frame = makeRawFrame("\x01:\x02:\x05:ASx00");
+    BOOST_REQUIRE_EQUAL(-1, parser.extract(&frame[0], frame.size()));
+    BOOST_REQUIRE_EQUAL(FrameParser::HEADER, parser.getLastError());
+
+    frame = makeRawFrame("\x01:\x02:\x05:AS:00");
+    BOOST_REQUIRE_EQUAL(frame.size(), parser.extract(&frame[0], frame.size()));
+    frame = makeRawFrame("\x01:\x02:\x02:\x06:");
+    BOOST_REQUIRE_EQUAL(frame.size(), parser.extract(&frame[0], frame.size()));
+}
+
+BOOST_AUTO_TEST_CASE(FrameParser_accepts_lengths_of_99_and_more)
+{
+    Packet packet(1, 2);
+    packet.setCommand('A', 'S');
+    packet.data_size = 120;
+    for (int i = 0; i < packet.data_size; ++i)
+        packet.data[i] = '0';
+    vector<byte> frame;
+    packet.marshal(frame);
+
+    FrameParser parser;
+    BOOST_REQUIRE_EQUAL(frame.size(), parser.extract(&frame[0], frame.size()));
+}
+
+BOOST_AUTO_TEST_CASE(FrameParser_rejects_a_corrupt_header_before_the_frame_is_complete)
+{
+    vector<byte> frame = makeFrame();
+    frame[4] = 'x';
+    FrameParser parser;
+    BOOST_REQUIRE_EQUAL(0, parser.extract(&frame[0], 4));
+    BOOST_REQUIRE_EQUAL(-1, parser.extract(&frame[0], 5));
+    BOOST_REQUIRE_EQUAL(FrameParser::HEADER, parser.getLastError());
+}
+
+BOOST_AUTO_TEST_CASE(FrameParser_reports_checksum_errors)
+{
+    vector<byte> frame = makeFrame();
+    frame[10] ^= 1;
+    FrameParser parser;
+    BOOST_REQUIRE_EQUAL(-1, parser.extract(&frame[0], frame.size()));
+    BOOST_REQUIRE_EQUAL(FrameParser::CHECKSUM, parser.getLastError());
+}
+
+BOOST_AUTO_TEST_CASE(FrameParser_restarts_if_the_buffer_was_reset_under_it)
+{
+    vector<byte> frame = makeFrame();
+    FrameParser parser;
+    BOOST_REQUIRE_EQUAL(0, parser.extract(&frame[0], 8));
+    BOOST_REQUIRE_EQUAL(0, parser.extract(&frame[0], 3));
+    BOOST_REQUIRE_EQUAL(frame.size(), parser.extract(&frame[0], frame.size()));
+}
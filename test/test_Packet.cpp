@@ -1,5 +1,6 @@
 #include <boost/test/unit_test.hpp>
 #include <ptu_kongsberg_oe10/Packet.hpp>
+#include <algorithm>
 
 using namespace std;
 using namespace ptu_kongsberg_oe10;
@@ -76,3 +77,127 @@ BOOST_AUTO_TEST_CASE(Packet_encodeAngle)
     BOOST_REQUIRE_EQUAL(expected[2], buffer[2]);
 }
 
+static string encodeDegrees(double degrees)
+{
+    byte buffer[3];
+    Packet::encodeAngle(buffer, static_cast<float>(degrees * M_PI / 180));
+    return string(buffer, buffer + 3);
+}
+
+BOOST_AUTO_TEST_CASE(Packet_encodeAngle_rounds_to_the_nearest_degree)
+{
+    // 5 degrees as a float is slightly less than 5, truncation gave 004
+    BOOST_REQUIRE(static_cast<float>(5 * M_PI / 180) * 180 / M_PI < 5);
+    BOOST_REQUIRE_EQUAL("005", encodeDegrees(5));
+    BOOST_REQUIRE_EQUAL("005", encodeDegrees(4.6));
+    BOOST_REQUIRE_EQUAL("005", encodeDegrees(5.4));
+    BOOST_REQUIRE_EQUAL("000", encodeDegrees(-0.4));
+    BOOST_REQUIRE_EQUAL("360", encodeDegrees(360.4));
+    BOOST_REQUIRE_THROW(encodeDegrees(360.6), std::range_error);
+    BOOST_REQUIRE_THROW(encodeDegrees(-0.6), std::range_error);
+
+    // isValidAngle agrees with the rounding
+    BOOST_REQUIRE(Packet::isValidAngle(static_cast<float>(360.4 * M_PI / 180)));
+    BOOST_REQUIRE(Packet::isValidAngle(static_cast<float>(-0.4 * M_PI / 180)));
+    BOOST_REQUIRE(!Packet::isValidAngle(static_cast<float>(360.6 * M_PI / 180)));
+    BOOST_REQUIRE(!Packet::isValidAngle(static_cast<float>(-0.6 * M_PI / 180)));
+}
+
+BOOST_AUTO_TEST_CASE(Packet_encodeAngle_round_trips_all_degrees)
+{
+    for (int degrees = 0; degrees <= 360; ++degrees)
+    {
+        byte buffer[3];
+        Packet::encodeAngle(buffer, static_cast<float>(degrees * M_PI / 180));
+        float parsed = Packet::parseAngle(buffer);
+        BOOST_REQUIRE_EQUAL(degrees, lround(parsed * 180 / M_PI));
+        Packet::encodeAngle(buffer, parsed);
+        BOOST_REQUIRE_EQUAL(degrees, lround(Packet::parseAngle(buffer) * 180 / M_PI));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(PacketView_points_into_the_parsed_buffer)
+{
+    Packet packet(1, 2);
+    packet.setCommand(Packet::ACK);
+    packet.data_size = 5;
+    packet.data[0] = 'T';
+    packet.data[1] = 'U';
+    packet.data[2] = '1';
+    packet.data[3] = '2';
+    packet.data[4] = '3';
+
+    vector<byte> buffer;
+    packet.marshal(buffer);
+
+    PacketView view = PacketView::parse(&buffer[0], buffer.size());
+    BOOST_REQUIRE_EQUAL(1, view.to);
+    BOOST_REQUIRE_EQUAL(2, view.from);
+    BOOST_REQUIRE_EQUAL(1, view.command_size);
+    BOOST_REQUIRE_EQUAL(5, view.data_size);
+    BOOST_REQUIRE(view.data >= &buffer[0] && view.data < &buffer[0] + buffer.size());
+    BOOST_REQUIRE_EQUAL("ACK", view.getCommandAsString());
+
+    Packet cmd(2);
+    cmd.setCommand('T', 'U');
+    view.validateResponseFor(cmd);
+    PacketView payload = view.skipData(2);
+    BOOST_REQUIRE_EQUAL(3, payload.data_size);
+    BOOST_REQUIRE_EQUAL(static_cast<byte>('1'), payload.data[0]);
+}
+
+BOOST_AUTO_TEST_CASE(PacketView_reports_the_NAK_error_byte)
+{
+    Packet packet(1, 2);
+    packet.setCommand(Packet::NAK);
+    packet.data_size = 3;
+    packet.data[0] = 'T';
+    packet.data[1] = 'U';
+    packet.data[2] = 0x08;
+
+    vector<byte> buffer;
+    packet.marshal(buffer);
+    PacketView view = PacketView::parse(&buffer[0], buffer.size());
+
+    Packet cmd(2);
+    cmd.setCommand('T', 'U');
+    try
+    {
+        view.validateResponseFor(cmd);
+        BOOST_FAIL("expected validateResponseFor to throw");
+    }
+    catch(std::runtime_error const& e)
+    {
+        BOOST_REQUIRE(string(e.what()).find("command not available for this device") != string::npos);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Packet_marshal_in_fixed_buffer_matches_the_protocol_layout)
+{
+    Packet packet(2, 1);
+    packet.setCommand('P', 'P');
+    packet.data_size = 3;
+    packet.data[0] = '2';
+    packet.data[1] = '4';
+    packet.data[2] = '5';
+
+    byte const expected[] = {
+        '<', 2, ':', 1, ':', 6, ':', 'P', 'P', ':', '2', '4', '5',
+        ':', 0x36, ':', 'G', '>' };
+
+    byte buffer[Packet::MAX_PACKET_SIZE];
+    int size = packet.marshal(buffer, Packet::MAX_PACKET_SIZE);
+    BOOST_REQUIRE_EQUAL(sizeof(expected), size);
+    BOOST_REQUIRE_EQUAL(packet.getMarshalledSize(), size);
+    BOOST_REQUIRE(equal(expected, expected + sizeof(expected), buffer));
+    BOOST_REQUIRE_EQUAL(size, Packet::extractPacket(buffer, size));
+    BOOST_REQUIRE_THROW(packet.marshal(buffer, size - 1), std::length_error);
+}
+
+BOOST_AUTO_TEST_CASE(Packet_MAX_PACKET_SIZE_fits_the_largest_frame)
+{
+    Packet packet;
+    packet.setCommand('P', 'P');
+    packet.data_size = Packet::MAX_DATA_SIZE;
+    BOOST_REQUIRE_EQUAL(Packet::MAX_PACKET_SIZE, packet.getMarshalledSize());
+}
@@ -0,0 +1,153 @@
+#include <boost/test/unit_test.hpp>
+#include "SimulatorFixture.hpp"
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <ptu_kongsberg_oe10/PoseEstimator.hpp>
+#include <cmath>
+#include <thread>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+static float deg2rad(float deg)
+{
+    return deg * M_PI / 180;
+}
+
+static PanTiltStatus makeStatus(base::Time const& time, float pan, float tilt,
+        float pan_speed = 0, float tilt_speed = 0)
+{
+    PanTiltStatus status;
+    status.time = time;
+    status.pan = pan;
+    status.tilt = tilt;
+    status.pan_speed = pan_speed;
+    status.tilt_speed = tilt_speed;
+    return status;
+}
+
+BOOST_AUTO_TEST_CASE(PoseEstimator_is_invalid_until_it_gets_an_AS_reply)
+{
+    PoseEstimator estimator(1, 1);
+    base::Time start = base::Time::fromSeconds(100);
+    estimator.setPanTarget(1, start);
+    BOOST_REQUIRE(!estimator.poseAt(start).valid);
+
+    estimator.update(makeStatus(start, 0.5, 0.2));
+    PoseEstimate estimate = estimator.poseAt(start);
+    BOOST_REQUIRE(estimate.valid);
+    BOOST_REQUIRE_CLOSE(0.5, estimate.pan, 1e-3);
+    BOOST_REQUIRE_CLOSE(0.2, estimate.tilt, 1e-3);
+    BOOST_REQUIRE_CLOSE(deg2rad(1), PoseEstimator::RESOLUTION, 1e-3);
+    BOOST_REQUIRE_CLOSE(deg2rad(0.5), estimate.pan_uncertainty, 1e-3);
+
+    estimator.reset();
+    BOOST_REQUIRE(!estimator.poseAt(start).valid);
+}
+
+BOOST_AUTO_TEST_CASE(PoseEstimator_interpolates_between_AS_replies)
+{
+    PoseEstimator estimator(1, 1);
+    base::Time start = base::Time::fromSeconds(100);
+    estimator.update(makeStatus(start, 0, 1, 0.2, 0.2));
+    estimator.update(makeStatus(start + base::Time::fromSeconds(1), 0.2, 0.8, 0.2, 0.2));
+
+    PoseEstimate estimate = estimator.poseAt(start + base::Time::fromMilliseconds(250));
+    BOOST_REQUIRE_CLOSE(0.05, estimate.pan, 1e-2);
+    BOOST_REQUIRE_CLOSE(0.95, estimate.tilt, 1e-2);
+
+    // Without a target, the motion goes on at the observed velocity
+    estimate = estimator.poseAt(start + base::Time::fromSeconds(2));
+    BOOST_REQUIRE_CLOSE(0.4, estimate.pan, 1e-2);
+    BOOST_REQUIRE_CLOSE(0.6, estimate.tilt, 1e-2);
+    BOOST_REQUIRE_CLOSE(deg2rad(0.5) + estimator.getVelocityNoise(),
+            estimate.pan_uncertainty, 1e-2);
+}
+
+BOOST_AUTO_TEST_CASE(PoseEstimator_extrapolates_towards_the_commanded_target)
+{
+    PoseEstimator estimator(2, 2);
+    base::Time start = base::Time::fromSeconds(100);
+    estimator.update(makeStatus(start, 0, 0));
+    estimator.setPanSpeed(0.25, start);
+    estimator.setPanTarget(1, start);
+
+    PoseEstimate estimate = estimator.poseAt(start + base::Time::fromSeconds(1));
+    BOOST_REQUIRE_CLOSE(0.5, estimate.pan, 1e-2);
+    BOOST_REQUIRE_SMALL(estimate.tilt, 1e-6f);
+    estimate = estimator.poseAt(start + base::Time::fromSeconds(3));
+    BOOST_REQUIRE_CLOSE(1, estimate.pan, 1e-3);
+
+    // The target becomes unknown after e.g. a stop, and the motion goes on
+    // at the last estimated velocity
+    estimator.clearPanTarget(start + base::Time::fromSeconds(1));
+    estimate = estimator.poseAt(start + base::Time::fromSeconds(3));
+    BOOST_REQUIRE_GT(estimate.pan_uncertainty, 0.5);
+}
+
+BOOST_AUTO_TEST_CASE(PoseEstimator_uncertainty_grows_with_the_velocity_disagreement)
+{
+    PoseEstimator estimator(1, 1);
+    estimator.setVelocityNoise(0);
+    base::Time start = base::Time::fromSeconds(100);
+    estimator.setPanSpeed(0.5, start);
+    estimator.setPanTarget(2, start);
+    estimator.update(makeStatus(start, 0, 0, 0.5));
+    // The axis only moved by 0.1 rad in a second, i.e. 0.4 rad/s slower
+    // than commanded
+    estimator.update(makeStatus(start + base::Time::fromSeconds(1), 0.1, 0, 0.5));
+
+    PoseEstimate estimate = estimator.poseAt(start + base::Time::fromSeconds(2));
+    BOOST_REQUIRE_CLOSE(0.6, estimate.pan, 1e-2);
+    BOOST_REQUIRE_CLOSE(deg2rad(0.5) + 0.4, estimate.pan_uncertainty, 1e-2);
+    BOOST_REQUIRE_CLOSE(deg2rad(0.5), estimate.tilt_uncertainty, 1e-2);
+}
+
+BOOST_AUTO_TEST_CASE(PoseEstimator_stops_when_the_rounded_angle_reaches_the_target)
+{
+    PoseEstimator estimator(1, 1);
+    base::Time start = base::Time::fromSeconds(100);
+    estimator.setPanSpeed(0.5, start);
+    estimator.setTiltSpeed(0.5, start);
+    estimator.setPanTarget(deg2rad(40.3), start);
+    estimator.setTiltTarget(deg2rad(41), start);
+    estimator.update(makeStatus(start, deg2rad(40), deg2rad(40), 0.5, 0.5));
+
+    // AS angles are whole degrees: pan has arrived, tilt is one count away
+    PoseEstimate estimate = estimator.poseAt(start + base::Time::fromSeconds(1));
+    BOOST_REQUIRE_CLOSE(deg2rad(40), estimate.pan, 1e-3);
+    BOOST_REQUIRE_CLOSE(deg2rad(41), estimate.tilt, 1e-3);
+}
+
+struct PoseEstimatorFixture : SimulatorFixture
+{
+    PoseEstimatorFixture()
+        : SimulatorFixture({ 2 }, base::Time::fromMilliseconds(500))
+    {
+        simulator.setMaxSpeed(100);
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(PoseEstimator_is_fed_by_the_driver, PoseEstimatorFixture)
+{
+    PoseEstimator estimator(deg2rad(100), deg2rad(100));
+    driver.setPoseEstimator(2, &estimator);
+    BOOST_REQUIRE_EQUAL(&estimator, driver.getPoseEstimator());
+
+    driver.getPanTiltStatus(2);
+    BOOST_REQUIRE(estimator.poseAt(base::Time::now()).valid);
+
+    driver.setPanSpeed(2, 0.5);
+    driver.setPanPosition(2, deg2rad(40));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    PanTiltStatus status = driver.getPanTiltStatus(2);
+    PoseEstimate estimate = estimator.poseAt(status.time);
+    BOOST_REQUIRE_LT(std::abs(estimate.pan - status.pan), deg2rad(1));
+
+    // Between polls, the estimate follows the commanded motion
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    estimate = estimator.poseAt(base::Time::now());
+    status = driver.getPanTiltStatus(2);
+    BOOST_REQUIRE_LT(std::abs(estimate.pan - status.pan), estimate.pan_uncertainty + deg2rad(2));
+    BOOST_REQUIRE_GT(estimate.pan, deg2rad(15));
+}
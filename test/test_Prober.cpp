@@ -0,0 +1,153 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/Simulator.hpp>
+#include <ptu_kongsberg_oe10/Prober.hpp>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+static boost::uint64_t countReplies(DriverStatistics const& stats, byte c0, byte c1)
+{
+    CommandStatistics const* entry = stats.find(c0, c1);
+    return entry ? entry->latency.count : 0;
+}
+
+BOOST_AUTO_TEST_CASE(Prober_tries_the_preferred_baud_rate_and_then_the_fastest_ones)
+{
+    Driver driver;
+    Prober prober(driver);
+    vector<int> baudrates;
+    baudrates.push_back(9600);
+    baudrates.push_back(115200);
+    baudrates.push_back(19200);
+    prober.setBaudRates(baudrates);
+
+    vector<int> order = prober.getProbeOrder();
+    BOOST_REQUIRE_EQUAL(3, order.size());
+    BOOST_REQUIRE_EQUAL(115200, order[0]);
+    BOOST_REQUIRE_EQUAL(19200, order[1]);
+    BOOST_REQUIRE_EQUAL(9600, order[2]);
+
+    prober.setPreferredBaudRate(9600);
+    order = prober.getProbeOrder();
+    BOOST_REQUIRE_EQUAL(9600, order[0]);
+    BOOST_REQUIRE_EQUAL(115200, order[1]);
+
+    BOOST_REQUIRE(Prober::getProbeTimeout(9600, base::Time()) >
+            Prober::getProbeTimeout(115200, base::Time()));
+    BOOST_REQUIRE(Prober::getProbeTimeout(9600, base::Time()) < base::Time::fromMilliseconds(50));
+}
+
+BOOST_AUTO_TEST_CASE(Prober_finds_a_device_with_a_broadcast_probe)
+{
+    Simulator simulator;
+    simulator.addDevice(5);
+    string path = simulator.start();
+
+    Driver driver;
+    Prober prober(driver);
+    ProbeResult result = prober.probe(path);
+
+    BOOST_REQUIRE(result.ok());
+    BOOST_REQUIRE_EQUAL(1, result.attempts);
+    BOOST_REQUIRE_EQUAL(5, result.device_id);
+    BOOST_REQUIRE_EQUAL(1, result.responders.size());
+    BOOST_REQUIRE_EQUAL(prober.getProbeOrder().front(), result.baudrate);
+    BOOST_REQUIRE(result.status.ptu.pan);
+    BOOST_REQUIRE(result.duration < base::Time::fromSeconds(1));
+    BOOST_REQUIRE(driver.getReadTimeout() == base::Time::fromSeconds(2));
+
+    // The capabilities are cached, and the driver is ready to use
+    BOOST_REQUIRE(driver.getCapabilities(5).ptu.tilt);
+    BOOST_REQUIRE_EQUAL(1, countReplies(driver.getStatistics(), 'S', 'T'));
+    driver.getPanTiltStatus(5);
+}
+
+BOOST_AUTO_TEST_CASE(Prober_probes_the_accepted_IDs_one_at_a_time)
+{
+    Simulator simulator;
+    simulator.addDevice(5);
+    simulator.addDevice(7);
+    simulator.setCollisions(true);
+    string path = simulator.start();
+
+    Driver driver;
+    Prober prober(driver);
+    vector<int> ids;
+    ids.push_back(3);
+    ids.push_back(7);
+    ids.push_back(5);
+    prober.setDeviceIDs(ids);
+    ProbeResult result = prober.probe(path);
+
+    BOOST_REQUIRE(result.ok());
+    BOOST_REQUIRE_EQUAL(2, result.attempts);
+    BOOST_REQUIRE_EQUAL(7, result.device_id);
+    BOOST_REQUIRE_EQUAL(1, result.responders.size());
+    BOOST_REQUIRE_EQUAL(prober.getProbeOrder().front(), result.baudrate);
+    BOOST_REQUIRE_EQUAL(0, driver.getStatistics().checksum_errors);
+    BOOST_REQUIRE_EQUAL(1, countReplies(driver.getStatistics(), 'S', 'T'));
+    driver.getPanTiltStatus(7);
+}
+
+BOOST_AUTO_TEST_CASE(Prober_scans_the_device_IDs_when_broadcast_replies_collide)
+{
+    Simulator simulator;
+    simulator.addDevice(4);
+    simulator.addDevice(6);
+    simulator.setCollisions(true);
+    string path = simulator.start();
+
+    Driver driver;
+    Prober prober(driver);
+    BOOST_REQUIRE_THROW(prober.setScanRange(1, 10), std::invalid_argument);
+    BOOST_REQUIRE_THROW(prober.setScanRange(10, 2), std::invalid_argument);
+    prober.setScanRange(2, 10);
+    ProbeResult result = prober.probe(path);
+
+    // The broadcast probe, then IDs 2, 3 and 4
+    BOOST_REQUIRE(result.ok());
+    BOOST_REQUIRE_EQUAL(4, result.attempts);
+    BOOST_REQUIRE_EQUAL(4, result.device_id);
+    BOOST_REQUIRE_EQUAL(prober.getProbeOrder().front(), result.baudrate);
+    BOOST_REQUIRE_EQUAL(2, driver.getStatistics().checksum_errors);
+    BOOST_REQUIRE_EQUAL(0, result.unresolved_baudrate);
+    BOOST_REQUIRE(driver.getCapabilities(4).ptu.tilt);
+    BOOST_REQUIRE_EQUAL(1, countReplies(driver.getStatistics(), 'S', 'T'));
+}
+
+BOOST_AUTO_TEST_CASE(Prober_reports_colliding_devices_it_could_not_resolve)
+{
+    Simulator simulator;
+    simulator.addDevice(200);
+    simulator.addDevice(201);
+    simulator.setCollisions(true);
+    string path = simulator.start();
+
+    Driver driver;
+    Prober prober(driver);
+    prober.setDeadline(base::Time::fromMilliseconds(300));
+    ProbeResult result = prober.probe(path);
+
+    BOOST_REQUIRE(!result.ok());
+    BOOST_REQUIRE_EQUAL(prober.getProbeOrder().front(), result.unresolved_baudrate);
+    BOOST_REQUIRE(!driver.isValid());
+}
+
+BOOST_AUTO_TEST_CASE(Prober_gives_up_at_the_deadline)
+{
+    Simulator simulator;
+    simulator.addDevice(3);
+    string path = simulator.start();
+
+    Driver driver;
+    Prober prober(driver);
+    prober.setDeviceIDs(vector<int>(1, 4));
+    prober.setDeadline(base::Time::fromMilliseconds(300));
+    base::Time start = monotonicNow();
+    ProbeResult result = prober.probe(path);
+
+    BOOST_REQUIRE(!result.ok());
+    BOOST_REQUIRE(monotonicNow() - start < base::Time::fromMilliseconds(500));
+    BOOST_REQUIRE_GT(result.attempts, static_cast<int>(prober.getProbeOrder().size()));
+    BOOST_REQUIRE(!driver.isValid());
+}
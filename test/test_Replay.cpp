@@ -0,0 +1,153 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/ReplayStream.hpp>
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <ptu_kongsberg_oe10/Simulator.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+/** A capture file that is deleted when the test ends */
+struct CaptureFile
+{
+    string path;
+
+    CaptureFile()
+    {
+        char name[] = "/tmp/ptu_kongsberg_oe10_replay_XXXXXX";
+        int fd = mkstemp(name);
+        ::close(fd);
+        path = name;
+    }
+    ~CaptureFile()
+    {
+        unlink(path.c_str());
+    }
+
+    void save(Trace const& trace)
+    {
+        ofstream file(path.c_str(), ios::binary);
+        trace.dump(file);
+    }
+};
+
+template<typename Command>
+static vector<byte> request(Command const& command, int device_id)
+{
+    vector<byte> buffer(Command::FRAME_SIZE);
+    commands::marshal(command, device_id, &buffer[0]);
+    return buffer;
+}
+
+static vector<byte> panTiltStatusReply(int device_id, int pan)
+{
+    Packet packet(Packet::CONTROLLER, device_id);
+    packet.setCommand(Packet::ACK);
+    packet.data_size = 12;
+    byte data[] = { 'A', 'S', 0, 0, '0', '0', '0', '0', '0', '0', '0', '0' };
+    copy(data, data + 12, packet.data);
+    Packet::encodeAngle(packet.data + 4, pan * M_PI / 180);
+    vector<byte> buffer;
+    packet.marshal(buffer);
+    return buffer;
+}
+
+static void add(Trace& trace, TraceRecord::Direction direction, int time_ms, vector<byte> const& data)
+{
+    trace.add(direction, base::Time::fromMilliseconds(time_ms), &data[0], data.size());
+}
+
+BOOST_AUTO_TEST_CASE(Replay_plays_back_a_recorded_session)
+{
+    CaptureFile capture;
+    {
+        Simulator simulator;
+        simulator.addDevice(2);
+        simulator.setMaxSpeed(1000);
+        string path = simulator.start();
+
+        Trace trace;
+        Driver driver;
+        driver.setTrace(&trace);
+        driver.openURI("serial://" + path + ":19200");
+        driver.setPanSpeed(2, 1);
+        driver.setPanPosition(2, 90 * M_PI / 180);
+        usleep(200000);
+        driver.getPanTiltStatus(2);
+        driver.getStatus(2);
+        capture.save(trace);
+    }
+
+    Driver driver;
+    driver.openURI("replay://" + capture.path);
+    driver.setPanSpeed(2, 1);
+    driver.setPanPosition(2, 90 * M_PI / 180);
+    BOOST_REQUIRE_CLOSE(90, driver.getPanTiltStatus(2).pan * 180 / M_PI, 1e-3);
+    BOOST_REQUIRE_CLOSE(90, driver.getStatus(2).pan * 180 / M_PI, 1e-3);
+    BOOST_REQUIRE(dynamic_cast<ReplayStream*>(driver.getMainStream())->isFinished());
+}
+
+BOOST_AUTO_TEST_CASE(Replay_detects_commands_that_differ_from_the_recording)
+{
+    CaptureFile capture;
+    Trace trace;
+    add(trace, TraceRecord::TX, 0, request(commands::GetPanTiltStatus(), 2));
+    capture.save(trace);
+
+    Driver driver;
+    driver.openURI("replay://" + capture.path);
+    BOOST_REQUIRE_THROW(driver.getStatus(2), ReplayMismatch);
+}
+
+BOOST_AUTO_TEST_CASE(Replay_feeds_discarded_bytes_back_to_the_driver)
+{
+    CaptureFile capture;
+    Trace trace;
+    add(trace, TraceRecord::TX, 0, request(commands::GetPanTiltStatus(), 2));
+    vector<byte> garbage = { 'x', 'x', '<', 'y', 'y' };
+    add(trace, TraceRecord::RX_DISCARDED, 10, garbage);
+    add(trace, TraceRecord::RX, 10, panTiltStatusReply(2, 45));
+    capture.save(trace);
+
+    Driver driver;
+    driver.openURI("replay://" + capture.path);
+    BOOST_REQUIRE_CLOSE(45, driver.getPanTiltStatus(2).pan * 180 / M_PI, 1e-3);
+    BOOST_REQUIRE_EQUAL(5, driver.getStatistics().skipped_bytes);
+}
+
+BOOST_AUTO_TEST_CASE(Replay_times_out_immediately_when_the_recording_has_no_reply)
+{
+    CaptureFile capture;
+    Trace trace;
+    add(trace, TraceRecord::TX, 0, request(commands::GetPanTiltStatus(), 2));
+    add(trace, TraceRecord::TX, 2000, request(commands::GetPanTiltStatus(), 2));
+    add(trace, TraceRecord::RX, 2010, panTiltStatusReply(2, 10));
+    capture.save(trace);
+
+    Driver driver;
+    driver.openURI("replay://" + capture.path);
+    base::Time start = base::Time::now();
+    BOOST_REQUIRE_THROW(driver.getPanTiltStatus(2), iodrivers_base::TimeoutError);
+    BOOST_REQUIRE((base::Time::now() - start).toMilliseconds() < 500);
+    BOOST_REQUIRE_CLOSE(10, driver.getPanTiltStatus(2).pan * 180 / M_PI, 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(Replay_reproduces_the_recorded_reply_delays_in_realtime_mode)
+{
+    CaptureFile capture;
+    Trace trace;
+    add(trace, TraceRecord::TX, 1000, request(commands::GetPanTiltStatus(), 2));
+    add(trace, TraceRecord::RX, 1100, panTiltStatusReply(2, 10));
+    capture.save(trace);
+
+    Driver driver;
+    driver.openURI("replay://" + capture.path + ":realtime");
+    base::Time start = base::Time::now();
+    driver.getPanTiltStatus(2);
+    base::Time duration = base::Time::now() - start;
+    BOOST_REQUIRE_GE(duration.toMilliseconds(), 100);
+    BOOST_REQUIRE_LE(duration.toMilliseconds(), 300);
+}
@@ -0,0 +1,129 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/SampleRing.hpp>
+#include <ptu_kongsberg_oe10/PanTiltStreamer.hpp>
+#include "SimulatorFixture.hpp"
+#include <thread>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+BOOST_AUTO_TEST_CASE(SampleRing_rounds_capacity_to_a_power_of_two)
+{
+    SampleRing<int> ring(5);
+    BOOST_REQUIRE_EQUAL(8, ring.getCapacity());
+}
+
+BOOST_AUTO_TEST_CASE(SampleRing_reader_reads_samples_in_order)
+{
+    SampleRing<int> ring(4);
+    SampleRing<int>::Reader reader(ring);
+    int value;
+    BOOST_REQUIRE(!reader.read(value));
+    BOOST_REQUIRE(!ring.readLatest(value));
+
+    ring.push(1);
+    ring.push(2);
+    BOOST_REQUIRE(reader.read(value));
+    BOOST_REQUIRE_EQUAL(1, value);
+    BOOST_REQUIRE(reader.read(value));
+    BOOST_REQUIRE_EQUAL(2, value);
+    BOOST_REQUIRE(!reader.read(value));
+    BOOST_REQUIRE(ring.readLatest(value));
+    BOOST_REQUIRE_EQUAL(2, value);
+    BOOST_REQUIRE_EQUAL(0, reader.getLostCount());
+}
+
+BOOST_AUTO_TEST_CASE(SampleRing_reader_reports_overwritten_samples)
+{
+    SampleRing<int> ring(4);
+    SampleRing<int>::Reader reader(ring);
+    for (int i = 0; i < 10; ++i)
+        ring.push(i);
+
+    int value;
+    BOOST_REQUIRE(reader.read(value));
+    BOOST_REQUIRE_EQUAL(7, value);
+    BOOST_REQUIRE_EQUAL(7, reader.getLostCount());
+    BOOST_REQUIRE(reader.read(value));
+    BOOST_REQUIRE_EQUAL(8, value);
+    BOOST_REQUIRE(reader.read(value));
+    BOOST_REQUIRE_EQUAL(9, value);
+    BOOST_REQUIRE(!reader.read(value));
+}
+
+BOOST_AUTO_TEST_CASE(SampleRing_concurrent_readers_see_consistent_samples)
+{
+    struct Sample { int a; int b; };
+    SampleRing<Sample> ring(16);
+    int const COUNT = 100000;
+    SampleRing<Sample>::Reader reader(ring);
+
+    std::thread producer([&ring] {
+        for (int i = 0; i < COUNT; ++i)
+        {
+            Sample s = { i, -i };
+            ring.push(s);
+        }
+    });
+
+    int last = -1;
+    int received = 0;
+    while (last < COUNT - 1)
+    {
+        Sample s;
+        if (!reader.read(s))
+            continue;
+        BOOST_REQUIRE_EQUAL(s.a, -s.b);
+        BOOST_REQUIRE(s.a > last);
+        last = s.a;
+        ++received;
+    }
+    producer.join();
+    BOOST_REQUIRE_EQUAL(COUNT, received + reader.getLostCount());
+}
+
+struct StreamerFixture : SimulatorFixture
+{
+    StreamerFixture()
+        : SimulatorFixture({ 2 }, base::Time::fromMilliseconds(500)) {}
+};
+
+BOOST_FIXTURE_TEST_CASE(PanTiltStreamer_pushes_the_polled_status_in_its_ring, StreamerFixture)
+{
+    PanTiltStreamer streamer(driver, 2);
+    streamer.setPeriod(base::Time::fromMilliseconds(10));
+    SampleRing<PanTiltStatus>::Reader reader(streamer.getRing());
+    streamer.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    streamer.stop();
+
+    StreamerStatistics stats = streamer.getStatistics();
+    BOOST_REQUIRE_EQUAL(0, stats.errors);
+    BOOST_REQUIRE_GE(stats.samples, 10);
+    BOOST_REQUIRE_LE(stats.samples, 25);
+
+    PanTiltStatus first, status;
+    BOOST_REQUIRE(reader.read(first));
+    for (boost::uint64_t i = 1; i < stats.samples; ++i)
+        BOOST_REQUIRE(reader.read(status));
+    BOOST_REQUIRE(!reader.read(status));
+    BOOST_REQUIRE(status.time > first.time);
+}
+
+BOOST_FIXTURE_TEST_CASE(PanTiltStreamer_backs_off_while_the_polls_fail, StreamerFixture)
+{
+    // Once the simulator's end of the PTY is closed, every poll fails
+    // right away, as with an unplugged adapter
+    simulator.stop();
+
+    PanTiltStreamer streamer(driver, 2);
+    streamer.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    streamer.stop();
+
+    // Retries after 0, 10, 30, 70, 150 and 310ms
+    StreamerStatistics stats = streamer.getStatistics();
+    BOOST_REQUIRE_EQUAL(0, stats.samples);
+    BOOST_REQUIRE_GE(stats.errors, 3);
+    BOOST_REQUIRE_LE(stats.errors, 6);
+}
@@ -0,0 +1,93 @@
+#include <boost/test/unit_test.hpp>
+#include "SimulatorFixture.hpp"
+#include <ptu_kongsberg_oe10/ScriptRunner.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+struct ScriptRunnerFixture : SimulatorFixture
+{
+    ScriptRunnerFixture()
+        : SimulatorFixture({ 2, 3 }, base::Time::fromMilliseconds(500))
+    {
+        simulator.setMaxSpeed(1000);
+    }
+
+    /** Returns the report of the command of a script line */
+    static string getReport(string const& out, int line)
+    {
+        istringstream lines(out);
+        string report, current;
+        string const marker = " " + boost::lexical_cast<string>(line) + ": ";
+        bool found = false;
+        while (getline(lines, current))
+        {
+            if (current.compare(0, 2, "  ") != 0)
+                found = current.find(marker) != string::npos;
+            if (found)
+                report += current + "\n";
+        }
+        return report;
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(ScriptRunner_validates_the_whole_script_before_sending, ScriptRunnerFixture)
+{
+    ScriptRunner runner(driver);
+    ostringstream out;
+    istringstream script("2 pan 90 1\n\n# comment\n2 dance\n");
+    BOOST_REQUIRE_THROW(runner.run(script, out), UsageError);
+    BOOST_REQUIRE_EQUAL("", out.str());
+    BOOST_REQUIRE_CLOSE(0, driver.getPanTiltStatus(2).pan, 1e-3);
+
+    istringstream badTime("@soon 2 status\n");
+    BOOST_REQUIRE_THROW(runner.run(badTime, out), UsageError);
+    istringstream badWindow("window 0\n");
+    BOOST_REQUIRE_THROW(runner.run(badWindow, out), UsageError);
+}
+
+BOOST_FIXTURE_TEST_CASE(ScriptRunner_pipelines_consecutive_commands, ScriptRunnerFixture)
+{
+    ScriptRunner runner(driver);
+    ostringstream out;
+    istringstream script(
+            "2 pan 90 1\n"
+            "3 move 45 30 1 # both axes\n"
+            "2 status\n"
+            "3 status\n"
+            "@0.3 2 status\n"
+            "+0 3 info\n");
+    ScriptResult result = runner.run(script, out);
+    BOOST_REQUIRE(result.ok());
+    BOOST_REQUIRE_EQUAL(6, result.commands);
+    BOOST_REQUIRE_EQUAL(1, result.batches);
+    BOOST_REQUIRE(result.duration >= base::Time::fromMilliseconds(300));
+
+    BOOST_REQUIRE(getReport(out.str(), 1).find(" ms ok 1: 2 pan 90 1\n") != string::npos);
+    BOOST_REQUIRE(getReport(out.str(), 2).find("ok 2: 3 move 45 30 1\n") != string::npos);
+    BOOST_REQUIRE(getReport(out.str(), 4).find("  Status\n") != string::npos);
+    BOOST_REQUIRE(getReport(out.str(), 5).find("  Pan: 90 deg\n") != string::npos);
+    BOOST_REQUIRE(getReport(out.str(), 6).find("  Tilt: 30\n") != string::npos);
+    BOOST_REQUIRE_CLOSE(M_PI / 4, driver.getPanTiltStatus(3).pan, 1e-3);
+}
+
+BOOST_FIXTURE_TEST_CASE(ScriptRunner_reports_failures_and_continues, ScriptRunnerFixture)
+{
+    ScriptRunner runner(driver);
+    ostringstream out;
+    istringstream script(
+            "window 1\n"
+            "4 status\n"
+            "2 pan 90 1\n"
+            "2 status\n");
+    ScriptResult result = runner.run(script, out);
+    BOOST_REQUIRE(!result.ok());
+    BOOST_REQUIRE_EQUAL(3, result.commands);
+    BOOST_REQUIRE_EQUAL(1, result.failures);
+    BOOST_REQUIRE_EQUAL(0, result.batches);
+    BOOST_REQUIRE(getReport(out.str(), 2).find("error 2: 4 status\n") != string::npos);
+    BOOST_REQUIRE(getReport(out.str(), 4).find("ok 4: 2 status\n") != string::npos);
+}
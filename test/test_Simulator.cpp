@@ -0,0 +1,363 @@
+#include <boost/test/unit_test.hpp>
+#include "SimulatorFixture.hpp"
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <ptu_kongsberg_oe10/Pipeline.hpp>
+#include <ptu_kongsberg_oe10/AsyncDriver.hpp>
+#include <ptu_kongsberg_oe10/Trace.hpp>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+static float deg2rad(float deg)
+{
+    return deg * M_PI / 180;
+}
+
+struct TwoDevicesFixture : SimulatorFixture
+{
+    TwoDevicesFixture()
+        : SimulatorFixture({ 2, 3 }, base::Time::fromMilliseconds(500))
+    {
+        simulator.setMaxSpeed(1000);
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(Simulator_reports_its_status, TwoDevicesFixture)
+{
+    Status status = driver.getStatus(2);
+    BOOST_REQUIRE(status.ptu.pan);
+    BOOST_REQUIRE(status.ptu.tilt);
+    BOOST_REQUIRE_EQUAL(20, status.temperature.getCelsius());
+    BOOST_REQUIRE_EQUAL(40, status.humidity);
+}
+
+BOOST_FIXTURE_TEST_CASE(Simulator_moves_the_axes_to_the_commanded_positions, TwoDevicesFixture)
+{
+    driver.setPanSpeed(2, 1);
+    driver.setPanPosition(2, deg2rad(90));
+    driver.setTiltPosition(2, deg2rad(45));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    PanTiltStatus status = driver.getPanTiltStatus(2);
+    BOOST_REQUIRE_CLOSE(90, status.pan * 180 / M_PI, 1e-3);
+    BOOST_REQUIRE_CLOSE(45, status.tilt * 180 / M_PI, 1e-3);
+    BOOST_REQUIRE_EQUAL(0, simulator.getDevice(3).pan);
+}
+
+/** A PP request whose angle is not made of digits */
+struct MalformedPanPosition : commands::Descriptor<'P', 'P', 3, 3>
+{
+    typedef void Result;
+    void encode(byte* data) const { data[0] = '9'; data[1] = 'x'; data[2] = '9'; }
+    void decode(byte const*) const {}
+};
+
+BOOST_FIXTURE_TEST_CASE(Simulator_rejects_malformed_angles_with_a_NAK, TwoDevicesFixture)
+{
+    Expected<void> result = driver.tryExecute(2, MalformedPanPosition());
+    BOOST_REQUIRE_EQUAL(Error::NAK, result.error().code);
+    BOOST_REQUIRE_EQUAL(0x10, result.error().received);
+
+    // The simulator keeps serving
+    BOOST_REQUIRE_CLOSE(0, driver.getPanTiltStatus(2).pan, 1e-3);
+}
+
+BOOST_FIXTURE_TEST_CASE(Simulator_stops_tilting_at_the_end_stops, TwoDevicesFixture)
+{
+    driver.setTiltPosition(2, deg2rad(30));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    driver.setTiltPositiveEndStop(2);
+    driver.useEndStops(2, true);
+    driver.setTiltPosition(2, deg2rad(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    driver.tiltUp(2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    PanTiltStatus status = driver.getPanTiltStatus(2);
+    BOOST_REQUIRE_CLOSE(30, status.tilt * 180 / M_PI, 1e-3);
+    BOOST_REQUIRE(status.uses_tilt_stop);
+}
+
+BOOST_FIXTURE_TEST_CASE(Simulator_answers_pipelined_requests_to_several_devices, TwoDevicesFixture)
+{
+    Pipeline pipeline(driver);
+    vector<int> indexes;
+    for (int i = 0; i < 10; ++i)
+        indexes.push_back(pipeline.add(2 + i % 2, commands::GetPanTiltStatus()));
+    pipeline.run();
+    for (size_t i = 0; i < indexes.size(); ++i)
+        BOOST_REQUIRE(pipeline.succeeded(indexes[i]));
+}
+
+BOOST_FIXTURE_TEST_CASE(Pipeline_timestamps_AS_replies_when_they_are_matched, TwoDevicesFixture)
+{
+    PoseEstimator estimator(1, 1);
+    driver.setPoseEstimator(2, &estimator);
+    driver.setPanPosition(2, deg2rad(90));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    Pipeline pipeline(driver);
+    int status2 = pipeline.add(2, commands::GetPanTiltStatus());
+    int status3 = pipeline.add(3, commands::GetPanTiltStatus());
+    pipeline.run();
+    base::Time end = monotonicNow();
+
+    // Stamped from each request's own I/O times, not from the time of get()
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    PanTiltStatus status = pipeline.get(status2, commands::GetPanTiltStatus());
+    BOOST_REQUIRE_EQUAL(pipeline.getWriteTime(status2), status.request_time);
+    BOOST_REQUIRE(status.first_byte_time <= end);
+    BOOST_REQUIRE(status.received_time < base::Time::now() - base::Time::fromMilliseconds(90));
+    BOOST_REQUIRE_EQUAL(Driver::estimateSampleTime(status.request_time,
+                commands::GetPanTiltStatus::FRAME_SIZE, status.first_byte_time, 19200),
+            status.sample_time);
+
+    // The second request is at the end of the write
+    PanTiltStatus other = pipeline.get(status3, commands::GetPanTiltStatus());
+    BOOST_REQUIRE_EQUAL(Driver::estimateSampleTime(other.request_time,
+                2 * commands::GetPanTiltStatus::FRAME_SIZE, other.first_byte_time, 19200),
+            other.sample_time);
+
+    // The reply has been fed to the pose estimator
+    PoseEstimate estimate = estimator.poseAt(status.time);
+    BOOST_REQUIRE(estimate.valid);
+    BOOST_REQUIRE_CLOSE(status.pan, estimate.pan, 1e-3);
+    driver.setPoseEstimator(2, 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(Pipeline_does_not_queue_commands_that_fail_to_marshal, TwoDevicesFixture)
+{
+    Pipeline pipeline(driver);
+    BOOST_REQUIRE_THROW(pipeline.add(2, commands::SetPanPosition(deg2rad(400))), std::range_error);
+    BOOST_REQUIRE_EQUAL(0, pipeline.size());
+    pipeline.run();
+
+    int status = pipeline.add(2, commands::GetPanTiltStatus());
+    pipeline.run();
+    BOOST_REQUIRE(pipeline.succeeded(status));
+    BOOST_REQUIRE_EQUAL(0, driver.getStatistics().naks);
+    BOOST_REQUIRE_EQUAL(0, simulator.getDevice(2).pan_target);
+}
+
+BOOST_FIXTURE_TEST_CASE(Simulator_emulates_the_serial_line_delays, TwoDevicesFixture)
+{
+    // At 1000 bauds a byte takes 10ms, i.e. 150ms for the 15 bytes of the AS
+    // request and 260ms for its 26 bytes reply
+    simulator.setBaudrate(1000);
+    simulator.setProcessingLatency(base::Time::fromMilliseconds(20));
+    driver.setReadTimeout(base::Time::fromSeconds(2));
+
+    base::Time start = base::Time::now();
+    driver.getPanTiltStatus(2);
+    base::Time duration = base::Time::now() - start;
+    BOOST_REQUIRE_GE(duration.toMilliseconds(), 400);
+    BOOST_REQUIRE_LE(duration.toMilliseconds(), 700);
+}
+
+/** One device per valid ID, so that the checksums of the replies to a
+ * broadcast request take all but a few of the byte values */
+struct AllDevicesFixture : SimulatorFixture
+{
+    AllDevicesFixture()
+        : SimulatorFixture(allDeviceIDs(), base::Time::fromMilliseconds(500))
+    {
+        simulator.setCollisions(true);
+    }
+
+    static vector<int> allDeviceIDs()
+    {
+        vector<int> ids;
+        for (int id = Packet::CONTROLLER + 1; id < Packet::BROADCAST; ++id)
+            ids.push_back(id);
+        return ids;
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(Simulator_collisions_only_corrupt_the_checksums, AllDevicesFixture)
+{
+    Trace trace;
+    driver.setTrace(&trace);
+    BOOST_REQUIRE_THROW(driver.getPanTiltStatus(Packet::BROADCAST), iodrivers_base::TimeoutError);
+    BOOST_REQUIRE_EQUAL(allDeviceIDs().size(), driver.getStatistics().checksum_errors);
+
+    // All the corrupted frames are discarded, and the corruption never
+    // creates a frame delimiter. The sender ID at offset 3 legitimately
+    // takes the values of '<' and '>'
+    SampleRing<TraceRecord>::Reader reader(trace.getRing(), 0);
+    TraceRecord record;
+    vector<byte> discarded;
+    while (reader.read(record))
+    {
+        if (record.direction == TraceRecord::RX_DISCARDED)
+            discarded.insert(discarded.end(), record.data, record.data + record.size);
+    }
+    int const frameSize = commands::GetPanTiltStatus::RESPONSE_FRAME_SIZE;
+    BOOST_REQUIRE_EQUAL(allDeviceIDs().size() * frameSize, discarded.size());
+    for (size_t frame = 0; frame < discarded.size(); frame += frameSize)
+    {
+        BOOST_REQUIRE_EQUAL('<', discarded[frame]);
+        BOOST_REQUIRE_EQUAL('>', discarded[frame + frameSize - 1]);
+        for (int i = 1; i < frameSize - 1; ++i)
+        {
+            byte b = discarded[frame + i];
+            BOOST_REQUIRE(i == 3 || (b != '<' && b != '>'));
+        }
+    }
+    driver.setTrace(0);
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_read_timeout_bounds_the_whole_reply, TwoDevicesFixture)
+{
+    // The first byte of the reply arrives after about 170ms, but the whole
+    // reply takes 430ms
+    simulator.setBaudrate(1000);
+    simulator.setProcessingLatency(base::Time::fromMilliseconds(20));
+    driver.setReadTimeout(base::Time::fromMilliseconds(300));
+
+    base::Time start = base::Time::now();
+    BOOST_REQUIRE_THROW(driver.getPanTiltStatus(2), iodrivers_base::TimeoutError);
+    base::Time duration = base::Time::now() - start;
+    BOOST_REQUIRE_GE(duration.toMilliseconds(), 290);
+    BOOST_REQUIRE_LE(duration.toMilliseconds(), 380);
+}
+
+BOOST_FIXTURE_TEST_CASE(Simulator_can_be_driven_asynchronously, TwoDevicesFixture)
+{
+    AsyncDriver async;
+    driver.close();
+    async.openURI(getURI());
+    std::future<PanTiltStatus> status2 = async.submit(2, commands::GetPanTiltStatus());
+    std::future<PanTiltStatus> status3 = async.submit(3, commands::GetPanTiltStatus());
+    BOOST_REQUIRE_EQUAL(0, status2.get().pan);
+    BOOST_REQUIRE_EQUAL(0, status3.get().pan);
+}
+
+static boost::uint64_t countReplies(DriverStatistics const& stats, byte c0, byte c1)
+{
+    CommandStatistics const* entry = stats.find(c0, c1);
+    return entry ? entry->latency.count : 0;
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_reads_the_capabilities_once_per_connection, TwoDevicesFixture)
+{
+    Capabilities capabilities = driver.getCapabilities(2);
+    BOOST_REQUIRE(capabilities.ptu.pan);
+    BOOST_REQUIRE(capabilities.ptu.tilt);
+    driver.setEnvironmentTTL(base::Time());
+    driver.getCapabilities(2);
+    BOOST_REQUIRE_EQUAL(1, countReplies(driver.getStatistics(), 'S', 'T'));
+
+    // The settings cache is unrelated
+    driver.setStateCacheEnabled(true);
+    driver.setStateCacheEnabled(false);
+    driver.getCapabilities(2);
+    BOOST_REQUIRE_EQUAL(1, countReplies(driver.getStatistics(), 'S', 'T'));
+
+    driver.openURI(getURI());
+    driver.getCapabilities(2);
+    BOOST_REQUIRE_EQUAL(2, countReplies(driver.getStatistics(), 'S', 'T'));
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_rejects_device_IDs_out_of_the_protocol_range, TwoDevicesFixture)
+{
+    BOOST_REQUIRE_THROW(driver.getCapabilities(-1), std::invalid_argument);
+    BOOST_REQUIRE_THROW(driver.getEnvironment(300), std::invalid_argument);
+    BOOST_REQUIRE_THROW(driver.refreshEnvironment(256), std::invalid_argument);
+    BOOST_REQUIRE_THROW(driver.getStatus(-2), std::invalid_argument);
+    BOOST_REQUIRE_EQUAL(0, countReplies(driver.getStatistics(), 'S', 'T'));
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_reads_positions_with_AS_while_the_environment_is_fresh, TwoDevicesFixture)
+{
+    driver.setPanSpeed(2, 1);
+    driver.setPanPosition(2, deg2rad(90));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    Status first = driver.getStatus(2);
+    Status second = driver.getStatus(2);
+    BOOST_REQUIRE_EQUAL(1, countReplies(driver.getStatistics(), 'S', 'T'));
+    BOOST_REQUIRE_EQUAL(1, countReplies(driver.getStatistics(), 'A', 'S'));
+    BOOST_REQUIRE_CLOSE(90, second.pan * 180 / M_PI, 1e-3);
+    BOOST_REQUIRE_EQUAL(20, second.temperature.getCelsius());
+    BOOST_REQUIRE(second.ptu.tilt);
+    BOOST_REQUIRE(second.time > first.time);
+
+    driver.setEnvironmentTTL(base::Time::fromMilliseconds(50));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    driver.getStatus(2);
+    BOOST_REQUIRE_EQUAL(2, countReplies(driver.getStatistics(), 'S', 'T'));
+}
+
+BOOST_FIXTURE_TEST_CASE(AsyncDriver_refreshes_the_environment_in_the_background, TwoDevicesFixture)
+{
+    AsyncDriver async;
+    driver.close();
+    async.getDriver().setEnvironmentTTL(base::Time::fromMilliseconds(200));
+    async.openURI(getURI());
+    async.setEnvironmentRefresh(2, base::Time::fromMilliseconds(50));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    async.setEnvironmentRefresh(2, base::Time());
+
+    BOOST_REQUIRE_EQUAL(20, async.getEnvironment(2).get().temperature.getCelsius());
+    async.getStatus(2).get();
+    DriverStatistics stats = async.getStatistics().get();
+    BOOST_REQUIRE_GE(countReplies(stats, 'S', 'T'), 4);
+    BOOST_REQUIRE_EQUAL(1, countReplies(stats, 'A', 'S'));
+}
+
+BOOST_FIXTURE_TEST_CASE(AsyncDriver_polls_the_status_faster_while_the_device_moves, TwoDevicesFixture)
+{
+    AsyncDriver async;
+    driver.close();
+    async.openURI(getURI());
+    BOOST_REQUIRE_THROW(async.setStatusPolling(2, base::Time(), base::Time::fromSeconds(1), AsyncDriver::StatusCallback()),
+            std::invalid_argument);
+
+    std::atomic<int> polls(0);
+    async.setStatusPolling(2, base::Time::fromMilliseconds(20), base::Time::fromMilliseconds(200),
+            [&polls](Expected<PanTiltStatus> const& status) { if (status) ++polls; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    BOOST_REQUIRE(!async.isMoving(2));
+    BOOST_REQUIRE_LE(polls, 3);
+
+    // 45 degrees at 50 deg/s
+    async.submit(2, commands::SetPanSpeed(0.05)).get();
+    async.submit(2, commands::SetPanPosition(deg2rad(45))).get();
+    BOOST_REQUIRE(async.isMoving(2));
+    int idlePolls = polls;
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    BOOST_REQUIRE(async.isMoving(2));
+    BOOST_REQUIRE_GE(polls - idlePolls, 5);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    BOOST_REQUIRE(!async.isMoving(2));
+    async.stopStatusPolling(2);
+    BOOST_REQUIRE(!async.isMoving(2));
+}
+
+BOOST_FIXTURE_TEST_CASE(AsyncDriver_refreshes_the_environment_while_polling_fast, TwoDevicesFixture)
+{
+    AsyncDriver async;
+    driver.close();
+    async.openURI(getURI());
+
+    // A poll period shorter than the AS round trip keeps a poll due at all
+    // times while the device moves
+    async.setStatusPolling(2, base::Time::fromMicroseconds(1), base::Time::fromSeconds(1),
+            AsyncDriver::StatusCallback());
+    async.submit(2, commands::SetPanSpeed(0.05)).get();
+    async.submit(2, commands::SetPanPosition(deg2rad(45))).get();
+    DriverStatistics before = async.getStatistics().get();
+    async.setEnvironmentRefresh(2, base::Time::fromMilliseconds(50));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    BOOST_REQUIRE(async.isMoving(2));
+    async.setEnvironmentRefresh(2, base::Time());
+    async.stopStatusPolling(2);
+
+    DriverStatistics stats = async.getStatistics().get();
+    BOOST_REQUIRE_GE(countReplies(stats, 'S', 'T') - countReplies(before, 'S', 'T'), 4);
+    BOOST_REQUIRE_GT(countReplies(stats, 'A', 'S'), 10);
+}
@@ -0,0 +1,139 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/StateCache.hpp>
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <ptu_kongsberg_oe10/Pipeline.hpp>
+#include "SimulatorFixture.hpp"
+#include <cmath>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+BOOST_AUTO_TEST_CASE(StateCache_matches_the_last_recorded_payload)
+{
+    StateCache cache;
+    byte const speed[1] = { 0x32 };
+    byte const other[1] = { 0x33 };
+    BOOST_REQUIRE(!cache.matches(2, StateCache::PAN_SPEED, speed, 1));
+    cache.update(2, StateCache::PAN_SPEED, speed, 1);
+    BOOST_REQUIRE(cache.matches(2, StateCache::PAN_SPEED, speed, 1));
+    BOOST_REQUIRE(!cache.matches(2, StateCache::PAN_SPEED, other, 1));
+    BOOST_REQUIRE(!cache.matches(3, StateCache::PAN_SPEED, speed, 1));
+    BOOST_REQUIRE(!cache.matches(2, StateCache::TILT_SPEED, speed, 1));
+}
+
+BOOST_AUTO_TEST_CASE(StateCache_invalidates_settings_selectively)
+{
+    StateCache cache;
+    byte const target[3] = { '0', '9', '0' };
+    cache.update(2, StateCache::PAN_TARGET, target, 3);
+    cache.update(2, StateCache::TILT_TARGET, target, 3);
+    cache.update(3, StateCache::TILT_TARGET, target, 3);
+
+    cache.invalidate(2, StateCache::bit(StateCache::TILT_TARGET));
+    BOOST_REQUIRE(cache.matches(2, StateCache::PAN_TARGET, target, 3));
+    BOOST_REQUIRE(!cache.matches(2, StateCache::TILT_TARGET, target, 3));
+    BOOST_REQUIRE(cache.matches(3, StateCache::TILT_TARGET, target, 3));
+
+    // Broadcast commands affect devices we may not know about
+    cache.update(Packet::BROADCAST, StateCache::TILT_TARGET, target, 3);
+    BOOST_REQUIRE(!cache.matches(2, StateCache::PAN_TARGET, target, 3));
+    BOOST_REQUIRE(!cache.matches(3, StateCache::TILT_TARGET, target, 3));
+}
+
+struct StateCacheFixture : SimulatorFixture
+{
+    StateCacheFixture()
+        : SimulatorFixture({ 2 }, base::Time::fromMilliseconds(100), { 4 })
+    {
+        driver.setStateCacheEnabled(true);
+    }
+
+    boost::uint64_t suppressed(byte c0, byte c1)
+    {
+        DriverStatistics stats = driver.getStatistics();
+        CommandStatistics const* entry = stats.find(c0, c1);
+        return entry ? entry->suppressed : 0;
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(Driver_does_not_resend_unchanged_settings, StateCacheFixture)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        driver.useEndStops(2, false);
+        driver.setPanSpeed(2, 0.5);
+        driver.setPanPosition(2, M_PI / 2);
+    }
+    BOOST_REQUIRE_EQUAL(2, suppressed('D', 'S'));
+    BOOST_REQUIRE_EQUAL(2, suppressed('P', 'P'));
+    BOOST_REQUIRE_EQUAL(2, suppressed('E', 'S'));
+    BOOST_REQUIRE_EQUAL(6, driver.getStatistics().suppressed_commands);
+
+    driver.setPanSpeed(2, 0.6);
+    BOOST_REQUIRE_EQUAL(2, suppressed('D', 'S'));
+    BOOST_REQUIRE_CLOSE(0.6, simulator.getDevice(2).pan_speed, 1e-3);
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_state_cache_is_disabled_by_default, StateCacheFixture)
+{
+    driver.setStateCacheEnabled(false);
+    driver.setPanSpeed(2, 0.5);
+    driver.setPanSpeed(2, 0.5);
+    BOOST_REQUIRE_EQUAL(0, driver.getStatistics().suppressed_commands);
+    BOOST_REQUIRE(!Driver().isStateCacheEnabled());
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_move_only_sends_the_settings_that_change, StateCacheFixture)
+{
+    driver.move(2, M_PI / 2, M_PI / 4, 1, 1);
+    MoveResult result = driver.tryMove(2, M_PI, M_PI / 4, 1, 1);
+    BOOST_REQUIRE(result.ok());
+    BOOST_REQUIRE_EQUAL(3, driver.getStatistics().suppressed_commands);
+    BOOST_REQUIRE_CLOSE(180, simulator.getDevice(2).pan_target, 1e-3);
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_forgets_the_settings_of_a_device_that_NAKs, StateCacheFixture)
+{
+    driver.setPanSpeed(4, 0.5);
+    BOOST_REQUIRE(!driver.tryExecute(4, commands::SetTiltSpeed(0.5)).ok());
+    driver.setPanSpeed(4, 0.5);
+    BOOST_REQUIRE_EQUAL(0, driver.getStatistics().suppressed_commands);
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_forgets_the_settings_of_a_device_that_times_out, StateCacheFixture)
+{
+    driver.setTiltSpeed(2, 0.5);
+    simulator.setProcessingLatency(base::Time::fromMilliseconds(300));
+    BOOST_REQUIRE_EQUAL(Error::TIMEOUT, driver.tryExecute(2, commands::GetPanTiltStatus()).error().code);
+    driver.tryExecute(2, commands::SetTiltSpeed(0.5));
+    BOOST_REQUIRE_EQUAL(0, driver.getStatistics().suppressed_commands);
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_forgets_all_settings_when_reopened, StateCacheFixture)
+{
+    driver.setTiltSpeed(2, 0.5);
+    driver.close();
+    driver.openURI(getURI());
+    driver.setTiltSpeed(2, 0.5);
+    BOOST_REQUIRE_EQUAL(0, driver.getStatistics().suppressed_commands);
+}
+
+BOOST_FIXTURE_TEST_CASE(Driver_forgets_the_tilt_target_on_tilt_movements, StateCacheFixture)
+{
+    simulator.setMaxSpeed(1000);
+    driver.setTiltPosition(2, M_PI / 4);
+    driver.tiltDown(2);
+    driver.setTiltPosition(2, M_PI / 4);
+    BOOST_REQUIRE_EQUAL(0, driver.getStatistics().suppressed_commands);
+}
+
+BOOST_FIXTURE_TEST_CASE(Pipeline_updates_the_state_cache, StateCacheFixture)
+{
+    Pipeline pipeline(driver);
+    pipeline.add(2, commands::SetPanSpeed(0.2));
+    pipeline.add(2, commands::SetTiltSpeed(0.3));
+    pipeline.run();
+    driver.setPanSpeed(2, 0.2);
+    driver.setTiltSpeed(2, 0.3);
+    BOOST_REQUIRE_EQUAL(2, driver.getStatistics().suppressed_commands);
+}
@@ -0,0 +1,45 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/Statistics.hpp>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+BOOST_AUTO_TEST_CASE(LatencyHistogram_uses_power_of_two_buckets)
+{
+    BOOST_REQUIRE_EQUAL(0, LatencyHistogram::getBucketIndex(base::Time()));
+    BOOST_REQUIRE_EQUAL(0, LatencyHistogram::getBucketIndex(base::Time::fromMicroseconds(1)));
+    BOOST_REQUIRE_EQUAL(1, LatencyHistogram::getBucketIndex(base::Time::fromMicroseconds(3)));
+    BOOST_REQUIRE_EQUAL(10, LatencyHistogram::getBucketIndex(base::Time::fromMicroseconds(1024)));
+    BOOST_REQUIRE_EQUAL(LatencyHistogram::BUCKET_COUNT - 1,
+            LatencyHistogram::getBucketIndex(base::Time::fromSeconds(1e6)));
+}
+
+BOOST_AUTO_TEST_CASE(LatencyHistogram_computes_summary_values)
+{
+    LatencyHistogram histogram;
+    for (int i = 0; i < 90; ++i)
+        histogram.add(base::Time::fromMicroseconds(1000));
+    for (int i = 0; i < 10; ++i)
+        histogram.add(base::Time::fromMicroseconds(100000));
+
+    BOOST_REQUIRE_EQUAL(100, histogram.count);
+    BOOST_REQUIRE_EQUAL(1000, histogram.min);
+    BOOST_REQUIRE_EQUAL(100000, histogram.max);
+    BOOST_REQUIRE_EQUAL(base::Time::fromMicroseconds(10900), histogram.getMean());
+    BOOST_REQUIRE_EQUAL(base::Time::fromMicroseconds(1024), histogram.getPercentile(0.5));
+    BOOST_REQUIRE_EQUAL(base::Time::fromMicroseconds(131072), histogram.getPercentile(0.95));
+}
+
+BOOST_AUTO_TEST_CASE(DriverStatistics_counts_NAK_error_bits_per_command)
+{
+    DriverStatistics stats;
+    byte command[2] = { 'A', 'S' };
+    stats.addNAK(command, 0x09);
+    BOOST_REQUIRE_EQUAL(1, stats.naks);
+    BOOST_REQUIRE_EQUAL(1, stats.nak_errors[0]);
+    BOOST_REQUIRE_EQUAL(0, stats.nak_errors[1]);
+    BOOST_REQUIRE_EQUAL(1, stats.nak_errors[3]);
+    BOOST_REQUIRE(stats.find('A', 'S'));
+    BOOST_REQUIRE_EQUAL(1, stats.find('A', 'S')->naks);
+    BOOST_REQUIRE(!stats.find('S', 'T'));
+}
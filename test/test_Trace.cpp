@@ -0,0 +1,89 @@
+#include <boost/test/unit_test.hpp>
+#include <ptu_kongsberg_oe10/Trace.hpp>
+#include <ptu_kongsberg_oe10/Driver.hpp>
+#include <ptu_kongsberg_oe10/Simulator.hpp>
+#include <sstream>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+static vector<TraceRecord> parseCapture(string const& capture)
+{
+    byte const* buffer = reinterpret_cast<byte const*>(capture.data());
+    int size = capture.size();
+    int offset = Trace::parseFileHeader(buffer, size);
+
+    vector<TraceRecord> records;
+    TraceRecord record;
+    while (int used = Trace::parseRecord(buffer + offset, size - offset, record))
+    {
+        records.push_back(record);
+        offset += used;
+    }
+    BOOST_REQUIRE_EQUAL(size, offset);
+    return records;
+}
+
+BOOST_AUTO_TEST_CASE(Trace_dumps_and_parses_back_its_records)
+{
+    Trace trace(16);
+    byte tx[] = "<\x02:\x01:\x03:AS:";
+    byte rx[] = "garbage";
+    trace.add(TraceRecord::TX, base::Time::fromMicroseconds(1000), tx, sizeof(tx) - 1);
+    trace.add(TraceRecord::RX_DISCARDED, base::Time::fromMicroseconds(0x123456789LL), rx, sizeof(rx) - 1);
+
+    ostringstream stream;
+    BOOST_REQUIRE_EQUAL(2, trace.dump(stream));
+    vector<TraceRecord> records = parseCapture(stream.str());
+    BOOST_REQUIRE_EQUAL(2, records.size());
+    BOOST_REQUIRE_EQUAL(TraceRecord::TX, records[0].direction);
+    BOOST_REQUIRE_EQUAL(1000, records[0].time.toMicroseconds());
+    BOOST_REQUIRE_EQUAL(sizeof(tx) - 1, records[0].size);
+    BOOST_REQUIRE(equal(tx, tx + sizeof(tx) - 1, records[0].data));
+    BOOST_REQUIRE_EQUAL(TraceRecord::RX_DISCARDED, records[1].direction);
+    BOOST_REQUIRE_EQUAL(0x123456789LL, records[1].time.toMicroseconds());
+}
+
+BOOST_AUTO_TEST_CASE(Trace_splits_big_chunks_over_several_records)
+{
+    Trace trace(16);
+    vector<byte> data(Packet::MAX_PACKET_SIZE + 10, 'x');
+    trace.add(TraceRecord::RX_DISCARDED, base::Time(), &data[0], data.size());
+    BOOST_REQUIRE_EQUAL(2, trace.getRing().getCount());
+}
+
+BOOST_AUTO_TEST_CASE(Trace_dump_only_writes_the_records_still_in_the_ring)
+{
+    Trace trace(4);
+    byte data = 0;
+    for (int i = 0; i < 10; ++i)
+        trace.add(TraceRecord::TX, base::Time::fromMicroseconds(i), &data, 1);
+
+    ostringstream stream;
+    BOOST_REQUIRE_EQUAL(4, trace.dump(stream));
+    vector<TraceRecord> records = parseCapture(stream.str());
+    BOOST_REQUIRE_EQUAL(6, records.front().time.toMicroseconds());
+}
+
+BOOST_AUTO_TEST_CASE(Trace_records_the_driver_traffic)
+{
+    Simulator simulator;
+    simulator.addDevice(2);
+    string path = simulator.start();
+
+    Trace trace;
+    Driver driver;
+    driver.setTrace(&trace);
+    driver.openURI("serial://" + path + ":19200");
+    driver.getPanTiltStatus(2);
+
+    ostringstream stream;
+    trace.dump(stream);
+    vector<TraceRecord> records = parseCapture(stream.str());
+    BOOST_REQUIRE_EQUAL(2, records.size());
+    BOOST_REQUIRE_EQUAL(TraceRecord::TX, records[0].direction);
+    BOOST_REQUIRE_EQUAL(commands::GetPanTiltStatus::FRAME_SIZE, records[0].size);
+    BOOST_REQUIRE_EQUAL(TraceRecord::RX, records[1].direction);
+    BOOST_REQUIRE_EQUAL(commands::GetPanTiltStatus::RESPONSE_FRAME_SIZE, records[1].size);
+    BOOST_REQUIRE(records[0].time <= records[1].time);
+}
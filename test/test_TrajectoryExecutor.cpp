@@ -0,0 +1,103 @@
+#include <boost/test/unit_test.hpp>
+#include "SimulatorFixture.hpp"
+#include <ptu_kongsberg_oe10/TrajectoryExecutor.hpp>
+#include <cmath>
+#include <thread>
+
+using namespace std;
+using namespace ptu_kongsberg_oe10;
+
+static float deg2rad(float deg)
+{
+    return deg * M_PI / 180;
+}
+
+struct TrajectoryFixture : SimulatorFixture
+{
+    TrajectoryFixture()
+        : SimulatorFixture({ 2 }, base::Time::fromMilliseconds(500))
+    {
+        simulator.setMaxSpeed(100);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(TrajectoryExecutor_interpolates_between_waypoints)
+{
+    Trajectory trajectory;
+    trajectory.push_back(Waypoint(base::Time::fromMilliseconds(100), 1, 0.5));
+    trajectory.push_back(Waypoint(base::Time::fromMilliseconds(300), 2, 0.1));
+
+    float pan, tilt;
+    TrajectoryExecutor::interpolate(trajectory, base::Time(), pan, tilt);
+    BOOST_REQUIRE_CLOSE(1, pan, 1e-3);
+    TrajectoryExecutor::interpolate(trajectory, base::Time::fromMilliseconds(150), pan, tilt);
+    BOOST_REQUIRE_CLOSE(1.25, pan, 1e-3);
+    BOOST_REQUIRE_CLOSE(0.4, tilt, 1e-3);
+    TrajectoryExecutor::interpolate(trajectory, base::Time::fromSeconds(1), pan, tilt);
+    BOOST_REQUIRE_CLOSE(2, pan, 1e-3);
+}
+
+BOOST_FIXTURE_TEST_CASE(TrajectoryExecutor_follows_the_waypoints_on_schedule, TrajectoryFixture)
+{
+    // 10 degrees per 100ms at 100 deg/s
+    Trajectory trajectory;
+    for (int i = 0; i < 4; ++i)
+    {
+        trajectory.push_back(Waypoint(base::Time::fromMilliseconds(100 * i),
+                    deg2rad(10 * i), deg2rad(5), 1, 1));
+    }
+
+    TrajectoryExecutor executor(driver, 2);
+    TrajectoryResult result = executor.execute(trajectory);
+    BOOST_REQUIRE(result.ok());
+    BOOST_REQUIRE_EQUAL(4, result.waypoints.size());
+    BOOST_REQUIRE(result.max_lateness < base::Time::fromMilliseconds(20));
+    for (size_t i = 1; i < result.waypoints.size(); ++i)
+        BOOST_REQUIRE(result.waypoints[i].sent < trajectory[i - 1].time + base::Time::fromMilliseconds(20));
+    BOOST_REQUIRE(!executor.getCommandDelay().isNull());
+
+    BOOST_REQUIRE_GT(result.tracking.size(), 5);
+    BOOST_REQUIRE_LT(result.pan_max_error, deg2rad(5));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    PanTiltStatus status = driver.getPanTiltStatus(2);
+    BOOST_REQUIRE_CLOSE(30, status.pan * 180 / M_PI, 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(TrajectoryExecutor_rejects_invalid_trajectories_without_sending_anything, TrajectoryFixture)
+{
+    TrajectoryExecutor executor(driver, 2);
+    Trajectory trajectory;
+    BOOST_REQUIRE_THROW(executor.execute(trajectory), std::invalid_argument);
+
+    trajectory.push_back(Waypoint(base::Time::fromMilliseconds(100), 0, 0));
+    trajectory.push_back(Waypoint(base::Time::fromMilliseconds(50), 0.1, 0));
+    BOOST_REQUIRE_THROW(executor.execute(trajectory), std::invalid_argument);
+
+    trajectory[1] = Waypoint(base::Time::fromMilliseconds(200), 0.1, 0, 2);
+    BOOST_REQUIRE_THROW(executor.execute(trajectory), std::invalid_argument);
+    BOOST_REQUIRE(!driver.getStatistics().find('P', 'P'));
+}
+
+BOOST_FIXTURE_TEST_CASE(TrajectoryExecutor_can_be_cancelled, TrajectoryFixture)
+{
+    Trajectory trajectory;
+    trajectory.push_back(Waypoint(base::Time(), 0, 0));
+    trajectory.push_back(Waypoint(base::Time::fromSeconds(10), deg2rad(90), 0));
+    trajectory.push_back(Waypoint(base::Time::fromSeconds(20), deg2rad(180), 0));
+
+    TrajectoryExecutor executor(driver, 2);
+    executor.setFeedbackEnabled(false);
+    std::thread canceller([&executor] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        executor.cancel();
+    });
+    base::Time start = monotonicNow();
+    TrajectoryResult result = executor.execute(trajectory);
+    canceller.join();
+
+    BOOST_REQUIRE(result.cancelled);
+    BOOST_REQUIRE(!result.ok());
+    BOOST_REQUIRE_EQUAL(2, result.waypoints.size());
+    BOOST_REQUIRE(monotonicNow() - start < base::Time::fromSeconds(1));
+}